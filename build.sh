@@ -1,7 +1,7 @@
 #!/bin/bash
 
 CC=clang
-FLAGS="-lm"
+FLAGS="-lm -lpthread"
 
 buildpat="*${1}*_main.c"
 [[ -z "$1" ]] && buildpat="*_main.c"
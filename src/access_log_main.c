@@ -0,0 +1,160 @@
+#include "base/base_inc.h"
+#include "http.h"
+#include "http_access_log.h"
+#include <stdio.h>
+#include <time.h>
+
+// NOTE: turns the binary access log files written with --access-log into text or CSV, so the
+// serving hosts never format a log line
+
+#define DECODE_CHUNK_RECORDS 4096
+
+typedef enum DecodeFormat {
+    DecodeFormat_Text,
+    DecodeFormat_Csv,
+} DecodeFormat;
+
+local void decode_write_path(AccessLogRecord *record, DecodeFormat format) {
+    u64 length = Min(record->path_length, ACCESS_LOG_PATH_SIZE);
+
+    if (format == DecodeFormat_Csv) {
+        fputc('"', stdout);
+    } else if (length == 0) {
+        fputc('-', stdout);
+    }
+
+    for (u64 index = 0; index < length; ++index) {
+        u8 c = record->path[index];
+
+        if ((c & 0xff) < 0x20 || (c & 0xff) >= 0x7f) {
+            c = '?';
+        }
+
+        if (c == '"' && format == DecodeFormat_Csv) {
+            fputc('"', stdout);
+        }
+
+        fputc(c, stdout);
+    }
+
+    if (record->flags & AccessLogFlag_PathTruncated) {
+        fputs("...", stdout);
+    }
+
+    if (format == DecodeFormat_Csv) {
+        fputc('"', stdout);
+    }
+}
+
+local void decode_write_record(AccessLogRecord *record, DecodeFormat format) {
+    char time_buffer[32];
+    char client_buffer[32];
+    time_t seconds = record->timestamp / 1000000000ull;
+    u32 micros = (record->timestamp % 1000000000ull) / 1000;
+    struct tm utc;
+
+    gmtime_r(&seconds, &utc);
+    strftime(time_buffer, sizeof(time_buffer), "%Y-%m-%dT%H:%M:%S", &utc);
+
+    u8 *octets = (u8 *)&record->client_address;
+
+    if (record->flags & AccessLogFlag_Unix) {
+        snprintf(client_buffer, sizeof(client_buffer), "unix");
+    } else if (record->flags & AccessLogFlag_IPv6) {
+        snprintf(client_buffer, sizeof(client_buffer), "ipv6");
+    } else {
+        snprintf(client_buffer, sizeof(client_buffer), "%u.%u.%u.%u", octets[0] & 0xff, octets[1] & 0xff,
+                 octets[2] & 0xff, octets[3] & 0xff);
+    }
+
+    char *protocol = (record->flags & AccessLogFlag_Proxy) ? "proxy" : (record->flags & AccessLogFlag_Http2) ? "h2" : "h1";
+    String8 method = http_method_string((HttpMethod)record->method);
+
+    if (method.len == 0) {
+        method = str8("-");
+    }
+
+    if (format == DecodeFormat_Csv) {
+        printf("%s.%06uZ,%s,%u,%s,%.*s,", time_buffer, micros, client_buffer, record->client_port, protocol,
+               str8_expand(method));
+        decode_write_path(record, format);
+        printf(",%u,%u,%llu,%u\n", record->path_length, record->status, (unsigned long long)record->bytes,
+               record->latency);
+    } else {
+        printf("%s.%06uZ %s:%u %s %.*s ", time_buffer, micros, client_buffer, record->client_port, protocol,
+               str8_expand(method));
+        decode_write_path(record, format);
+        printf(" %u %llu %uus\n", record->status, (unsigned long long)record->bytes, record->latency);
+    }
+}
+
+local b32 decode_file(char *path, DecodeFormat format, u64 *record_count_out) {
+    b32 ok = 0;
+    FILE *file = fopen(path, "rb");
+    local AccessLogRecord records[DECODE_CHUNK_RECORDS];
+
+    if (!file) {
+        log_error("failed to open %s\n", path);
+        return ok;
+    }
+
+    AccessLogHeader header;
+
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, ACCESS_LOG_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != ACCESS_LOG_VERSION || header.record_size != sizeof(AccessLogRecord)) {
+        log_error("%s is not a version %d access log\n", path, ACCESS_LOG_VERSION);
+        fclose(file);
+        return ok;
+    }
+
+    for (;;) {
+        u64 count = fread(records, sizeof(AccessLogRecord), DECODE_CHUNK_RECORDS, file);
+
+        // NOTE: a zeroed record is a gap left by a failed write
+        for (u64 index = 0; index < count; ++index) {
+            if (records[index].timestamp != 0) {
+                decode_write_record(&records[index], format);
+                *record_count_out += 1;
+            }
+        }
+
+        if (count < DECODE_CHUNK_RECORDS) {
+            break;
+        }
+    }
+
+    ok = !ferror(file);
+    fclose(file);
+
+    return ok;
+}
+
+i32 main(i32 argc, char **argv) {
+    DecodeFormat format = DecodeFormat_Text;
+    u64 record_count = 0;
+    u32 file_count = 0;
+    b32 ok = 1;
+
+    for (i32 arg_index = 1; arg_index < argc; ++arg_index) {
+        String8 arg = str8_from_cstring(argv[arg_index]);
+
+        if (str8_are_equal(arg, str8("--csv"))) {
+            format = DecodeFormat_Csv;
+            printf("timestamp,client,port,protocol,method,path,path_length,status,bytes,latency_us\n");
+        } else if (str8_are_equal(arg, str8("--text"))) {
+            format = DecodeFormat_Text;
+        } else {
+            ok &= decode_file(argv[arg_index], format, &record_count);
+            file_count += 1;
+        }
+    }
+
+    if (file_count == 0) {
+        log_fatal("usage: %s [--text | --csv] file...\n", argv[0]);
+        return 1;
+    }
+
+    fprintf(stderr, "%llu records from %u files\n", (unsigned long long)record_count, file_count);
+
+    return ok ? 0 : 1;
+}
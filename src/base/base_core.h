@@ -29,6 +29,7 @@ typedef uint32_t b32;
 
 #define global static
 #define local static
+#define thread_static __thread
 
 #define AlignPow2(x, b) (((x) + (b) - 1) & (~((b) - 1)))
 
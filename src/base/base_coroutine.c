@@ -0,0 +1,209 @@
+#include "base_coroutine.h"
+#include "base_log.h"
+#include "base_os_linux.h"
+
+#if !defined(__x86_64__)
+#error "coroutine context switching is only implemented for x86-64"
+#endif
+
+#if defined(__SANITIZE_ADDRESS__)
+#define COROUTINE_SANITIZE_ADDRESS 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define COROUTINE_SANITIZE_ADDRESS 1
+#endif
+#endif
+
+#if defined(COROUTINE_SANITIZE_ADDRESS)
+void __sanitizer_start_switch_fiber(void **fake_stack_save, const void *bottom, u64 size);
+void __sanitizer_finish_switch_fiber(void *fake_stack_save, const void **bottom_old, u64 *size_old);
+#endif
+
+global u64 coroutine_stack_size = COROUTINE_DEFAULT_STACK_SIZE;
+thread_static CoroutinePool coroutine_thread_pool;
+thread_static Coroutine *coroutine_running;
+
+//////////////////////////////
+// Context switch
+
+// NOTE: saves the callee-saved registers and the SSE/x87 control words on the current stack,
+// stores the stack pointer through the first argument and continues on the second stack, whose
+// top was laid out the same way, either by an earlier switch or by coroutine_alloc
+void coroutine_switch(void **save_stack_pointer, void *load_stack_pointer);
+
+__asm__(".text\n"
+        ".globl coroutine_switch\n"
+        ".type coroutine_switch, @function\n"
+        "coroutine_switch:\n"
+        "    pushq %rbp\n"
+        "    pushq %rbx\n"
+        "    pushq %r12\n"
+        "    pushq %r13\n"
+        "    pushq %r14\n"
+        "    pushq %r15\n"
+        "    subq $8, %rsp\n"
+        "    stmxcsr (%rsp)\n"
+        "    fnstcw 4(%rsp)\n"
+        "    movq %rsp, (%rdi)\n"
+        "    movq %rsi, %rsp\n"
+        "    ldmxcsr (%rsp)\n"
+        "    fldcw 4(%rsp)\n"
+        "    addq $8, %rsp\n"
+        "    popq %r15\n"
+        "    popq %r14\n"
+        "    popq %r13\n"
+        "    popq %r12\n"
+        "    popq %rbx\n"
+        "    popq %rbp\n"
+        "    ret\n"
+        ".size coroutine_switch, .-coroutine_switch\n");
+
+local void coroutine_switch_in(Coroutine *coroutine) {
+#if defined(COROUTINE_SANITIZE_ADDRESS)
+    __sanitizer_finish_switch_fiber(coroutine->sanitizer_fake_stack, &coroutine->sanitizer_caller_base,
+                                    &coroutine->sanitizer_caller_size);
+#else
+    (void)coroutine;
+#endif
+}
+
+local void coroutine_switch_out(Coroutine *coroutine) {
+#if defined(COROUTINE_SANITIZE_ADDRESS)
+    void **fake_stack = coroutine->is_finished ? 0 : &coroutine->sanitizer_fake_stack;
+    __sanitizer_start_switch_fiber(fake_stack, coroutine->sanitizer_caller_base, coroutine->sanitizer_caller_size);
+#endif
+
+    coroutine_switch(&coroutine->stack_pointer, coroutine->caller_stack_pointer);
+    coroutine_switch_in(coroutine);
+}
+
+// NOTE: entered through the ret of the first switch, never returns
+local void coroutine_start(void) {
+    Coroutine *coroutine = coroutine_running;
+    coroutine_switch_in(coroutine);
+
+    coroutine->entry(coroutine->user);
+    coroutine->is_finished = 1;
+
+    coroutine_switch_out(coroutine);
+    __builtin_unreachable();
+}
+
+// NOTE: the frame coroutine_switch pops: control words, six registers, then coroutine_start
+// as the return address, leaving the stack aligned as at a call
+local void coroutine_prepare(Coroutine *coroutine, CoroutineEntry *entry, void *user) {
+    u64 *top = (u64 *)(coroutine->stack_base + coroutine->stack_size);
+    u64 *frame = top - 9;
+
+    frame[0] = 0x1f80 | ((u64)0x037f << 32);
+
+    for (u32 index = 1; index <= 6; ++index) {
+        frame[index] = 0;
+    }
+
+    frame[7] = (u64)coroutine_start;
+    frame[8] = 0;
+
+    coroutine->stack_pointer = frame;
+    coroutine->entry = entry;
+    coroutine->user = user;
+    coroutine->is_finished = 0;
+}
+
+//////////////////////////////
+// Pool
+
+// NOTE: read by every thread without locking, so it is set before the workers start
+void coroutine_set_stack_size(u64 stack_size) {
+    coroutine_stack_size = AlignPow2(stack_size, PAGE_SIZE);
+}
+
+Coroutine *coroutine_alloc(CoroutineEntry *entry, void *user) {
+    CoroutinePool *pool = &coroutine_thread_pool;
+    Coroutine *coroutine = pool->first_free;
+
+    if (coroutine) {
+        pool->first_free = coroutine->next_free;
+        pool->free_count -= 1;
+    } else {
+        u64 stack_size = coroutine_stack_size;
+        Arena *arena = arena_alloc(2 * PAGE_SIZE + stack_size, PAGE_SIZE, 0, 0);
+        coroutine = push_struct_zero(arena, Coroutine);
+        u8 *region = arena_push(arena, PAGE_SIZE + stack_size, PAGE_SIZE);
+
+        if (!coroutine || !region || mem_guard(region, PAGE_SIZE) != 0) {
+            arena_release(arena);
+            return 0;
+        }
+
+        coroutine->arena = arena;
+        coroutine->stack_base = region + PAGE_SIZE;
+        coroutine->stack_size = stack_size;
+        pool->allocated_count += 1;
+    }
+
+    coroutine->next_free = 0;
+    coroutine_prepare(coroutine, entry, user);
+
+    pool->live_count += 1;
+    pool->peak_count = Max(pool->peak_count, pool->live_count);
+
+    return coroutine;
+}
+
+// NOTE: a coroutine that has not finished is dropped together with whatever its stack holds
+void coroutine_release(Coroutine *coroutine) {
+    CoroutinePool *pool = &coroutine_thread_pool;
+    pool->live_count -= 1;
+
+    if (pool->free_count == COROUTINE_MAX_FREE) {
+        arena_release(coroutine->arena);
+        return;
+    }
+
+    coroutine->next_free = pool->first_free;
+    pool->first_free = coroutine;
+    pool->free_count += 1;
+}
+
+//////////////////////////////
+// Scheduling
+
+// NOTE: runs the coroutine until it yields or finishes; resuming from inside another
+// coroutine nests, and the inner one yields back to it
+void coroutine_resume(Coroutine *coroutine) {
+    Coroutine *previous = coroutine_running;
+    coroutine_running = coroutine;
+
+#if defined(COROUTINE_SANITIZE_ADDRESS)
+    void *fake_stack = 0;
+    __sanitizer_start_switch_fiber(&fake_stack, coroutine->stack_base, coroutine->stack_size);
+#endif
+
+    coroutine_switch(&coroutine->caller_stack_pointer, coroutine->stack_pointer);
+
+#if defined(COROUTINE_SANITIZE_ADDRESS)
+    __sanitizer_finish_switch_fiber(fake_stack, 0, 0);
+#endif
+
+    coroutine_running = previous;
+}
+
+void coroutine_yield(void) {
+    Coroutine *coroutine = coroutine_running;
+
+    if (!coroutine) {
+        log_fatal("coroutine_yield called outside a coroutine\n");
+        os_abort(1);
+    }
+
+    coroutine_switch_out(coroutine);
+}
+
+Coroutine *coroutine_current(void) {
+    return coroutine_running;
+}
+
+CoroutinePool *coroutine_pool(void) {
+    return &coroutine_thread_pool;
+}
@@ -0,0 +1,54 @@
+#ifndef BASE_COROUTINE_H
+#define BASE_COROUTINE_H
+
+#include "base_core.h"
+#include "base_memory.h"
+
+#define COROUTINE_DEFAULT_STACK_SIZE (64 * 1024)
+#define COROUTINE_MAX_FREE 256
+
+typedef void CoroutineEntry(void *user);
+
+// NOTE: a stackful coroutine; the record and its stack share one arena laid out as the header
+// page, a guard page and the stack, so an overflow faults instead of running into the record.
+// Only the stack pages a coroutine actually touches are ever backed by memory
+typedef struct Coroutine Coroutine;
+struct Coroutine {
+    Coroutine *next_free;
+    Arena *arena;
+    u8 *stack_base;
+    u64 stack_size;
+
+    void *stack_pointer;
+    void *caller_stack_pointer;
+    CoroutineEntry *entry;
+    void *user;
+    b32 is_finished;
+
+    void *sanitizer_fake_stack;
+    const void *sanitizer_caller_base;
+    u64 sanitizer_caller_size;
+};
+
+// NOTE: finished coroutines go back to a per-thread free list, so a steady request rate reuses
+// the same few warm stacks; beyond COROUTINE_MAX_FREE they are unmapped
+typedef struct CoroutinePool CoroutinePool;
+struct CoroutinePool {
+    Coroutine *first_free;
+    u32 free_count;
+    u32 live_count;
+    u32 peak_count;
+    u64 allocated_count;
+};
+
+void coroutine_set_stack_size(u64 stack_size);
+
+Coroutine *coroutine_alloc(CoroutineEntry *entry, void *user);
+void coroutine_release(Coroutine *coroutine);
+
+void coroutine_resume(Coroutine *coroutine);
+void coroutine_yield(void);
+Coroutine *coroutine_current(void);
+CoroutinePool *coroutine_pool(void);
+
+#endif // BASE_COROUTINE_H
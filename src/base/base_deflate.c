@@ -0,0 +1,682 @@
+#include "base_deflate.h"
+#include <string.h>
+
+// NOTE: an LZ77 pass over hash chains with one step of lazy matching, coded in blocks with
+// dynamic Huffman tables (RFC 1951), about what zlib does at its default level
+
+global u16 deflate_length_base[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                      31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+global u8 deflate_length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+global u16 deflate_distance_base[30] = {1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,   65,    97,    129,
+                                        193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+global u8 deflate_distance_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+global u8 deflate_length_order[DEFLATE_LENGTH_CODES] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+thread_static DeflateState *deflate_thread_state;
+
+local DeflateState *deflate_state(void) {
+    DeflateState *state = deflate_thread_state;
+
+    if (state) {
+        return state;
+    }
+
+    state = mem_allocate(sizeof(DeflateState));
+
+    if (!state) {
+        return 0;
+    }
+
+    for (u32 code = 0; code < 29; ++code) {
+        u32 end = code == 28 ? DEFLATE_MAX_MATCH + 1 : deflate_length_base[code + 1];
+
+        for (u32 length = deflate_length_base[code]; length < end && length <= DEFLATE_MAX_MATCH; ++length) {
+            state->length_codes[length] = code;
+        }
+    }
+
+    // NOTE: distances up to 256 index the table directly, longer ones by their bits above the
+    // seventh, as every code past 16 spans a multiple of 128
+    for (u32 code = 0; code < 30; ++code) {
+        u32 end = deflate_distance_base[code] + (1 << deflate_distance_extra[code]);
+
+        for (u32 distance = deflate_distance_base[code]; distance < end; ++distance) {
+            if (distance <= 256) {
+                state->distance_codes[distance - 1] = code;
+            } else {
+                state->distance_codes[256 + ((distance - 1) >> 7)] = code;
+            }
+        }
+    }
+
+    for (u32 index = 0; index < 256; ++index) {
+        u32 crc = index;
+
+        for (u32 bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+        }
+
+        state->crc_table[index] = crc;
+    }
+
+    deflate_thread_state = state;
+
+    return state;
+}
+
+local u32 deflate_distance_code(DeflateState *state, u32 distance) {
+    return distance <= 256 ? state->distance_codes[distance - 1] : state->distance_codes[256 + ((distance - 1) >> 7)];
+}
+
+//////////////////////////////
+// Checksums
+
+u32 deflate_crc32(String8 data) {
+    DeflateState *state = deflate_state();
+    u32 crc = 0xffffffff;
+
+    if (!state) {
+        return 0;
+    }
+
+    for (u64 index = 0; index < data.len; ++index) {
+        crc = state->crc_table[(crc ^ data.data[index]) & 0xff] ^ (crc >> 8);
+    }
+
+    return crc ^ 0xffffffff;
+}
+
+u32 deflate_adler32(String8 data) {
+    u32 a = 1;
+    u32 b = 0;
+    u64 index = 0;
+
+    // NOTE: 5552 bytes is the most that can be summed before b could overflow
+    while (index < data.len) {
+        u64 end = Min(index + 5552, data.len);
+
+        for (; index < end; ++index) {
+            a += data.data[index] & 0xff;
+            b += a;
+        }
+
+        a %= 65521;
+        b %= 65521;
+    }
+
+    return (b << 16) | a;
+}
+
+//////////////////////////////
+// Bit output
+
+typedef struct DeflateWriter DeflateWriter;
+struct DeflateWriter {
+    u8 *out;
+    u64 capacity;
+    u64 pos;
+    u64 bits;
+    u32 bit_count;
+    b32 is_full;
+};
+
+local void deflate_put_bits(DeflateWriter *writer, u32 value, u32 count) {
+    writer->bits |= (u64)value << writer->bit_count;
+    writer->bit_count += count;
+
+    if (writer->bit_count >= 32) {
+        if (writer->pos + 4 > writer->capacity) {
+            writer->is_full = 1;
+            writer->pos = 0;
+        }
+
+        writer->out[writer->pos++] = (u8)writer->bits;
+        writer->out[writer->pos++] = (u8)(writer->bits >> 8);
+        writer->out[writer->pos++] = (u8)(writer->bits >> 16);
+        writer->out[writer->pos++] = (u8)(writer->bits >> 24);
+        writer->bits >>= 32;
+        writer->bit_count -= 32;
+    }
+}
+
+local void deflate_flush_bits(DeflateWriter *writer) {
+    while (writer->bit_count > 0) {
+        if (writer->pos + 1 > writer->capacity) {
+            writer->is_full = 1;
+            writer->pos = 0;
+        }
+
+        writer->out[writer->pos++] = (u8)writer->bits;
+        writer->bits >>= 8;
+        writer->bit_count = writer->bit_count > 8 ? writer->bit_count - 8 : 0;
+    }
+}
+
+local void deflate_put_bytes(DeflateWriter *writer, u8 *data, u32 size) {
+    if (writer->pos + size > writer->capacity) {
+        writer->is_full = 1;
+        return;
+    }
+
+    memcpy(writer->out + writer->pos, data, size);
+    writer->pos += size;
+}
+
+//////////////////////////////
+// Huffman codes
+
+typedef struct DeflateSymbol DeflateSymbol;
+struct DeflateSymbol {
+    u32 key;
+    u32 symbol;
+};
+
+// NOTE: optimal code lengths computed in place over symbols sorted by ascending frequency
+// (Moffat and Katajainen), then limited to max_length by moving codes down from the longest
+// lengths until the Kraft sum is exact again; the most frequent symbols get the shortest codes
+local void deflate_build_lengths(u32 *frequencies, u32 count, u32 max_length, u8 *lengths_out) {
+    DeflateSymbol symbols[DEFLATE_LITERAL_CODES];
+    u32 length_counts[33] = {0};
+    u32 used = 0;
+
+    memset(lengths_out, 0, count);
+
+    for (u32 symbol = 0; symbol < count; ++symbol) {
+        if (frequencies[symbol]) {
+            u32 index = used++;
+
+            while (index > 0 && symbols[index - 1].key > frequencies[symbol]) {
+                symbols[index] = symbols[index - 1];
+                index -= 1;
+            }
+
+            symbols[index].key = frequencies[symbol];
+            symbols[index].symbol = symbol;
+        }
+    }
+
+    if (used == 0) {
+        return;
+    }
+
+    if (used == 1) {
+        lengths_out[symbols[0].symbol] = 1;
+        return;
+    }
+
+    symbols[0].key += symbols[1].key;
+    i32 root = 0;
+    i32 leaf = 2;
+
+    for (i32 next = 1; next < (i32)used - 1; ++next) {
+        if (leaf >= (i32)used || symbols[root].key < symbols[leaf].key) {
+            symbols[next].key = symbols[root].key;
+            symbols[root++].key = next;
+        } else {
+            symbols[next].key = symbols[leaf++].key;
+        }
+
+        if (leaf >= (i32)used || (root < next && symbols[root].key < symbols[leaf].key)) {
+            symbols[next].key += symbols[root].key;
+            symbols[root++].key = next;
+        } else {
+            symbols[next].key += symbols[leaf++].key;
+        }
+    }
+
+    symbols[used - 2].key = 0;
+
+    for (i32 next = (i32)used - 3; next >= 0; --next) {
+        symbols[next].key = symbols[symbols[next].key].key + 1;
+    }
+
+    i32 available = 1;
+    i32 taken = 0;
+    u32 depth = 0;
+    root = (i32)used - 2;
+    i32 next = (i32)used - 1;
+
+    while (available > 0) {
+        while (root >= 0 && symbols[root].key == depth) {
+            taken += 1;
+            root -= 1;
+        }
+
+        while (available > taken) {
+            symbols[next--].key = depth;
+            available -= 1;
+        }
+
+        available = 2 * taken;
+        depth += 1;
+        taken = 0;
+    }
+
+    for (u32 index = 0; index < used; ++index) {
+        length_counts[Min(symbols[index].key, 32)] += 1;
+    }
+
+    for (u32 length = max_length + 1; length <= 32; ++length) {
+        length_counts[max_length] += length_counts[length];
+    }
+
+    u32 total = 0;
+
+    for (u32 length = max_length; length > 0; --length) {
+        total += length_counts[length] << (max_length - length);
+    }
+
+    while (total != (1u << max_length)) {
+        length_counts[max_length] -= 1;
+
+        for (u32 length = max_length - 1; length > 0; --length) {
+            if (length_counts[length]) {
+                length_counts[length] -= 1;
+                length_counts[length + 1] += 2;
+                break;
+            }
+        }
+
+        total -= 1;
+    }
+
+    u32 index = used;
+
+    for (u32 length = 1; length <= max_length; ++length) {
+        for (u32 remaining = length_counts[length]; remaining > 0; --remaining) {
+            lengths_out[symbols[--index].symbol] = length;
+        }
+    }
+}
+
+// NOTE: canonical codes, bit-reversed because deflate sends Huffman codes from the top bit
+// while everything else goes least significant bit first
+local void deflate_build_codes(u8 *lengths, u32 count, u16 *codes_out) {
+    u32 length_counts[16] = {0};
+    u32 next_code[16] = {0};
+    u32 code = 0;
+
+    for (u32 symbol = 0; symbol < count; ++symbol) {
+        length_counts[lengths[symbol] & 0xff] += 1;
+    }
+
+    length_counts[0] = 0;
+
+    for (u32 length = 1; length < 16; ++length) {
+        code = (code + length_counts[length - 1]) << 1;
+        next_code[length] = code;
+    }
+
+    for (u32 symbol = 0; symbol < count; ++symbol) {
+        u32 length = lengths[symbol];
+        u32 value = next_code[length]++;
+        u32 reversed = 0;
+
+        for (u32 bit = 0; bit < length; ++bit) {
+            reversed = (reversed << 1) | ((value >> bit) & 1);
+        }
+
+        codes_out[symbol] = length ? reversed : 0;
+    }
+}
+
+// NOTE: a code over fewer than two symbols would be incomplete, which inflaters reject for
+// the code length alphabet and some reject everywhere, so unused symbols are padded in
+local void deflate_pad_frequencies(u32 *frequencies, u32 count) {
+    u32 used = 0;
+
+    for (u32 symbol = 0; symbol < count && used < 2; ++symbol) {
+        used += frequencies[symbol] != 0;
+    }
+
+    for (u32 symbol = 0; symbol < count && used < 2; ++symbol) {
+        if (!frequencies[symbol]) {
+            frequencies[symbol] = 1;
+            used += 1;
+        }
+    }
+}
+
+//////////////////////////////
+// Blocks
+
+local void deflate_write_block(DeflateState *state, DeflateWriter *writer, u32 token_count, b32 is_final) {
+    u32 literal_frequencies[DEFLATE_LITERAL_CODES] = {0};
+    u32 distance_frequencies[DEFLATE_DISTANCE_CODES] = {0};
+    u32 length_frequencies[DEFLATE_LENGTH_CODES] = {0};
+    u8 literal_lengths[DEFLATE_LITERAL_CODES];
+    u8 distance_lengths[DEFLATE_DISTANCE_CODES];
+    u8 length_lengths[DEFLATE_LENGTH_CODES];
+    u16 literal_codes[DEFLATE_LITERAL_CODES];
+    u16 distance_codes[DEFLATE_DISTANCE_CODES];
+    u16 length_codes[DEFLATE_LENGTH_CODES];
+
+    for (u32 index = 0; index < token_count; ++index) {
+        DeflateToken token = state->tokens[index];
+
+        if (token.distance == 0) {
+            literal_frequencies[token.value] += 1;
+        } else {
+            literal_frequencies[257 + state->length_codes[token.value]] += 1;
+            distance_frequencies[deflate_distance_code(state, token.distance)] += 1;
+        }
+    }
+
+    literal_frequencies[256] = 1;
+    deflate_pad_frequencies(literal_frequencies, DEFLATE_LITERAL_CODES);
+    deflate_pad_frequencies(distance_frequencies, DEFLATE_DISTANCE_CODES);
+    deflate_build_lengths(literal_frequencies, DEFLATE_LITERAL_CODES, 15, literal_lengths);
+    deflate_build_lengths(distance_frequencies, DEFLATE_DISTANCE_CODES, 15, distance_lengths);
+    deflate_build_codes(literal_lengths, DEFLATE_LITERAL_CODES, literal_codes);
+    deflate_build_codes(distance_lengths, DEFLATE_DISTANCE_CODES, distance_codes);
+
+    u32 literal_count = DEFLATE_LITERAL_CODES;
+    u32 distance_count = DEFLATE_DISTANCE_CODES;
+
+    while (literal_count > 257 && literal_lengths[literal_count - 1] == 0) {
+        literal_count -= 1;
+    }
+
+    while (distance_count > 1 && distance_lengths[distance_count - 1] == 0) {
+        distance_count -= 1;
+    }
+
+    // NOTE: both code length lists are sent as one, run-length coded: 16 repeats the previous
+    // length 3-6 times, 17 and 18 give 3-10 and 11-138 zeros
+    u8 lengths[DEFLATE_LITERAL_CODES + DEFLATE_DISTANCE_CODES];
+    u8 runs[DEFLATE_LITERAL_CODES + DEFLATE_DISTANCE_CODES];
+    u8 run_extras[DEFLATE_LITERAL_CODES + DEFLATE_DISTANCE_CODES];
+    u32 length_count = literal_count + distance_count;
+    u32 run_count = 0;
+
+    memcpy(lengths, literal_lengths, literal_count);
+    memcpy(lengths + literal_count, distance_lengths, distance_count);
+
+    for (u32 index = 0; index < length_count;) {
+        u8 length = lengths[index];
+        u32 repeat = 1;
+
+        while (index + repeat < length_count && lengths[index + repeat] == length) {
+            repeat += 1;
+        }
+
+        index += repeat;
+
+        if (length == 0) {
+            while (repeat >= 11) {
+                u32 run = Min(repeat, 138);
+                runs[run_count] = 18;
+                run_extras[run_count++] = run - 11;
+                repeat -= run;
+            }
+
+            if (repeat >= 3) {
+                runs[run_count] = 17;
+                run_extras[run_count++] = repeat - 3;
+                repeat = 0;
+            }
+        } else {
+            runs[run_count] = length;
+            run_extras[run_count++] = 0;
+            repeat -= 1;
+
+            while (repeat >= 3) {
+                u32 run = Min(repeat, 6);
+                runs[run_count] = 16;
+                run_extras[run_count++] = run - 3;
+                repeat -= run;
+            }
+        }
+
+        while (repeat > 0) {
+            runs[run_count] = length;
+            run_extras[run_count++] = 0;
+            repeat -= 1;
+        }
+    }
+
+    for (u32 index = 0; index < run_count; ++index) {
+        length_frequencies[runs[index] & 0xff] += 1;
+    }
+
+    deflate_pad_frequencies(length_frequencies, DEFLATE_LENGTH_CODES);
+    deflate_build_lengths(length_frequencies, DEFLATE_LENGTH_CODES, 7, length_lengths);
+    deflate_build_codes(length_lengths, DEFLATE_LENGTH_CODES, length_codes);
+
+    u32 order_count = DEFLATE_LENGTH_CODES;
+
+    while (order_count > 4 && length_lengths[deflate_length_order[order_count - 1] & 0xff] == 0) {
+        order_count -= 1;
+    }
+
+    deflate_put_bits(writer, is_final, 1);
+    deflate_put_bits(writer, 2, 2);
+    deflate_put_bits(writer, literal_count - 257, 5);
+    deflate_put_bits(writer, distance_count - 1, 5);
+    deflate_put_bits(writer, order_count - 4, 4);
+
+    for (u32 index = 0; index < order_count; ++index) {
+        deflate_put_bits(writer, length_lengths[deflate_length_order[index] & 0xff], 3);
+    }
+
+    for (u32 index = 0; index < run_count; ++index) {
+        u32 symbol = runs[index];
+        deflate_put_bits(writer, length_codes[symbol], length_lengths[symbol]);
+
+        if (symbol == 16) {
+            deflate_put_bits(writer, run_extras[index], 2);
+        } else if (symbol == 17) {
+            deflate_put_bits(writer, run_extras[index], 3);
+        } else if (symbol == 18) {
+            deflate_put_bits(writer, run_extras[index], 7);
+        }
+    }
+
+    for (u32 index = 0; index < token_count; ++index) {
+        DeflateToken token = state->tokens[index];
+
+        if (token.distance == 0) {
+            deflate_put_bits(writer, literal_codes[token.value], literal_lengths[token.value]);
+            continue;
+        }
+
+        u32 length_code = state->length_codes[token.value];
+        u32 distance_code = deflate_distance_code(state, token.distance);
+
+        deflate_put_bits(writer, literal_codes[257 + length_code], literal_lengths[257 + length_code]);
+        deflate_put_bits(writer, token.value - deflate_length_base[length_code], deflate_length_extra[length_code]);
+        deflate_put_bits(writer, distance_codes[distance_code], distance_lengths[distance_code]);
+        deflate_put_bits(writer, token.distance - deflate_distance_base[distance_code],
+                         deflate_distance_extra[distance_code]);
+    }
+
+    deflate_put_bits(writer, literal_codes[256], literal_lengths[256]);
+}
+
+//////////////////////////////
+// Matching
+
+local u32 deflate_hash(u8 *data) {
+    u32 value = (u32)(data[0] & 0xff) | ((u32)(data[1] & 0xff) << 8) | ((u32)(data[2] & 0xff) << 16);
+
+    return (value * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+}
+
+local void deflate_insert(DeflateState *state, String8 input, u64 pos) {
+    if (pos + DEFLATE_MIN_MATCH <= input.len) {
+        u32 hash = deflate_hash(input.data + pos);
+        state->prev[pos & (DEFLATE_WINDOW_SIZE - 1)] = state->head[hash];
+        state->head[hash] = (i32)pos + 1;
+    }
+}
+
+// NOTE: walks the chain of earlier positions with the same hash, newest first, for the longest
+// match within the window; returns its length, zero when shorter than DEFLATE_MIN_MATCH
+local u32 deflate_find_match(DeflateState *state, String8 input, u64 pos, u32 *distance_out) {
+    u32 best_length = 0;
+    u64 max_length = Min(input.len - pos, DEFLATE_MAX_MATCH);
+
+    if (max_length < DEFLATE_MIN_MATCH) {
+        return 0;
+    }
+
+    u8 *current = input.data + pos;
+    i64 candidate = (i64)state->head[deflate_hash(current)] - 1;
+
+    for (u32 chain = 0; chain < DEFLATE_MAX_CHAIN && candidate >= 0; ++chain) {
+        if (pos - candidate > DEFLATE_WINDOW_SIZE) {
+            break;
+        }
+
+        u8 *match = input.data + candidate;
+
+        if (match[best_length] == current[best_length] && match[0] == current[0]) {
+            u32 length = 0;
+
+            while (length + 8 <= max_length) {
+                u64 a, b;
+                memcpy(&a, match + length, 8);
+                memcpy(&b, current + length, 8);
+
+                if (a != b) {
+                    length += __builtin_ctzll(a ^ b) >> 3;
+                    break;
+                }
+
+                length += 8;
+            }
+
+            if (length + 8 > max_length) {
+                while (length < max_length && match[length] == current[length]) {
+                    length += 1;
+                }
+            }
+
+            if (length > best_length) {
+                best_length = length;
+                *distance_out = (u32)(pos - candidate);
+
+                if (length >= DEFLATE_NICE_MATCH || length == max_length) {
+                    break;
+                }
+            }
+        }
+
+        i64 next = (i64)state->prev[candidate & (DEFLATE_WINDOW_SIZE - 1)] - 1;
+
+        // NOTE: the slot was reused by a newer position, so the chain ends here
+        if (next >= candidate) {
+            break;
+        }
+
+        candidate = next;
+    }
+
+    return best_length >= DEFLATE_MIN_MATCH ? best_length : 0;
+}
+
+//////////////////////////////
+// Streams
+
+// NOTE: the most output accepted; data that would code larger than this gives up instead
+u64 deflate_bound(u64 size) {
+    return size + size / 8 + (size / DEFLATE_BLOCK_TOKENS + 1) * 320 + 64;
+}
+
+// NOTE: zlib framing is the "deflate" content coding, gzip the "gzip" one. Returns an invalid
+// string when working memory is unavailable or the output would not fit deflate_bound
+String8 deflate_compress(Arena *arena, String8 input, DeflateFormat format) {
+    String8 result = {0};
+    DeflateState *state = deflate_state();
+    DeflateWriter writer = {0};
+
+    if (!state) {
+        return result;
+    }
+
+    writer.capacity = deflate_bound(input.len);
+    writer.out = arena_push(arena, writer.capacity, 8);
+
+    if (!writer.out) {
+        return result;
+    }
+
+    if (format == DeflateFormat_Zlib) {
+        deflate_put_bytes(&writer, (u8 *)"\x78\x9c", 2);
+    } else if (format == DeflateFormat_Gzip) {
+        deflate_put_bytes(&writer, (u8 *)"\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\x03", 10);
+    }
+
+    memset(state->head, 0, sizeof(state->head));
+
+    u32 token_count = 0;
+    u64 pos = 0;
+    b32 has_final_block = 0;
+
+    while (pos < input.len && !writer.is_full) {
+        u32 distance = 0;
+        u32 length = deflate_find_match(state, input, pos, &distance);
+
+        deflate_insert(state, input, pos);
+
+        // NOTE: a longer match one byte on is worth a literal first
+        if (length && length < DEFLATE_NICE_MATCH) {
+            u32 next_distance = 0;
+            u32 next_length = deflate_find_match(state, input, pos + 1, &next_distance);
+
+            if (next_length > length) {
+                length = 0;
+            }
+        }
+
+        if (length) {
+            state->tokens[token_count].value = length;
+            state->tokens[token_count].distance = distance;
+
+            for (u64 index = pos + 1; index < pos + length; ++index) {
+                deflate_insert(state, input, index);
+            }
+
+            pos += length;
+        } else {
+            state->tokens[token_count].value = input.data[pos] & 0xff;
+            state->tokens[token_count].distance = 0;
+            pos += 1;
+        }
+
+        if (++token_count == DEFLATE_BLOCK_TOKENS) {
+            has_final_block = pos == input.len;
+            deflate_write_block(state, &writer, token_count, has_final_block);
+            token_count = 0;
+        }
+    }
+
+    if (!has_final_block) {
+        deflate_write_block(state, &writer, token_count, 1);
+    }
+
+    deflate_flush_bits(&writer);
+
+    if (format == DeflateFormat_Zlib) {
+        u32 adler = deflate_adler32(input);
+        u8 trailer[4] = {(u8)(adler >> 24), (u8)(adler >> 16), (u8)(adler >> 8), (u8)adler};
+        deflate_put_bytes(&writer, trailer, 4);
+    } else if (format == DeflateFormat_Gzip) {
+        u32 crc = deflate_crc32(input);
+        u32 size = (u32)input.len;
+        u8 trailer[8] = {(u8)crc, (u8)(crc >> 8), (u8)(crc >> 16), (u8)(crc >> 24),
+                         (u8)size, (u8)(size >> 8), (u8)(size >> 16), (u8)(size >> 24)};
+        deflate_put_bytes(&writer, trailer, 8);
+    }
+
+    if (writer.is_full) {
+        arena_pop(arena, writer.capacity);
+        return result;
+    }
+
+    arena_pop(arena, writer.capacity - writer.pos);
+    result.data = writer.out;
+    result.len = writer.pos;
+
+    return result;
+}
@@ -0,0 +1,51 @@
+#ifndef BASE_DEFLATE_H
+#define BASE_DEFLATE_H
+
+#include "base_core.h"
+#include "base_memory.h"
+#include "base_string.h"
+
+#define DEFLATE_WINDOW_SIZE 32768
+#define DEFLATE_HASH_BITS 15
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+#define DEFLATE_MAX_CHAIN 128
+#define DEFLATE_NICE_MATCH 128
+#define DEFLATE_BLOCK_TOKENS 16384
+
+#define DEFLATE_LITERAL_CODES 286
+#define DEFLATE_DISTANCE_CODES 30
+#define DEFLATE_LENGTH_CODES 19
+
+typedef enum DeflateFormat {
+    DeflateFormat_Raw,
+    DeflateFormat_Zlib,
+    DeflateFormat_Gzip,
+} DeflateFormat;
+
+// NOTE: a literal when distance is zero, otherwise a match of value bytes
+typedef struct DeflateToken DeflateToken;
+struct DeflateToken {
+    u16 value;
+    u16 distance;
+};
+
+// NOTE: per-thread working memory, kept between calls: hash chains over the last window, the
+// tokens of the block being built and the lookup tables
+typedef struct DeflateState DeflateState;
+struct DeflateState {
+    i32 head[1 << DEFLATE_HASH_BITS];
+    i32 prev[DEFLATE_WINDOW_SIZE];
+    DeflateToken tokens[DEFLATE_BLOCK_TOKENS];
+    u8 length_codes[DEFLATE_MAX_MATCH + 1];
+    u8 distance_codes[512];
+    u32 crc_table[256];
+};
+
+u64 deflate_bound(u64 size);
+String8 deflate_compress(Arena *arena, String8 input, DeflateFormat format);
+
+u32 deflate_crc32(String8 data);
+u32 deflate_adler32(String8 data);
+
+#endif // BASE_DEFLATE_H
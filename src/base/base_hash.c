@@ -0,0 +1,329 @@
+#include "base_hash.h"
+#include <immintrin.h>
+#include <string.h>
+
+//////////////////////////////
+// Hashing
+
+// NOTE: wyhash (final version 4), public domain; 64x64->128 multiplies fold 16 input bytes per
+// step and short keys are read with at most four overlapping loads
+global u64 hash_secret[4] = {0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull};
+
+local void hash_multiply(u64 *a, u64 *b) {
+    __uint128_t result = (__uint128_t)*a * *b;
+    *a = (u64)result;
+    *b = (u64)(result >> 64);
+}
+
+local u64 hash_mix(u64 a, u64 b) {
+    hash_multiply(&a, &b);
+
+    return a ^ b;
+}
+
+local u64 hash_read8(u8 *p) {
+    u64 result;
+    memcpy(&result, p, 8);
+
+    return result;
+}
+
+local u64 hash_read4(u8 *p) {
+    u32 result;
+    memcpy(&result, p, 4);
+
+    return result;
+}
+
+local u64 hash_read3(u8 *p, u64 length) {
+    return ((u64)(p[0] & 0xff) << 16) | ((u64)(p[length >> 1] & 0xff) << 8) | (u64)(p[length - 1] & 0xff);
+}
+
+u64 hash_string_seeded(String8 string, u64 seed) {
+    u8 *p = string.data;
+    u64 length = string.len;
+    u64 a = 0;
+    u64 b = 0;
+
+    seed ^= hash_mix(seed ^ hash_secret[0], hash_secret[1]);
+
+    if (length <= 16) {
+        if (length >= 4) {
+            a = (hash_read4(p) << 32) | hash_read4(p + ((length >> 3) << 2));
+            b = (hash_read4(p + length - 4) << 32) | hash_read4(p + length - 4 - ((length >> 3) << 2));
+        } else if (length > 0) {
+            a = hash_read3(p, length);
+        }
+    } else {
+        u64 remaining = length;
+
+        if (remaining > 48) {
+            u64 seed1 = seed;
+            u64 seed2 = seed;
+
+            do {
+                seed = hash_mix(hash_read8(p) ^ hash_secret[1], hash_read8(p + 8) ^ seed);
+                seed1 = hash_mix(hash_read8(p + 16) ^ hash_secret[2], hash_read8(p + 24) ^ seed1);
+                seed2 = hash_mix(hash_read8(p + 32) ^ hash_secret[3], hash_read8(p + 40) ^ seed2);
+                p += 48;
+                remaining -= 48;
+            } while (remaining > 48);
+
+            seed ^= seed1 ^ seed2;
+        }
+
+        while (remaining > 16) {
+            seed = hash_mix(hash_read8(p) ^ hash_secret[1], hash_read8(p + 8) ^ seed);
+            p += 16;
+            remaining -= 16;
+        }
+
+        a = hash_read8(p + remaining - 16);
+        b = hash_read8(p + remaining - 8);
+    }
+
+    a ^= hash_secret[1];
+    b ^= seed;
+    hash_multiply(&a, &b);
+
+    return hash_mix(a ^ hash_secret[0] ^ length, b ^ hash_secret[1]);
+}
+
+u64 hash_string(String8 string) {
+    return hash_string_seeded(string, 0);
+}
+
+u64 hash_u64(u64 value) {
+    return hash_mix(value ^ hash_secret[0], hash_secret[1] ^ 8);
+}
+
+//////////////////////////////
+// Hash map
+
+local u32 hash_map_match(u8 *group, u8 control) {
+#if defined(__SSE2__)
+    __m128i bytes = _mm_load_si128((__m128i *)group);
+
+    return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(control)));
+#else
+    u32 result = 0;
+
+    for (u32 index = 0; index < HASH_MAP_GROUP_SIZE; ++index) {
+        result |= (u32)(group[index] == control) << index;
+    }
+
+    return result;
+#endif
+}
+
+// NOTE: empty and deleted are the only control bytes with the top bit set
+local u32 hash_map_match_free(u8 *group) {
+#if defined(__SSE2__)
+    return (u32)_mm_movemask_epi8(_mm_load_si128((__m128i *)group));
+#else
+    u32 result = 0;
+
+    for (u32 index = 0; index < HASH_MAP_GROUP_SIZE; ++index) {
+        result |= (u32)((group[index] & 0x80) != 0) << index;
+    }
+
+    return result;
+#endif
+}
+
+local u64 hash_map_capacity_for(u64 count) {
+    u64 capacity = HASH_MAP_GROUP_SIZE;
+
+    while (capacity * 7 / 8 < count) {
+        capacity *= 2;
+    }
+
+    return capacity;
+}
+
+local b32 hash_map_allocate(HashMap *map, u64 capacity) {
+    u8 *control = arena_push(map->arena, capacity, HASH_MAP_GROUP_SIZE);
+    HashMapSlot *slots = push_array(map->arena, HashMapSlot, capacity);
+
+    if (!control || !slots) {
+        return 0;
+    }
+
+    memset(control, HASH_MAP_CONTROL_EMPTY, capacity);
+
+    map->control = control;
+    map->slots = slots;
+    map->capacity = capacity;
+    map->count = 0;
+    map->deleted_count = 0;
+
+    return 1;
+}
+
+// NOTE: probes whole groups in triangular order, which visits every group of a power of two
+// sized table; the low 7 bits of the hash go into the control byte, the rest pick the group
+local void hash_map_place(HashMap *map, String8 key, void *value, u64 hash) {
+    u64 group_mask = map->capacity / HASH_MAP_GROUP_SIZE - 1;
+    u64 group_index = (hash >> 7) & group_mask;
+
+    for (u64 step = 1;; ++step) {
+        u8 *group = map->control + group_index * HASH_MAP_GROUP_SIZE;
+        u32 free_mask = hash_map_match_free(group);
+
+        if (free_mask) {
+            u64 index = group_index * HASH_MAP_GROUP_SIZE + __builtin_ctz(free_mask);
+
+            if (map->control[index] == HASH_MAP_CONTROL_DELETED) {
+                map->deleted_count -= 1;
+            }
+
+            map->control[index] = (u8)(hash & 0x7f);
+            map->slots[index].key = key;
+            map->slots[index].value = value;
+            map->count += 1;
+            return;
+        }
+
+        group_index = (group_index + step) & group_mask;
+    }
+}
+
+local HashMapSlot *hash_map_find(HashMap *map, String8 key, u64 hash) {
+    if (map->capacity == 0) {
+        return 0;
+    }
+
+    u64 group_mask = map->capacity / HASH_MAP_GROUP_SIZE - 1;
+    u64 group_index = (hash >> 7) & group_mask;
+    u8 control = (u8)(hash & 0x7f);
+
+    for (u64 step = 1;; ++step) {
+        u8 *group = map->control + group_index * HASH_MAP_GROUP_SIZE;
+        u32 matches = hash_map_match(group, control);
+
+        while (matches) {
+            HashMapSlot *slot = &map->slots[group_index * HASH_MAP_GROUP_SIZE + __builtin_ctz(matches)];
+
+            if (slot->key.len == key.len && memcmp(slot->key.data, key.data, key.len) == 0) {
+                return slot;
+            }
+
+            matches &= matches - 1;
+        }
+
+        // NOTE: an insert would have used this empty slot, so the key is not further along
+        if (hash_map_match(group, HASH_MAP_CONTROL_EMPTY)) {
+            return 0;
+        }
+
+        group_index = (group_index + step) & group_mask;
+    }
+}
+
+local b32 hash_map_rehash(HashMap *map, u64 capacity) {
+    u8 *control = map->control;
+    HashMapSlot *slots = map->slots;
+    u64 old_capacity = map->capacity;
+
+    if (!hash_map_allocate(map, capacity)) {
+        return 0;
+    }
+
+    for (u64 index = 0; index < old_capacity; ++index) {
+        if ((control[index] & 0x80) == 0) {
+            hash_map_place(map, slots[index].key, slots[index].value, hash_string(slots[index].key));
+        }
+    }
+
+    return 1;
+}
+
+b32 hash_map_init(HashMap *map, Arena *arena, u64 expected_count) {
+    memset(map, 0, sizeof(HashMap));
+    map->arena = arena;
+
+    return hash_map_allocate(map, hash_map_capacity_for(expected_count));
+}
+
+// NOTE: for tables known up front; sized once and filled without duplicate or growth checks,
+// so the keys must be distinct
+b32 hash_map_build(HashMap *map, Arena *arena, String8 *keys, void **values, u64 count) {
+    if (!hash_map_init(map, arena, count)) {
+        return 0;
+    }
+
+    for (u64 index = 0; index < count; ++index) {
+        hash_map_place(map, keys[index], values[index], hash_string(keys[index]));
+    }
+
+    return 1;
+}
+
+void **hash_map_lookup(HashMap *map, String8 key) {
+    HashMapSlot *slot = hash_map_find(map, key, hash_string(key));
+
+    return slot ? &slot->value : 0;
+}
+
+void *hash_map_get(HashMap *map, String8 key) {
+    HashMapSlot *slot = hash_map_find(map, key, hash_string(key));
+
+    return slot ? slot->value : 0;
+}
+
+b32 hash_map_insert(HashMap *map, String8 key, void *value) {
+    u64 hash = hash_string(key);
+    HashMapSlot *slot = hash_map_find(map, key, hash);
+
+    if (slot) {
+        slot->value = value;
+        return 1;
+    }
+
+    // NOTE: deleted slots count against the load factor so every probe still ends on an empty
+    // slot; a table that is mostly tombstones is rebuilt at the same size
+    if ((map->count + map->deleted_count + 1) * 8 > map->capacity * 7) {
+        u64 capacity = map->count * 2 < map->capacity ? map->capacity : map->capacity * 2;
+
+        if (!hash_map_rehash(map, Max(capacity, hash_map_capacity_for(map->count + 1)))) {
+            return 0;
+        }
+    }
+
+    hash_map_place(map, key, value, hash);
+
+    return 1;
+}
+
+b32 hash_map_remove(HashMap *map, String8 key) {
+    HashMapSlot *slot = hash_map_find(map, key, hash_string(key));
+
+    if (!slot) {
+        return 0;
+    }
+
+    u64 index = slot - map->slots;
+    u8 *group = map->control + (index & ~(u64)(HASH_MAP_GROUP_SIZE - 1));
+
+    // NOTE: probes stop at a group with an empty slot, so inside such a group the slot can go
+    // back to empty; elsewhere a tombstone keeps later keys of the probe sequence reachable
+    if (hash_map_match(group, HASH_MAP_CONTROL_EMPTY)) {
+        map->control[index] = HASH_MAP_CONTROL_EMPTY;
+    } else {
+        map->control[index] = HASH_MAP_CONTROL_DELETED;
+        map->deleted_count += 1;
+    }
+
+    map->count -= 1;
+
+    return 1;
+}
+
+void hash_map_clear(HashMap *map) {
+    if (map->control) {
+        memset(map->control, HASH_MAP_CONTROL_EMPTY, map->capacity);
+    }
+
+    map->count = 0;
+    map->deleted_count = 0;
+}
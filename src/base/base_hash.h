@@ -0,0 +1,51 @@
+#ifndef BASE_HASH_H
+#define BASE_HASH_H
+
+#include "base_core.h"
+#include "base_memory.h"
+#include "base_string.h"
+
+//////////////////////////////
+// Hashing
+
+u64 hash_string(String8 string);
+u64 hash_string_seeded(String8 string, u64 seed);
+u64 hash_u64(u64 value);
+
+//////////////////////////////
+// Hash map
+
+// NOTE: Swiss table layout; one control byte per slot holds 7 bits of the hash, or marks the
+// slot empty or deleted, and a whole group of control bytes is matched with one SIMD compare
+#define HASH_MAP_GROUP_SIZE 16
+#define HASH_MAP_CONTROL_EMPTY ((u8)0x80)
+#define HASH_MAP_CONTROL_DELETED ((u8)0xfe)
+
+typedef struct HashMapSlot HashMapSlot;
+struct HashMapSlot {
+    String8 key;
+    void *value;
+};
+
+// NOTE: keys are referenced, not copied, and must outlive their entry. Storage comes from the
+// arena, so growing leaves the previous arrays behind until the arena is cleared
+typedef struct HashMap HashMap;
+struct HashMap {
+    Arena *arena;
+    u8 *control;
+    HashMapSlot *slots;
+    u64 capacity;
+    u64 count;
+    u64 deleted_count;
+};
+
+b32 hash_map_init(HashMap *map, Arena *arena, u64 expected_count);
+b32 hash_map_build(HashMap *map, Arena *arena, String8 *keys, void **values, u64 count);
+
+void **hash_map_lookup(HashMap *map, String8 key);
+void *hash_map_get(HashMap *map, String8 key);
+b32 hash_map_insert(HashMap *map, String8 key, void *value);
+b32 hash_map_remove(HashMap *map, String8 key);
+void hash_map_clear(HashMap *map);
+
+#endif // BASE_HASH_H
@@ -3,9 +3,13 @@
 #define BASE_INC_H
 
 #include "base_core.h" // IWYU pragma: export
+#include "base_coroutine.h"
+#include "base_deflate.h"
+#include "base_hash.h"
 #include "base_log.h"
 #include "base_memory.h"
 #include "base_os_linux.h"
+#include "base_sha1.h"
 #include "base_string.h"
 #include "base_thread.h"
 
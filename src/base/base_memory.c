@@ -39,6 +39,10 @@ i32 mem_release(void *ptr, u64 size) {
     return munmap(ptr, size);
 }
 
+i32 mem_guard(void *ptr, u64 size) {
+    return mprotect(ptr, size, PROT_NONE);
+}
+
 //////////////////////////////
 // Arena
 
@@ -74,7 +78,8 @@ Arena *arena_alloc(u64 reserve_size, u64 commit_size, void *optional_buffer, b32
 
 void *arena_push(Arena *arena, u64 size, u64 align) {
     Arena *current = arena->current;
-    u64 pos_new = AlignPow2(current->pos, align) + size;
+    u64 pos_aligned = AlignPow2(current->pos, align);
+    u64 pos_new = pos_aligned + size;
 
     if (pos_new > current->reserve_size && current->is_chained) {
         u64 reserve_size = current->reserve_size;
@@ -90,7 +95,8 @@ void *arena_push(Arena *arena, u64 size, u64 align) {
         new_arena_block->prev = arena->current;
         arena->current = new_arena_block;
         current = new_arena_block;
-        pos_new = AlignPow2(current->pos, align) + size;
+        pos_aligned = AlignPow2(current->pos, align);
+        pos_new = pos_aligned + size;
     }
 
     if (current->committed < pos_new) {
@@ -107,7 +113,7 @@ void *arena_push(Arena *arena, u64 size, u64 align) {
     void *result = 0;
 
     if (current->committed >= pos_new) {
-        result = (u8 *)current->base_pointer + current->pos;
+        result = (u8 *)current->base_pointer + pos_aligned;
         current->pos = pos_new;
     }
 
@@ -14,6 +14,7 @@ void *mem_allocate(u64 size);
 i32 mem_commit(void *ptr, u64 size);
 i32 mem_decommit(void *ptr, u64 size);
 i32 mem_release(void *ptr, u64 size);
+i32 mem_guard(void *ptr, u64 size);
 
 void mem_error(u8 *message);
 
@@ -48,10 +49,10 @@ void arena_release(Arena *arena);
 void *arena_push(Arena *arena, u64 size, u64 align);
 void *arena_push_zero(Arena *arena, u64 size, u64 align);
 
-#define push_array(arena, type, count) (type *)arena_push((arena), sizeof(type) * (count), sizeof(type))
-#define push_array_zero(arena, type, count) (type *)arena_push_zero((arena), sizeof(type) * (count), sizeof(type))
-#define push_struct(arena, type) push_array((arena), (type), 1)
-#define push_struct_zero(arena, type) push_array_zero((arena), (type), 1)
+#define push_array(arena, type, count) (type *)arena_push((arena), sizeof(type) * (count), _Alignof(type))
+#define push_array_zero(arena, type, count) (type *)arena_push_zero((arena), sizeof(type) * (count), _Alignof(type))
+#define push_struct(arena, type) push_array((arena), type, 1)
+#define push_struct_zero(arena, type) push_array_zero((arena), type, 1)
 
 void arena_pop(Arena *arena, u64 size);
 void arena_pop_to(Arena *arena, u64 pos);
@@ -1,6 +1,10 @@
 #include "base_os_linux.h"
 #include "base_core.h"
 #include "base_log.h"
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
 
 //////////////////////////////
 //  Handle
@@ -22,7 +26,64 @@ OS_Handle os_handle_zero() {
 //  Process
 
 void os_abort(i32 exit_code) {
-    syscall1(SYS_EXIT, exit_code);
+    fflush(stdout);
+    syscall1(SYS_EXIT_GROUP, exit_code);
+}
+
+void os_ignore_broken_pipe(void) {
+    signal(SIGPIPE, SIG_IGN);
+}
+
+u32 os_processor_count(void) {
+    i64 count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return count > 0 ? (u32)count : 1;
+}
+
+// NOTE: pins the calling thread; processors past the first 1024 are not supported
+b32 os_set_thread_processor(u32 processor) {
+    u64 mask[16] = {0};
+
+    if (processor >= sizeof(mask) * 8) {
+        return 0;
+    }
+
+    mask[processor / 64] = 1ull << (processor % 64);
+
+    return syscall3(SYS_SCHED_SETAFFINITY, 0, sizeof(mask), (u64)mask) == 0;
+}
+
+// NOTE: installed without SA_RESTART, so a blocking io_uring_enter returns -EINTR and the
+// interrupted thread gets to look at whatever the handler flagged
+b32 os_set_signal_handler(i32 signal_number, void (*handler)(i32)) {
+    b32 ok = 0;
+    struct sigaction action = {0};
+    action.sa_handler = handler;
+    sigemptyset(&action.sa_mask);
+
+    if (sigaction(signal_number, &action, 0) == 0) {
+        ok = 1;
+    }
+
+    return ok;
+}
+
+//////////////////////////////
+//  Time
+
+// NOTE: goes through the vDSO, so reading the clock never enters the kernel
+u64 os_now_nanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (u64)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+u64 os_now_unix_nanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    return (u64)now.tv_sec * 1000000000ull + now.tv_nsec;
 }
 
 //////////////////////////////
@@ -34,18 +95,46 @@ u16 network_byte_order(u16 n) {
     return result;
 }
 
-OS_Handle os_socket_ipv4(void) {
+OS_Handle os_socket(u16 family) {
     OS_Handle handle = {0};
 
-    i32 fd = syscall3(SYS_SOCKET, AF_INET, SOCK_STREAM, 0);
+    i32 fd = syscall3(SYS_SOCKET, family, SOCK_STREAM | SOCK_CLOEXEC, 0);
 
-    if (fd != -1) {
+    if (fd >= 0) {
         handle.value = fd;
     }
 
     return handle;
 }
 
+OS_Handle os_socket_ipv4(void) {
+    return os_socket(AF_INET);
+}
+
+OS_Handle os_socket_ipv6(void) {
+    return os_socket(AF_INET6);
+}
+
+OS_Handle os_socket_unix(void) {
+    return os_socket(AF_UNIX);
+}
+
+b32 os_bind(OS_Handle handle, SockAddr *addr, u32 addr_length) {
+    b32 ok = 0;
+
+    if (handle.value == 0) {
+        return ok;
+    }
+
+    i32 result = syscall3(SYS_BIND, handle.value, (u64)addr, addr_length);
+
+    if (result >= 0) {
+        ok = 1;
+    }
+
+    return ok;
+}
+
 b32 os_bind_ipv4(OS_Handle handle, u16 port) {
     b32 ok = 0;
 
@@ -85,6 +174,49 @@ b32 os_listen(OS_Handle handle, u32 backlog) {
     return ok;
 }
 
+// NOTE: 0 once connected, or the negated errno, so callers can tell a refused connection apart
+i32 os_connect(OS_Handle handle, SockAddr *addr, u32 addr_length) {
+    if (handle.value == 0) {
+        return -EBADF;
+    }
+
+    return syscall3(SYS_CONNECT, handle.value, (u64)addr, addr_length);
+}
+
+SockAddrIPv4 os_sockaddr_ipv4(u32 addr, u16 port) {
+    SockAddrIPv4 result = {0};
+
+    result.family = AF_INET;
+    result.port = network_byte_order(port);
+    result.addr = addr;
+
+    return result;
+}
+
+b32 os_sockaddr_unix(String8 path, SockAddrUnix *addr_out, u32 *addr_length_out) {
+    b32 ok = 0;
+
+    if (path.len == 0 || path.len >= sizeof(addr_out->path)) {
+        return ok;
+    }
+
+    memset(addr_out, 0, sizeof(*addr_out));
+    addr_out->family = AF_UNIX;
+    memcpy(addr_out->path, path.data, path.len);
+
+    *addr_length_out = sizeof(addr_out->family) + path.len + 1;
+
+    // NOTE: a leading '@' selects the abstract namespace, whose names are not NUL-terminated
+    if (path.data[0] == '@') {
+        addr_out->path[0] = 0;
+        *addr_length_out -= 1;
+    }
+
+    ok = 1;
+
+    return ok;
+}
+
 b32 os_close(OS_Handle handle) {
     u32 fd = handle.value;
     b32 ok = 0;
@@ -98,6 +230,524 @@ b32 os_close(OS_Handle handle) {
     return ok;
 }
 
+b32 os_set_ipv6_only(OS_Handle handle, b32 is_ipv6_only) {
+    b32 ok = 0;
+    i32 value = is_ipv6_only ? 1 : 0;
+
+    i32 result = syscall5(SYS_SETSOCKOPT, handle.value, IPPROTO_IPV6, IPV6_V6ONLY, (u64)&value, sizeof(value));
+
+    if (result >= 0) {
+        ok = 1;
+    }
+
+    return ok;
+}
+
+b32 os_set_socket_option(OS_Handle handle, i32 level, i32 name, i32 value) {
+    b32 ok = 0;
+
+    i32 result = syscall5(SYS_SETSOCKOPT, handle.value, level, name, (u64)&value, sizeof(value));
+
+    if (result >= 0) {
+        ok = 1;
+    }
+
+    return ok;
+}
+
+b32 os_get_socket_option(OS_Handle handle, i32 level, i32 name, i32 *value_out) {
+    b32 ok = 0;
+    u32 length = sizeof(*value_out);
+
+    i32 result = syscall5(SYS_GETSOCKOPT, handle.value, level, name, (u64)value_out, (u64)&length);
+
+    if (result >= 0) {
+        ok = 1;
+    }
+
+    return ok;
+}
+
+b32 os_peer_address(OS_Handle handle, void *addr_out, u32 *addr_length) {
+    b32 ok = 0;
+
+    i32 result = syscall3(SYS_GETPEERNAME, handle.value, (u64)addr_out, (u64)addr_length);
+
+    if (result >= 0) {
+        ok = 1;
+    }
+
+    return ok;
+}
+
+b32 os_parse_ipv4(String8 host, u32 *addr_out) {
+    u32 addr = 0;
+    u32 part = 0;
+    u32 digits = 0;
+    u32 parts = 0;
+
+    for (u64 index = 0; index < host.len; ++index) {
+        u8 c = host.data[index];
+
+        if (c >= '0' && c <= '9') {
+            part = part * 10 + (c - '0');
+            digits++;
+
+            if (part > 255 || digits > 3) {
+                return 0;
+            }
+        } else if (c == '.' && digits > 0 && parts < 3) {
+            addr |= part << (8 * parts);
+            parts++;
+            part = 0;
+            digits = 0;
+        } else {
+            return 0;
+        }
+    }
+
+    if (digits == 0 || parts != 3) {
+        return 0;
+    }
+
+    *addr_out = addr | (part << 24);
+
+    return 1;
+}
+
+b32 os_parse_ipv6(String8 host, u8 *addr_out) {
+    u16 groups[8] = {0};
+    u32 group_count = 0;
+    i32 gap_index = -1;
+    u64 pos = 0;
+
+    if (host.len >= 2 && host.data[0] == ':' && host.data[1] == ':') {
+        gap_index = 0;
+        pos = 2;
+    }
+
+    while (pos < host.len) {
+        u32 value = 0;
+        u32 digits = 0;
+
+        while (pos < host.len && digits < 5) {
+            u8 c = host.data[pos] | 0x20;
+
+            if (host.data[pos] >= '0' && host.data[pos] <= '9') {
+                value = value * 16 + (host.data[pos] - '0');
+            } else if (c >= 'a' && c <= 'f') {
+                value = value * 16 + (c - 'a' + 10);
+            } else {
+                break;
+            }
+
+            digits++;
+            pos++;
+        }
+
+        if (digits == 0 || digits > 4 || group_count == 8) {
+            return 0;
+        }
+
+        groups[group_count++] = value;
+
+        if (pos == host.len) {
+            break;
+        }
+
+        if (host.data[pos] != ':') {
+            return 0;
+        }
+
+        pos++;
+
+        if (pos < host.len && host.data[pos] == ':') {
+            if (gap_index != -1) {
+                return 0;
+            }
+
+            gap_index = group_count;
+            pos++;
+        } else if (pos == host.len) {
+            return 0;
+        }
+    }
+
+    if ((gap_index == -1 && group_count != 8) || (gap_index != -1 && group_count > 7)) {
+        return 0;
+    }
+
+    memset(addr_out, 0, 16);
+
+    u32 tail_count = gap_index == -1 ? 0 : group_count - gap_index;
+    u32 head_count = group_count - tail_count;
+
+    for (u32 index = 0; index < head_count; ++index) {
+        addr_out[index * 2] = groups[index] >> 8;
+        addr_out[index * 2 + 1] = groups[index] & 0xff;
+    }
+
+    for (u32 index = 0; index < tail_count; ++index) {
+        u32 group_index = 8 - tail_count + index;
+        addr_out[group_index * 2] = groups[head_count + index] >> 8;
+        addr_out[group_index * 2 + 1] = groups[head_count + index] & 0xff;
+    }
+
+    return 1;
+}
+
+b32 os_sockaddr_from_string(String8 address, SockAddr *addr_out, u32 *addr_length_out) {
+    String8 unix_prefix = str8("unix:");
+    u64 port = 0;
+
+    memset(addr_out, 0, sizeof(*addr_out));
+
+    if (str8_are_equal(str8_prefix(address, unix_prefix.len), unix_prefix)) {
+        return os_sockaddr_unix(str8_skip(address, unix_prefix.len), (SockAddrUnix *)addr_out, addr_length_out);
+    }
+
+    if (address.len > 0 && address.data[0] == '[') {
+        SockAddrIPv6 *addr_ipv6 = (SockAddrIPv6 *)addr_out;
+        String8 host = str8_split_to(str8_skip(address, 1), "]:");
+        String8 port_string = str8_skip(address, host.len + 3);
+
+        if (!str8_is_valid(host) || !os_parse_ipv6(host, addr_ipv6->addr) ||
+            !str8_to_u64(port_string, &port) || port > 0xffff) {
+            return 0;
+        }
+
+        addr_ipv6->family = AF_INET6;
+        addr_ipv6->port = network_byte_order(port);
+        *addr_length_out = sizeof(SockAddrIPv6);
+
+        return 1;
+    }
+
+    String8 host = str8_split_to(address, ":");
+    String8 port_string = str8_skip(address, host.len + 1);
+    u32 addr = 0;
+
+    // NOTE: a bare port listens on every IPv4 interface
+    if (!str8_is_valid(host)) {
+        host = str8("0.0.0.0");
+        port_string = address;
+    } else if (str8_are_equal(host, str8("localhost"))) {
+        host = str8("127.0.0.1");
+    } else if (str8_are_equal(host, str8("*"))) {
+        host = str8("0.0.0.0");
+    }
+
+    if (!os_parse_ipv4(host, &addr) || !str8_to_u64(port_string, &port) || port > 0xffff) {
+        return 0;
+    }
+
+    *(SockAddrIPv4 *)addr_out = os_sockaddr_ipv4(addr, port);
+    *addr_length_out = sizeof(SockAddrIPv4);
+
+    return 1;
+}
+
+local u64 os_write_ipv4(u8 *buffer, u8 *octets) {
+    u64 len = 0;
+
+    for (u32 index = 0; index < 4; ++index) {
+        if (index > 0) {
+            buffer[len++] = '.';
+        }
+
+        len += str8_write_u64(buffer + len, octets[index] & 0xff);
+    }
+
+    return len;
+}
+
+String8 os_sockaddr_host_string(SockAddr *addr, u8 *buffer) {
+    String8 result = {0, buffer};
+    local u8 hex_digits[] = "0123456789abcdef";
+
+    if (addr->family == AF_INET) {
+        SockAddrIPv4 *addr_ipv4 = (SockAddrIPv4 *)addr;
+
+        result.len = os_write_ipv4(buffer, (u8 *)&addr_ipv4->addr);
+    } else if (addr->family == AF_INET6) {
+        SockAddrIPv6 *addr_ipv6 = (SockAddrIPv6 *)addr;
+        u8 *bytes = addr_ipv6->addr;
+        local u8 v4_mapped_prefix[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+
+        if (memcmp(bytes, v4_mapped_prefix, sizeof(v4_mapped_prefix)) == 0) {
+            result.len = os_write_ipv4(buffer, bytes + 12);
+            return result;
+        }
+
+        // NOTE: RFC 5952, the longest run of two or more zero groups collapses to "::"
+        i32 gap_start = -1;
+        i32 gap_length = 1;
+
+        for (i32 start = 0; start < 8;) {
+            i32 length = 0;
+
+            while (start + length < 8 && bytes[(start + length) * 2] == 0 && bytes[(start + length) * 2 + 1] == 0) {
+                length++;
+            }
+
+            if (length > gap_length) {
+                gap_start = start;
+                gap_length = length;
+            }
+
+            start += length > 0 ? length : 1;
+        }
+
+        for (i32 group = 0; group < 8; ++group) {
+            if (group == gap_start) {
+                buffer[result.len++] = ':';
+                buffer[result.len++] = ':';
+                group += gap_length - 1;
+                continue;
+            }
+
+            if (group > 0 && group != gap_start + gap_length) {
+                buffer[result.len++] = ':';
+            }
+
+            u32 value = ((bytes[group * 2] & 0xff) << 8) | (bytes[group * 2 + 1] & 0xff);
+            b32 is_leading = 1;
+
+            for (i32 shift = 12; shift >= 0; shift -= 4) {
+                u32 nibble = (value >> shift) & 0xf;
+
+                if (nibble == 0 && is_leading && shift > 0) {
+                    continue;
+                }
+
+                is_leading = 0;
+                buffer[result.len++] = hex_digits[nibble];
+            }
+        }
+    } else if (addr->family == AF_UNIX) {
+        memcpy(buffer, "unix", 4);
+        result.len = 4;
+    }
+
+    return result;
+}
+
+//////////////////////////////
+//  Files
+
+// NOTE: opens for writing, truncating an existing file
+OS_Handle os_create_file(String8 path) {
+    OS_Handle handle = {0};
+    u8 path_buffer[4096];
+
+    if (path.len >= sizeof(path_buffer)) {
+        return handle;
+    }
+
+    memcpy(path_buffer, path.data, path.len);
+    path_buffer[path.len] = 0;
+
+    i32 fd = syscall4(SYS_OPENAT, AT_FDCWD, (u64)path_buffer, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (fd >= 0) {
+        handle.value = fd;
+    }
+
+    return handle;
+}
+
+OS_Handle os_open_file(String8 path) {
+    OS_Handle handle = {0};
+    u8 path_buffer[4096];
+
+    if (path.len >= sizeof(path_buffer)) {
+        return handle;
+    }
+
+    memcpy(path_buffer, path.data, path.len);
+    path_buffer[path.len] = 0;
+
+    i32 fd = syscall4(SYS_OPENAT, AT_FDCWD, (u64)path_buffer, O_RDONLY | O_CLOEXEC, 0);
+
+    if (fd >= 0) {
+        handle.value = fd;
+    }
+
+    return handle;
+}
+
+b32 os_delete_file(String8 path) {
+    b32 ok = 0;
+    u8 path_buffer[4096];
+
+    if (path.len >= sizeof(path_buffer)) {
+        return ok;
+    }
+
+    memcpy(path_buffer, path.data, path.len);
+    path_buffer[path.len] = 0;
+
+    i32 result = syscall1(SYS_UNLINK, (u64)path_buffer);
+
+    if (result >= 0) {
+        ok = 1;
+    }
+
+    return ok;
+}
+
+// NOTE: sized with lseek, so only for regular files
+String8 os_read_entire_file(Arena *arena, String8 path) {
+    String8 result = {0};
+    OS_Handle handle = os_open_file(path);
+
+    if (!handle.value) {
+        return result;
+    }
+
+    i64 size = syscall3(SYS_LSEEK, handle.value, 0, 2);
+    u8 *data = size >= 0 ? arena_push(arena, size + 1, 8) : 0;
+    i64 offset = 0;
+
+    if (data && syscall3(SYS_LSEEK, handle.value, 0, 0) == 0) {
+        while (offset < size) {
+            i64 read = syscall3(SYS_READ, handle.value, (u64)(data + offset), size - offset);
+
+            if (read <= 0) {
+                break;
+            }
+
+            offset += read;
+        }
+    }
+
+    if (data && offset == size) {
+        data[size] = 0;
+        result.data = data;
+        result.len = size;
+    }
+
+    os_close(handle);
+
+    return result;
+}
+
+b32 os_write_all(OS_Handle handle, String8 data) {
+    while (data.len > 0) {
+        i64 written = syscall3(SYS_WRITE, handle.value, (u64)data.data, data.len);
+
+        if (written <= 0) {
+            return 0;
+        }
+
+        data = str8_skip(data, written);
+    }
+
+    return 1;
+}
+
+// NOTE: the kernel's struct stat on x86-64, of which only the mode, size and modification time
+// are read
+typedef struct LinuxStat LinuxStat;
+struct LinuxStat {
+    u64 device;
+    u64 inode;
+    u64 link_count;
+    u32 mode;
+    u32 user;
+    u32 group;
+    u32 padding;
+    u64 special_device;
+    i64 size;
+    i64 block_size;
+    i64 block_count;
+    u64 access_time;
+    u64 access_time_nanoseconds;
+    u64 modified_time;
+    u64 modified_time_nanoseconds;
+    u64 change_time;
+    u64 change_time_nanoseconds;
+    i64 reserved[3];
+};
+
+local void os_file_info_from_stat(LinuxStat *stat, OS_FileInfo *info_out) {
+    info_out->size = stat->size;
+    info_out->modified_time = stat->modified_time;
+    info_out->is_regular = (stat->mode & 0170000) == 0100000;
+    info_out->is_socket = (stat->mode & 0170000) == 0140000;
+}
+
+b32 os_file_info(OS_Handle handle, OS_FileInfo *info_out) {
+    LinuxStat stat = {0};
+
+    if (syscall2(SYS_FSTAT, handle.value, (u64)&stat) != 0) {
+        return 0;
+    }
+
+    os_file_info_from_stat(&stat, info_out);
+
+    return 1;
+}
+
+// NOTE: lstat, so a symbolic link is described rather than followed; 0 when nothing is at path
+b32 os_path_info(String8 path, OS_FileInfo *info_out) {
+    LinuxStat stat = {0};
+    u8 path_buffer[4096];
+
+    if (path.len >= sizeof(path_buffer)) {
+        return 0;
+    }
+
+    memcpy(path_buffer, path.data, path.len);
+    path_buffer[path.len] = 0;
+
+    if (syscall2(SYS_LSTAT, (u64)path_buffer, (u64)&stat) != 0) {
+        return 0;
+    }
+
+    os_file_info_from_stat(&stat, info_out);
+
+    return 1;
+}
+
+i64 os_read_at(OS_Handle handle, u8 *buffer, u64 size, u64 offset) {
+    return syscall4(SYS_PREAD64, handle.value, (u64)buffer, size, offset);
+}
+
+i64 os_write_at(OS_Handle handle, u8 *buffer, u64 size, u64 offset) {
+    return syscall4(SYS_PWRITE64, handle.value, (u64)buffer, size, offset);
+}
+
+//////////////////////////////
+//  Pipes
+
+b32 os_shutdown(OS_Handle handle) {
+    b32 ok = 0;
+
+    i32 result = syscall2(SYS_SHUTDOWN, handle.value, SHUT_RDWR);
+
+    if (result >= 0) {
+        ok = 1;
+    }
+
+    return ok;
+}
+
+b32 os_pipe(OS_Handle *read_handle, OS_Handle *write_handle) {
+    b32 ok = 0;
+    i32 fds[2];
+
+    i32 result = syscall2(SYS_PIPE2, (u64)fds, 0);
+
+    if (result >= 0) {
+        *read_handle = os_handle_from_fd(fds[0]);
+        *write_handle = os_handle_from_fd(fds[1]);
+        ok = 1;
+    }
+
+    return ok;
+}
+
 //////////////////////////////
 //  IO
 
@@ -125,6 +775,8 @@ i32 os_io_uring_init_ring(IO_Uring *ring) {
         return 1;
     }
 
+    ring->features = p.features;
+
     int sring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
     int cring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
 
@@ -180,6 +832,10 @@ i32 os_io_uring_wait_cqe(IO_Uring *ring, IO_Uring_Completion_Entry **completion_
 
     i32 result = os_io_uring_enter(ring->ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
 
+    if (result < 0) {
+        return result;
+    }
+
     head = os_io_read_barrier(ring->cring_head);
 
     *completion_entry = &ring->cqes[head & (*ring->cring_mask)];
@@ -201,6 +857,19 @@ IO_Uring_Submission_Entry *os_io_uring_get_sqe(IO_Uring *ring, u32 *tail_out) {
     return submission_entry;
 }
 
+// NOTE: the entry after the one at *tail, for building a linked chain before any of it is
+// published; *tail is advanced to the new entry
+IO_Uring_Submission_Entry *os_io_uring_get_next_sqe(IO_Uring *ring, u32 *tail) {
+    u32 next = *tail + 1;
+    u32 index = next & *ring->sring_mask;
+
+    IO_Uring_Submission_Entry *submission_entry = &ring->sqes[index];
+    ring->sring_array[index] = index;
+    *tail = next;
+
+    return submission_entry;
+}
+
 void os_io_uring_prep_sqe(IO_Uring_Submission_Entry *submission_entry, u32 opcode) {
     memset(submission_entry, 0, sizeof(*submission_entry));
     submission_entry->opcode = opcode;
@@ -9,20 +9,65 @@
 #include <string.h>
 #include <sys/mman.h>
 
+#define SYS_READ 0
 #define SYS_WRITE 1
 #define SYS_CLOSE 3
+#define SYS_FSTAT 5
+#define SYS_LSTAT 6
+#define SYS_LSEEK 8
+#define SYS_PREAD64 17
+#define SYS_PWRITE64 18
 #define SYS_SOCKET 41
+#define SYS_CONNECT 42
 #define SYS_ACCEPT 43
+#define SYS_SHUTDOWN 48
 #define SYS_BIND 49
+#define SYS_GETPEERNAME 52
+#define SYS_SETSOCKOPT 54
+#define SYS_GETSOCKOPT 55
 #define SYS_LISTEN 50
 #define SYS_EXIT 60
+#define SYS_UNLINK 87
+#define SYS_SCHED_SETAFFINITY 203
+#define SYS_EXIT_GROUP 231
+#define SYS_OPENAT 257
+#define SYS_PIPE2 293
 #define SYS_IO_URING_SETUP 425
 #define SYS_IO_URING_ENTER 426
 #define SYS_IO_URING_REGISTER 427
 
+#define AF_UNIX 1
 #define AF_INET 2
+#define AF_INET6 10
 
 #define SOCK_STREAM 1
+#define SOCK_CLOEXEC 02000000
+
+#define MSG_NOSIGNAL 0x4000
+
+#define SHUT_RDWR 2
+
+#define AT_FDCWD -100
+#define O_RDONLY 00
+#define O_WRONLY 01
+#define O_CREAT 0100
+#define O_TRUNC 01000
+#define O_CLOEXEC 02000000
+
+#define IPPROTO_IPV6 41
+#define IPV6_V6ONLY 26
+
+#define SOL_SOCKET 1
+#define SO_REUSEADDR 2
+#define SO_SNDBUF 7
+#define SO_RCVBUF 8
+#define SO_REUSEPORT 15
+#define SO_INCOMING_CPU 49
+
+#define IPPROTO_TCP 6
+#define TCP_NODELAY 1
+#define TCP_DEFER_ACCEPT 9
+#define TCP_FASTOPEN 23
 
 //////////////////////////////
 //  Handle
@@ -39,6 +84,16 @@ OS_Handle os_handle_zero(void);
 //  Process
 
 void os_abort(i32 exit_code);
+void os_ignore_broken_pipe(void);
+u32 os_processor_count(void);
+b32 os_set_thread_processor(u32 processor);
+b32 os_set_signal_handler(i32 signal_number, void (*handler)(i32));
+
+//////////////////////////////
+//  Time
+
+u64 os_now_nanoseconds(void);
+u64 os_now_unix_nanoseconds(void);
 
 //////////////////////////////
 //  Network
@@ -51,10 +106,80 @@ struct SockAddrIPv4 {
     u8 zero[8];
 };
 
+typedef struct SockAddrIPv6 SockAddrIPv6;
+struct SockAddrIPv6 {
+    u16 family;
+    u16 port;
+    u32 flow_info;
+    u8 addr[16];
+    u32 scope_id;
+};
+
+typedef struct SockAddrUnix SockAddrUnix;
+struct SockAddrUnix {
+    u16 family;
+    u8 path[108];
+};
+
+// NOTE: large enough for any address family, like sockaddr_storage
+typedef struct SockAddr SockAddr;
+struct SockAddr {
+    u16 family;
+    u8 data[126];
+} __attribute__((aligned(8)));
+
+#define OS_ADDRESS_STRING_SIZE 64
+
+u16 network_byte_order(u16 n);
+
+OS_Handle os_socket(u16 family);
 OS_Handle os_socket_ipv4(void);
+OS_Handle os_socket_ipv6(void);
+OS_Handle os_socket_unix(void);
+b32 os_bind(OS_Handle handle, SockAddr *addr, u32 addr_length);
 b32 os_bind_ipv4(OS_Handle handle, u16 port);
 b32 os_listen(OS_Handle handle, u32 backlog);
+i32 os_connect(OS_Handle handle, SockAddr *addr, u32 addr_length);
 b32 os_close(OS_Handle handle);
+b32 os_shutdown(OS_Handle handle);
+b32 os_peer_address(OS_Handle handle, void *addr_out, u32 *addr_length);
+b32 os_set_ipv6_only(OS_Handle handle, b32 is_ipv6_only);
+b32 os_set_socket_option(OS_Handle handle, i32 level, i32 name, i32 value);
+b32 os_get_socket_option(OS_Handle handle, i32 level, i32 name, i32 *value_out);
+
+SockAddrIPv4 os_sockaddr_ipv4(u32 addr, u16 port);
+b32 os_sockaddr_unix(String8 path, SockAddrUnix *addr_out, u32 *addr_length_out);
+
+b32 os_parse_ipv4(String8 host, u32 *addr_out);
+b32 os_parse_ipv6(String8 host, u8 *addr_out);
+b32 os_sockaddr_from_string(String8 address, SockAddr *addr_out, u32 *addr_length_out);
+String8 os_sockaddr_host_string(SockAddr *addr, u8 *buffer);
+
+//////////////////////////////
+//  Files
+
+typedef struct OS_FileInfo OS_FileInfo;
+struct OS_FileInfo {
+    u64 size;
+    u64 modified_time;
+    b32 is_regular;
+    b32 is_socket;
+};
+
+OS_Handle os_create_file(String8 path);
+OS_Handle os_open_file(String8 path);
+b32 os_delete_file(String8 path);
+String8 os_read_entire_file(Arena *arena, String8 path);
+b32 os_write_all(OS_Handle handle, String8 data);
+b32 os_file_info(OS_Handle handle, OS_FileInfo *info_out);
+b32 os_path_info(String8 path, OS_FileInfo *info_out);
+i64 os_read_at(OS_Handle handle, u8 *buffer, u64 size, u64 offset);
+i64 os_write_at(OS_Handle handle, u8 *buffer, u64 size, u64 offset);
+
+//////////////////////////////
+//  Pipes
+
+b32 os_pipe(OS_Handle *read_handle, OS_Handle *write_handle);
 
 //////////////////////////////
 //  IO
@@ -64,10 +189,12 @@ b32 os_close(OS_Handle handle);
 typedef struct io_uring_params IO_Uring_Params;
 typedef struct io_uring_sqe IO_Uring_Submission_Entry;
 typedef struct io_uring_cqe IO_Uring_Completion_Entry;
+typedef struct __kernel_timespec IO_Uring_Timespec;
 
 typedef struct IO_Uring IO_Uring;
 struct IO_Uring {
     i32 ring_fd;
+    u32 features;
     u32 *sring_tail;
     u32 *sring_mask;
     u32 *sring_array;
@@ -88,6 +215,7 @@ i32 os_io_uring_enter(i32 ring_fd, u32 to_submit, u32 min_complete, u32 flags);
 i32 os_io_uring_init_ring(IO_Uring *ring);
 i32 os_io_uring_wait_cqe(IO_Uring *ring, IO_Uring_Completion_Entry **completion_entry);
 IO_Uring_Submission_Entry *os_io_uring_get_sqe(IO_Uring *ring, u32 *tail_out);
+IO_Uring_Submission_Entry *os_io_uring_get_next_sqe(IO_Uring *ring, u32 *tail);
 void os_io_uring_prep_sqe(IO_Uring_Submission_Entry *submission_entry, u32 opcode);
 
 #endif // BASE_OS_LINUX_H
@@ -0,0 +1,116 @@
+#include "base_sha1.h"
+#include <string.h>
+
+#define SHA1_ROTATE_LEFT(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+local void sha1_process_block(SHA1 *sha, u8 *block) {
+    u32 w[80];
+
+    for (u32 index = 0; index < 16; ++index) {
+        w[index] = ((u32)(block[index * 4] & 0xff) << 24) | ((u32)(block[index * 4 + 1] & 0xff) << 16) |
+                   ((u32)(block[index * 4 + 2] & 0xff) << 8) | (u32)(block[index * 4 + 3] & 0xff);
+    }
+
+    for (u32 index = 16; index < 80; ++index) {
+        u32 x = w[index - 3] ^ w[index - 8] ^ w[index - 14] ^ w[index - 16];
+        w[index] = SHA1_ROTATE_LEFT(x, 1);
+    }
+
+    u32 a = sha->state[0];
+    u32 b = sha->state[1];
+    u32 c = sha->state[2];
+    u32 d = sha->state[3];
+    u32 e = sha->state[4];
+
+    for (u32 index = 0; index < 80; ++index) {
+        u32 f, k;
+
+        if (index < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5a827999;
+        } else if (index < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ed9eba1;
+        } else if (index < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8f1bbcdc;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xca62c1d6;
+        }
+
+        u32 temp = SHA1_ROTATE_LEFT(a, 5) + f + e + k + w[index];
+        e = d;
+        d = c;
+        c = SHA1_ROTATE_LEFT(b, 30);
+        b = a;
+        a = temp;
+    }
+
+    sha->state[0] += a;
+    sha->state[1] += b;
+    sha->state[2] += c;
+    sha->state[3] += d;
+    sha->state[4] += e;
+}
+
+void sha1_init(SHA1 *sha) {
+    memset(sha, 0, sizeof(SHA1));
+    sha->state[0] = 0x67452301;
+    sha->state[1] = 0xefcdab89;
+    sha->state[2] = 0x98badcfe;
+    sha->state[3] = 0x10325476;
+    sha->state[4] = 0xc3d2e1f0;
+}
+
+void sha1_update(SHA1 *sha, String8 data) {
+    sha->length += data.len;
+
+    while (data.len > 0) {
+        u64 copy = Min(data.len, SHA1_BLOCK_SIZE - sha->block_length);
+
+        memcpy(sha->block + sha->block_length, data.data, copy);
+        sha->block_length += copy;
+        data = str8_skip(data, copy);
+
+        if (sha->block_length == SHA1_BLOCK_SIZE) {
+            sha1_process_block(sha, sha->block);
+            sha->block_length = 0;
+        }
+    }
+}
+
+void sha1_final(SHA1 *sha, u8 *digest_out) {
+    u64 bit_length = sha->length * 8;
+
+    sha->block[sha->block_length++] = (u8)0x80;
+
+    if (sha->block_length > SHA1_BLOCK_SIZE - 8) {
+        memset(sha->block + sha->block_length, 0, SHA1_BLOCK_SIZE - sha->block_length);
+        sha1_process_block(sha, sha->block);
+        sha->block_length = 0;
+    }
+
+    memset(sha->block + sha->block_length, 0, SHA1_BLOCK_SIZE - 8 - sha->block_length);
+
+    for (u32 index = 0; index < 8; ++index) {
+        sha->block[SHA1_BLOCK_SIZE - 1 - index] = (u8)(bit_length >> (index * 8));
+    }
+
+    sha1_process_block(sha, sha->block);
+
+    for (u32 index = 0; index < 5; ++index) {
+        digest_out[index * 4] = (u8)(sha->state[index] >> 24);
+        digest_out[index * 4 + 1] = (u8)(sha->state[index] >> 16);
+        digest_out[index * 4 + 2] = (u8)(sha->state[index] >> 8);
+        digest_out[index * 4 + 3] = (u8)sha->state[index];
+    }
+}
+
+void sha1(String8 data, u8 *digest_out) {
+    SHA1 sha;
+
+    sha1_init(&sha);
+    sha1_update(&sha, data);
+    sha1_final(&sha, digest_out);
+}
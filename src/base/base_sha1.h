@@ -0,0 +1,24 @@
+#ifndef BASE_SHA1_H
+#define BASE_SHA1_H
+
+#include "base_core.h"
+#include "base_string.h"
+
+#define SHA1_DIGEST_SIZE 20
+#define SHA1_BLOCK_SIZE 64
+
+typedef struct SHA1 SHA1;
+struct SHA1 {
+    u32 state[5];
+    u64 length;
+    u8 block[SHA1_BLOCK_SIZE];
+    u32 block_length;
+};
+
+void sha1_init(SHA1 *sha);
+void sha1_update(SHA1 *sha, String8 data);
+void sha1_final(SHA1 *sha, u8 *digest_out);
+
+void sha1(String8 data, u8 *digest_out);
+
+#endif // BASE_SHA1_H
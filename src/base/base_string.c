@@ -26,6 +26,31 @@ b32 str8_are_equal(String8 a, String8 b) {
     return 1;
 }
 
+b32 str8_are_equal_case_insensitive(String8 a, String8 b) {
+    if (a.len != b.len) {
+        return 0;
+    }
+
+    for (u64 index = 0; index < a.len; ++index) {
+        u8 char_a = a.data[index];
+        u8 char_b = b.data[index];
+
+        if (char_a >= 'A' && char_a <= 'Z') {
+            char_a += 'a' - 'A';
+        }
+
+        if (char_b >= 'A' && char_b <= 'Z') {
+            char_b += 'a' - 'A';
+        }
+
+        if (char_a != char_b) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
 String8 str8_prefix(String8 string, u64 size) {
     u64 size_clamped = ClampTop(size, string.len);
     String8 result = {size_clamped, string.data};
@@ -36,7 +61,7 @@ String8 str8_prefix(String8 string, u64 size) {
 String8 str8_postfix(String8 string, u64 size) {
     u64 size_clamped = ClampTop(size, string.len);
     u64 new_base = string.len - size_clamped;
-    String8 result = {size, string.data + new_base};
+    String8 result = {size_clamped, string.data + new_base};
 
     return result;
 }
@@ -64,11 +89,193 @@ String8 str8_split_to(String8 string, u8 *delimiter) {
 
 String8 str8_read_to(String8 *string, u8 *delimiter) {
     String8 result = str8_split_to(*string, delimiter);
-    string->data += result.len + strlen(delimiter);
+
+    if (str8_is_valid(result)) {
+        *string = str8_skip(*string, result.len + strlen(delimiter));
+    }
+
+    return result;
+}
+
+String8 str8_trim_whitespace(String8 string) {
+    while (string.len > 0 && (string.data[0] == ' ' || string.data[0] == '\t')) {
+        string.data++;
+        string.len--;
+    }
+
+    while (string.len > 0 && (string.data[string.len - 1] == ' ' || string.data[string.len - 1] == '\t')) {
+        string.len--;
+    }
+
+    return string;
+}
+
+String8 str8_from_cstring(u8 *cstring) {
+    String8 result = {strlen(cstring), cstring};
 
     return result;
 }
 
+b32 str8_to_u64(String8 string, u64 *value_out) {
+    u64 value = 0;
+
+    if (string.len == 0 || string.len > 19) {
+        return 0;
+    }
+
+    for (u64 index = 0; index < string.len; ++index) {
+        u8 c = string.data[index];
+
+        if (c < '0' || c > '9') {
+            return 0;
+        }
+
+        value = value * 10 + (c - '0');
+    }
+
+    *value_out = value;
+
+    return 1;
+}
+
+local i32 str8_base64_value(u8 c) {
+    i32 result = -1;
+
+    if (c >= 'A' && c <= 'Z') {
+        result = c - 'A';
+    } else if (c >= 'a' && c <= 'z') {
+        result = c - 'a' + 26;
+    } else if (c >= '0' && c <= '9') {
+        result = c - '0' + 52;
+    } else if (c == '+' || c == '-') {
+        result = 62;
+    } else if (c == '/' || c == '_') {
+        result = 63;
+    }
+
+    return result;
+}
+
+// NOTE: accepts both the standard and the URL-safe alphabet, with or without padding
+b32 str8_base64_decode(String8 string, u8 *out, u64 *len_out) {
+    u32 bits = 0;
+    u32 bit_count = 0;
+    u64 len = 0;
+
+    while (string.len > 0 && string.data[string.len - 1] == '=') {
+        string.len -= 1;
+    }
+
+    for (u64 index = 0; index < string.len; ++index) {
+        i32 value = str8_base64_value(string.data[index]);
+
+        if (value < 0) {
+            return 0;
+        }
+
+        bits = (bits << 6) | value;
+        bit_count += 6;
+
+        if (bit_count >= 8) {
+            bit_count -= 8;
+            out[len++] = (u8)(bits >> bit_count);
+        }
+    }
+
+    *len_out = len;
+
+    return 1;
+}
+
+global u8 str8_base64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// NOTE: writes 4 * ceil(len / 3) padded bytes of the standard alphabet
+u64 str8_base64_encode(String8 string, u8 *out) {
+    u64 len = 0;
+    u64 index = 0;
+
+    for (; index + 3 <= string.len; index += 3) {
+        u32 bits = ((u32)(string.data[index] & 0xff) << 16) | ((u32)(string.data[index + 1] & 0xff) << 8) |
+                   (u32)(string.data[index + 2] & 0xff);
+
+        out[len++] = str8_base64_alphabet[(bits >> 18) & 0x3f];
+        out[len++] = str8_base64_alphabet[(bits >> 12) & 0x3f];
+        out[len++] = str8_base64_alphabet[(bits >> 6) & 0x3f];
+        out[len++] = str8_base64_alphabet[bits & 0x3f];
+    }
+
+    if (index < string.len) {
+        u32 bits = (u32)(string.data[index] & 0xff) << 16;
+
+        if (index + 1 < string.len) {
+            bits |= (u32)(string.data[index + 1] & 0xff) << 8;
+        }
+
+        out[len++] = str8_base64_alphabet[(bits >> 18) & 0x3f];
+        out[len++] = str8_base64_alphabet[(bits >> 12) & 0x3f];
+        out[len++] = index + 1 < string.len ? str8_base64_alphabet[(bits >> 6) & 0x3f] : '=';
+        out[len++] = '=';
+    }
+
+    return len;
+}
+
+b32 str8_is_utf8(String8 string) {
+    u64 pos = 0;
+
+    while (pos < string.len) {
+        u32 c = string.data[pos] & 0xff;
+
+        if (c < 0x80) {
+            pos += 1;
+            continue;
+        }
+
+        u32 extra = 0;
+        u32 min = 0;
+        u32 codepoint = 0;
+
+        if ((c & 0xe0) == 0xc0) {
+            extra = 1;
+            min = 0x80;
+            codepoint = c & 0x1f;
+        } else if ((c & 0xf0) == 0xe0) {
+            extra = 2;
+            min = 0x800;
+            codepoint = c & 0x0f;
+        } else if ((c & 0xf8) == 0xf0) {
+            extra = 3;
+            min = 0x10000;
+            codepoint = c & 0x07;
+        } else {
+            return 0;
+        }
+
+        if (pos + extra >= string.len) {
+            return 0;
+        }
+
+        for (u32 index = 1; index <= extra; ++index) {
+            u32 next = string.data[pos + index] & 0xff;
+
+            if ((next & 0xc0) != 0x80) {
+                return 0;
+            }
+
+            codepoint = (codepoint << 6) | (next & 0x3f);
+        }
+
+        // NOTE: overlong encodings, UTF-16 surrogates and values past U+10FFFF are rejected
+        if (codepoint < min || (codepoint >= 0xd800 && codepoint <= 0xdfff) || codepoint > 0x10ffff) {
+            return 0;
+        }
+
+        pos += 1 + extra;
+    }
+
+    return 1;
+}
+
 i64 str8_find_substring(String8 string, u8 *substring) {
     if (!*substring) {
         return -1;
@@ -76,9 +283,10 @@ i64 str8_find_substring(String8 string, u8 *substring) {
 
     for (i64 pos = 0; pos < string.len; pos++) {
         const u8 *h = string.data + pos;
+        const u8 *end = string.data + string.len;
         const u8 *n = substring;
 
-        while (*h && *n && *h == *n) {
+        while (h < end && *n && *h == *n) {
             h++;
             n++;
         }
@@ -90,3 +298,445 @@ i64 str8_find_substring(String8 string, u8 *substring) {
 
     return -1;
 }
+
+//////////////////////////////
+// Formatting
+
+global u64 str8_powers_of_ten[20] = {
+    0,
+    10ull,
+    100ull,
+    1000ull,
+    10000ull,
+    100000ull,
+    1000000ull,
+    10000000ull,
+    100000000ull,
+    1000000000ull,
+    10000000000ull,
+    100000000000ull,
+    1000000000000ull,
+    10000000000000ull,
+    100000000000000ull,
+    1000000000000000ull,
+    10000000000000000ull,
+    100000000000000000ull,
+    1000000000000000000ull,
+    10000000000000000000ull,
+};
+
+global u8 str8_digit_pairs[] = "00010203040506070809"
+                               "10111213141516171819"
+                               "20212223242526272829"
+                               "30313233343536373839"
+                               "40414243444546474849"
+                               "50515253545556575859"
+                               "60616263646566676869"
+                               "70717273747576777879"
+                               "80818283848586878889"
+                               "90919293949596979899";
+
+global u8 str8_hex_digits[] = "0123456789abcdef";
+
+// NOTE: bits * 1233 / 4096 approximates bits * log10(2), which is either the digit count
+// minus one or one less than that; a single table compare settles it. powers[0] is 0 so that
+// zero still has one digit
+u32 str8_u64_length(u64 value) {
+    u32 bits = 64 - __builtin_clzll(value | 1);
+    u32 estimate = (bits * 1233) >> 12;
+
+    return estimate - (value < str8_powers_of_ten[estimate]) + 1;
+}
+
+u32 str8_u64_hex_length(u64 value) {
+    return (64 - __builtin_clzll(value | 1) + 3) >> 2;
+}
+
+u64 str8_write_u64(u8 *out, u64 value) {
+    u32 length = str8_u64_length(value);
+    u8 *cursor = out + length;
+
+    while (value >= 100) {
+        u64 pair = (value % 100) * 2;
+        value /= 100;
+        cursor -= 2;
+        cursor[0] = str8_digit_pairs[pair];
+        cursor[1] = str8_digit_pairs[pair + 1];
+    }
+
+    if (value >= 10) {
+        cursor -= 2;
+        cursor[0] = str8_digit_pairs[value * 2];
+        cursor[1] = str8_digit_pairs[value * 2 + 1];
+    } else {
+        cursor[-1] = '0' + value;
+    }
+
+    return length;
+}
+
+u64 str8_write_u64_hex(u8 *out, u64 value) {
+    u32 length = str8_u64_hex_length(value);
+
+    for (u32 index = length; index > 0; --index) {
+        out[index - 1] = str8_hex_digits[value & 0xf];
+        value >>= 4;
+    }
+
+    return length;
+}
+
+global u8 str8_day_names[] = "SunMonTueWedThuFriSat";
+global u8 str8_month_names[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+local void str8_write_2_digits(u8 *out, u32 value) {
+    out[0] = str8_digit_pairs[value * 2];
+    out[1] = str8_digit_pairs[value * 2 + 1];
+}
+
+// NOTE: IMF-fixdate (RFC 9110 5.6.7), e.g. "Sun, 06 Nov 1994 08:49:37 GMT"; the civil date
+// comes from days since the epoch with 400-year eras starting on March 1st, so leap days fall
+// at the end of a year
+u64 str8_write_http_date(u8 *out, u64 unix_seconds) {
+    u64 days = unix_seconds / 86400;
+    u32 seconds_of_day = unix_seconds % 86400;
+    u32 weekday = (days + 4) % 7;
+
+    u64 shifted = days + 719468;
+    u64 era = shifted / 146097;
+    u32 day_of_era = shifted - era * 146097;
+    u32 year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    u32 day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    u32 month_index = (5 * day_of_year + 2) / 153;
+    u32 day = day_of_year - (153 * month_index + 2) / 5 + 1;
+    u32 month = month_index < 10 ? month_index + 3 : month_index - 9;
+    u64 year = year_of_era + era * 400 + (month <= 2);
+
+    memcpy(out, str8_day_names + weekday * 3, 3);
+    memcpy(out + 3, ", ", 2);
+    str8_write_2_digits(out + 5, day);
+    out[7] = ' ';
+    memcpy(out + 8, str8_month_names + (month - 1) * 3, 3);
+    out[11] = ' ';
+    str8_write_2_digits(out + 12, (year / 100) % 100);
+    str8_write_2_digits(out + 14, year % 100);
+    out[16] = ' ';
+    str8_write_2_digits(out + 17, seconds_of_day / 3600);
+    out[19] = ':';
+    str8_write_2_digits(out + 20, seconds_of_day / 60 % 60);
+    out[22] = ':';
+    str8_write_2_digits(out + 23, seconds_of_day % 60);
+    memcpy(out + 25, " GMT", 4);
+
+    return STR8_HTTP_DATE_SIZE;
+}
+
+local b32 str8_parse_digits(u8 *data, u32 count, u32 *value_out) {
+    u32 value = 0;
+
+    for (u32 index = 0; index < count; ++index) {
+        u32 digit = (u32)(data[index] - '0');
+
+        if (digit > 9) {
+            return 0;
+        }
+
+        value = value * 10 + digit;
+    }
+
+    *value_out = value;
+
+    return 1;
+}
+
+// NOTE: the inverse of str8_write_http_date. Only IMF-fixdate is accepted; the obsolete RFC 850
+// and asctime forms, like dates before 1970, fail and leave the header to be ignored
+b32 str8_parse_http_date(String8 date, u64 *unix_seconds_out) {
+    u32 day, year, hours, minutes, seconds;
+    u32 month = 0;
+
+    if (date.len != STR8_HTTP_DATE_SIZE || date.data[3] != ',' || date.data[4] != ' ' || date.data[7] != ' ' ||
+        date.data[11] != ' ' || date.data[16] != ' ' || date.data[19] != ':' || date.data[22] != ':' ||
+        memcmp(date.data + 25, " GMT", 4) != 0) {
+        return 0;
+    }
+
+    while (month < 12 && memcmp(date.data + 8, str8_month_names + month * 3, 3) != 0) {
+        month += 1;
+    }
+
+    if (month == 12 || !str8_parse_digits(date.data + 5, 2, &day) || !str8_parse_digits(date.data + 12, 4, &year) ||
+        !str8_parse_digits(date.data + 17, 2, &hours) || !str8_parse_digits(date.data + 20, 2, &minutes) ||
+        !str8_parse_digits(date.data + 23, 2, &seconds)) {
+        return 0;
+    }
+
+    month += 1;
+
+    if (year < 1970 || day < 1 || day > 31 || hours > 23 || minutes > 59 || seconds > 60) {
+        return 0;
+    }
+
+    u64 shifted_year = year - (month <= 2);
+    u64 era = shifted_year / 400;
+    u32 year_of_era = shifted_year - era * 400;
+    u32 day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    u32 day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    u64 days = era * 146097 + day_of_era - 719468;
+
+    *unix_seconds_out = days * 86400 + hours * 3600 + minutes * 60 + seconds;
+
+    return 1;
+}
+
+String8 str8_push_copy(Arena *arena, String8 string) {
+    String8 result = {0};
+    result.data = arena_push(arena, string.len, 1);
+
+    if (result.data) {
+        memcpy(result.data, string.data, string.len);
+        result.len = string.len;
+    }
+
+    return result;
+}
+
+String8 str8_push_u64(Arena *arena, u64 value) {
+    String8 result = {0};
+    result.data = arena_push(arena, str8_u64_length(value), 1);
+
+    if (result.data) {
+        result.len = str8_write_u64(result.data, value);
+    }
+
+    return result;
+}
+
+String8 str8_push_u64_hex(Arena *arena, u64 value) {
+    String8 result = {0};
+    result.data = arena_push(arena, str8_u64_hex_length(value), 1);
+
+    if (result.data) {
+        result.len = str8_write_u64_hex(result.data, value);
+    }
+
+    return result;
+}
+
+String8 str8_push_http_date(Arena *arena, u64 unix_seconds) {
+    String8 result = {0};
+    result.data = arena_push(arena, STR8_HTTP_DATE_SIZE, 1);
+
+    if (result.data) {
+        result.len = str8_write_http_date(result.data, unix_seconds);
+    }
+
+    return result;
+}
+
+local void str8_format_emit(u8 *out, u64 *length, u8 *data, u64 size) {
+    if (out) {
+        memcpy(out + *length, data, size);
+    }
+
+    *length += size;
+}
+
+local void str8_format_pad(u8 *out, u64 *length, u8 pad, u32 count) {
+    if (out) {
+        memset(out + *length, pad, count);
+    }
+
+    *length += count;
+}
+
+// NOTE: measures when out is 0. Understands %d %i %u %x with optional l/ll/z and a zero or
+// space padded width, %c, %s, %.*s, %S for a String8 and %%; anything else is copied as is
+local u64 str8_format(u8 *out, char *format, va_list args) {
+    u64 length = 0;
+
+    for (char *cursor = format; *cursor;) {
+        if (*cursor != '%') {
+            char *run = cursor;
+
+            while (*cursor && *cursor != '%') {
+                cursor += 1;
+            }
+
+            str8_format_emit(out, &length, (u8 *)run, cursor - run);
+            continue;
+        }
+
+        char *spec = cursor++;
+        u8 pad = ' ';
+        u32 width = 0;
+        b32 has_precision = 0;
+        i32 precision = 0;
+        u32 long_count = 0;
+
+        if (*cursor == '0') {
+            pad = '0';
+            cursor += 1;
+        }
+
+        while (*cursor >= '0' && *cursor <= '9') {
+            width = width * 10 + (*cursor++ - '0');
+        }
+
+        if (cursor[0] == '.' && cursor[1] == '*') {
+            has_precision = 1;
+            precision = va_arg(args, i32);
+            cursor += 2;
+        }
+
+        while (*cursor == 'l' || *cursor == 'z') {
+            long_count += *cursor == 'z' ? 2 : 1;
+            cursor += 1;
+        }
+
+        switch (*cursor) {
+        case 'd':
+        case 'i':
+        case 'u':
+        case 'x': {
+            b32 is_signed = *cursor == 'd' || *cursor == 'i';
+            b32 is_negative = 0;
+            u64 value = 0;
+
+            if (is_signed) {
+                i64 signed_value = long_count ? va_arg(args, i64) : va_arg(args, i32);
+                is_negative = signed_value < 0;
+                value = is_negative ? 0 - (u64)signed_value : (u64)signed_value;
+            } else {
+                value = long_count ? va_arg(args, u64) : va_arg(args, u32);
+            }
+
+            u32 digits = *cursor == 'x' ? str8_u64_hex_length(value) : str8_u64_length(value);
+            u32 size = digits + is_negative;
+            u32 padding = width > size ? width - size : 0;
+
+            if (pad == ' ') {
+                str8_format_pad(out, &length, ' ', padding);
+            }
+
+            if (is_negative) {
+                str8_format_emit(out, &length, "-", 1);
+            }
+
+            if (pad == '0') {
+                str8_format_pad(out, &length, '0', padding);
+            }
+
+            if (out) {
+                *cursor == 'x' ? str8_write_u64_hex(out + length, value) : str8_write_u64(out + length, value);
+            }
+
+            length += digits;
+        } break;
+        case 'c': {
+            u8 c = (u8)va_arg(args, i32);
+            str8_format_emit(out, &length, &c, 1);
+        } break;
+        case 's': {
+            u8 *string = va_arg(args, u8 *);
+            u64 size = has_precision ? (u64)Max(precision, 0) : strlen(string);
+            str8_format_emit(out, &length, string, size);
+        } break;
+        case 'S': {
+            String8 string = va_arg(args, String8);
+            str8_format_emit(out, &length, string.data, string.len);
+        } break;
+        case '%': {
+            str8_format_emit(out, &length, "%", 1);
+        } break;
+        default: {
+            if (!*cursor) {
+                str8_format_emit(out, &length, (u8 *)spec, cursor - spec);
+                continue;
+            }
+
+            str8_format_emit(out, &length, (u8 *)spec, cursor + 1 - spec);
+        } break;
+        }
+
+        cursor += 1;
+    }
+
+    return length;
+}
+
+String8 str8_pushfv(Arena *arena, char *format, va_list args) {
+    String8 result = {0};
+    va_list measure_args;
+
+    va_copy(measure_args, args);
+    u64 length = str8_format(0, format, measure_args);
+    va_end(measure_args);
+
+    result.data = arena_push(arena, length, 1);
+
+    if (result.data) {
+        result.len = str8_format(result.data, format, args);
+    }
+
+    return result;
+}
+
+String8 str8_pushf(Arena *arena, char *format, ...) {
+    va_list args;
+
+    va_start(args, format);
+    String8 result = str8_pushfv(arena, format, args);
+    va_end(args);
+
+    return result;
+}
+
+//////////////////////////////
+// String lists
+
+b32 str8_list_push(Arena *arena, String8List *list, String8 string) {
+    String8Node *node = push_struct(arena, String8Node);
+
+    if (!node) {
+        return 0;
+    }
+
+    node->next = 0;
+    node->string = string;
+
+    if (list->last) {
+        list->last->next = node;
+    } else {
+        list->first = node;
+    }
+
+    list->last = node;
+    list->node_count += 1;
+    list->total_len += string.len;
+
+    return 1;
+}
+
+String8 str8_list_join(Arena *arena, String8List *list, String8 separator) {
+    String8 result = {0};
+    u64 separator_total = list->node_count > 1 ? separator.len * (list->node_count - 1) : 0;
+
+    result.data = arena_push(arena, list->total_len + separator_total, 1);
+
+    if (!result.data) {
+        return result;
+    }
+
+    for (String8Node *node = list->first; node != 0; node = node->next) {
+        memcpy(result.data + result.len, node->string.data, node->string.len);
+        result.len += node->string.len;
+
+        if (node->next) {
+            memcpy(result.data + result.len, separator.data, separator.len);
+            result.len += separator.len;
+        }
+    }
+
+    return result;
+}
@@ -2,6 +2,7 @@
 #define BASE_STRING_H
 
 #include "base_core.h"
+#include "base_memory.h"
 
 //////////////////////////////
 // String type
@@ -19,11 +20,20 @@ typedef struct {
         sizeof(string) - 1, (u8 *)(string) \
     }
 
+#define str8_comp(string)                  \
+    {                                      \
+        sizeof(string) - 1, (u8 *)(string) \
+    }
+
 #define str8_expand(s) (int)(s.len), (s.data)
 
+#define STR8_U64_MAX_SIZE 20
+#define STR8_HTTP_DATE_SIZE 29
+
 b32 str8_is_valid(String8 string);
 b32 str8_is_in_bounds(String8 source, u64 pos);
 b32 str8_are_equal(String8 a, String8 b);
+b32 str8_are_equal_case_insensitive(String8 a, String8 b);
 String8 str8_allocate(u64 len);
 
 String8 str8_prefix(String8 string, u64 size);
@@ -31,7 +41,51 @@ String8 str8_postfix(String8 string, u64 size);
 String8 str8_skip(String8 string, u64 amount);
 String8 str8_split_to(String8 string, u8 *delimiter);
 String8 str8_read_to(String8 *string, u8 *delimiter);
+String8 str8_trim_whitespace(String8 string);
+String8 str8_from_cstring(u8 *cstring);
+
+b32 str8_to_u64(String8 string, u64 *value_out);
+b32 str8_base64_decode(String8 string, u8 *out, u64 *len_out);
+u64 str8_base64_encode(String8 string, u8 *out);
+b32 str8_is_utf8(String8 string);
 
 i64 str8_find_substring(String8 string, u8 *substring);
 
+//////////////////////////////
+// Formatting
+
+u32 str8_u64_length(u64 value);
+u32 str8_u64_hex_length(u64 value);
+u64 str8_write_u64(u8 *out, u64 value);
+u64 str8_write_u64_hex(u8 *out, u64 value);
+u64 str8_write_http_date(u8 *out, u64 unix_seconds);
+b32 str8_parse_http_date(String8 date, u64 *unix_seconds_out);
+
+String8 str8_push_copy(Arena *arena, String8 string);
+String8 str8_push_u64(Arena *arena, u64 value);
+String8 str8_push_u64_hex(Arena *arena, u64 value);
+String8 str8_push_http_date(Arena *arena, u64 unix_seconds);
+String8 str8_pushfv(Arena *arena, char *format, va_list args);
+String8 str8_pushf(Arena *arena, char *format, ...);
+
+//////////////////////////////
+// String lists
+
+typedef struct String8Node String8Node;
+struct String8Node {
+    String8Node *next;
+    String8 string;
+};
+
+typedef struct String8List String8List;
+struct String8List {
+    String8Node *first;
+    String8Node *last;
+    u64 node_count;
+    u64 total_len;
+};
+
+b32 str8_list_push(Arena *arena, String8List *list, String8 string);
+String8 str8_list_join(Arena *arena, String8List *list, String8 separator);
+
 #endif // BASE_STRING_H
@@ -1,6 +1,7 @@
 #include "base_thread.h"
 #include "base_core.h"
 #include "base_memory.h"
+#include <pthread.h>
 
 #define ARENA_RESERVE_SIZE (64 * megabyte)
 #define ARENA_COMMIT_SIZE (64 * kilobyte)
@@ -9,8 +10,8 @@
 ThreadContext *thread_context_alloc(u32 thread_id) {
     Arena *arena = arena_alloc(ARENA_RESERVE_SIZE, ARENA_COMMIT_SIZE, 0, 1);
 
-    ThreadContext *result = arena_push_zero(arena, sizeof(ThreadContext), sizeof(ThreadContext));
-    result->thread_id = 0;
+    ThreadContext *result = push_struct_zero(arena, ThreadContext);
+    result->thread_id = thread_id;
     result->permanent_arena = arena;
 
     return result;
@@ -41,3 +42,15 @@ void thread_scratch_release(ThreadContext *context, Scratch *scratch) {
     scratch->next_free = context->last_free_scratch_arena;
     context->last_free_scratch_arena = scratch;
 }
+
+b32 thread_launch(ThreadEntryPoint *entry_point, void *params) {
+    b32 ok = 0;
+    pthread_t thread;
+
+    if (pthread_create(&thread, 0, entry_point, params) == 0) {
+        pthread_detach(thread);
+        ok = 1;
+    }
+
+    return ok;
+}
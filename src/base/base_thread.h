@@ -4,19 +4,26 @@
 #include "base_memory.h"
 #include "base_os_linux.h"
 
+#define THREAD_MAX_LISTENERS 8
+
 typedef struct ThreadContext ThreadContext;
 struct ThreadContext {
     u32 thread_id;
     Arena *permanent_arena;
     Scratch *last_free_scratch_arena;
     IO_Uring ring;
-    OS_Handle server_handle;
+    OS_Handle listener_handles[THREAD_MAX_LISTENERS];
+    u32 listener_count;
 };
 
+typedef void *ThreadEntryPoint(void *params);
+
 ThreadContext *thread_context_alloc(u32 thread_id);
 void thread_context_release(ThreadContext *context);
 
 Scratch *thread_scratch_alloc(ThreadContext *context);
 void thread_scratch_release(ThreadContext *context, Scratch *scratch);
 
+b32 thread_launch(ThreadEntryPoint *entry_point, void *params);
+
 #endif // BASE_THREAD_H
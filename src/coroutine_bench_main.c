@@ -0,0 +1,141 @@
+#include "base/base_inc.h"
+#include <stdio.h>
+#include <ucontext.h>
+
+// NOTE: measures what a task handler pays for running on a coroutine: a suspend and resume
+// round trip, taking a coroutine from the pool, and the resident memory of suspended ones,
+// with glibc's swapcontext as the reference point for the switch
+
+#define BENCH_SWITCHES (1 << 24)
+#define BENCH_STARTS (1 << 20)
+#define BENCH_SUSPENDED 10000
+#define BENCH_FRAME_SIZE 2048
+
+global u64 bench_counter;
+
+local void bench_yield_loop(void *user) {
+    for (;;) {
+        bench_counter += 1;
+        coroutine_yield();
+    }
+}
+
+local void bench_return(void *user) {
+    bench_counter += 1;
+}
+
+// NOTE: a frame about the size of a handler that parsed something on its stack
+local void bench_suspend_with_frame(void *user) {
+    volatile u8 frame[BENCH_FRAME_SIZE];
+
+    for (u32 index = 0; index < BENCH_FRAME_SIZE; index += 64) {
+        frame[index] = (u8)index;
+    }
+
+    coroutine_yield();
+    bench_counter += frame[64];
+}
+
+global ucontext_t bench_main_context;
+global ucontext_t bench_ucontext;
+
+local void bench_ucontext_loop(void) {
+    for (;;) {
+        bench_counter += 1;
+        swapcontext(&bench_ucontext, &bench_main_context);
+    }
+}
+
+local u64 bench_resident_bytes(void) {
+    u64 pages = 0;
+    u64 resident = 0;
+    FILE *file = fopen("/proc/self/statm", "r");
+
+    if (file) {
+        if (fscanf(file, "%llu %llu", (unsigned long long *)&pages, (unsigned long long *)&resident) != 2) {
+            resident = 0;
+        }
+
+        fclose(file);
+    }
+
+    return resident * PAGE_SIZE;
+}
+
+i32 main(i32 argc, char **argv) {
+    Coroutine *coroutine = coroutine_alloc(bench_yield_loop, 0);
+
+    if (!coroutine) {
+        printf("failed to allocate a coroutine\n");
+        return 1;
+    }
+
+    u64 begin = os_now_nanoseconds();
+
+    for (u32 index = 0; index < BENCH_SWITCHES; ++index) {
+        coroutine_resume(coroutine);
+    }
+
+    f64 coroutine_ns = (f64)(os_now_nanoseconds() - begin) / BENCH_SWITCHES;
+    coroutine_release(coroutine);
+
+    u8 *ucontext_stack = mem_allocate(COROUTINE_DEFAULT_STACK_SIZE);
+    getcontext(&bench_ucontext);
+    bench_ucontext.uc_stack.ss_sp = ucontext_stack;
+    bench_ucontext.uc_stack.ss_size = COROUTINE_DEFAULT_STACK_SIZE;
+    bench_ucontext.uc_link = 0;
+    makecontext(&bench_ucontext, bench_ucontext_loop, 0);
+
+    begin = os_now_nanoseconds();
+
+    for (u32 index = 0; index < BENCH_SWITCHES / 16; ++index) {
+        swapcontext(&bench_main_context, &bench_ucontext);
+    }
+
+    f64 ucontext_ns = (f64)(os_now_nanoseconds() - begin) / (BENCH_SWITCHES / 16);
+
+    printf("%-36s %10.1f ns\n", "resume + yield", coroutine_ns);
+    printf("%-36s %10.1f ns\n", "swapcontext there and back", ucontext_ns);
+
+    begin = os_now_nanoseconds();
+
+    for (u32 index = 0; index < BENCH_STARTS; ++index) {
+        Coroutine *task = coroutine_alloc(bench_return, 0);
+        coroutine_resume(task);
+        coroutine_release(task);
+    }
+
+    printf("%-36s %10.1f ns\n", "pooled alloc + run + release", (f64)(os_now_nanoseconds() - begin) / BENCH_STARTS);
+
+    Coroutine **suspended = mem_allocate(sizeof(Coroutine *) * BENCH_SUSPENDED);
+    u64 resident_before = bench_resident_bytes();
+    begin = os_now_nanoseconds();
+
+    for (u32 index = 0; index < BENCH_SUSPENDED; ++index) {
+        suspended[index] = coroutine_alloc(bench_suspend_with_frame, 0);
+
+        if (!suspended[index]) {
+            printf("failed to allocate coroutine %u\n", index);
+            return 1;
+        }
+
+        coroutine_resume(suspended[index]);
+    }
+
+    f64 fresh_ns = (f64)(os_now_nanoseconds() - begin) / BENCH_SUSPENDED;
+    u64 resident_after = bench_resident_bytes();
+
+    printf("%-36s %10.1f ns\n", "fresh alloc + run to first yield", fresh_ns);
+    printf("%-36s %10.1f KB\n", "resident per suspended coroutine",
+           (f64)(resident_after - resident_before) / BENCH_SUSPENDED / 1024.0);
+    printf("%-36s %10.1f KB\n", "reserved per coroutine", (f64)(2 * PAGE_SIZE + COROUTINE_DEFAULT_STACK_SIZE) / 1024.0);
+
+    for (u32 index = 0; index < BENCH_SUSPENDED; ++index) {
+        coroutine_resume(suspended[index]);
+        coroutine_release(suspended[index]);
+    }
+
+    printf("(%llu)\n", (unsigned long long)(bench_counter & 0xff));
+
+    return 0;
+}
@@ -0,0 +1,162 @@
+#include "base/base_inc.h"
+#include <stdio.h>
+
+// NOTE: compares hash_map lookups against the linear String8 scan they replace, for table
+// sizes from a handful of known headers up to a route or cache table
+
+#define BENCH_LOOKUPS (1 << 22)
+#define BENCH_MAX_KEYS 4096
+
+global u32 bench_sizes[] = {4, 8, 16, 32, 64, 256, 1024, 4096};
+
+local u64 bench_random(u64 *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+
+    return *state;
+}
+
+local String8 bench_key(Arena *arena, u32 index) {
+    String8 result = {0};
+    result.data = arena_push(arena, 48, 1);
+    result.len = snprintf((char *)result.data, 48, "/api/v1/resources/%u/items", index * 2654435761u);
+
+    return result;
+}
+
+local b32 bench_verify(Arena *arena, String8 *keys, u32 count) {
+    HashMap map;
+
+    if (!hash_map_init(&map, arena, 0)) {
+        return 0;
+    }
+
+    for (u32 index = 0; index < count; ++index) {
+        if (!hash_map_insert(&map, keys[index], (void *)(u64)(index + 1))) {
+            return 0;
+        }
+    }
+
+    for (u32 index = 0; index < count; index += 2) {
+        if (!hash_map_remove(&map, keys[index])) {
+            return 0;
+        }
+    }
+
+    for (u32 index = 0; index < count; ++index) {
+        void *expected = (index % 2) ? (void *)(u64)(index + 1) : 0;
+
+        if (hash_map_get(&map, keys[index]) != expected) {
+            return 0;
+        }
+    }
+
+    for (u32 index = 0; index < count; index += 2) {
+        hash_map_insert(&map, keys[index], (void *)(u64)(index + 1));
+    }
+
+    for (u32 index = 0; index < count; ++index) {
+        if (hash_map_get(&map, keys[index]) != (void *)(u64)(index + 1)) {
+            return 0;
+        }
+    }
+
+    return map.count == count;
+}
+
+i32 main(i32 argc, char **argv) {
+    Arena *arena = arena_alloc(256 * megabyte, 64 * kilobyte, 0, 1);
+    String8 *keys = push_array(arena, String8, BENCH_MAX_KEYS);
+    String8 *probes = push_array(arena, String8, BENCH_MAX_KEYS * 2);
+    void **values = push_array(arena, void *, BENCH_MAX_KEYS);
+    u32 *order = push_array(arena, u32, BENCH_LOOKUPS);
+    u64 random_state = 0x9e3779b97f4a7c15ull;
+
+    for (u32 index = 0; index < BENCH_MAX_KEYS; ++index) {
+        keys[index] = bench_key(arena, index);
+        values[index] = (void *)(u64)(index + 1);
+    }
+
+    // NOTE: probes are copies, so matches have to compare bytes rather than pointers; the second
+    // half are keys that are never inserted
+    for (u32 index = 0; index < BENCH_MAX_KEYS * 2; ++index) {
+        String8 key = index < BENCH_MAX_KEYS ? keys[index] : bench_key(arena, index);
+        probes[index].data = arena_push(arena, key.len, 1);
+        probes[index].len = key.len;
+        memcpy(probes[index].data, key.data, key.len);
+    }
+
+    if (!bench_verify(arena, keys, BENCH_MAX_KEYS)) {
+        printf("hash map verification failed\n");
+        return 1;
+    }
+
+    printf("%8s %14s %14s %14s %14s\n", "keys", "scan hit ns", "map hit ns", "scan miss ns", "map miss ns");
+
+    for (u32 size_index = 0; size_index < array_count(bench_sizes); ++size_index) {
+        u32 count = bench_sizes[size_index];
+        HashMap map;
+        u64 checksum = 0;
+        f64 results[4];
+
+        hash_map_build(&map, arena, keys, values, count);
+
+        for (u32 pass = 0; pass < 4; ++pass) {
+            b32 is_miss = pass >= 2;
+            b32 use_map = pass % 2;
+            u32 lookups = use_map || count <= 256 ? BENCH_LOOKUPS : BENCH_LOOKUPS / 16;
+
+            for (u32 index = 0; index < lookups; ++index) {
+                order[index] = (u32)(bench_random(&random_state) % count) + (is_miss ? BENCH_MAX_KEYS : 0);
+            }
+
+            u64 begin = os_now_nanoseconds();
+
+            for (u32 index = 0; index < lookups; ++index) {
+                String8 probe = probes[order[index]];
+
+                if (use_map) {
+                    checksum += (u64)hash_map_get(&map, probe);
+                } else {
+                    for (u32 key_index = 0; key_index < count; ++key_index) {
+                        if (str8_are_equal(keys[key_index], probe)) {
+                            checksum += (u64)values[key_index];
+                            break;
+                        }
+                    }
+                }
+            }
+
+            results[pass] = (f64)(os_now_nanoseconds() - begin) / lookups;
+        }
+
+        printf("%8u %14.1f %14.1f %14.1f %14.1f  (%llu)\n", count, results[0], results[1], results[2], results[3],
+               (unsigned long long)(checksum & 0xff));
+    }
+
+    u32 hash_lengths[] = {8, 16, 32, 64, 256, 4096};
+    u8 *hash_input = arena_push_zero(arena, 4096, 64);
+    u64 hash_sum = 0;
+
+    printf("\n%8s %14s %14s\n", "bytes", "hash ns", "GB/s");
+
+    for (u32 length_index = 0; length_index < array_count(hash_lengths); ++length_index) {
+        String8 input = {hash_lengths[length_index], hash_input};
+        u32 iterations = BENCH_LOOKUPS / (1 + input.len / 64);
+        u64 begin = os_now_nanoseconds();
+
+        for (u32 index = 0; index < iterations; ++index) {
+            hash_input[0] = (u8)index;
+            hash_sum += hash_string(input);
+        }
+
+        f64 elapsed = (f64)(os_now_nanoseconds() - begin);
+        printf("%8llu %14.2f %14.2f\n", (unsigned long long)input.len, elapsed / iterations,
+               (f64)input.len * iterations / elapsed);
+    }
+
+    printf("(%llu)\n", (unsigned long long)(hash_sum & 0xff));
+
+    return 0;
+}
@@ -0,0 +1,491 @@
+#include "http.h"
+
+global String8 http_method_strings[] = {
+    str8_comp("GET"),
+    str8_comp("POST"),
+    str8_comp("PUT"),
+    str8_comp("DELETE"),
+    str8_comp("HEAD"),
+    str8_comp("OPTIONS"),
+    str8_comp("PATCH"),
+};
+
+global String8 http_header_names[HttpHeaderId_Count] = {
+    [HttpHeaderId_Host] = str8_comp("Host"),
+    [HttpHeaderId_ContentLength] = str8_comp("Content-Length"),
+    [HttpHeaderId_ContentType] = str8_comp("Content-Type"),
+    [HttpHeaderId_Connection] = str8_comp("Connection"),
+    [HttpHeaderId_TransferEncoding] = str8_comp("Transfer-Encoding"),
+    [HttpHeaderId_Accept] = str8_comp("Accept"),
+    [HttpHeaderId_AcceptEncoding] = str8_comp("Accept-Encoding"),
+    [HttpHeaderId_Upgrade] = str8_comp("Upgrade"),
+    [HttpHeaderId_Expect] = str8_comp("Expect"),
+    [HttpHeaderId_Cookie] = str8_comp("Cookie"),
+    [HttpHeaderId_Authorization] = str8_comp("Authorization"),
+    [HttpHeaderId_UserAgent] = str8_comp("User-Agent"),
+    [HttpHeaderId_IfNoneMatch] = str8_comp("If-None-Match"),
+    [HttpHeaderId_IfModifiedSince] = str8_comp("If-Modified-Since"),
+    [HttpHeaderId_IfRange] = str8_comp("If-Range"),
+    [HttpHeaderId_Range] = str8_comp("Range"),
+    [HttpHeaderId_XForwardedFor] = str8_comp("X-Forwarded-For"),
+    [HttpHeaderId_Http2Settings] = str8_comp("HTTP2-Settings"),
+    [HttpHeaderId_SecWebSocketKey] = str8_comp("Sec-WebSocket-Key"),
+    [HttpHeaderId_SecWebSocketVersion] = str8_comp("Sec-WebSocket-Version"),
+};
+
+typedef struct HttpStatusReason HttpStatusReason;
+struct HttpStatusReason {
+    u32 status;
+    String8 reason;
+};
+
+global HttpStatusReason http_status_reasons[] = {
+    {100, str8_comp("Continue")},
+    {101, str8_comp("Switching Protocols")},
+    {200, str8_comp("OK")},
+    {201, str8_comp("Created")},
+    {204, str8_comp("No Content")},
+    {206, str8_comp("Partial Content")},
+    {301, str8_comp("Moved Permanently")},
+    {302, str8_comp("Found")},
+    {304, str8_comp("Not Modified")},
+    {400, str8_comp("Bad Request")},
+    {403, str8_comp("Forbidden")},
+    {404, str8_comp("Not Found")},
+    {405, str8_comp("Method Not Allowed")},
+    {411, str8_comp("Length Required")},
+    {412, str8_comp("Precondition Failed")},
+    {413, str8_comp("Content Too Large")},
+    {416, str8_comp("Range Not Satisfiable")},
+    {429, str8_comp("Too Many Requests")},
+    {431, str8_comp("Request Header Fields Too Large")},
+    {500, str8_comp("Internal Server Error")},
+    {501, str8_comp("Not Implemented")},
+    {502, str8_comp("Bad Gateway")},
+    {503, str8_comp("Service Unavailable")},
+    {504, str8_comp("Gateway Timeout")},
+};
+
+i64 http_find_head_end(String8 buffer) {
+    i64 pos = str8_find_substring(buffer, "\r\n\r\n");
+
+    if (pos == -1) {
+        return -1;
+    }
+
+    return pos + 4;
+}
+
+HttpRequest http_parse_request(Arena *arena, String8 request_buffer) {
+    HttpRequest request = {0};
+    i64 head_end = http_find_head_end(request_buffer);
+
+    if (head_end == -1) {
+        return request;
+    }
+
+    String8 head = str8_prefix(request_buffer, head_end - 2);
+    String8 method_line = str8_read_to(&head, "\r\n");
+
+    request.is_valid = 1;
+    request.body = str8_skip(request_buffer, head_end);
+
+    http_parse_method(&request, method_line);
+
+    if (!http_parse_headers(arena, head, &request.headers)) {
+        request.is_valid = 0;
+    }
+
+    return request;
+}
+
+void http_parse_method(HttpRequest *request, String8 method_line) {
+    String8 method = str8_read_to(&method_line, " ");
+    String8 path = str8_read_to(&method_line, " ");
+    String8 version = method_line;
+
+    if (!str8_is_valid(method) || !str8_is_valid(path) || path.len == 0) {
+        request->is_valid = 0;
+        return;
+    }
+
+    request->method = http_method_from_string(method);
+    request->path = path;
+
+    if (!http_parse_version(version, &request->version)) {
+        request->is_valid = 0;
+    }
+}
+
+local void http_headers_index(HttpHeaders *headers) {
+    memset(headers->known, 0, sizeof(headers->known));
+
+    for (u32 index = 0; index < headers->count; ++index) {
+        HttpHeader *header = &headers->items[index];
+        header->hash = http_header_hash(header->key);
+        header->next = index + 1 < headers->count ? header + 1 : 0;
+
+        HttpHeaderId id = http_header_id_from_hash(header->key, header->hash);
+
+        if (id != HttpHeaderId_Unknown && headers->known[id] == 0) {
+            headers->known[id] = index + 1;
+        }
+    }
+}
+
+b32 http_parse_headers(Arena *arena, String8 header_string, HttpHeaders *headers_out) {
+    HttpHeaders headers = {0};
+    u32 capacity = 0;
+
+    // NOTE: every header line ends in CRLF, so counting line ends sizes the array up front
+    for (u64 index = 0; index + 1 < header_string.len; ++index) {
+        if (header_string.data[index] == '\r' && header_string.data[index + 1] == '\n') {
+            capacity += 1;
+        }
+    }
+
+    if (capacity > 0xffff) {
+        return 0;
+    }
+
+    headers.items = push_array(arena, HttpHeader, capacity);
+
+    if (capacity > 0 && !headers.items) {
+        return 0;
+    }
+
+    while (header_string.len > 0) {
+        String8 line = str8_read_to(&header_string, "\r\n");
+
+        if (!str8_is_valid(line) || headers.count == capacity) {
+            return 0;
+        }
+
+        String8 key = str8_read_to(&line, ":");
+
+        if (!str8_is_valid(key) || key.len == 0) {
+            return 0;
+        }
+
+        HttpHeader *header = &headers.items[headers.count++];
+        header->key = key;
+        header->value = str8_trim_whitespace(line);
+    }
+
+    http_headers_index(&headers);
+    *headers_out = headers;
+
+    return 1;
+}
+
+b32 http_parse_version(String8 version_string, HttpVersion *version_out) {
+    b32 ok = 1;
+
+    if (str8_are_equal(version_string, str8("HTTP/1.1"))) {
+        *version_out = HTTP_VERSION_11;
+    } else if (str8_are_equal(version_string, str8("HTTP/1.0"))) {
+        *version_out = HTTP_VERSION_10;
+    } else {
+        ok = 0;
+    }
+
+    return ok;
+}
+
+HttpResponse http_parse_response(Arena *arena, String8 response_buffer) {
+    HttpResponse response = {0};
+    i64 head_end = http_find_head_end(response_buffer);
+
+    if (head_end == -1) {
+        return response;
+    }
+
+    String8 head = str8_prefix(response_buffer, head_end - 2);
+    String8 status_line = str8_read_to(&head, "\r\n");
+    String8 version = str8_read_to(&status_line, " ");
+    String8 status = str8_prefix(status_line, 3);
+    u64 status_code = 0;
+
+    if (!http_parse_version(version, &response.version)) {
+        return response;
+    }
+
+    if (status.len != 3 || !str8_to_u64(status, &status_code)) {
+        return response;
+    }
+
+    HttpHeaders headers = {0};
+
+    response.status = (u32)status_code;
+    response.body = str8_skip(response_buffer, head_end);
+    response.is_valid = http_parse_headers(arena, head, &headers);
+    response.headers = headers.items;
+
+    return response;
+}
+
+String8 http_header_find(HttpHeader *headers, String8 key) {
+    String8 result = {0};
+
+    for (HttpHeader *header = headers; header != 0; header = header->next) {
+        if (str8_are_equal_case_insensitive(header->key, key)) {
+            result = header->value;
+            break;
+        }
+    }
+
+    return result;
+}
+
+// NOTE: FNV-1a over the ASCII-lowercased name, so hashes agree for any spelling of a header
+u32 http_header_hash(String8 key) {
+    u32 hash = 2166136261u;
+
+    for (u64 index = 0; index < key.len; ++index) {
+        u8 c = key.data[index];
+
+        if (c >= 'A' && c <= 'Z') {
+            c += 'a' - 'A';
+        }
+
+        hash = (hash ^ (c & 0xff)) * 16777619u;
+    }
+
+    return hash;
+}
+
+// NOTE: the cases are http_header_hash of each known name; a hash names one candidate, which a
+// single compare confirms, so another header whose hash collides is still unknown
+HttpHeaderId http_header_id_from_hash(String8 key, u32 hash) {
+    HttpHeaderId result = HttpHeaderId_Unknown;
+
+    switch (hash) {
+        case 0xaffea56f:
+            result = HttpHeaderId_Host;
+            break;
+        case 0x4df9451d:
+            result = HttpHeaderId_ContentLength;
+            break;
+        case 0xfcf70995:
+            result = HttpHeaderId_ContentType;
+            break;
+        case 0x38b99ed9:
+            result = HttpHeaderId_Connection;
+            break;
+        case 0xddb4744c:
+            result = HttpHeaderId_TransferEncoding;
+            break;
+        case 0x08247e29:
+            result = HttpHeaderId_Accept;
+            break;
+        case 0xc9715a99:
+            result = HttpHeaderId_AcceptEncoding;
+            break;
+        case 0xdc97cc77:
+            result = HttpHeaderId_Upgrade;
+            break;
+        case 0x96da6b58:
+            result = HttpHeaderId_Expect;
+            break;
+        case 0x77a740bf:
+            result = HttpHeaderId_Cookie;
+            break;
+        case 0x913657be:
+            result = HttpHeaderId_Authorization;
+            break;
+        case 0x24259bee:
+            result = HttpHeaderId_UserAgent;
+            break;
+        case 0x972b6177:
+            result = HttpHeaderId_IfNoneMatch;
+            break;
+        case 0x83e879a9:
+            result = HttpHeaderId_IfModifiedSince;
+            break;
+        case 0x8b887e3e:
+            result = HttpHeaderId_IfRange;
+            break;
+        case 0xfadc0cd2:
+            result = HttpHeaderId_Range;
+            break;
+        case 0xadb2f988:
+            result = HttpHeaderId_XForwardedFor;
+            break;
+        case 0xba46b895:
+            result = HttpHeaderId_Http2Settings;
+            break;
+        case 0xcab5ec26:
+            result = HttpHeaderId_SecWebSocketKey;
+            break;
+        case 0x050a86e1:
+            result = HttpHeaderId_SecWebSocketVersion;
+            break;
+        default:
+            break;
+    }
+
+    if (result != HttpHeaderId_Unknown && !str8_are_equal_case_insensitive(key, http_header_names[result])) {
+        result = HttpHeaderId_Unknown;
+    }
+
+    return result;
+}
+
+HttpHeaderId http_header_id(String8 key) {
+    return http_header_id_from_hash(key, http_header_hash(key));
+}
+
+String8 http_headers_get(HttpHeaders *headers, HttpHeaderId id) {
+    String8 result = {0};
+
+    if (id < HttpHeaderId_Count && headers->known[id] != 0) {
+        result = headers->items[headers->known[id] - 1].value;
+    }
+
+    return result;
+}
+
+String8 http_headers_find(HttpHeaders *headers, String8 key) {
+    String8 result = {0};
+    u32 hash = http_header_hash(key);
+    HttpHeaderId id = http_header_id_from_hash(key, hash);
+
+    if (id != HttpHeaderId_Unknown) {
+        return http_headers_get(headers, id);
+    }
+
+    for (u32 index = 0; index < headers->count; ++index) {
+        HttpHeader *header = &headers->items[index];
+
+        if (header->hash == hash && str8_are_equal_case_insensitive(header->key, key)) {
+            result = header->value;
+            break;
+        }
+    }
+
+    return result;
+}
+
+b32 http_headers_from_list(Arena *arena, HttpHeader *list, HttpHeaders *headers_out) {
+    HttpHeaders headers = {0};
+    u32 capacity = 0;
+
+    for (HttpHeader *header = list; header != 0; header = header->next) {
+        capacity += 1;
+    }
+
+    if (capacity > 0xffff) {
+        return 0;
+    }
+
+    headers.items = push_array(arena, HttpHeader, capacity);
+
+    if (capacity > 0 && !headers.items) {
+        return 0;
+    }
+
+    for (HttpHeader *header = list; header != 0; header = header->next) {
+        headers.items[headers.count++] = *header;
+    }
+
+    http_headers_index(&headers);
+    *headers_out = headers;
+
+    return 1;
+}
+
+String8 http_method_string(HttpMethod method) {
+    String8 result = str8("");
+
+    if (method < array_count(http_method_strings)) {
+        result = http_method_strings[method];
+    }
+
+    return result;
+}
+
+HttpMethod http_method_from_string(String8 method) {
+    HttpMethod result = HTTP_METHOD_UNKNOWN;
+
+    for (u32 index = 0; index < array_count(http_method_strings); ++index) {
+        if (str8_are_equal(method, http_method_strings[index])) {
+            result = (HttpMethod)index;
+            break;
+        }
+    }
+
+    return result;
+}
+
+String8 http_status_reason(u32 status) {
+    String8 result = str8("Unknown");
+
+    for (u32 index = 0; index < array_count(http_status_reasons); ++index) {
+        if (http_status_reasons[index].status == status) {
+            result = http_status_reasons[index].reason;
+            break;
+        }
+    }
+
+    return result;
+}
+
+local void http_append(String8 *buffer, String8 string) {
+    memcpy(buffer->data + buffer->len, string.data, string.len);
+    buffer->len += string.len;
+}
+
+local void http_append_u64(String8 *buffer, u64 value) {
+    buffer->len += str8_write_u64(buffer->data + buffer->len, value);
+}
+
+String8 http_serialize_response(Arena *arena, HttpResponse *response, b32 include_body) {
+    String8 reason = http_status_reason(response->status);
+    b32 has_content_length = str8_is_valid(http_header_find(response->headers, str8("Content-Length")));
+    u64 body_length = response->file.value ? response->file_length : response->body.len;
+
+    // NOTE: informational, 204 and 304 responses never carry a body, nor a length for one
+    if (response->status < 200 || response->status == 204 || response->status == 304) {
+        has_content_length = 1;
+    }
+
+    u64 capacity = reason.len + 64 + (include_body ? response->body.len : 0);
+
+    for (HttpHeader *header = response->headers; header != 0; header = header->next) {
+        capacity += header->key.len + header->value.len + 4;
+    }
+
+    String8 result = {0};
+    result.data = arena_push(arena, capacity, 8);
+
+    if (!result.data) {
+        return result;
+    }
+
+    http_append(&result, str8("HTTP/1.1 "));
+    http_append_u64(&result, response->status);
+    http_append(&result, str8(" "));
+    http_append(&result, reason);
+    http_append(&result, str8("\r\n"));
+
+    for (HttpHeader *header = response->headers; header != 0; header = header->next) {
+        http_append(&result, header->key);
+        http_append(&result, str8(": "));
+        http_append(&result, header->value);
+        http_append(&result, str8("\r\n"));
+    }
+
+    if (!has_content_length) {
+        http_append(&result, str8("Content-Length: "));
+        http_append_u64(&result, body_length);
+        http_append(&result, str8("\r\n"));
+    }
+
+    http_append(&result, str8("\r\n"));
+
+    if (include_body && response->body.len > 0) {
+        http_append(&result, response->body);
+    }
+
+    return result;
+}
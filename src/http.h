@@ -3,7 +3,7 @@
 
 #include "base/base_inc.h"
 
-enum HttpMethod {
+typedef enum HttpMethod {
     HTTP_METHOD_GET,
     HTTP_METHOD_POST,
     HTTP_METHOD_PUT,
@@ -11,36 +11,118 @@ enum HttpMethod {
     HTTP_METHOD_HEAD,
     HTTP_METHOD_OPTIONS,
     HTTP_METHOD_PATCH,
-};
+    HTTP_METHOD_UNKNOWN,
+} HttpMethod;
 
-enum HttpVersion {
+typedef enum HttpVersion {
     HTTP_VERSION_10,
     HTTP_VERSION_11,
-};
+    HTTP_VERSION_20,
+} HttpVersion;
+
+// NOTE: headers that are looked up by name on most requests; their first occurrence is
+// indexed while parsing so lookups are a single array access
+typedef enum HttpHeaderId {
+    HttpHeaderId_Host,
+    HttpHeaderId_ContentLength,
+    HttpHeaderId_ContentType,
+    HttpHeaderId_Connection,
+    HttpHeaderId_TransferEncoding,
+    HttpHeaderId_Accept,
+    HttpHeaderId_AcceptEncoding,
+    HttpHeaderId_Upgrade,
+    HttpHeaderId_Expect,
+    HttpHeaderId_Cookie,
+    HttpHeaderId_Authorization,
+    HttpHeaderId_UserAgent,
+    HttpHeaderId_IfNoneMatch,
+    HttpHeaderId_IfModifiedSince,
+    HttpHeaderId_IfRange,
+    HttpHeaderId_Range,
+    HttpHeaderId_XForwardedFor,
+    HttpHeaderId_Http2Settings,
+    HttpHeaderId_SecWebSocketKey,
+    HttpHeaderId_SecWebSocketVersion,
+    HttpHeaderId_Count,
+    HttpHeaderId_Unknown = HttpHeaderId_Count,
+} HttpHeaderId;
+
 typedef struct HttpHeader HttpHeader;
 struct HttpHeader {
     String8 key;
     String8 value;
     HttpHeader *next;
+    u32 hash;
+};
+
+// NOTE: parsed headers sit in one array in the request arena, still chained through next so
+// code written against header lists keeps working; known[id] is the index + 1 of the first
+// header with that name, 0 when there is none
+typedef struct HttpHeaders HttpHeaders;
+struct HttpHeaders {
+    HttpHeader *items;
+    u32 count;
+    u16 known[HttpHeaderId_Count];
 };
 
 typedef struct HttpRequest HttpRequest;
 struct HttpRequest {
+    b32 is_valid;
     HttpMethod method;
     String8 path;
     HttpVersion version;
-    HttpHeader *headers;
+    HttpHeaders headers;
     String8 body;
 };
 
+typedef struct WsHandler WsHandler;
+typedef struct CompressVariant CompressVariant;
+
 typedef struct HttpResponse HttpResponse;
 struct HttpResponse {
+    b32 is_valid;
+    HttpVersion version;
+    u32 status;
     HttpHeader *headers;
     String8 body;
+    WsHandler *websocket;
+
+    // NOTE: validators, quoted with a W/ prefix when weak and in unix seconds (0 for none), and
+    // a body still on disk; http_prepare_response turns them into headers, 304s and ranges. A
+    // file still open afterwards is the body: file_length bytes from file_offset, sent after the
+    // head by whoever writes the response, who also closes it
+    String8 etag;
+    u64 last_modified;
+    OS_Handle file;
+    u64 file_size;
+    u64 file_offset;
+    u64 file_length;
+    String8 file_path;
+
+    // NOTE: a cached compressed body that body points into, held until whoever writes the
+    // response releases it
+    CompressVariant *compress_variant;
 };
 
-HttpRequest http_parse_request(String8 request_buffer);
+i64 http_find_head_end(String8 buffer);
+
+HttpRequest http_parse_request(Arena *arena, String8 request_buffer);
 void http_parse_method(HttpRequest *request, String8 method_line);
-void http_parse_headers(HttpRequest *request, String8 header_string);
+b32 http_parse_headers(Arena *arena, String8 header_string, HttpHeaders *headers_out);
+b32 http_parse_version(String8 version_string, HttpVersion *version_out);
+
+HttpResponse http_parse_response(Arena *arena, String8 response_buffer);
+String8 http_serialize_response(Arena *arena, HttpResponse *response, b32 include_body);
+
+String8 http_header_find(HttpHeader *headers, String8 key);
+u32 http_header_hash(String8 key);
+HttpHeaderId http_header_id(String8 key);
+HttpHeaderId http_header_id_from_hash(String8 key, u32 hash);
+String8 http_headers_get(HttpHeaders *headers, HttpHeaderId id);
+String8 http_headers_find(HttpHeaders *headers, String8 key);
+b32 http_headers_from_list(Arena *arena, HttpHeader *list, HttpHeaders *headers_out);
+String8 http_method_string(HttpMethod method);
+HttpMethod http_method_from_string(String8 method);
+String8 http_status_reason(u32 status);
 
 #endif // HTTP_H
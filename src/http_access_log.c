@@ -0,0 +1,318 @@
+#include "http_access_log.h"
+#include <signal.h>
+
+// NOTE: log operations use the slot bits of a connection's user_data with every bit set, a slot
+// the slab never hands out, and the buffer index in the generation bits
+#define ACCESS_LOG_USER_DATA(event_type, buffer_index) \
+    (((u64)(buffer_index) << 32) | ((u64)((1 << REQUEST_USER_DATA_SLOT_BITS) - 1) << 8) | ((u64)(event_type) << 1))
+
+b32 access_log_enabled;
+
+global u8 access_log_prefix[ACCESS_LOG_MAX_PREFIX_SIZE];
+global u64 access_log_prefix_length;
+global u64 access_log_rotate_size;
+global u64 access_log_start_seconds;
+global u32 access_log_running_workers;
+volatile i32 access_log_stop_pending;
+thread_static AccessLog *access_log_state;
+
+// NOTE: the default action comes back, so a second signal ends the process right away
+local void access_log_on_signal(i32 signal_number) {
+    access_log_stop_pending = 1;
+    signal(signal_number, SIG_DFL);
+}
+
+void access_log_init(String8 prefix, u64 rotate_size) {
+    access_log_prefix_length = Min(prefix.len, sizeof(access_log_prefix));
+    memcpy(access_log_prefix, prefix.data, access_log_prefix_length);
+    access_log_rotate_size = rotate_size ? rotate_size : ACCESS_LOG_DEFAULT_ROTATE_SIZE;
+    access_log_start_seconds = os_now_unix_nanoseconds() / 1000000000ull;
+    access_log_enabled = 1;
+
+    if (!os_set_signal_handler(SIGINT, access_log_on_signal) || !os_set_signal_handler(SIGTERM, access_log_on_signal)) {
+        log_warn("failed to install the access log shutdown handlers\n");
+    }
+}
+
+local void access_log_submit_timer(AccessLog *log) {
+    u32 tail;
+    IO_Uring *ring = &log->context->ring;
+    IO_Uring_Submission_Entry *sqe = os_io_uring_get_sqe(ring, &tail);
+
+    os_io_uring_prep_sqe(sqe, IORING_OP_TIMEOUT);
+
+    sqe->fd = -1;
+    sqe->addr = (u64)&log->timer;
+    sqe->len = 1;
+    sqe->user_data = ACCESS_LOG_USER_DATA(EventType_AccessLogTimer, 0);
+
+    server_submit(log->context, sqe, tail);
+}
+
+void access_log_thread_init(ThreadContext *context) {
+    if (!access_log_enabled) {
+        return;
+    }
+
+    AccessLog *log = push_struct_zero(context->permanent_arena, AccessLog);
+
+    if (!log) {
+        log_fatal("failed to allocate the access log\n");
+        os_abort(1);
+    }
+
+    for (u32 index = 0; index < array_count(log->buffers); ++index) {
+        log->buffers[index] = push_array(context->permanent_arena, AccessLogRecord, ACCESS_LOG_BUFFER_RECORDS);
+
+        if (!log->buffers[index]) {
+            log_fatal("failed to allocate access log buffers\n");
+            os_abort(1);
+        }
+    }
+
+    // NOTE: records carry wall clock time, derived from the monotonic clock already read for
+    // the latency
+    log->context = context;
+    log->clock_offset = os_now_unix_nanoseconds() - os_now_nanoseconds();
+    log->timer.tv_sec = ACCESS_LOG_FLUSH_INTERVAL_NS / 1000000000ull;
+    log->timer.tv_nsec = ACCESS_LOG_FLUSH_INTERVAL_NS % 1000000000ull;
+    access_log_state = log;
+    __atomic_add_fetch(&access_log_running_workers, 1, __ATOMIC_RELAXED);
+
+    access_log_submit_timer(log);
+}
+
+local void access_log_flush(AccessLog *log) {
+    if (log->count == log->flushed || !log->file.value) {
+        return;
+    }
+
+    u64 size = (u64)(log->count - log->flushed) * sizeof(AccessLogRecord);
+    AccessLogRecord *records = log->buffers[log->active] + log->flushed;
+
+    // NOTE: the process may exit as soon as every worker has stopped, so nothing is left in flight
+    if (log->is_stopped) {
+        if (os_write_at(log->file, (u8 *)records, size, log->file_offset) != (i64)size) {
+            log->failed_writes += 1;
+        }
+    } else {
+        u32 tail;
+        IO_Uring_Submission_Entry *sqe = os_io_uring_get_sqe(&log->context->ring, &tail);
+
+        os_io_uring_prep_sqe(sqe, IORING_OP_WRITE);
+
+        sqe->fd = log->file.value;
+        sqe->addr = (u64)records;
+        sqe->len = size;
+        sqe->off = log->file_offset;
+        sqe->user_data = ACCESS_LOG_USER_DATA(EventType_AccessLogWrite, log->active);
+
+        server_submit(log->context, sqe, tail);
+
+        log->pending_writes[log->active] += 1;
+    }
+
+    log->flushed = log->count;
+    log->first_unflushed_time = 0;
+    log->file_offset += size;
+
+    // NOTE: files rotate at the first write that crosses the size. The submitted write holds its
+    // own reference to the file, so the descriptor can be closed right away; the next record
+    // opens the next file
+    if (log->file_offset >= access_log_rotate_size) {
+        os_close(log->file);
+        log->file = os_handle_zero();
+    }
+}
+
+local b32 access_log_open_file(AccessLog *log) {
+    Scratch *scratch = thread_scratch_alloc(log->context);
+    String8 prefix = {access_log_prefix_length, access_log_prefix};
+    String8 path = str8_pushf(scratch, "%S.%u.%llu.%u.alog", prefix, log->context->thread_id,
+                              access_log_start_seconds, log->file_sequence);
+
+    log->file = os_create_file(path);
+    thread_scratch_release(log->context, scratch);
+
+    // NOTE: after a failure opening is retried once per timer tick rather than per record
+    if (!log->file.value) {
+        log->is_open_failed = 1;
+        log_error("failed to open access log file %.*s.%u.%llu.%u.alog\n", (int)access_log_prefix_length,
+                  access_log_prefix, log->context->thread_id, access_log_start_seconds, log->file_sequence);
+        return 0;
+    }
+
+    // NOTE: written synchronously, once per file, so a file whose records never made it out
+    // still decodes
+    AccessLogHeader header = {0};
+
+    memcpy(header.magic, ACCESS_LOG_MAGIC, sizeof(header.magic));
+    header.version = ACCESS_LOG_VERSION;
+    header.record_size = sizeof(AccessLogRecord);
+    header.worker = log->context->thread_id;
+    header.sequence = log->file_sequence;
+    header.created = os_now_unix_nanoseconds();
+
+    log->file_sequence += 1;
+    log->file_offset = sizeof(AccessLogHeader);
+
+    if (!os_write_all(log->file, (String8){sizeof(header), (u8 *)&header})) {
+        log->is_open_failed = 1;
+        log_error("failed to write the access log header\n");
+        os_close(log->file);
+        log->file = os_handle_zero();
+        return 0;
+    }
+
+    return 1;
+}
+
+local b32 access_log_reserve(AccessLog *log) {
+    if (log->count == ACCESS_LOG_BUFFER_RECORDS) {
+        access_log_flush(log);
+
+        u32 other = log->active ^ 1;
+
+        if (log->pending_writes[other]) {
+            return 0;
+        }
+
+        log->active = other;
+        log->count = 0;
+        log->flushed = 0;
+    }
+
+    return log->file.value || (!log->is_open_failed && access_log_open_file(log));
+}
+
+void access_log_push(SockAddr *client_address, u64 start_time, u32 flags, HttpMethod method, String8 path, u32 status, u64 bytes) {
+    AccessLog *log = access_log_state;
+
+    if (!log) {
+        return;
+    }
+
+    if (!access_log_reserve(log)) {
+        log->dropped += 1;
+        return;
+    }
+
+    u64 now = os_now_nanoseconds();
+    u64 latency = start_time && now > start_time ? (now - start_time) / 1000 : 0;
+    AccessLogRecord *record = &log->buffers[log->active][log->count++];
+
+    record->timestamp = now + log->clock_offset;
+    record->bytes = bytes;
+    record->latency = (u32)ClampTop(latency, 0xffffffffull);
+    record->client_address = 0;
+    record->client_port = 0;
+    record->status = status;
+    record->method = method;
+    record->path_length = (u16)ClampTop(path.len, 0xffff);
+
+    if (client_address && client_address->family == AF_INET) {
+        SockAddrIPv4 *address = (SockAddrIPv4 *)client_address;
+        record->client_address = address->addr;
+        record->client_port = network_byte_order(address->port);
+    } else if (client_address && client_address->family == AF_INET6) {
+        SockAddrIPv6 *address = (SockAddrIPv6 *)client_address;
+        u8 mapped_prefix[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, (u8)0xff, (u8)0xff};
+
+        if (memcmp(address->addr, mapped_prefix, sizeof(mapped_prefix)) == 0) {
+            memcpy(&record->client_address, address->addr + 12, 4);
+        } else {
+            flags |= AccessLogFlag_IPv6;
+        }
+
+        record->client_port = network_byte_order(address->port);
+    } else if (client_address && client_address->family == AF_UNIX) {
+        flags |= AccessLogFlag_Unix;
+    }
+
+    u64 path_size = Min(path.len, ACCESS_LOG_PATH_SIZE);
+    memcpy(record->path, path.data, path_size);
+    memset(record->path + path_size, 0, ACCESS_LOG_PATH_SIZE - path_size);
+
+    if (path.len > ACCESS_LOG_PATH_SIZE) {
+        flags |= AccessLogFlag_PathTruncated;
+    }
+
+    record->flags = flags;
+
+    if (!log->first_unflushed_time) {
+        log->first_unflushed_time = now;
+    }
+
+    if (log->count == ACCESS_LOG_BUFFER_RECORDS || log->is_stopping) {
+        access_log_flush(log);
+    }
+}
+
+// NOTE: writes out whatever is buffered; 1 while writes of this worker are still in flight, in
+// which case their completions have to be handled before the log is complete
+b32 access_log_drain(void) {
+    AccessLog *log = access_log_state;
+
+    if (!log) {
+        return 0;
+    }
+
+    access_log_flush(log);
+
+    return log->pending_writes[0] + log->pending_writes[1] > 0;
+}
+
+local void access_log_check_stopped(AccessLog *log) {
+    if (log->is_stopped || access_log_drain()) {
+        return;
+    }
+
+    log->is_stopped = 1;
+
+    if (__atomic_sub_fetch(&access_log_running_workers, 1, __ATOMIC_ACQ_REL) == 0) {
+        log_info("access log written out, exiting\n");
+        os_abort(0);
+    }
+}
+
+void access_log_on_completion(ThreadContext *context, u64 user_data, i32 result) {
+    AccessLog *log = access_log_state;
+    enum EventType event_type = (enum EventType)((user_data >> 1) & 0x7f);
+
+    if (!log) {
+        return;
+    }
+
+    if (event_type == EventType_AccessLogTimer) {
+        log->is_open_failed = 0;
+
+        if (access_log_stop_pending) {
+            log->is_stopping = 1;
+            access_log_check_stopped(log);
+            return;
+        }
+
+        if (log->first_unflushed_time && os_now_nanoseconds() - log->first_unflushed_time >= ACCESS_LOG_FLUSH_INTERVAL_NS / 2) {
+            access_log_flush(log);
+        }
+
+        access_log_submit_timer(log);
+        return;
+    }
+
+    u32 buffer_index = (user_data >> 32) & 1;
+    log->pending_writes[buffer_index] -= 1;
+
+    // NOTE: a failed or short write leaves a zeroed gap in the file, which the decoder skips
+    if (result < 0) {
+        log->failed_writes += 1;
+
+        if (log->failed_writes == 1) {
+            log_warn("access log write failed: %d\n", result);
+        }
+    }
+
+    if (log->is_stopping) {
+        access_log_check_stopped(log);
+    }
+}
@@ -0,0 +1,109 @@
+#ifndef HTTP_ACCESS_LOG_H
+#define HTTP_ACCESS_LOG_H
+
+#include "http_server.h"
+
+#define ACCESS_LOG_MAGIC "HTTPALOG"
+#define ACCESS_LOG_VERSION 1
+#define ACCESS_LOG_PATH_SIZE 32
+#define ACCESS_LOG_BUFFER_RECORDS 16384
+#define ACCESS_LOG_FLUSH_INTERVAL_NS 1000000000ull
+#define ACCESS_LOG_DEFAULT_ROTATE_SIZE (256 * megabyte)
+#define ACCESS_LOG_MAX_PREFIX_SIZE 3072
+
+typedef enum AccessLogFlag {
+    AccessLogFlag_Http2 = 0x1,
+    AccessLogFlag_Proxy = 0x2,
+    AccessLogFlag_PathTruncated = 0x4,
+    AccessLogFlag_IPv6 = 0x8,
+    AccessLogFlag_Unix = 0x10,
+} AccessLogFlag;
+
+// NOTE: fixed 64 byte records in host byte order, except client_address which keeps the network
+// order of the socket address. IPv6 peers other than v4-mapped ones are only flagged. bytes is
+// the serialized response for HTTP/1.1 and the body for HTTP/2, whose headers are compressed;
+// latency is in microseconds from accept, or from the stream's HEADERS for HTTP/2
+typedef struct AccessLogRecord AccessLogRecord;
+struct AccessLogRecord {
+    u64 timestamp;
+    u64 bytes;
+    u32 latency;
+    u32 client_address;
+    u16 client_port;
+    u16 status;
+    u8 method;
+    u8 flags;
+    u16 path_length;
+    u8 path[ACCESS_LOG_PATH_SIZE];
+};
+
+// NOTE: every file starts with one header in a record sized slot, so the file is a plain array
+// of records from then on. It is written as soon as the file is opened
+typedef struct AccessLogHeader AccessLogHeader;
+struct AccessLogHeader {
+    u8 magic[8];
+    u32 version;
+    u32 record_size;
+    u32 worker;
+    u32 sequence;
+    u64 created;
+    u8 reserved[32];
+};
+
+// NOTE: each worker fills one of two buffers and writes it out with io_uring when it is full
+// or the oldest unwritten record is older than the flush interval; with both buffers still in
+// flight new records are counted as dropped instead of blocking the worker. On SIGINT or
+// SIGTERM every worker writes out what it holds at its next timer tick and waits for its
+// writes; the process exits once all of them have, and a stopped worker writes synchronously
+typedef struct AccessLog AccessLog;
+struct AccessLog {
+    ThreadContext *context;
+    OS_Handle file;
+    b32 is_open_failed;
+    b32 is_stopping;
+    b32 is_stopped;
+    u64 file_offset;
+    u32 file_sequence;
+    u64 clock_offset;
+
+    AccessLogRecord *buffers[2];
+    u32 active;
+    u32 count;
+    u32 flushed;
+    u32 pending_writes[2];
+    u64 first_unflushed_time;
+
+    IO_Uring_Timespec timer;
+    u64 dropped;
+    u64 failed_writes;
+};
+
+extern b32 access_log_enabled;
+
+#define access_log_is_completion(user_data) \
+    ((((user_data) >> 1) & 0x7f) == EventType_AccessLogWrite || (((user_data) >> 1) & 0x7f) == EventType_AccessLogTimer)
+
+#define access_log_now() (access_log_enabled ? os_now_nanoseconds() : 0)
+
+#define access_log_start(request)                          \
+    do {                                                   \
+        if (access_log_enabled) {                          \
+            (request)->accept_time = os_now_nanoseconds(); \
+        }                                                  \
+    } while (0)
+
+#define access_log_record(request, start_time, flags, method, path, status, bytes)                           \
+    do {                                                                                                     \
+        if (access_log_enabled) {                                                                            \
+            access_log_push((request)->client_address, (start_time), (flags), (method), (path), (status), (bytes)); \
+        }                                                                                                    \
+    } while (0)
+
+void access_log_init(String8 prefix, u64 rotate_size);
+void access_log_thread_init(ThreadContext *context);
+
+void access_log_push(SockAddr *client_address, u64 start_time, u32 flags, HttpMethod method, String8 path, u32 status, u64 bytes);
+void access_log_on_completion(ThreadContext *context, u64 user_data, i32 result);
+b32 access_log_drain(void);
+
+#endif // HTTP_ACCESS_LOG_H
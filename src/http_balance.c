@@ -0,0 +1,128 @@
+#include "http_balance.h"
+#include "http_access_log.h"
+#include "http_trace.h"
+#include <errno.h>
+
+global WorkerLoad balance_loads[BALANCE_MAX_WORKERS];
+global u32 balance_worker_count;
+global b32 balance_is_disabled;
+
+void balance_init(u32 worker_count) {
+    balance_worker_count = ClampTop(worker_count, BALANCE_MAX_WORKERS);
+}
+
+void balance_thread_init(ThreadContext *context) {
+    WorkerLoad *load = &balance_loads[context->thread_id];
+
+    __atomic_store_n(&load->ring_fd, context->ring.ring_fd, __ATOMIC_RELEASE);
+}
+
+void balance_publish(ThreadContext *context) {
+    WorkerLoad *load = &balance_loads[context->thread_id];
+
+    // NOTE: the ring indices cannot stand in for this: skipped completions and messages from
+    // other workers would leave them drifting apart
+    __atomic_store_n(&load->pending_completions, server_pending_completions(), __ATOMIC_RELAXED);
+}
+
+void balance_connection_opened(ThreadContext *context) {
+    WorkerLoad *load = &balance_loads[context->thread_id];
+
+    __atomic_store_n(&load->in_flight, load->in_flight + 1, __ATOMIC_RELAXED);
+}
+
+void balance_connection_closed(ThreadContext *context) {
+    WorkerLoad *load = &balance_loads[context->thread_id];
+
+    __atomic_store_n(&load->in_flight, load->in_flight - 1, __ATOMIC_RELAXED);
+}
+
+local u32 balance_score(WorkerLoad *load) {
+    u32 in_flight = __atomic_load_n(&load->in_flight, __ATOMIC_RELAXED);
+    u32 pending_completions = __atomic_load_n(&load->pending_completions, __ATOMIC_RELAXED);
+
+    return in_flight + pending_completions;
+}
+
+b32 balance_try_handoff(ThreadContext *context, OS_Handle client_handle) {
+    b32 ok = 0;
+
+    if (balance_worker_count < 2 || balance_is_disabled) {
+        return ok;
+    }
+
+    u32 own_score = balance_score(&balance_loads[context->thread_id]);
+    u32 target_score = own_score;
+    i32 target_ring_fd = -1;
+
+    for (u32 worker_index = 0; worker_index < balance_worker_count; ++worker_index) {
+        WorkerLoad *load = &balance_loads[worker_index];
+        i32 ring_fd = __atomic_load_n(&load->ring_fd, __ATOMIC_ACQUIRE);
+        u32 score = balance_score(load);
+
+        if (worker_index != context->thread_id && ring_fd > 0 && score < target_score) {
+            target_score = score;
+            target_ring_fd = ring_fd;
+        }
+    }
+
+    if (target_ring_fd == -1 || own_score < target_score + BALANCE_HANDOFF_THRESHOLD) {
+        return ok;
+    }
+
+    u32 tail;
+    IO_Uring_Submission_Entry *sqe = os_io_uring_get_sqe(&context->ring, &tail);
+
+    // NOTE: IORING_MSG_DATA posts a completion on the target ring with res = len and user_data = off,
+    // the fd table is shared by all threads so the raw fd is enough to hand the connection over
+    os_io_uring_prep_sqe(sqe, IORING_OP_MSG_RING);
+
+    sqe->fd = target_ring_fd;
+    sqe->addr = IORING_MSG_DATA;
+    sqe->len = client_handle.value;
+    sqe->off = BALANCE_USER_DATA_HANDOFF;
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    sqe->user_data = (client_handle.value << 32) | BALANCE_USER_DATA_HANDOFF_FAILED;
+
+    return server_submit(context, sqe, tail);
+}
+
+local void balance_adopt(ThreadContext *context, OS_Handle client_handle) {
+    struct Request *request = request_alloc(context);
+    u32 address_length = sizeof(SockAddr);
+
+    if (!request) {
+        os_close(client_handle);
+        return;
+    }
+
+    request->client_handle = client_handle;
+    request->event_type = EventType_Read;
+
+    if (os_peer_address(client_handle, request->client_address, &address_length)) {
+        request->client_address_length = address_length;
+    }
+
+    balance_connection_opened(context);
+    access_log_start(request);
+    trace_sample(request);
+    trace_instant(request, TraceStage_Accept, client_handle.value);
+    submit_read(context, request);
+}
+
+void balance_on_message(ThreadContext *context, u64 user_data, i32 result) {
+    if (user_data == BALANCE_USER_DATA_HANDOFF) {
+        balance_adopt(context, os_handle_from_fd(result));
+        return;
+    }
+
+    if ((user_data & 0xffffffff) == BALANCE_USER_DATA_HANDOFF_FAILED) {
+        // NOTE: the message never reached the target ring, keep the connection here
+        if (result == -EINVAL || result == -EOPNOTSUPP) {
+            log_warn("IORING_OP_MSG_RING unsupported, disabling connection rebalancing\n");
+            balance_is_disabled = 1;
+        }
+
+        balance_adopt(context, os_handle_from_fd(user_data >> 32));
+    }
+}
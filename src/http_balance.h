@@ -0,0 +1,31 @@
+#ifndef HTTP_BALANCE_H
+#define HTTP_BALANCE_H
+
+#include "http_server.h"
+
+#define BALANCE_MAX_WORKERS 64
+#define BALANCE_HANDOFF_THRESHOLD 2
+
+// NOTE: connection operations keep bit 0 of user_data clear, so odd values are ring messages
+#define BALANCE_USER_DATA_HANDOFF 0x1
+#define BALANCE_USER_DATA_HANDOFF_FAILED 0x3
+#define balance_is_message(user_data) ((user_data) & 0x1)
+
+typedef struct WorkerLoad WorkerLoad;
+struct WorkerLoad {
+    i32 ring_fd;
+    u32 in_flight;
+    u32 pending_completions;
+} __attribute__((aligned(64)));
+
+void balance_init(u32 worker_count);
+void balance_thread_init(ThreadContext *context);
+
+void balance_publish(ThreadContext *context);
+void balance_connection_opened(ThreadContext *context);
+void balance_connection_closed(ThreadContext *context);
+
+b32 balance_try_handoff(ThreadContext *context, OS_Handle client_handle);
+void balance_on_message(ThreadContext *context, u64 user_data, i32 result);
+
+#endif // HTTP_BALANCE_H
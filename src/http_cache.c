@@ -0,0 +1,376 @@
+#include "http_cache.h"
+#include "http_access_log.h"
+
+#define MICRO_CACHE_MAP_ARENA_SIZE (256 * kilobyte)
+
+global MicroCacheRoute micro_cache_routes[MICRO_CACHE_MAX_ROUTES];
+global u32 micro_cache_route_count;
+global u64 micro_cache_budget;
+thread_static MicroCache *micro_cache;
+
+global String8 micro_cache_unavailable = str8_comp(
+    "HTTP/1.1 503 Service Unavailable\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n");
+
+//////////////////////////////
+// Configuration
+
+// NOTE: routes are read by every worker without locking, so they are added before the workers
+// start; the path is referenced, not copied
+b32 micro_cache_add_route(String8 path, u32 ttl_ms, HttpHeaderId *vary, u32 vary_count) {
+    if (micro_cache_route_count == MICRO_CACHE_MAX_ROUTES || vary_count > MICRO_CACHE_MAX_VARY || path.len == 0) {
+        return 0;
+    }
+
+    MicroCacheRoute *route = &micro_cache_routes[micro_cache_route_count++];
+    memset(route, 0, sizeof(MicroCacheRoute));
+
+    route->is_prefix = path.data[path.len - 1] == '*';
+    route->path = route->is_prefix ? str8_prefix(path, path.len - 1) : path;
+    route->ttl = (u64)(ttl_ms ? ttl_ms : MICRO_CACHE_DEFAULT_TTL_MS) * 1000000ull;
+    route->vary_count = vary_count;
+
+    for (u32 index = 0; index < vary_count; ++index) {
+        route->vary[index] = vary[index];
+    }
+
+    return 1;
+}
+
+void micro_cache_set_budget(u64 bytes) {
+    micro_cache_budget = bytes;
+}
+
+b32 micro_cache_is_enabled(void) {
+    return micro_cache_route_count > 0;
+}
+
+void micro_cache_thread_init(ThreadContext *context) {
+    if (!micro_cache_is_enabled()) {
+        return;
+    }
+
+    MicroCache *cache = push_struct_zero(context->permanent_arena, MicroCache);
+    cache->context = context;
+    cache->map_arena = arena_alloc(MICRO_CACHE_MAP_ARENA_SIZE, MICRO_CACHE_MAP_ARENA_SIZE, 0, 0);
+
+    if (!micro_cache_budget) {
+        micro_cache_budget = MICRO_CACHE_DEFAULT_BUDGET;
+    }
+
+    // NOTE: sized so that live entries plus the tombstones tolerated before a rebuild never
+    // make the map grow, which would leave old arrays behind in its arena
+    if (!hash_map_init(&cache->map, cache->map_arena, MICRO_CACHE_MAX_ENTRIES * 2)) {
+        log_fatal("failed to allocate the micro-cache\n");
+        os_abort(1);
+    }
+
+    micro_cache = cache;
+}
+
+//////////////////////////////
+// Entries
+
+local MicroCacheRoute *micro_cache_match(String8 path) {
+    String8 route_path = str8_split_to(path, "?");
+
+    if (!str8_is_valid(route_path)) {
+        route_path = path;
+    }
+
+    for (u32 index = 0; index < micro_cache_route_count; ++index) {
+        MicroCacheRoute *route = &micro_cache_routes[index];
+
+        if (route->is_prefix ? str8_are_equal(str8_prefix(route_path, route->path.len), route->path)
+                             : str8_are_equal(route_path, route->path)) {
+            return route;
+        }
+    }
+
+    return 0;
+}
+
+local String8 micro_cache_key(Arena *arena, MicroCacheRoute *route, HttpRequest *http_request) {
+    String8List parts = {0};
+    u8 method = (u8)http_request->method;
+
+    str8_list_push(arena, &parts, (String8){1, &method});
+    str8_list_push(arena, &parts, http_request->path);
+
+    for (u32 index = 0; index < route->vary_count; ++index) {
+        str8_list_push(arena, &parts, http_headers_get(&http_request->headers, route->vary[index]));
+    }
+
+    // NOTE: header values cannot contain NUL, so the separator keeps the parts apart
+    return str8_list_join(arena, &parts, str8("\0"));
+}
+
+local void micro_cache_link(MicroCache *cache, MicroCacheEntry *entry) {
+    entry->prev = 0;
+    entry->next = cache->head;
+
+    if (cache->head) {
+        cache->head->prev = entry;
+    } else {
+        cache->tail = entry;
+    }
+
+    cache->head = entry;
+}
+
+local void micro_cache_unlink(MicroCache *cache, MicroCacheEntry *entry) {
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        cache->head = entry->next;
+    }
+
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        cache->tail = entry->prev;
+    }
+
+    entry->prev = 0;
+    entry->next = 0;
+}
+
+local void micro_cache_free(ThreadContext *context, MicroCacheEntry *entry) {
+    if (entry->response_arena) {
+        arena_release(entry->response_arena);
+    }
+
+    thread_scratch_release(context, entry->arena);
+}
+
+local void micro_cache_rebuild_map(MicroCache *cache) {
+    arena_clear(cache->map_arena);
+    hash_map_init(&cache->map, cache->map_arena, MICRO_CACHE_MAX_ENTRIES * 2);
+
+    for (MicroCacheEntry *entry = cache->head; entry != 0; entry = entry->next) {
+        hash_map_insert(&cache->map, entry->key, entry);
+    }
+}
+
+local void micro_cache_evict(MicroCache *cache, MicroCacheEntry *entry) {
+    hash_map_remove(&cache->map, entry->key);
+    micro_cache_unlink(cache, entry);
+
+    cache->entry_count -= 1;
+    cache->bytes_used -= entry->response.len;
+    cache->evictions += 1;
+    entry->is_evicted = 1;
+
+    if (cache->map.deleted_count > MICRO_CACHE_MAX_ENTRIES / 2) {
+        micro_cache_rebuild_map(cache);
+    }
+
+    if (entry->ref_count == 0) {
+        micro_cache_free(cache->context, entry);
+    }
+}
+
+// NOTE: filling entries have requests parked on them and are never chosen
+local b32 micro_cache_evict_oldest(MicroCache *cache, MicroCacheEntry *keep) {
+    for (MicroCacheEntry *entry = cache->tail; entry != 0; entry = entry->prev) {
+        if (entry->is_ready && entry != keep) {
+            micro_cache_evict(cache, entry);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+MicroCacheResult micro_cache_begin(ThreadContext *context, struct Request *request, HttpRequest *http_request, MicroCacheEntry **entry_out) {
+    MicroCache *cache = micro_cache;
+
+    if (!cache || (http_request->method != HTTP_METHOD_GET && http_request->method != HTTP_METHOD_HEAD)) {
+        return MicroCacheResult_Uncached;
+    }
+
+    MicroCacheRoute *route = micro_cache_match(http_request->path);
+
+    if (!route) {
+        return MicroCacheResult_Uncached;
+    }
+
+    // NOTE: entries hold the full response, so conditional and range requests run the handler
+    HttpHeaders *headers = &http_request->headers;
+
+    if (headers->known[HttpHeaderId_IfNoneMatch] || headers->known[HttpHeaderId_IfModifiedSince] ||
+        headers->known[HttpHeaderId_Range]) {
+        return MicroCacheResult_Uncached;
+    }
+
+    String8 key = micro_cache_key(request->scratch_arena, route, http_request);
+
+    if (!key.data) {
+        return MicroCacheResult_Uncached;
+    }
+
+    MicroCacheEntry *entry = hash_map_get(&cache->map, key);
+
+    if (entry && !entry->is_ready) {
+        if (entry->waiter_count == MICRO_CACHE_MAX_WAITERS) {
+            return MicroCacheResult_Uncached;
+        }
+
+        entry->waiters[entry->waiter_count].slot_index = request->slot_index;
+        entry->waiters[entry->waiter_count].generation = request->generation;
+        entry->waiter_count += 1;
+        cache->coalesced += 1;
+
+        return MicroCacheResult_Waiting;
+    }
+
+    if (entry && os_now_nanoseconds() < entry->expires) {
+        micro_cache_unlink(cache, entry);
+        micro_cache_link(cache, entry);
+        cache->hits += 1;
+        *entry_out = entry;
+
+        return MicroCacheResult_Hit;
+    }
+
+    if (entry) {
+        micro_cache_evict(cache, entry);
+    }
+
+    if (cache->entry_count == MICRO_CACHE_MAX_ENTRIES && !micro_cache_evict_oldest(cache, 0)) {
+        return MicroCacheResult_Uncached;
+    }
+
+    Scratch *arena = thread_scratch_alloc(context);
+    entry = push_struct_zero(arena, MicroCacheEntry);
+    MicroCacheWaiter *waiters = push_array(arena, MicroCacheWaiter, MICRO_CACHE_MAX_WAITERS);
+    String8 entry_key = str8_push_copy(arena, key);
+    String8 path = str8_push_copy(arena, http_request->path);
+
+    if (!entry || !waiters || !entry_key.data || !path.data) {
+        thread_scratch_release(context, arena);
+        return MicroCacheResult_Uncached;
+    }
+
+    entry->arena = arena;
+    entry->waiters = waiters;
+    entry->key = entry_key;
+    entry->method = http_request->method;
+    entry->path = path;
+    entry->ttl = route->ttl;
+
+    hash_map_insert(&cache->map, entry->key, entry);
+    micro_cache_link(cache, entry);
+    cache->entry_count += 1;
+    cache->misses += 1;
+    *entry_out = entry;
+
+    return MicroCacheResult_Miss;
+}
+
+// NOTE: the body is pushed right behind the copied head, so the two stay one string
+local b32 micro_cache_push_body(MicroCacheEntry *entry, ResponseBody *body) {
+    u8 *data = arena_push(entry->response_arena, body->data.len + body->remaining, 1);
+    u64 offset = 0;
+
+    if (!data) {
+        return 0;
+    }
+
+    memcpy(data, body->data.data, body->data.len);
+
+    while (offset < body->remaining) {
+        i64 read = os_read_at(body->file, data + body->data.len + offset, body->remaining - offset,
+                              body->offset + offset);
+
+        if (read <= 0) {
+            return 0;
+        }
+
+        offset += read;
+    }
+
+    entry->response.len += body->data.len + body->remaining;
+
+    return 1;
+}
+
+// NOTE: the response is copied, so the caller still writes its own buffer; requests parked on
+// the entry are answered from the copy, and a response that is not kept still goes out to them.
+// response is what the caller serialized and body what it writes behind that, if anything; a
+// file body is read into the copy only when the whole response fits the budget. Without a
+// response, or with a file body over the budget, they get a 503
+void micro_cache_fill(ThreadContext *context, MicroCacheEntry *entry, HttpResponse *http_response, String8 response,
+                      ResponseBody *body) {
+    MicroCache *cache = micro_cache;
+    u32 status = http_response ? http_response->status : 0;
+    u64 body_length = body ? body->data.len + body->remaining : 0;
+    u64 size = response.len + body_length;
+    b32 is_cacheable = (status == 200 || status == 301 || status == 404) && size <= micro_cache_budget &&
+                       !str8_is_valid(http_header_find(http_response->headers, str8("Set-Cookie")));
+
+    if (str8_is_valid(response) && (!body || !body->remaining || size <= micro_cache_budget)) {
+        u64 reserve_size = AlignPow2(ARENA_HEADER_SIZE + size, PAGE_SIZE);
+        entry->response_arena = arena_alloc(reserve_size, reserve_size, 0, 0);
+        entry->response = str8_push_copy(entry->response_arena, response);
+
+        if (str8_is_valid(entry->response) && body_length && !micro_cache_push_body(entry, body)) {
+            entry->response = (String8){0};
+        }
+    }
+
+    entry->status = status;
+
+    if (!str8_is_valid(entry->response)) {
+        entry->response = micro_cache_unavailable;
+        entry->status = 503;
+        is_cacheable = 0;
+    }
+
+    entry->is_ready = 1;
+    entry->expires = os_now_nanoseconds() + entry->ttl;
+    cache->bytes_used += entry->response.len;
+
+    while (cache->bytes_used > micro_cache_budget && micro_cache_evict_oldest(cache, entry)) {
+    }
+
+    // NOTE: the entry can be evicted while answering, so it is held until every waiter is done
+    entry->ref_count += 1;
+
+    for (u32 index = 0; index < entry->waiter_count; ++index) {
+        MicroCacheWaiter *waiter = &entry->waiters[index];
+        struct Request *request = request_from_slot(waiter->slot_index, waiter->generation);
+
+        if (request) {
+            micro_cache_respond(context, request, entry);
+        }
+    }
+
+    entry->waiter_count = 0;
+
+    if (!is_cacheable || cache->bytes_used > micro_cache_budget) {
+        micro_cache_evict(cache, entry);
+    }
+
+    micro_cache_release(context, entry);
+}
+
+void micro_cache_respond(ThreadContext *context, struct Request *request, MicroCacheEntry *entry) {
+    entry->ref_count += 1;
+    request->cached_response = entry;
+    request->response_buffer = entry->response;
+    request->event_type = EventType_Write;
+
+    access_log_record(request, request->accept_time, 0, entry->method, entry->path, entry->status, entry->response.len);
+    submit_write(context, request);
+}
+
+void micro_cache_release(ThreadContext *context, MicroCacheEntry *entry) {
+    entry->ref_count -= 1;
+
+    if (entry->ref_count == 0 && entry->is_evicted) {
+        micro_cache_free(context, entry);
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef HTTP_CACHE_H
+#define HTTP_CACHE_H
+
+#include "http_server.h"
+
+#define MICRO_CACHE_MAX_ROUTES 32
+#define MICRO_CACHE_MAX_VARY 4
+#define MICRO_CACHE_MAX_ENTRIES 256
+#define MICRO_CACHE_MAX_WAITERS 1024
+#define MICRO_CACHE_DEFAULT_BUDGET (4 * megabyte)
+#define MICRO_CACHE_DEFAULT_TTL_MS 250
+
+// NOTE: a route matches its path exactly, or as a prefix when the path ends in '*'. Only GET
+// and HEAD are cached, keyed on method, path with query and the values of the vary headers
+typedef struct MicroCacheRoute MicroCacheRoute;
+struct MicroCacheRoute {
+    String8 path;
+    b32 is_prefix;
+    u64 ttl;
+    HttpHeaderId vary[MICRO_CACHE_MAX_VARY];
+    u32 vary_count;
+};
+
+typedef struct MicroCacheWaiter MicroCacheWaiter;
+struct MicroCacheWaiter {
+    u32 slot_index;
+    u32 generation;
+};
+
+// NOTE: a serialized HTTP/1.1 response. Bookkeeping lives in a scratch arena, the response in
+// an arena sized to it. Connections writing it hold a reference, so an entry that expires or is
+// evicted mid-write lives on until the last one closes. While the first miss runs the handler
+// the entry is filling, and requests for the same key park on it instead of running it again
+struct MicroCacheEntry {
+    MicroCacheEntry *prev;
+    MicroCacheEntry *next;
+    Scratch *arena;
+    u32 ref_count;
+    b32 is_ready;
+    b32 is_evicted;
+
+    String8 key;
+    HttpMethod method;
+    String8 path;
+    u64 ttl;
+    u64 expires;
+
+    Arena *response_arena;
+    String8 response;
+    u32 status;
+
+    MicroCacheWaiter *waiters;
+    u32 waiter_count;
+};
+
+typedef struct MicroCache MicroCache;
+struct MicroCache {
+    ThreadContext *context;
+    Arena *map_arena;
+    HashMap map;
+
+    // NOTE: least recently used at the tail
+    MicroCacheEntry *head;
+    MicroCacheEntry *tail;
+    u32 entry_count;
+    u64 bytes_used;
+
+    u64 hits;
+    u64 misses;
+    u64 coalesced;
+    u64 evictions;
+};
+
+typedef enum MicroCacheResult {
+    MicroCacheResult_Uncached,
+    MicroCacheResult_Hit,
+    MicroCacheResult_Miss,
+    MicroCacheResult_Waiting,
+} MicroCacheResult;
+
+b32 micro_cache_add_route(String8 path, u32 ttl_ms, HttpHeaderId *vary, u32 vary_count);
+void micro_cache_set_budget(u64 bytes);
+b32 micro_cache_is_enabled(void);
+
+void micro_cache_thread_init(ThreadContext *context);
+
+MicroCacheResult micro_cache_begin(ThreadContext *context, struct Request *request, HttpRequest *http_request, MicroCacheEntry **entry_out);
+void micro_cache_fill(ThreadContext *context, MicroCacheEntry *entry, HttpResponse *http_response, String8 response,
+                      ResponseBody *body);
+void micro_cache_respond(ThreadContext *context, struct Request *request, MicroCacheEntry *entry);
+void micro_cache_release(ThreadContext *context, MicroCacheEntry *entry);
+
+#endif // HTTP_CACHE_H
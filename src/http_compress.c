@@ -0,0 +1,335 @@
+#include "http_compress.h"
+
+global u64 compress_budget;
+thread_static CompressCache *compress_cache;
+
+global String8 http_encoding_names[HttpEncoding_Count] = {
+    [HttpEncoding_Identity] = str8_comp("identity"),
+    [HttpEncoding_Gzip] = str8_comp("gzip"),
+    [HttpEncoding_Deflate] = str8_comp("deflate"),
+    [HttpEncoding_Brotli] = str8_comp("br"),
+};
+
+//////////////////////////////
+// Configuration
+
+void compress_init(u64 budget) {
+    compress_budget = budget;
+}
+
+b32 compress_is_enabled(void) {
+    return compress_budget > 0;
+}
+
+void compress_thread_init(ThreadContext *context) {
+    if (!compress_is_enabled()) {
+        return;
+    }
+
+    CompressCache *cache = push_struct_zero(context->permanent_arena, CompressCache);
+
+    if (!cache) {
+        log_fatal("failed to allocate the compression cache\n");
+        os_abort(1);
+    }
+
+    cache->work_arena = arena_alloc(256 * megabyte, 64 * kilobyte, 0, 1);
+    compress_cache = cache;
+}
+
+String8 http_encoding_name(HttpEncoding encoding) {
+    return http_encoding_names[encoding];
+}
+
+//////////////////////////////
+// Negotiation
+
+// NOTE: the q parameter in thousandths, 1000 when absent; a malformed one counts as 0
+local u32 http_parse_quality(String8 parameters) {
+    while (parameters.len > 0) {
+        String8 parameter = str8_split_to(parameters, ";");
+
+        if (!str8_is_valid(parameter)) {
+            parameter = parameters;
+        }
+
+        parameters = str8_skip(parameters, Min(parameter.len + 1, parameters.len));
+        parameter = str8_trim_whitespace(parameter);
+
+        if (parameter.len < 2 || (parameter.data[0] != 'q' && parameter.data[0] != 'Q') || parameter.data[1] != '=') {
+            continue;
+        }
+
+        String8 value = str8_skip(parameter, 2);
+        u32 quality = 0;
+
+        if (value.len == 0 || (value.data[0] != '0' && value.data[0] != '1') || value.len > 5 ||
+            (value.len > 1 && value.data[1] != '.')) {
+            return 0;
+        }
+
+        quality = (value.data[0] - '0') * 1000;
+
+        for (u32 index = 2, scale = 100; index < value.len; ++index, scale /= 10) {
+            u32 digit = (u32)(value.data[index] - '0');
+
+            if (digit > 9) {
+                return 0;
+            }
+
+            quality += digit * scale;
+        }
+
+        return Min(quality, 1000);
+    }
+
+    return 1000;
+}
+
+// NOTE: the acceptable coding with the highest q value, ties going to br, then gzip, then
+// deflate. "*" covers the codings not listed. Without the header nothing is compressed, as
+// clients that decode content send it. br only counts when a precompressed variant exists
+HttpEncoding http_negotiate_encoding(String8 accept_encoding, b32 has_brotli) {
+    u32 qualities[HttpEncoding_Count] = {0};
+    b32 is_listed[HttpEncoding_Count] = {0};
+    u32 wildcard_quality = 0;
+    HttpEncoding result = HttpEncoding_Identity;
+    u32 best_quality = 0;
+
+    while (accept_encoding.len > 0) {
+        String8 item = str8_split_to(accept_encoding, ",");
+
+        if (!str8_is_valid(item)) {
+            item = accept_encoding;
+        }
+
+        accept_encoding = str8_skip(accept_encoding, Min(item.len + 1, accept_encoding.len));
+
+        String8 name = str8_split_to(item, ";");
+        String8 parameters = {0};
+
+        if (str8_is_valid(name)) {
+            parameters = str8_skip(item, name.len + 1);
+        } else {
+            name = item;
+        }
+
+        name = str8_trim_whitespace(name);
+        u32 quality = http_parse_quality(parameters);
+
+        if (str8_are_equal(name, str8("*"))) {
+            wildcard_quality = quality;
+            continue;
+        }
+
+        for (u32 encoding = HttpEncoding_Gzip; encoding < HttpEncoding_Count; ++encoding) {
+            if (str8_are_equal_case_insensitive(name, http_encoding_names[encoding])) {
+                qualities[encoding] = quality;
+                is_listed[encoding] = 1;
+            }
+        }
+    }
+
+    HttpEncoding preference[] = {HttpEncoding_Brotli, HttpEncoding_Gzip, HttpEncoding_Deflate};
+
+    for (u32 index = 0; index < array_count(preference); ++index) {
+        HttpEncoding encoding = preference[index];
+        u32 quality = is_listed[encoding] ? qualities[encoding] : wildcard_quality;
+
+        if (encoding == HttpEncoding_Brotli && !has_brotli) {
+            continue;
+        }
+
+        if (quality > best_quality) {
+            best_quality = quality;
+            result = encoding;
+        }
+    }
+
+    return result;
+}
+
+// NOTE: text and the structured formats served as text; images, video and archives are
+// compressed already
+b32 http_is_compressible_type(String8 content_type) {
+    String8 type = str8_split_to(content_type, ";");
+    type = str8_is_valid(type) ? str8_trim_whitespace(type) : content_type;
+
+    if (type.len >= 5 && str8_are_equal_case_insensitive(str8_prefix(type, 5), str8("text/"))) {
+        return 1;
+    }
+
+    return str8_find_substring(type, "json") != -1 || str8_find_substring(type, "javascript") != -1 ||
+           str8_find_substring(type, "xml") != -1 || str8_are_equal(type, str8("application/wasm"));
+}
+
+//////////////////////////////
+// Cache
+
+local void compress_variant_free(CompressVariant *variant) {
+    arena_release(variant->arena);
+}
+
+local void compress_evict(CompressCache *cache, CompressEntry *entry) {
+    CompressVariant *variant = entry->variant;
+
+    if (variant) {
+        cache->bytes_used -= variant->body.len;
+        variant->is_evicted = 1;
+
+        if (variant->ref_count == 0) {
+            compress_variant_free(variant);
+        }
+    }
+
+    memset(entry, 0, sizeof(CompressEntry));
+}
+
+local b32 compress_evict_next(CompressCache *cache) {
+    CompressEntry *entries = &cache->entries[0][0];
+    u32 entry_count = COMPRESS_CACHE_SETS * COMPRESS_CACHE_WAYS;
+
+    for (u32 step = 0; step < entry_count; ++step) {
+        CompressEntry *entry = &entries[cache->sweep++ % entry_count];
+
+        if (entry->variant) {
+            compress_evict(cache, entry);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+local CompressVariant *compress_variant_alloc(String8 body) {
+    u64 reserve_size = AlignPow2(ARENA_HEADER_SIZE + sizeof(CompressVariant) + 8 + body.len, PAGE_SIZE);
+    Arena *arena = arena_alloc(reserve_size, reserve_size, 0, 0);
+    CompressVariant *variant = push_struct_zero(arena, CompressVariant);
+
+    variant->arena = arena;
+    variant->body = str8_push_copy(arena, body);
+
+    return variant;
+}
+
+void compress_variant_release(CompressVariant *variant) {
+    variant->ref_count -= 1;
+
+    if (variant->ref_count == 0 && variant->is_evicted) {
+        compress_variant_free(variant);
+    }
+}
+
+// NOTE: returns the gzip or deflate (zlib) coded body; an invalid string when it would not be
+// smaller or the cache is off. A cached variant is returned in place, with a reference in
+// *variant_out for the caller to release once the body is written; one past the budget is
+// copied into arena, and remembered as incompressible when it does not fit there either. The
+// body is hashed on every call, compressed on the first one only
+String8 compress_body(Arena *arena, String8 body, HttpEncoding encoding, CompressVariant **variant_out) {
+    CompressCache *cache = compress_cache;
+    String8 result = {0};
+
+    if (!cache || (encoding != HttpEncoding_Gzip && encoding != HttpEncoding_Deflate)) {
+        return result;
+    }
+
+    u64 key = hash_u64(hash_string(body) + encoding) | 1;
+    CompressEntry *set = cache->entries[(key >> 32) % COMPRESS_CACHE_SETS];
+    CompressEntry *victim = &set[0];
+
+    cache->clock += 1;
+
+    for (u32 way = 0; way < COMPRESS_CACHE_WAYS; ++way) {
+        CompressEntry *entry = &set[way];
+
+        if (entry->key == key) {
+            entry->last_used = cache->clock;
+            cache->hits += 1;
+
+            if (entry->is_incompressible) {
+                return result;
+            }
+
+            cache->bytes_saved += body.len - entry->variant->body.len;
+            entry->variant->ref_count += 1;
+            *variant_out = entry->variant;
+
+            return entry->variant->body;
+        }
+
+        if (entry->key == 0 || (victim->key != 0 && entry->last_used < victim->last_used)) {
+            victim = entry;
+        }
+    }
+
+    cache->misses += 1;
+
+    DeflateFormat format = encoding == HttpEncoding_Gzip ? DeflateFormat_Gzip : DeflateFormat_Zlib;
+    String8 compressed = deflate_compress(cache->work_arena, body, format);
+    b32 is_incompressible = !str8_is_valid(compressed) || compressed.len >= body.len;
+
+    compress_evict(cache, victim);
+
+    if (!is_incompressible) {
+        while (cache->bytes_used + compressed.len > compress_budget && compress_evict_next(cache)) {
+        }
+
+        if (cache->bytes_used + compressed.len <= compress_budget) {
+            victim->variant = compress_variant_alloc(compressed);
+            victim->variant->ref_count += 1;
+            *variant_out = victim->variant;
+            cache->bytes_used += compressed.len;
+            result = victim->variant->body;
+        } else {
+            result = str8_push_copy(arena, compressed);
+        }
+
+        is_incompressible = !str8_is_valid(result);
+    }
+
+    if (str8_is_valid(result)) {
+        cache->bytes_saved += body.len - result.len;
+    }
+
+    if (victim->variant || is_incompressible) {
+        victim->key = key;
+        victim->last_used = cache->clock;
+        victim->is_incompressible = is_incompressible;
+    }
+
+    arena_clear(cache->work_arena);
+
+    return result;
+}
+
+// NOTE: a file body is read into the work arena, not the caller's, and only when it is within
+// the budget; an invalid string, as for compress_body, leaves the file to be sent as it is
+String8 compress_file(Arena *arena, OS_Handle file, u64 size, HttpEncoding encoding, CompressVariant **variant_out) {
+    CompressCache *cache = compress_cache;
+    String8 result = {0};
+
+    if (!cache || size > compress_budget) {
+        return result;
+    }
+
+    u8 *data = arena_push(cache->work_arena, size, 1);
+    u64 offset = 0;
+
+    while (data && offset < size) {
+        i64 read = os_read_at(file, data + offset, size - offset, offset);
+
+        if (read <= 0) {
+            break;
+        }
+
+        offset += read;
+    }
+
+    if (data && offset == size) {
+        result = compress_body(arena, (String8){size, data}, encoding, variant_out);
+    }
+
+    arena_clear(cache->work_arena);
+
+    return result;
+}
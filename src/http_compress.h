@@ -0,0 +1,66 @@
+#ifndef HTTP_COMPRESS_H
+#define HTTP_COMPRESS_H
+
+#include "http_server.h"
+
+#define COMPRESS_CACHE_SETS 64
+#define COMPRESS_CACHE_WAYS 4
+#define COMPRESS_DEFAULT_BUDGET (8 * megabyte)
+#define COMPRESS_MIN_SIZE 256
+
+typedef enum HttpEncoding {
+    HttpEncoding_Identity,
+    HttpEncoding_Gzip,
+    HttpEncoding_Deflate,
+    HttpEncoding_Brotli,
+    HttpEncoding_Count,
+} HttpEncoding;
+
+// NOTE: a coded body in an arena of its own. Responses send it in place and hold a reference
+// until it is written; an evicted variant is freed once the last of them is released
+struct CompressVariant {
+    Arena *arena;
+    u32 ref_count;
+    b32 is_evicted;
+    String8 body;
+};
+
+// NOTE: the compressed variant of a body, keyed by a hash of the body and the encoding. A body
+// that did not shrink, or whose variant is too large to be served, is remembered as
+// incompressible with no variant, so it is not tried again
+typedef struct CompressEntry CompressEntry;
+struct CompressEntry {
+    u64 key;
+    u32 last_used;
+    b32 is_incompressible;
+    CompressVariant *variant;
+};
+
+// NOTE: set associative, least recently used way replaced; past the budget, entries are
+// evicted in table order, like a clock hand, until the new variant fits
+typedef struct CompressCache CompressCache;
+struct CompressCache {
+    CompressEntry entries[COMPRESS_CACHE_SETS][COMPRESS_CACHE_WAYS];
+    Arena *work_arena;
+    u64 bytes_used;
+    u32 clock;
+    u32 sweep;
+
+    u64 hits;
+    u64 misses;
+    u64 bytes_saved;
+};
+
+void compress_init(u64 budget);
+b32 compress_is_enabled(void);
+void compress_thread_init(ThreadContext *context);
+
+HttpEncoding http_negotiate_encoding(String8 accept_encoding, b32 has_brotli);
+b32 http_is_compressible_type(String8 content_type);
+String8 http_encoding_name(HttpEncoding encoding);
+
+String8 compress_body(Arena *arena, String8 body, HttpEncoding encoding, CompressVariant **variant_out);
+String8 compress_file(Arena *arena, OS_Handle file, u64 size, HttpEncoding encoding, CompressVariant **variant_out);
+void compress_variant_release(CompressVariant *variant);
+
+#endif // HTTP_COMPRESS_H
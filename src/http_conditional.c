@@ -0,0 +1,517 @@
+#include "http_conditional.h"
+#include "http_compress.h"
+
+//////////////////////////////
+// Validators
+
+// NOTE: a quoted hex hash, the usual validator for a body the handler generated
+String8 http_etag_from_hash(Arena *arena, u64 hash, b32 is_weak) {
+    return str8_pushf(arena, "%s\"%016llx\"", is_weak ? "W/" : "", (unsigned long long)hash);
+}
+
+// NOTE: the body stays on disk and is sent from the file, whole or the part a Range asks for. The
+// validators are the modification time and size, as most servers derive them, so an edit that
+// keeps both within the same second goes unnoticed
+b32 http_response_set_file(Arena *arena, HttpResponse *response, String8 path) {
+    OS_Handle file = os_open_file(path);
+    OS_FileInfo info = {0};
+
+    if (!file.value) {
+        return 0;
+    }
+
+    if (!os_file_info(file, &info) || !info.is_regular) {
+        os_close(file);
+        return 0;
+    }
+
+    response->file = file;
+    response->file_size = info.size;
+    response->file_offset = 0;
+    response->file_length = info.size;
+    response->file_path = path;
+    response->body = (String8){0};
+    response->last_modified = info.modified_time;
+    response->etag = str8_pushf(arena, "\"%llx-%llx\"", (unsigned long long)info.modified_time,
+                                (unsigned long long)info.size);
+
+    return 1;
+}
+
+local String8 http_etag_opaque(String8 etag, b32 *is_weak_out) {
+    *is_weak_out = etag.len >= 2 && etag.data[0] == 'W' && etag.data[1] == '/';
+
+    return *is_weak_out ? str8_skip(etag, 2) : etag;
+}
+
+// NOTE: etag_list is an If-None-Match or If-Range value: "*" or entity tags separated by commas.
+// Weak comparison ignores the W/ prefix, strong comparison needs both tags strong
+b32 http_etag_matches(String8 etag_list, String8 etag, b32 is_weak_comparison) {
+    b32 is_weak;
+    String8 opaque = http_etag_opaque(etag, &is_weak);
+
+    if (!str8_is_valid(etag) || (is_weak && !is_weak_comparison)) {
+        return 0;
+    }
+
+    if (str8_are_equal(str8_trim_whitespace(etag_list), str8("*"))) {
+        return 1;
+    }
+
+    while (etag_list.len > 0) {
+        u8 c = etag_list.data[0];
+
+        if (c == ' ' || c == '\t' || c == ',') {
+            etag_list = str8_skip(etag_list, 1);
+            continue;
+        }
+
+        b32 is_candidate_weak;
+        String8 candidate = http_etag_opaque(etag_list, &is_candidate_weak);
+
+        if (candidate.len < 2 || candidate.data[0] != '"') {
+            return 0;
+        }
+
+        i64 close = str8_find_substring(str8_skip(candidate, 1), "\"");
+
+        if (close == -1) {
+            return 0;
+        }
+
+        String8 tag = str8_prefix(candidate, close + 2);
+
+        if (str8_are_equal(tag, opaque) && (is_weak_comparison || !is_candidate_weak)) {
+            return 1;
+        }
+
+        etag_list = str8_skip(candidate, tag.len);
+    }
+
+    return 0;
+}
+
+//////////////////////////////
+// Ranges
+
+// NOTE: parses "bytes=" followed by first-last, first- and -suffix specs into ranges clamped to
+// the body. A malformed header is ignored as if absent, and so is one asking for more ranges
+// than HTTP_MAX_RANGES or more bytes in total than the body has, which only overlapping ranges
+// do; serving those would let a short request multiply the response
+HttpRangeResult http_parse_range(String8 range, u64 size, HttpByteRange *ranges_out, u32 *range_count_out) {
+    String8 unit = str8_prefix(range, 6);
+    u32 spec_count = 0;
+    u32 range_count = 0;
+    u64 total_length = 0;
+
+    if (!str8_are_equal_case_insensitive(unit, str8("bytes="))) {
+        return HttpRangeResult_Ignore;
+    }
+
+    String8 specs = str8_skip(range, 6);
+
+    while (specs.len > 0) {
+        String8 spec = str8_split_to(specs, ",");
+
+        if (!str8_is_valid(spec)) {
+            spec = specs;
+        }
+
+        specs = str8_skip(specs, Min(spec.len + 1, specs.len));
+        spec = str8_trim_whitespace(spec);
+
+        if (spec.len == 0) {
+            continue;
+        }
+
+        if (++spec_count > HTTP_MAX_RANGES) {
+            return HttpRangeResult_Ignore;
+        }
+
+        String8 first_string = str8_split_to(spec, "-");
+
+        if (!str8_is_valid(first_string)) {
+            return HttpRangeResult_Ignore;
+        }
+
+        String8 last_string = str8_skip(spec, first_string.len + 1);
+        u64 first = 0;
+        u64 last = 0;
+
+        if (first_string.len == 0) {
+            if (!str8_to_u64(last_string, &last)) {
+                return HttpRangeResult_Ignore;
+            }
+
+            if (last == 0 || size == 0) {
+                continue;
+            }
+
+            first = size - Min(last, size);
+            last = size - 1;
+        } else {
+            if (!str8_to_u64(first_string, &first)) {
+                return HttpRangeResult_Ignore;
+            }
+
+            if (last_string.len == 0) {
+                last = size - 1;
+            } else if (!str8_to_u64(last_string, &last) || last < first) {
+                return HttpRangeResult_Ignore;
+            }
+
+            if (first >= size) {
+                continue;
+            }
+
+            last = Min(last, size - 1);
+        }
+
+        ranges_out[range_count].first = first;
+        ranges_out[range_count].length = last - first + 1;
+        total_length += ranges_out[range_count].length;
+        range_count += 1;
+    }
+
+    if (spec_count == 0 || total_length > size) {
+        return HttpRangeResult_Ignore;
+    }
+
+    *range_count_out = range_count;
+
+    return range_count > 0 ? HttpRangeResult_Satisfiable : HttpRangeResult_Unsatisfiable;
+}
+
+//////////////////////////////
+// Responses
+
+// NOTE: handler headers may live in static storage, so headers go in front and a dropped one is
+// unlinked by copying the headers ahead of it
+local void http_push_header(Arena *arena, HttpResponse *response, String8 key, String8 value) {
+    HttpHeader *header = str8_is_valid(value) ? push_struct_zero(arena, HttpHeader) : 0;
+
+    if (header) {
+        header->key = key;
+        header->value = value;
+        header->next = response->headers;
+        response->headers = header;
+    }
+}
+
+local void http_drop_header(Arena *arena, HttpResponse *response, String8 key) {
+    HttpHeader *first = 0;
+    HttpHeader **link = &first;
+
+    for (HttpHeader *header = response->headers; header != 0; header = header->next) {
+        if (str8_are_equal_case_insensitive(header->key, key)) {
+            *link = header->next;
+            response->headers = first;
+            return;
+        }
+
+        HttpHeader *copy = push_struct_zero(arena, HttpHeader);
+
+        if (!copy) {
+            return;
+        }
+
+        *copy = *header;
+        *link = copy;
+        link = &copy->next;
+    }
+}
+
+local b32 http_read_body(HttpResponse *response, u8 *out, u64 first, u64 length) {
+    if (!response->file.value) {
+        memcpy(out, response->body.data + first, length);
+        return 1;
+    }
+
+    while (length > 0) {
+        i64 read = os_read_at(response->file, out, length, first);
+
+        if (read <= 0) {
+            return 0;
+        }
+
+        out += read;
+        first += read;
+        length -= read;
+    }
+
+    return 1;
+}
+
+local b32 http_is_not_modified(HttpRequest *request, HttpResponse *response) {
+    String8 if_none_match = http_headers_get(&request->headers, HttpHeaderId_IfNoneMatch);
+    String8 if_modified_since = http_headers_get(&request->headers, HttpHeaderId_IfModifiedSince);
+    u64 since = 0;
+
+    if (str8_is_valid(if_none_match)) {
+        return http_etag_matches(if_none_match, response->etag, 1);
+    }
+
+    return response->last_modified && str8_is_valid(if_modified_since) &&
+           str8_parse_http_date(if_modified_since, &since) && response->last_modified <= since;
+}
+
+// NOTE: a Range guarded by If-Range only applies while the validator it names is current
+local b32 http_is_range_current(HttpRequest *request, HttpResponse *response) {
+    String8 if_range = str8_trim_whitespace(http_headers_get(&request->headers, HttpHeaderId_IfRange));
+    u64 date = 0;
+
+    if (!str8_is_valid(if_range)) {
+        return 1;
+    }
+
+    if (if_range.len > 0 && (if_range.data[0] == '"' || if_range.data[0] == 'W')) {
+        return http_etag_matches(if_range, response->etag, 0);
+    }
+
+    return response->last_modified && str8_parse_http_date(if_range, &date) && response->last_modified == date;
+}
+
+local void http_respond_multipart(Arena *arena, HttpResponse *response, HttpByteRange *ranges, u32 range_count,
+                                  u64 size) {
+    String8 content_type = http_header_find(response->headers, str8("Content-Type"));
+    String8 boundary = str8_push_u64_hex(arena, hash_u64(hash_string(response->etag) ^ size));
+    String8 *part_heads = push_array(arena, String8, range_count);
+    u64 length = boundary.len + 8;
+
+    if (!part_heads || !str8_is_valid(boundary)) {
+        return;
+    }
+
+    for (u32 index = 0; index < range_count; ++index) {
+        u64 last = ranges[index].first + ranges[index].length - 1;
+
+        if (str8_is_valid(content_type)) {
+            part_heads[index] = str8_pushf(arena, "\r\n--%S\r\nContent-Type: %S\r\nContent-Range: bytes %llu-%llu/%llu\r\n\r\n",
+                                           boundary, content_type, (unsigned long long)ranges[index].first,
+                                           (unsigned long long)last, (unsigned long long)size);
+        } else {
+            part_heads[index] = str8_pushf(arena, "\r\n--%S\r\nContent-Range: bytes %llu-%llu/%llu\r\n\r\n", boundary,
+                                           (unsigned long long)ranges[index].first, (unsigned long long)last,
+                                           (unsigned long long)size);
+        }
+
+        length += part_heads[index].len + ranges[index].length;
+    }
+
+    u8 *data = arena_push(arena, length, 1);
+    u64 offset = 0;
+
+    if (!data) {
+        return;
+    }
+
+    for (u32 index = 0; index < range_count; ++index) {
+        memcpy(data + offset, part_heads[index].data, part_heads[index].len);
+        offset += part_heads[index].len;
+
+        if (!http_read_body(response, data + offset, ranges[index].first, ranges[index].length)) {
+            return;
+        }
+
+        offset += ranges[index].length;
+    }
+
+    String8 tail = str8_pushf(arena, "\r\n--%S--\r\n", boundary);
+    memcpy(data + offset, tail.data, tail.len);
+    offset += tail.len;
+
+    http_drop_header(arena, response, str8("Content-Type"));
+    http_drop_header(arena, response, str8("Content-Length"));
+    http_push_header(arena, response, str8("Content-Type"), str8_pushf(arena, "multipart/byteranges; boundary=%S", boundary));
+
+    response->status = 206;
+    response->body.data = data;
+    response->body.len = offset;
+    response->file_length = 0;
+}
+
+//////////////////////////////
+// Encodings
+
+// NOTE: a precompressed variant, path.br or path.gz next to the file, replaces it along with its
+// validators; the original stays open when there is none
+local b32 http_open_encoded_file(Arena *arena, HttpResponse *response, HttpEncoding encoding) {
+    OS_Handle original = response->file;
+    String8 path = str8_pushf(arena, "%S.%s", response->file_path, encoding == HttpEncoding_Brotli ? "br" : "gz");
+
+    if (!str8_is_valid(path) || !http_response_set_file(arena, response, path)) {
+        return 0;
+    }
+
+    os_close(original);
+
+    return 1;
+}
+
+// NOTE: whether a precompressed variant is served depends on Accept-Encoding as soon as one
+// exists, so its presence alone asks for Vary, even when this client did not get it
+local b32 http_has_encoded_file(Arena *arena, String8 path) {
+    OS_FileInfo info = {0};
+
+    return os_path_info(str8_pushf(arena, "%S.br", path), &info) ||
+           os_path_info(str8_pushf(arena, "%S.gz", path), &info);
+}
+
+// NOTE: each variant needs its own strong validator, so the coding goes inside the quotes
+local String8 http_etag_variant(Arena *arena, String8 etag, HttpEncoding encoding) {
+    if (etag.len < 2 || etag.data[etag.len - 1] != '"') {
+        return etag;
+    }
+
+    return str8_pushf(arena, "%S-%S\"", str8_prefix(etag, etag.len - 1), http_encoding_name(encoding));
+}
+
+local void http_add_vary(Arena *arena, HttpResponse *response, String8 key) {
+    String8 vary = http_header_find(response->headers, str8("Vary"));
+
+    if (!str8_is_valid(vary)) {
+        http_push_header(arena, response, str8("Vary"), key);
+    } else if (!str8_are_equal(str8_trim_whitespace(vary), str8("*")) && str8_find_substring(vary, key.data) == -1) {
+        http_drop_header(arena, response, str8("Vary"));
+        http_push_header(arena, response, str8("Vary"), str8_pushf(arena, "%S, %S", vary, key));
+    }
+}
+
+// NOTE: runs before the validators are compared, so 304s and ranges apply to the encoded body
+// under its own ETag. A file is served from a precompressed variant when there is one, any
+// other compressible body of COMPRESS_MIN_SIZE or more is deflated through the per-thread cache
+local void http_select_encoding(Arena *arena, HttpRequest *request, HttpResponse *response) {
+    if (!compress_is_enabled() || response->status != 200 ||
+        str8_is_valid(http_header_find(response->headers, str8("Content-Encoding")))) {
+        return;
+    }
+
+    String8 accept_encoding = http_headers_get(&request->headers, HttpHeaderId_AcceptEncoding);
+    String8 content_type = http_header_find(response->headers, str8("Content-Type"));
+    b32 is_compressible = str8_is_valid(content_type) && http_is_compressible_type(content_type);
+    b32 has_path = response->file.value && str8_is_valid(response->file_path);
+    HttpEncoding encoding = http_negotiate_encoding(accept_encoding, has_path);
+    b32 is_encoded = 0;
+
+    if (has_path && encoding == HttpEncoding_Brotli) {
+        is_encoded = http_open_encoded_file(arena, response, encoding);
+
+        if (!is_encoded) {
+            encoding = http_negotiate_encoding(accept_encoding, 0);
+        }
+    }
+
+    if (has_path && !is_encoded && encoding == HttpEncoding_Gzip) {
+        is_encoded = http_open_encoded_file(arena, response, encoding);
+    }
+
+    u64 size = response->file.value ? response->file_size : response->body.len;
+
+    // NOTE: a cached variant is sent in place under the reference the response holds
+    if (!is_encoded && is_compressible && encoding != HttpEncoding_Identity && size >= COMPRESS_MIN_SIZE) {
+        CompressVariant **variant_out = &response->compress_variant;
+        String8 compressed = response->file.value ? compress_file(arena, response->file, size, encoding, variant_out)
+                                                  : compress_body(arena, response->body, encoding, variant_out);
+
+        if (str8_is_valid(compressed) && response->file.value) {
+            os_close(response->file);
+            response->file = (OS_Handle){0};
+            response->file_length = 0;
+        }
+
+        if (str8_is_valid(compressed)) {
+            response->body = compressed;
+            is_encoded = 1;
+        }
+    }
+
+    if (is_encoded) {
+        http_drop_header(arena, response, str8("Content-Length"));
+        http_push_header(arena, response, str8("Content-Encoding"), http_encoding_name(encoding));
+        response->etag = http_etag_variant(arena, response->etag, encoding);
+    }
+
+    if (is_encoded || is_compressible || (has_path && http_has_encoded_file(arena, response->file_path))) {
+        http_add_vary(arena, response, str8("Accept-Encoding"));
+    }
+}
+
+// NOTE: called on every handler response before it is serialized. A 200 to a GET or HEAD with
+// validators answers If-None-Match and If-Modified-Since with a 304, and a 200 to a GET answers
+// Range with a 206 or 416. A file body is not read here, except for the parts of a multipart
+// 206, which falls back to the whole file when they do not fit the arena
+void http_prepare_response(Arena *arena, HttpRequest *request, HttpResponse *response) {
+    http_select_encoding(arena, request, response);
+
+    b32 is_get = request->method == HTTP_METHOD_GET;
+    b32 is_conditional = response->status == 200 && (is_get || request->method == HTTP_METHOD_HEAD);
+    u64 size = response->file.value ? response->file_size : response->body.len;
+
+    if (is_conditional && (str8_is_valid(response->etag) || response->last_modified) &&
+        http_is_not_modified(request, response)) {
+        response->status = 304;
+        response->body = (String8){0};
+        http_drop_header(arena, response, str8("Content-Type"));
+        http_drop_header(arena, response, str8("Content-Length"));
+    } else if (is_conditional) {
+        String8 range = http_headers_get(&request->headers, HttpHeaderId_Range);
+        HttpByteRange ranges[HTTP_MAX_RANGES];
+        u32 range_count = 0;
+        HttpRangeResult range_result = HttpRangeResult_Ignore;
+
+        if (is_get && str8_is_valid(range) && http_is_range_current(request, response)) {
+            range_result = http_parse_range(range, size, ranges, &range_count);
+        }
+
+        if (range_result == HttpRangeResult_Unsatisfiable) {
+            response->status = 416;
+            response->body = (String8){0};
+            http_drop_header(arena, response, str8("Content-Length"));
+            http_push_header(arena, response, str8("Content-Range"),
+                             str8_pushf(arena, "bytes */%llu", (unsigned long long)size));
+        } else if (range_result == HttpRangeResult_Satisfiable && range_count == 1) {
+            if (response->file.value) {
+                response->file_offset = ranges[0].first;
+                response->file_length = ranges[0].length;
+            } else {
+                response->body = str8_prefix(str8_skip(response->body, ranges[0].first), ranges[0].length);
+            }
+
+            response->status = 206;
+            http_drop_header(arena, response, str8("Content-Length"));
+            http_push_header(arena, response, str8("Content-Range"),
+                             str8_pushf(arena, "bytes %llu-%llu/%llu", (unsigned long long)ranges[0].first,
+                                        (unsigned long long)(ranges[0].first + ranges[0].length - 1),
+                                        (unsigned long long)size));
+        } else if (range_result == HttpRangeResult_Satisfiable) {
+            http_respond_multipart(arena, response, ranges, range_count, size);
+        }
+
+        if (response->status == 200) {
+            http_push_header(arena, response, str8("Accept-Ranges"), str8("bytes"));
+        }
+    }
+
+    // NOTE: a HEAD only needs the length of a file body. Otherwise the file stays open when its
+    // bytes are the body of a 200 or single range 206, and is closed for anything else
+    b32 is_file_body = request->method != HTTP_METHOD_HEAD && (response->status == 200 || response->status == 206) &&
+                       response->file_length > 0;
+
+    if (response->file.value && response->status == 200 && request->method == HTTP_METHOD_HEAD) {
+        http_push_header(arena, response, str8("Content-Length"), str8_push_u64(arena, size));
+    }
+
+    if (response->file.value && !is_file_body) {
+        os_close(response->file);
+        response->file = (OS_Handle){0};
+        response->file_length = 0;
+    }
+
+    if (response->status == 200 || response->status == 206 || response->status == 304) {
+        if (response->last_modified) {
+            http_push_header(arena, response, str8("Last-Modified"), str8_push_http_date(arena, response->last_modified));
+        }
+
+        http_push_header(arena, response, str8("ETag"), response->etag);
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef HTTP_CONDITIONAL_H
+#define HTTP_CONDITIONAL_H
+
+#include "http.h"
+
+#define HTTP_MAX_RANGES 16
+
+typedef struct HttpByteRange HttpByteRange;
+struct HttpByteRange {
+    u64 first;
+    u64 length;
+};
+
+typedef enum HttpRangeResult {
+    HttpRangeResult_Ignore,
+    HttpRangeResult_Satisfiable,
+    HttpRangeResult_Unsatisfiable,
+} HttpRangeResult;
+
+String8 http_etag_from_hash(Arena *arena, u64 hash, b32 is_weak);
+b32 http_response_set_file(Arena *arena, HttpResponse *response, String8 path);
+
+b32 http_etag_matches(String8 etag_list, String8 etag, b32 is_weak_comparison);
+HttpRangeResult http_parse_range(String8 range, u64 size, HttpByteRange *ranges_out, u32 *range_count_out);
+
+void http_prepare_response(Arena *arena, HttpRequest *request, HttpResponse *response);
+
+#endif // HTTP_CONDITIONAL_H
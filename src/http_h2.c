@@ -0,0 +1,1145 @@
+#include "http_h2.h"
+#include "http_access_log.h"
+#include "http_compress.h"
+#include "http_conditional.h"
+#include "http_rate_limit.h"
+#include "http_trace.h"
+
+global String8 h2_preface = str8_comp("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n");
+
+global String8 h2_upgrade_response = str8_comp(
+    "HTTP/1.1 101 Switching Protocols\r\n"
+    "Connection: Upgrade\r\n"
+    "Upgrade: h2c\r\n"
+    "\r\n");
+
+// NOTE: connection-specific fields have no meaning in HTTP/2 and must not be sent
+global String8 h2_connection_headers[] = {
+    str8_comp("Connection"),
+    str8_comp("Keep-Alive"),
+    str8_comp("Proxy-Connection"),
+    str8_comp("Transfer-Encoding"),
+    str8_comp("Upgrade"),
+};
+
+local void h2_connection_error(ThreadContext *context, struct Request *request, H2Error error);
+local void h2_resume(ThreadContext *context, struct Request *request);
+
+//////////////////////////////
+// Frame writing
+
+local u32 h2_read_u32(u8 *data) {
+    return ((u32)(data[0] & 0xff) << 24) | ((u32)(data[1] & 0xff) << 16) |
+           ((u32)(data[2] & 0xff) << 8) | (u32)(data[3] & 0xff);
+}
+
+local void h2_write_u32(u8 *out, u32 value) {
+    out[0] = (u8)(value >> 24);
+    out[1] = (u8)(value >> 16);
+    out[2] = (u8)(value >> 8);
+    out[3] = (u8)value;
+}
+
+local u8 *h2_push_frame(H2Connection *connection, u32 length, u8 type, u8 flags, u32 stream_id) {
+    if (connection->write_length + H2_FRAME_HEADER_SIZE + length > connection->write_buffer.len) {
+        return 0;
+    }
+
+    u8 *out = connection->write_buffer.data + connection->write_length;
+    out[0] = (u8)(length >> 16);
+    out[1] = (u8)(length >> 8);
+    out[2] = (u8)length;
+    out[3] = type;
+    out[4] = flags;
+    h2_write_u32(out + 5, stream_id & H2_MAX_WINDOW_SIZE);
+
+    connection->write_length += H2_FRAME_HEADER_SIZE + length;
+
+    return out + H2_FRAME_HEADER_SIZE;
+}
+
+local void h2_release_streams(ThreadContext *context, H2Connection *connection);
+
+// NOTE: control frames may use the space held back from response data; a peer that still
+// manages to fill it is not reading and the connection is dropped
+local u8 *h2_push_control(ThreadContext *context, H2Connection *connection, u32 length, u8 type, u8 flags, u32 stream_id) {
+    u8 *payload = h2_push_frame(connection, length, type, flags, stream_id);
+
+    if (!payload && !connection->is_failed) {
+        connection->is_failed = 1;
+        connection->is_draining = 1;
+        h2_release_streams(context, connection);
+    }
+
+    return payload;
+}
+
+local void h2_queue_settings(H2Connection *connection) {
+    u8 *payload = h2_push_frame(connection, 12, H2FrameType_Settings, 0, 0);
+
+    payload[0] = 0;
+    payload[1] = H2Setting_MaxConcurrentStreams;
+    h2_write_u32(payload + 2, H2_MAX_STREAMS);
+    payload[6] = 0;
+    payload[7] = H2Setting_MaxHeaderListSize;
+    h2_write_u32(payload + 8, HPACK_MAX_HEADER_LIST_SIZE);
+}
+
+local void h2_queue_rst_stream(ThreadContext *context, H2Connection *connection, u32 stream_id, H2Error error) {
+    u8 *payload = h2_push_control(context, connection, 4, H2FrameType_RstStream, 0, stream_id);
+
+    if (payload) {
+        h2_write_u32(payload, error);
+    }
+}
+
+local void h2_queue_window_update(ThreadContext *context, H2Connection *connection, u32 stream_id, u32 increment) {
+    u8 *payload = h2_push_control(context, connection, 4, H2FrameType_WindowUpdate, 0, stream_id);
+
+    if (payload) {
+        h2_write_u32(payload, increment);
+    }
+}
+
+//////////////////////////////
+// Streams
+
+local H2Stream *h2_stream_find(H2Connection *connection, u32 stream_id) {
+    for (u32 index = 0; index < H2_MAX_STREAMS; ++index) {
+        if (connection->streams[index].id == stream_id) {
+            return &connection->streams[index];
+        }
+    }
+
+    return 0;
+}
+
+local H2Stream *h2_stream_open(ThreadContext *context, H2Connection *connection, u32 stream_id) {
+    H2Stream *stream = h2_stream_find(connection, 0);
+
+    if (stream) {
+        memset(stream, 0, sizeof(H2Stream));
+        stream->id = stream_id;
+        stream->arena = thread_scratch_alloc(context);
+        stream->recv_window = H2_DEFAULT_WINDOW_SIZE;
+        stream->send_window = connection->peer_initial_window;
+        stream->start_time = access_log_now();
+        connection->stream_count += 1;
+    }
+
+    return stream;
+}
+
+local void h2_stream_release(ThreadContext *context, H2Connection *connection, H2Stream *stream) {
+    if (connection->continuation_stream == stream) {
+        connection->continuation_stream = 0;
+        connection->continuation_arena = 0;
+    }
+
+    if (stream->response_file.value) {
+        os_close(stream->response_file);
+    }
+
+    if (stream->response_variant) {
+        compress_variant_release(stream->response_variant);
+    }
+
+    thread_scratch_release(context, stream->arena);
+    memset(stream, 0, sizeof(H2Stream));
+    connection->stream_count -= 1;
+}
+
+local void h2_stream_reset(ThreadContext *context, H2Connection *connection, H2Stream *stream, H2Error error) {
+    h2_queue_rst_stream(context, connection, stream->id, error);
+    h2_stream_release(context, connection, stream);
+}
+
+local void h2_release_streams(ThreadContext *context, H2Connection *connection) {
+    if (connection->continuation_arena && !connection->continuation_stream) {
+        thread_scratch_release(context, connection->continuation_arena);
+    }
+
+    connection->continuation_stream_id = 0;
+    connection->continuation_stream = 0;
+    connection->continuation_arena = 0;
+
+    for (u32 index = 0; index < H2_MAX_STREAMS; ++index) {
+        if (connection->streams[index].id != 0) {
+            h2_stream_release(context, connection, &connection->streams[index]);
+        }
+    }
+}
+
+local b32 h2_is_connection_header(String8 key) {
+    for (u32 index = 0; index < array_count(h2_connection_headers); ++index) {
+        if (str8_are_equal_case_insensitive(key, h2_connection_headers[index])) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+local void h2_stream_respond(ThreadContext *context, H2Connection *connection, H2Stream *stream, HttpResponse *response) {
+    b32 has_content_length = str8_is_valid(http_header_find(response->headers, str8("Content-Length")));
+    b32 needs_content_length = !has_content_length && response->status != 204 && response->status != 304;
+    u64 body_length = response->file.value ? response->file_length : response->body.len;
+    u8 length_buffer[STR8_U64_MAX_SIZE];
+    String8 content_length = {0, length_buffer};
+    u64 capacity = 16;
+
+    if (needs_content_length) {
+        content_length.len = str8_write_u64(length_buffer, body_length);
+        capacity += hpack_encoded_header_size(str8("content-length"), content_length);
+    }
+
+    for (HttpHeader *header = response->headers; header != 0; header = header->next) {
+        capacity += hpack_encoded_header_size(header->key, header->value);
+    }
+
+    String8 block = {0};
+    block.data = arena_push(stream->arena, capacity, 8);
+
+    // NOTE: the stream owns the file and any cached variant from here, so releasing it closes
+    // the file and drops the reference too
+    stream->response_file = response->file;
+    stream->response_file_offset = response->file_offset;
+    stream->response_variant = response->compress_variant;
+
+    if (!block.data) {
+        h2_stream_reset(context, connection, stream, H2Error_Internal);
+        return;
+    }
+
+    block.len += hpack_encode_status(block.data, response->status);
+
+    for (HttpHeader *header = response->headers; header != 0; header = header->next) {
+        if (!h2_is_connection_header(header->key)) {
+            block.len += hpack_encode_header(block.data + block.len, header->key, header->value);
+        }
+    }
+
+    if (needs_content_length) {
+        block.len += hpack_encode_header(block.data + block.len, str8("content-length"), content_length);
+    }
+
+    stream->is_responding = 1;
+    stream->response_head = block;
+    stream->response_body = response->body;
+    stream->response_length = body_length;
+
+    if (stream->request.method == HTTP_METHOD_HEAD) {
+        stream->response_body = (String8){0};
+        stream->response_length = 0;
+    }
+}
+
+local void h2_stream_dispatch(ThreadContext *context, struct Request *request, H2Stream *stream) {
+    H2Connection *connection = request->h2;
+    HttpRequest *http_request = &stream->request;
+    HttpResponse response = {0};
+
+    if (stream->is_body_too_large) {
+        response.is_valid = 1;
+        response.version = HTTP_VERSION_20;
+        response.status = 413;
+    } else if (!rate_limit_allow_request(request, http_request->path)) {
+        response.is_valid = 1;
+        response.version = HTTP_VERSION_20;
+        response.status = 429;
+    } else {
+        trace_begin(connection, TraceStage_Handler);
+        server_run_handler(stream->arena, &stream->request, &response);
+        trace_end(connection, TraceStage_Handler);
+        http_prepare_response(stream->arena, http_request, &response);
+    }
+
+    // NOTE: a failed response resets the stream, which clears it, so the record is written first
+    u64 body_length = response.file.value ? response.file_length : response.body.len;
+
+    if (http_request->method == HTTP_METHOD_HEAD) {
+        body_length = 0;
+    }
+
+    access_log_record(request, stream->start_time, AccessLogFlag_Http2, http_request->method, http_request->path,
+                      response.status, body_length);
+
+    h2_stream_respond(context, connection, stream, &response);
+}
+
+// NOTE: returns 0 once the write buffer is full, so the caller can stop visiting streams
+local b32 h2_stream_write(ThreadContext *context, H2Connection *connection, H2Stream *stream) {
+    u64 max_frame_size = Min(connection->peer_max_frame_size, H2_MAX_FRAME_SIZE);
+    u64 limit = connection->write_buffer.len - H2_CONTROL_RESERVE;
+
+    if (!stream->is_head_sent) {
+        String8 head = stream->response_head;
+        u64 frame_count = head.len / max_frame_size + 1;
+        b32 end_stream = stream->response_length == 0;
+        u8 type = H2FrameType_Headers;
+
+        if (connection->write_length + head.len + frame_count * H2_FRAME_HEADER_SIZE > limit) {
+            return 0;
+        }
+
+        do {
+            u64 fragment_length = Min(head.len, max_frame_size);
+            u8 flags = 0;
+
+            if (type == H2FrameType_Headers && end_stream) {
+                flags |= H2_FLAG_END_STREAM;
+            }
+
+            if (fragment_length == head.len) {
+                flags |= H2_FLAG_END_HEADERS;
+            }
+
+            u8 *payload = h2_push_frame(connection, fragment_length, type, flags, stream->id);
+            memcpy(payload, head.data, fragment_length);
+
+            head = str8_skip(head, fragment_length);
+            type = H2FrameType_Continuation;
+        } while (head.len > 0);
+
+        stream->is_head_sent = 1;
+    }
+
+    while (stream->response_offset < stream->response_length) {
+        i64 window = Min(stream->send_window, connection->send_window);
+
+        if (window <= 0) {
+            return 1;
+        }
+
+        if (connection->write_length + H2_FRAME_HEADER_SIZE >= limit) {
+            return 0;
+        }
+
+        u64 chunk = stream->response_length - stream->response_offset;
+        chunk = Min(chunk, (u64)window);
+        chunk = Min(chunk, max_frame_size);
+        chunk = Min(chunk, limit - connection->write_length - H2_FRAME_HEADER_SIZE);
+
+        b32 is_last = stream->response_offset + chunk == stream->response_length;
+        u8 *payload = h2_push_frame(connection, chunk, H2FrameType_Data, is_last ? H2_FLAG_END_STREAM : 0, stream->id);
+
+        if (!stream->response_file.value) {
+            memcpy(payload, stream->response_body.data + stream->response_offset, chunk);
+        } else if (os_read_at(stream->response_file, payload, chunk, stream->response_file_offset + stream->response_offset) !=
+                   (i64)chunk) {
+            // NOTE: a file that shrank since its length was sent cannot finish the body; the frame
+            // is taken back and the stream reset
+            connection->write_length -= H2_FRAME_HEADER_SIZE + chunk;
+            h2_stream_reset(context, connection, stream, H2Error_Internal);
+            return 1;
+        }
+
+        stream->response_offset += chunk;
+        stream->send_window -= chunk;
+        connection->send_window -= chunk;
+    }
+
+    h2_stream_release(context, connection, stream);
+
+    return 1;
+}
+
+local void h2_pump_streams(ThreadContext *context, H2Connection *connection) {
+    // NOTE: the starting stream rotates so one large response cannot starve the others
+    for (u32 visited = 0; visited < H2_MAX_STREAMS; ++visited) {
+        H2Stream *stream = &connection->streams[(connection->next_stream_index + visited) % H2_MAX_STREAMS];
+
+        if (stream->id == 0 || !stream->is_responding) {
+            continue;
+        }
+
+        if (!h2_stream_write(context, connection, stream)) {
+            break;
+        }
+    }
+
+    connection->next_stream_index = (connection->next_stream_index + 1) % H2_MAX_STREAMS;
+}
+
+//////////////////////////////
+// Frame handling
+
+local b32 h2_build_request(Arena *arena, HttpRequest *request, HttpHeader *headers) {
+    HttpHeader *fields = 0;
+    HttpHeader *last = 0;
+    String8 authority = {0};
+    b32 has_method = 0;
+
+    request->is_valid = 1;
+    request->version = HTTP_VERSION_20;
+    request->method = HTTP_METHOD_UNKNOWN;
+
+    for (HttpHeader *header = headers, *next = 0; header != 0; header = next) {
+        next = header->next;
+        header->next = 0;
+
+        if (header->key.len > 0 && header->key.data[0] == ':') {
+            // NOTE: pseudo-headers must precede regular fields
+            if (last) {
+                return 0;
+            }
+
+            if (str8_are_equal(header->key, str8(":method"))) {
+                request->method = http_method_from_string(header->value);
+                has_method = 1;
+            } else if (str8_are_equal(header->key, str8(":path"))) {
+                request->path = header->value;
+            } else if (str8_are_equal(header->key, str8(":authority"))) {
+                authority = header->value;
+            } else if (!str8_are_equal(header->key, str8(":scheme"))) {
+                return 0;
+            }
+
+            continue;
+        }
+
+        if (last) {
+            last->next = header;
+        } else {
+            fields = header;
+        }
+
+        last = header;
+    }
+
+    if (!has_method || request->path.len == 0) {
+        return 0;
+    }
+
+    // NOTE: handlers written against HTTP/1.1 look for Host
+    if (authority.len > 0 && !str8_is_valid(http_header_find(fields, str8("Host")))) {
+        HttpHeader *host = push_struct_zero(arena, HttpHeader);
+
+        if (!host) {
+            return 0;
+        }
+
+        host->key = str8("host");
+        host->value = authority;
+        host->next = fields;
+        fields = host;
+    }
+
+    return http_headers_from_list(arena, fields, &request->headers);
+}
+
+local void h2_on_header_block(ThreadContext *context, struct Request *request, u32 stream_id, H2Stream *stream, Scratch *arena, String8 block, b32 end_stream) {
+    H2Connection *connection = request->h2;
+    HttpHeader *headers = 0;
+
+    connection->continuation_stream_id = 0;
+    connection->continuation_stream = 0;
+    connection->continuation_arena = 0;
+
+    // NOTE: the block is decoded even for refused streams to keep the HPACK table in sync
+    b32 is_decoded = hpack_decode(arena, &connection->decoder, block, &headers);
+
+    if (!stream) {
+        thread_scratch_release(context, arena);
+    }
+
+    if (!is_decoded) {
+        h2_connection_error(context, request, H2Error_Compression);
+        return;
+    }
+
+    if (!stream) {
+        h2_queue_rst_stream(context, connection, stream_id, H2Error_RefusedStream);
+        return;
+    }
+
+    // NOTE: trailers are accepted and dropped
+    if (!stream->has_headers) {
+        stream->has_headers = 1;
+
+        if (!h2_build_request(stream->arena, &stream->request, headers)) {
+            h2_stream_reset(context, connection, stream, H2Error_Protocol);
+            return;
+        }
+    }
+
+    if (end_stream) {
+        stream->is_request_complete = 1;
+        h2_stream_dispatch(context, request, stream);
+    }
+}
+
+local b32 h2_strip_padding(H2FrameHeader *frame, String8 *payload) {
+    if (frame->flags & H2_FLAG_PADDED) {
+        if (payload->len == 0) {
+            return 0;
+        }
+
+        u64 pad_length = payload->data[0] & 0xff;
+        *payload = str8_skip(*payload, 1);
+
+        if (pad_length > payload->len) {
+            return 0;
+        }
+
+        payload->len -= pad_length;
+    }
+
+    return 1;
+}
+
+local void h2_on_headers(ThreadContext *context, struct Request *request, H2FrameHeader *frame, String8 payload) {
+    H2Connection *connection = request->h2;
+    b32 end_stream = (frame->flags & H2_FLAG_END_STREAM) != 0;
+
+    if (frame->stream_id == 0 || (frame->stream_id & 1) == 0 || !h2_strip_padding(frame, &payload)) {
+        h2_connection_error(context, request, H2Error_Protocol);
+        return;
+    }
+
+    if (frame->flags & H2_FLAG_PRIORITY) {
+        if (payload.len < 5) {
+            h2_connection_error(context, request, H2Error_Protocol);
+            return;
+        }
+
+        payload = str8_skip(payload, 5);
+    }
+
+    H2Stream *stream = h2_stream_find(connection, frame->stream_id);
+    Scratch *arena = 0;
+
+    if (stream) {
+        if (stream->is_request_complete) {
+            h2_connection_error(context, request, H2Error_StreamClosed);
+            return;
+        }
+
+        if (!end_stream) {
+            h2_connection_error(context, request, H2Error_Protocol);
+            return;
+        }
+
+        arena = stream->arena;
+    } else {
+        if (frame->stream_id <= connection->last_stream_id) {
+            h2_connection_error(context, request, H2Error_StreamClosed);
+            return;
+        }
+
+        connection->last_stream_id = frame->stream_id;
+
+        if (!connection->is_draining) {
+            stream = h2_stream_open(context, connection, frame->stream_id);
+        }
+
+        arena = stream ? stream->arena : thread_scratch_alloc(context);
+    }
+
+    if (frame->flags & H2_FLAG_END_HEADERS) {
+        h2_on_header_block(context, request, frame->stream_id, stream, arena, payload, end_stream);
+        return;
+    }
+
+    connection->continuation_stream_id = frame->stream_id;
+    connection->continuation_stream = stream;
+    connection->continuation_arena = arena;
+    connection->continuation_end_stream = end_stream;
+    connection->continuation_block.data = arena_push(arena, H2_MAX_HEADER_BLOCK_SIZE, 8);
+    connection->continuation_block.len = 0;
+
+    if (!connection->continuation_block.data || payload.len > H2_MAX_HEADER_BLOCK_SIZE) {
+        h2_connection_error(context, request, H2Error_EnhanceYourCalm);
+        return;
+    }
+
+    memcpy(connection->continuation_block.data, payload.data, payload.len);
+    connection->continuation_block.len = payload.len;
+}
+
+local void h2_on_continuation(ThreadContext *context, struct Request *request, H2FrameHeader *frame, String8 payload) {
+    H2Connection *connection = request->h2;
+    String8 *block = &connection->continuation_block;
+
+    if (block->len + payload.len > H2_MAX_HEADER_BLOCK_SIZE) {
+        h2_connection_error(context, request, H2Error_EnhanceYourCalm);
+        return;
+    }
+
+    memcpy(block->data + block->len, payload.data, payload.len);
+    block->len += payload.len;
+
+    if (frame->flags & H2_FLAG_END_HEADERS) {
+        h2_on_header_block(context, request, connection->continuation_stream_id, connection->continuation_stream,
+                           connection->continuation_arena, *block, connection->continuation_end_stream);
+    }
+}
+
+local void h2_on_data(ThreadContext *context, struct Request *request, H2FrameHeader *frame, String8 payload) {
+    H2Connection *connection = request->h2;
+    u64 flow_length = frame->length;
+
+    if (frame->stream_id == 0) {
+        h2_connection_error(context, request, H2Error_Protocol);
+        return;
+    }
+
+    if (flow_length > connection->recv_window) {
+        h2_connection_error(context, request, H2Error_FlowControl);
+        return;
+    }
+
+    connection->recv_window -= flow_length;
+    connection->recv_unacked += flow_length;
+
+    if (!h2_strip_padding(frame, &payload)) {
+        h2_connection_error(context, request, H2Error_Protocol);
+        return;
+    }
+
+    H2Stream *stream = h2_stream_find(connection, frame->stream_id);
+
+    if (!stream || !stream->has_headers || stream->is_request_complete) {
+        if (frame->stream_id > connection->last_stream_id) {
+            h2_connection_error(context, request, H2Error_Protocol);
+        } else if (stream) {
+            h2_stream_reset(context, connection, stream, H2Error_StreamClosed);
+        }
+
+        return;
+    }
+
+    if (flow_length > stream->recv_window) {
+        h2_stream_reset(context, connection, stream, H2Error_FlowControl);
+        return;
+    }
+
+    stream->recv_window -= flow_length;
+    stream->recv_unacked += flow_length;
+
+    // NOTE: bodies past the limit are still drained, so the peer is answered with a 413
+    if (stream->request.body.len + payload.len > H2_MAX_REQUEST_BODY_SIZE) {
+        stream->is_body_too_large = 1;
+    }
+
+    if (!stream->is_body_too_large && payload.len > 0) {
+        if (stream->body_capacity == 0) {
+            stream->request.body.data = arena_push(stream->arena, H2_MAX_REQUEST_BODY_SIZE, 8);
+            stream->request.body.len = 0;
+            stream->body_capacity = H2_MAX_REQUEST_BODY_SIZE;
+        }
+
+        if (!stream->request.body.data) {
+            stream->is_body_too_large = 1;
+        } else {
+            memcpy(stream->request.body.data + stream->request.body.len, payload.data, payload.len);
+            stream->request.body.len += payload.len;
+        }
+    }
+
+    if (frame->flags & H2_FLAG_END_STREAM) {
+        stream->is_request_complete = 1;
+        h2_stream_dispatch(context, request, stream);
+    }
+}
+
+local b32 h2_apply_settings(ThreadContext *context, H2Connection *connection, String8 payload, H2Error *error_out) {
+    for (u64 pos = 0; pos + 6 <= payload.len; pos += 6) {
+        u32 id = ((u32)(payload.data[pos] & 0xff) << 8) | (u32)(payload.data[pos + 1] & 0xff);
+        u32 value = h2_read_u32(payload.data + pos + 2);
+
+        switch (id) {
+        case H2Setting_EnablePush:
+            if (value > 1) {
+                *error_out = H2Error_Protocol;
+                return 0;
+            }
+            break;
+        case H2Setting_InitialWindowSize: {
+            if (value > H2_MAX_WINDOW_SIZE) {
+                *error_out = H2Error_FlowControl;
+                return 0;
+            }
+
+            i64 delta = (i64)value - (i64)connection->peer_initial_window;
+
+            for (u32 index = 0; index < H2_MAX_STREAMS; ++index) {
+                H2Stream *stream = &connection->streams[index];
+
+                if (stream->id != 0) {
+                    stream->send_window += delta;
+
+                    if (stream->send_window > H2_MAX_WINDOW_SIZE) {
+                        *error_out = H2Error_FlowControl;
+                        return 0;
+                    }
+                }
+            }
+
+            connection->peer_initial_window = value;
+        } break;
+        case H2Setting_MaxFrameSize:
+            if (value < H2_MAX_FRAME_SIZE || value > 0xffffff) {
+                *error_out = H2Error_Protocol;
+                return 0;
+            }
+
+            connection->peer_max_frame_size = value;
+            break;
+        default:
+            // NOTE: the encoder never indexes, so the peer's table size does not matter
+            break;
+        }
+    }
+
+    return 1;
+}
+
+local void h2_on_window_update(ThreadContext *context, struct Request *request, H2FrameHeader *frame, String8 payload) {
+    H2Connection *connection = request->h2;
+
+    if (payload.len != 4) {
+        h2_connection_error(context, request, H2Error_FrameSize);
+        return;
+    }
+
+    u32 increment = h2_read_u32(payload.data) & H2_MAX_WINDOW_SIZE;
+
+    if (frame->stream_id == 0) {
+        if (increment == 0) {
+            h2_connection_error(context, request, H2Error_Protocol);
+        } else if (connection->send_window + increment > H2_MAX_WINDOW_SIZE) {
+            h2_connection_error(context, request, H2Error_FlowControl);
+        } else {
+            connection->send_window += increment;
+        }
+
+        return;
+    }
+
+    H2Stream *stream = h2_stream_find(connection, frame->stream_id);
+
+    if (!stream) {
+        if (frame->stream_id > connection->last_stream_id) {
+            h2_connection_error(context, request, H2Error_Protocol);
+        }
+
+        return;
+    }
+
+    if (increment == 0) {
+        h2_stream_reset(context, connection, stream, H2Error_Protocol);
+    } else if (stream->send_window + increment > H2_MAX_WINDOW_SIZE) {
+        h2_stream_reset(context, connection, stream, H2Error_FlowControl);
+    } else {
+        stream->send_window += increment;
+    }
+}
+
+local void h2_on_frame(ThreadContext *context, struct Request *request, H2FrameHeader *frame, String8 payload) {
+    H2Connection *connection = request->h2;
+
+    if (connection->continuation_stream_id != 0 &&
+        (frame->type != H2FrameType_Continuation || frame->stream_id != connection->continuation_stream_id)) {
+        h2_connection_error(context, request, H2Error_Protocol);
+        return;
+    }
+
+    switch (frame->type) {
+    case H2FrameType_Data:
+        h2_on_data(context, request, frame, payload);
+        break;
+    case H2FrameType_Headers:
+        h2_on_headers(context, request, frame, payload);
+        break;
+    case H2FrameType_Priority:
+        if (frame->stream_id == 0) {
+            h2_connection_error(context, request, H2Error_Protocol);
+        } else if (payload.len != 5) {
+            h2_queue_rst_stream(context, connection, frame->stream_id, H2Error_FrameSize);
+        }
+        break;
+    case H2FrameType_RstStream: {
+        if (frame->stream_id == 0 || frame->stream_id > connection->last_stream_id) {
+            h2_connection_error(context, request, H2Error_Protocol);
+            break;
+        }
+
+        if (payload.len != 4) {
+            h2_connection_error(context, request, H2Error_FrameSize);
+            break;
+        }
+
+        H2Stream *stream = h2_stream_find(connection, frame->stream_id);
+
+        if (stream) {
+            h2_stream_release(context, connection, stream);
+        }
+    } break;
+    case H2FrameType_Settings: {
+        H2Error error = H2Error_None;
+
+        if (frame->stream_id != 0) {
+            h2_connection_error(context, request, H2Error_Protocol);
+            break;
+        }
+
+        if (frame->flags & H2_FLAG_ACK) {
+            if (payload.len != 0) {
+                h2_connection_error(context, request, H2Error_FrameSize);
+            }
+            break;
+        }
+
+        if (payload.len % 6 != 0) {
+            h2_connection_error(context, request, H2Error_FrameSize);
+            break;
+        }
+
+        if (!h2_apply_settings(context, connection, payload, &error)) {
+            h2_connection_error(context, request, error);
+            break;
+        }
+
+        h2_push_control(context, connection, 0, H2FrameType_Settings, H2_FLAG_ACK, 0);
+    } break;
+    case H2FrameType_Ping: {
+        if (frame->stream_id != 0) {
+            h2_connection_error(context, request, H2Error_Protocol);
+            break;
+        }
+
+        if (payload.len != 8) {
+            h2_connection_error(context, request, H2Error_FrameSize);
+            break;
+        }
+
+        if (frame->flags & H2_FLAG_ACK) {
+            break;
+        }
+
+        u8 *ack = h2_push_control(context, connection, 8, H2FrameType_Ping, H2_FLAG_ACK, 0);
+
+        if (ack) {
+            memcpy(ack, payload.data, 8);
+        }
+    } break;
+    case H2FrameType_GoAway:
+        if (frame->stream_id != 0) {
+            h2_connection_error(context, request, H2Error_Protocol);
+            break;
+        }
+
+        connection->is_draining = 1;
+        break;
+    case H2FrameType_WindowUpdate:
+        h2_on_window_update(context, request, frame, payload);
+        break;
+    case H2FrameType_Continuation:
+        if (connection->continuation_stream_id == 0) {
+            h2_connection_error(context, request, H2Error_Protocol);
+            break;
+        }
+
+        h2_on_continuation(context, request, frame, payload);
+        break;
+    case H2FrameType_PushPromise:
+        h2_connection_error(context, request, H2Error_Protocol);
+        break;
+    default:
+        // NOTE: unknown frame types are ignored
+        break;
+    }
+}
+
+local void h2_send_window_updates(ThreadContext *context, H2Connection *connection) {
+    // NOTE: window updates are batched per read and only sent once half a window is consumed
+    if (connection->recv_unacked >= H2_DEFAULT_WINDOW_SIZE / 2) {
+        h2_queue_window_update(context, connection, 0, connection->recv_unacked);
+        connection->recv_window += connection->recv_unacked;
+        connection->recv_unacked = 0;
+    }
+
+    for (u32 index = 0; index < H2_MAX_STREAMS && !connection->is_failed; ++index) {
+        H2Stream *stream = &connection->streams[index];
+
+        if (stream->id != 0 && !stream->is_request_complete && stream->recv_unacked >= H2_DEFAULT_WINDOW_SIZE / 2) {
+            h2_queue_window_update(context, connection, stream->id, stream->recv_unacked);
+            stream->recv_window += stream->recv_unacked;
+            stream->recv_unacked = 0;
+        }
+    }
+}
+
+local void h2_process_input(ThreadContext *context, struct Request *request) {
+    H2Connection *connection = request->h2;
+    String8 input = str8_prefix(request->request_buffer, request->request_length);
+    u64 consumed = 0;
+
+    if (connection->expects_preface) {
+        u64 compare_length = Min(input.len, H2_PREFACE_SIZE);
+
+        if (memcmp(input.data, h2_preface.data, compare_length) != 0) {
+            h2_connection_error(context, request, H2Error_Protocol);
+            return;
+        }
+
+        if (input.len < H2_PREFACE_SIZE) {
+            return;
+        }
+
+        consumed = H2_PREFACE_SIZE;
+        connection->expects_preface = 0;
+    }
+
+    while (!connection->is_failed) {
+        String8 rest = str8_skip(input, consumed);
+
+        if (rest.len < H2_FRAME_HEADER_SIZE) {
+            break;
+        }
+
+        H2FrameHeader frame = {0};
+        frame.length = ((u32)(rest.data[0] & 0xff) << 16) | ((u32)(rest.data[1] & 0xff) << 8) | (u32)(rest.data[2] & 0xff);
+        frame.type = rest.data[3];
+        frame.flags = rest.data[4];
+        frame.stream_id = h2_read_u32(rest.data + 5) & H2_MAX_WINDOW_SIZE;
+
+        if (frame.length > H2_MAX_FRAME_SIZE) {
+            h2_connection_error(context, request, H2Error_FrameSize);
+            break;
+        }
+
+        if (rest.len < H2_FRAME_HEADER_SIZE + frame.length) {
+            break;
+        }
+
+        h2_on_frame(context, request, &frame, str8_prefix(str8_skip(rest, H2_FRAME_HEADER_SIZE), frame.length));
+        consumed += H2_FRAME_HEADER_SIZE + frame.length;
+    }
+
+    if (connection->is_failed) {
+        request->request_length = 0;
+        return;
+    }
+
+    memmove(input.data, input.data + consumed, input.len - consumed);
+    request->request_length = input.len - consumed;
+
+    h2_send_window_updates(context, connection);
+}
+
+//////////////////////////////
+// Connection
+
+local void h2_connection_error(ThreadContext *context, struct Request *request, H2Error error) {
+    H2Connection *connection = request->h2;
+
+    if (connection->is_failed) {
+        return;
+    }
+
+    u8 *payload = h2_push_control(context, connection, 8, H2FrameType_GoAway, 0, 0);
+
+    if (payload) {
+        h2_write_u32(payload, connection->last_stream_id);
+        h2_write_u32(payload + 4, error);
+    }
+
+    log_error("h2 connection error %d\n", error);
+
+    connection->is_failed = 1;
+    connection->is_draining = 1;
+    h2_release_streams(context, connection);
+}
+
+local void h2_close(ThreadContext *context, struct Request *request) {
+    H2Connection *connection = request->h2;
+
+    // NOTE: shutting the socket down completes the outstanding read, whose buffer must
+    // not be released before it does
+    if (!connection->is_closing) {
+        connection->is_closing = 1;
+        os_shutdown(request->client_handle);
+    }
+
+    if (connection->is_receiving || connection->send_length > 0) {
+        return;
+    }
+
+    h2_release_streams(context, connection);
+    thread_scratch_release(context, connection->write_arena);
+    thread_scratch_release(context, connection->arena);
+    request_close(context, request);
+}
+
+local void h2_flush(ThreadContext *context, struct Request *request) {
+    H2Connection *connection = request->h2;
+
+    if (connection->is_closing || connection->send_length > 0 || connection->write_length == 0) {
+        return;
+    }
+
+    connection->send_length = connection->write_length;
+    request->response_buffer = str8_prefix(connection->write_buffer, connection->send_length);
+
+    if (!submit_send(context, request)) {
+        connection->send_length = 0;
+        h2_close(context, request);
+    }
+}
+
+local void h2_resume(ThreadContext *context, struct Request *request) {
+    H2Connection *connection = request->h2;
+
+    if (!connection->is_failed) {
+        h2_pump_streams(context, connection);
+    }
+
+    h2_flush(context, request);
+
+    if (connection->is_closing) {
+        return;
+    }
+
+    if (connection->is_draining && connection->stream_count == 0 && connection->write_length == 0) {
+        h2_close(context, request);
+        return;
+    }
+
+    if (!connection->is_receiving && !connection->is_failed) {
+        connection->is_receiving = 1;
+
+        if (!submit_read(context, request)) {
+            connection->is_receiving = 0;
+            h2_close(context, request);
+        }
+    }
+}
+
+local H2Connection *h2_connection_alloc(ThreadContext *context, struct Request *request, String8 leftover) {
+    Scratch *arena = thread_scratch_alloc(context);
+    H2Connection *connection = push_struct_zero(arena, H2Connection);
+    connection->arena = arena;
+    connection->trace_id = request->trace_id;
+    connection->write_arena = thread_scratch_alloc(context);
+    connection->write_buffer.data = arena_push(connection->write_arena, H2_WRITE_BUFFER_SIZE, 8);
+    connection->write_buffer.len = H2_WRITE_BUFFER_SIZE;
+    connection->send_window = H2_DEFAULT_WINDOW_SIZE;
+    connection->recv_window = H2_DEFAULT_WINDOW_SIZE;
+    connection->peer_initial_window = H2_DEFAULT_WINDOW_SIZE;
+    connection->peer_max_frame_size = H2_MAX_FRAME_SIZE;
+
+    hpack_table_init(arena, &connection->decoder);
+
+    // NOTE: the request buffer is swapped for one that holds a full frame, and bytes that
+    // arrived behind the preface or upgrade request carry over
+    String8 read_buffer = {0};
+    read_buffer.data = arena_push(arena, H2_READ_BUFFER_SIZE, 8);
+    read_buffer.len = H2_READ_BUFFER_SIZE;
+    memcpy(read_buffer.data, leftover.data, leftover.len);
+
+    request->request_buffer = read_buffer;
+    request->request_length = leftover.len;
+    request->event_type = EventType_H2Read;
+    request->send_event_type = EventType_H2Write;
+    request->h2 = connection;
+
+    return connection;
+}
+
+b32 h2_matches_preface(String8 received) {
+    u64 compare_length = Min(received.len, H2_PREFACE_SIZE);
+
+    return memcmp(received.data, h2_preface.data, compare_length) == 0;
+}
+
+void h2_begin(ThreadContext *context, struct Request *request) {
+    String8 received = str8_prefix(request->request_buffer, request->request_length);
+    H2Connection *connection = h2_connection_alloc(context, request, str8_skip(received, H2_PREFACE_SIZE));
+
+    h2_queue_settings(connection);
+    h2_process_input(context, request);
+    h2_resume(context, request);
+}
+
+b32 h2_begin_upgrade(ThreadContext *context, struct Request *request, HttpRequest *http_request, u64 head_length) {
+    String8 encoded_settings = http_headers_get(&http_request->headers, HttpHeaderId_Http2Settings);
+    u8 settings_buffer[H2_MAX_STREAMS * 6];
+    String8 settings = {0, settings_buffer};
+
+    if (!str8_is_valid(encoded_settings) || encoded_settings.len > sizeof(settings_buffer) * 4 / 3) {
+        return 0;
+    }
+
+    if (!str8_base64_decode(encoded_settings, settings.data, &settings.len) || settings.len % 6 != 0) {
+        return 0;
+    }
+
+    String8 received = str8_prefix(request->request_buffer, request->request_length);
+    H2Connection *connection = h2_connection_alloc(context, request, str8_skip(received, head_length));
+    H2Error error = H2Error_None;
+
+    memcpy(connection->write_buffer.data, h2_upgrade_response.data, h2_upgrade_response.len);
+    connection->write_length = h2_upgrade_response.len;
+    connection->expects_preface = 1;
+
+    h2_queue_settings(connection);
+
+    if (!h2_apply_settings(context, connection, settings, &error)) {
+        h2_connection_error(context, request, error);
+        h2_resume(context, request);
+        return 1;
+    }
+
+    // NOTE: the upgraded request becomes stream 1, already half-closed by the client
+    H2Stream *stream = h2_stream_open(context, connection, 1);
+    stream->has_headers = 1;
+    stream->is_request_complete = 1;
+    stream->request = *http_request;
+    stream->request.version = HTTP_VERSION_20;
+    stream->request.body = (String8){0};
+    connection->last_stream_id = 1;
+
+    h2_stream_dispatch(context, request, stream);
+    h2_process_input(context, request);
+    h2_resume(context, request);
+
+    return 1;
+}
+
+void h2_on_read(ThreadContext *context, struct Request *request, i32 result) {
+    H2Connection *connection = request->h2;
+    connection->is_receiving = 0;
+
+    if (connection->is_closing || result <= 0) {
+        h2_close(context, request);
+        return;
+    }
+
+    request->request_length += result;
+
+    h2_process_input(context, request);
+    h2_resume(context, request);
+}
+
+void h2_on_write(ThreadContext *context, struct Request *request, i32 result) {
+    H2Connection *connection = request->h2;
+
+    if (result <= 0) {
+        connection->send_length = 0;
+        h2_close(context, request);
+        return;
+    }
+
+    memmove(connection->write_buffer.data, connection->write_buffer.data + result, connection->write_length - result);
+    connection->write_length -= result;
+    connection->send_length = 0;
+
+    if (connection->is_closing) {
+        h2_close(context, request);
+        return;
+    }
+
+    h2_resume(context, request);
+}
@@ -0,0 +1,141 @@
+#ifndef HTTP_H2_H
+#define HTTP_H2_H
+
+#include "http_hpack.h"
+#include "http_server.h"
+
+#define H2_PREFACE_SIZE 24
+#define H2_FRAME_HEADER_SIZE 9
+#define H2_MAX_FRAME_SIZE 16384
+#define H2_READ_BUFFER_SIZE (H2_FRAME_HEADER_SIZE + H2_MAX_FRAME_SIZE)
+#define H2_WRITE_BUFFER_SIZE (24 * 1024)
+#define H2_CONTROL_RESERVE 512
+#define H2_MAX_STREAMS 32
+#define H2_MAX_HEADER_BLOCK_SIZE (8 * 1024)
+#define H2_MAX_REQUEST_BODY_SIZE (8 * 1024)
+#define H2_DEFAULT_WINDOW_SIZE 65535
+#define H2_MAX_WINDOW_SIZE 0x7fffffff
+
+typedef enum H2FrameType {
+    H2FrameType_Data = 0x0,
+    H2FrameType_Headers = 0x1,
+    H2FrameType_Priority = 0x2,
+    H2FrameType_RstStream = 0x3,
+    H2FrameType_Settings = 0x4,
+    H2FrameType_PushPromise = 0x5,
+    H2FrameType_Ping = 0x6,
+    H2FrameType_GoAway = 0x7,
+    H2FrameType_WindowUpdate = 0x8,
+    H2FrameType_Continuation = 0x9,
+} H2FrameType;
+
+#define H2_FLAG_END_STREAM 0x1
+#define H2_FLAG_ACK 0x1
+#define H2_FLAG_END_HEADERS 0x4
+#define H2_FLAG_PADDED 0x8
+#define H2_FLAG_PRIORITY 0x20
+
+typedef enum H2Error {
+    H2Error_None = 0x0,
+    H2Error_Protocol = 0x1,
+    H2Error_Internal = 0x2,
+    H2Error_FlowControl = 0x3,
+    H2Error_StreamClosed = 0x5,
+    H2Error_FrameSize = 0x6,
+    H2Error_RefusedStream = 0x7,
+    H2Error_Cancel = 0x8,
+    H2Error_Compression = 0x9,
+    H2Error_EnhanceYourCalm = 0xb,
+} H2Error;
+
+typedef enum H2Setting {
+    H2Setting_HeaderTableSize = 0x1,
+    H2Setting_EnablePush = 0x2,
+    H2Setting_MaxConcurrentStreams = 0x3,
+    H2Setting_InitialWindowSize = 0x4,
+    H2Setting_MaxFrameSize = 0x5,
+    H2Setting_MaxHeaderListSize = 0x6,
+} H2Setting;
+
+typedef struct H2FrameHeader H2FrameHeader;
+struct H2FrameHeader {
+    u32 length;
+    u8 type;
+    u8 flags;
+    u32 stream_id;
+};
+
+typedef struct H2Stream H2Stream;
+struct H2Stream {
+    u32 id;
+    Scratch *arena;
+    u64 start_time;
+
+    b32 has_headers;
+    b32 is_request_complete;
+    b32 is_body_too_large;
+    HttpRequest request;
+    u64 body_capacity;
+    i64 recv_window;
+    u64 recv_unacked;
+
+    b32 is_responding;
+    b32 is_head_sent;
+    String8 response_head;
+    String8 response_body;
+    u64 response_offset;
+    CompressVariant *response_variant;
+
+    // NOTE: a body still on disk, read straight into its DATA frames
+    OS_Handle response_file;
+    u64 response_file_offset;
+    u64 response_length;
+    i64 send_window;
+};
+
+struct H2Connection {
+    Scratch *arena;
+    Scratch *write_arena;
+    u32 trace_id;
+
+    // NOTE: frames are appended behind the bytes of an in-flight send, so everything produced
+    // while a send is outstanding goes out together in the next one
+    String8 write_buffer;
+    u64 write_length;
+    u64 send_length;
+    b32 is_receiving;
+
+    b32 expects_preface;
+    b32 is_draining;
+    b32 is_failed;
+    b32 is_closing;
+
+    HpackTable decoder;
+
+    H2Stream streams[H2_MAX_STREAMS];
+    u32 stream_count;
+    u32 last_stream_id;
+    u32 next_stream_index;
+
+    u32 continuation_stream_id;
+    H2Stream *continuation_stream;
+    Scratch *continuation_arena;
+    String8 continuation_block;
+    b32 continuation_end_stream;
+
+    i64 send_window;
+    i64 recv_window;
+    u64 recv_unacked;
+    u32 peer_initial_window;
+    u32 peer_max_frame_size;
+};
+
+b32 h2_matches_preface(String8 received);
+
+void h2_begin(ThreadContext *context, struct Request *request);
+b32 h2_begin_upgrade(ThreadContext *context, struct Request *request, HttpRequest *http_request, u64 head_length);
+
+void h2_on_read(ThreadContext *context, struct Request *request, i32 result);
+void h2_on_write(ThreadContext *context, struct Request *request, i32 result);
+
+#endif // HTTP_H2_H
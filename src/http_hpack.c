@@ -0,0 +1,493 @@
+#include "http_hpack.h"
+
+typedef struct HpackStaticEntry HpackStaticEntry;
+struct HpackStaticEntry {
+    String8 name;
+    String8 value;
+};
+
+global HpackStaticEntry hpack_static_table[HPACK_STATIC_TABLE_COUNT] = {
+    {str8_comp(":authority"), str8_comp("")},
+    {str8_comp(":method"), str8_comp("GET")},
+    {str8_comp(":method"), str8_comp("POST")},
+    {str8_comp(":path"), str8_comp("/")},
+    {str8_comp(":path"), str8_comp("/index.html")},
+    {str8_comp(":scheme"), str8_comp("http")},
+    {str8_comp(":scheme"), str8_comp("https")},
+    {str8_comp(":status"), str8_comp("200")},
+    {str8_comp(":status"), str8_comp("204")},
+    {str8_comp(":status"), str8_comp("206")},
+    {str8_comp(":status"), str8_comp("304")},
+    {str8_comp(":status"), str8_comp("400")},
+    {str8_comp(":status"), str8_comp("404")},
+    {str8_comp(":status"), str8_comp("500")},
+    {str8_comp("accept-charset"), str8_comp("")},
+    {str8_comp("accept-encoding"), str8_comp("gzip, deflate")},
+    {str8_comp("accept-language"), str8_comp("")},
+    {str8_comp("accept-ranges"), str8_comp("")},
+    {str8_comp("accept"), str8_comp("")},
+    {str8_comp("access-control-allow-origin"), str8_comp("")},
+    {str8_comp("age"), str8_comp("")},
+    {str8_comp("allow"), str8_comp("")},
+    {str8_comp("authorization"), str8_comp("")},
+    {str8_comp("cache-control"), str8_comp("")},
+    {str8_comp("content-disposition"), str8_comp("")},
+    {str8_comp("content-encoding"), str8_comp("")},
+    {str8_comp("content-language"), str8_comp("")},
+    {str8_comp("content-length"), str8_comp("")},
+    {str8_comp("content-location"), str8_comp("")},
+    {str8_comp("content-range"), str8_comp("")},
+    {str8_comp("content-type"), str8_comp("")},
+    {str8_comp("cookie"), str8_comp("")},
+    {str8_comp("date"), str8_comp("")},
+    {str8_comp("etag"), str8_comp("")},
+    {str8_comp("expect"), str8_comp("")},
+    {str8_comp("expires"), str8_comp("")},
+    {str8_comp("from"), str8_comp("")},
+    {str8_comp("host"), str8_comp("")},
+    {str8_comp("if-match"), str8_comp("")},
+    {str8_comp("if-modified-since"), str8_comp("")},
+    {str8_comp("if-none-match"), str8_comp("")},
+    {str8_comp("if-range"), str8_comp("")},
+    {str8_comp("if-unmodified-since"), str8_comp("")},
+    {str8_comp("last-modified"), str8_comp("")},
+    {str8_comp("link"), str8_comp("")},
+    {str8_comp("location"), str8_comp("")},
+    {str8_comp("max-forwards"), str8_comp("")},
+    {str8_comp("proxy-authenticate"), str8_comp("")},
+    {str8_comp("proxy-authorization"), str8_comp("")},
+    {str8_comp("range"), str8_comp("")},
+    {str8_comp("referer"), str8_comp("")},
+    {str8_comp("refresh"), str8_comp("")},
+    {str8_comp("retry-after"), str8_comp("")},
+    {str8_comp("server"), str8_comp("")},
+    {str8_comp("set-cookie"), str8_comp("")},
+    {str8_comp("strict-transport-security"), str8_comp("")},
+    {str8_comp("transfer-encoding"), str8_comp("")},
+    {str8_comp("user-agent"), str8_comp("")},
+    {str8_comp("vary"), str8_comp("")},
+    {str8_comp("via"), str8_comp("")},
+    {str8_comp("www-authenticate"), str8_comp("")},
+};
+
+//////////////////////////////
+// Huffman
+
+// NOTE: the HPACK code is canonical, so a code is fully described by how many
+// codes there are of each bit length and the symbols sorted by (length, symbol)
+global u8 hpack_huffman_counts[31] = {
+    0, 0, 0, 0, 0, 10, 26, 32, 6, 0, 5, 3, 2, 6, 2, 3,
+    0, 0, 0, 3, 8, 13, 26, 29, 12, 4, 15, 19, 29, 0, 4,
+};
+
+global u16 hpack_huffman_symbols[257] = {
+    48, 49, 50, 97, 99, 101, 105, 111, 115, 116, 32, 37, 45, 46, 47, 51,
+    52, 53, 54, 55, 56, 57, 61, 65, 95, 98, 100, 102, 103, 104, 108, 109,
+    110, 112, 114, 117, 58, 66, 67, 68, 69, 70, 71, 72, 73, 74, 75, 76,
+    77, 78, 79, 80, 81, 82, 83, 84, 85, 86, 87, 89, 106, 107, 113, 118,
+    119, 120, 121, 122, 38, 42, 44, 59, 88, 90, 33, 34, 40, 41, 63, 39,
+    43, 124, 35, 62, 0, 36, 64, 91, 93, 126, 94, 125, 60, 96, 123, 92,
+    195, 208, 128, 130, 131, 162, 184, 194, 224, 226, 153, 161, 167, 172, 176, 177,
+    179, 209, 216, 217, 227, 229, 230, 129, 132, 133, 134, 136, 146, 154, 156, 160,
+    163, 164, 169, 170, 173, 178, 181, 185, 186, 187, 189, 190, 196, 198, 228, 232,
+    233, 1, 135, 137, 138, 139, 140, 141, 143, 147, 149, 150, 151, 152, 155, 157,
+    158, 165, 166, 168, 174, 175, 180, 182, 183, 188, 191, 197, 231, 239, 9, 142,
+    144, 145, 148, 159, 171, 206, 215, 225, 236, 237, 199, 207, 234, 235, 192, 193,
+    200, 201, 202, 205, 210, 213, 218, 219, 238, 240, 242, 243, 255, 203, 204, 211,
+    212, 214, 221, 222, 223, 241, 244, 245, 246, 247, 248, 250, 251, 252, 253, 254,
+    2, 3, 4, 5, 6, 7, 8, 11, 12, 14, 15, 16, 17, 18, 19, 20,
+    21, 23, 24, 25, 26, 27, 28, 29, 30, 31, 127, 220, 249, 10, 13, 22,
+    256,
+};
+
+#define HPACK_HUFFMAN_EOS 256
+#define HPACK_HUFFMAN_MAX_CODE_LENGTH 30
+
+local b32 hpack_huffman_decode(Arena *arena, String8 input, String8 *output) {
+    // NOTE: the shortest code is 5 bits
+    u8 *out = arena_push(arena, input.len * 8 / 5 + 1, 1);
+    u64 out_length = 0;
+    u32 code = 0;
+    u32 first = 0;
+    u32 index = 0;
+    u32 length = 0;
+
+    if (!out) {
+        return 0;
+    }
+
+    for (u64 pos = 0; pos < input.len; ++pos) {
+        u32 byte = input.data[pos] & 0xff;
+
+        for (i32 bit = 7; bit >= 0; --bit) {
+            code = (code << 1) | ((byte >> bit) & 1);
+            length += 1;
+
+            u32 count = hpack_huffman_counts[length];
+
+            if (code - first < count) {
+                u32 symbol = hpack_huffman_symbols[index + code - first];
+
+                if (symbol == HPACK_HUFFMAN_EOS) {
+                    return 0;
+                }
+
+                out[out_length++] = (u8)symbol;
+                code = 0;
+                first = 0;
+                index = 0;
+                length = 0;
+            } else {
+                if (length == HPACK_HUFFMAN_MAX_CODE_LENGTH) {
+                    return 0;
+                }
+
+                index += count;
+                first = (first + count) << 1;
+            }
+        }
+    }
+
+    // NOTE: padding is a prefix of EOS, which is all one bits, and shorter than a byte
+    if (length > 7 || code != (1u << length) - 1) {
+        return 0;
+    }
+
+    output->data = out;
+    output->len = out_length;
+
+    return 1;
+}
+
+//////////////////////////////
+// Dynamic table
+
+void hpack_table_init(Arena *arena, HpackTable *table) {
+    memset(table, 0, sizeof(HpackTable));
+    table->data = arena_push(arena, HPACK_TABLE_SIZE, 8);
+    table->max_size = HPACK_TABLE_SIZE;
+}
+
+local void hpack_table_evict(HpackTable *table, u32 needed) {
+    while (table->count > 0 && table->size + needed > table->max_size) {
+        HpackEntry *entry = &table->entries[table->first];
+
+        table->size -= entry->name_length + entry->value_length + HPACK_ENTRY_OVERHEAD;
+        table->first = (table->first + 1) % HPACK_MAX_ENTRIES;
+        table->count -= 1;
+    }
+
+    if (table->count == 0) {
+        table->data_end = 0;
+    }
+}
+
+local void hpack_table_insert(HpackTable *table, String8 name, String8 value) {
+    u32 length = name.len + value.len;
+    u32 entry_size = length + HPACK_ENTRY_OVERHEAD;
+
+    hpack_table_evict(table, entry_size);
+
+    // NOTE: an entry larger than the table empties it and is not inserted
+    if (entry_size > table->max_size) {
+        return;
+    }
+
+    if (table->data_end + length > HPACK_TABLE_SIZE) {
+        u32 start = table->entries[table->first].offset;
+
+        memmove(table->data, table->data + start, table->data_end - start);
+
+        for (u32 entry_index = 0; entry_index < table->count; ++entry_index) {
+            table->entries[(table->first + entry_index) % HPACK_MAX_ENTRIES].offset -= start;
+        }
+
+        table->data_end -= start;
+    }
+
+    HpackEntry *entry = &table->entries[(table->first + table->count) % HPACK_MAX_ENTRIES];
+    entry->offset = table->data_end;
+    entry->name_length = name.len;
+    entry->value_length = value.len;
+
+    memcpy(table->data + table->data_end, name.data, name.len);
+    memcpy(table->data + table->data_end + name.len, value.data, value.len);
+
+    table->data_end += length;
+    table->count += 1;
+    table->size += entry_size;
+}
+
+local String8 hpack_copy(Arena *arena, u8 *data, u64 len) {
+    String8 result = {0};
+    result.data = arena_push(arena, len + 1, 1);
+
+    if (result.data) {
+        memcpy(result.data, data, len);
+        result.len = len;
+    }
+
+    return result;
+}
+
+local b32 hpack_table_lookup(Arena *arena, HpackTable *table, u64 index, String8 *name_out, String8 *value_out) {
+    if (index == 0) {
+        return 0;
+    }
+
+    if (index <= HPACK_STATIC_TABLE_COUNT) {
+        *name_out = hpack_static_table[index - 1].name;
+        *value_out = hpack_static_table[index - 1].value;
+        return 1;
+    }
+
+    u64 dynamic_index = index - HPACK_STATIC_TABLE_COUNT - 1;
+
+    if (dynamic_index >= table->count) {
+        return 0;
+    }
+
+    // NOTE: entries are copied out because later insertions may evict or move them
+    HpackEntry *entry = &table->entries[(table->first + table->count - 1 - dynamic_index) % HPACK_MAX_ENTRIES];
+    *name_out = hpack_copy(arena, table->data + entry->offset, entry->name_length);
+    *value_out = hpack_copy(arena, table->data + entry->offset + entry->name_length, entry->value_length);
+
+    return name_out->data != 0 && value_out->data != 0;
+}
+
+//////////////////////////////
+// Decoding
+
+local b32 hpack_decode_integer(String8 *block, u32 prefix_bits, u64 *value_out) {
+    u64 max_prefix = (1u << prefix_bits) - 1;
+    u64 value = 0;
+    u32 shift = 0;
+
+    if (block->len == 0) {
+        return 0;
+    }
+
+    value = block->data[0] & max_prefix;
+    *block = str8_skip(*block, 1);
+
+    if (value == max_prefix) {
+        for (;;) {
+            if (block->len == 0 || shift > 28) {
+                return 0;
+            }
+
+            u64 byte = block->data[0] & 0xff;
+            *block = str8_skip(*block, 1);
+
+            value += (byte & 0x7f) << shift;
+            shift += 7;
+
+            if ((byte & 0x80) == 0) {
+                break;
+            }
+        }
+    }
+
+    *value_out = value;
+
+    return 1;
+}
+
+local b32 hpack_decode_string(Arena *arena, String8 *block, String8 *string_out) {
+    u64 length = 0;
+    b32 is_huffman = block->len > 0 && (block->data[0] & 0x80);
+
+    if (!hpack_decode_integer(block, 7, &length) || length > block->len) {
+        return 0;
+    }
+
+    String8 raw = str8_prefix(*block, length);
+    *block = str8_skip(*block, length);
+
+    if (is_huffman) {
+        return hpack_huffman_decode(arena, raw, string_out);
+    }
+
+    *string_out = hpack_copy(arena, raw.data, raw.len);
+
+    return string_out->data != 0;
+}
+
+b32 hpack_decode(Arena *arena, HpackTable *table, String8 block, HttpHeader **headers_out) {
+    HttpHeader *last = 0;
+    u64 list_size = 0;
+    b32 allow_size_update = 1;
+
+    *headers_out = 0;
+
+    while (block.len > 0) {
+        u32 byte = block.data[0] & 0xff;
+        String8 name = {0};
+        String8 value = {0};
+        b32 is_insert = 0;
+
+        if (byte & 0x80) {
+            u64 index = 0;
+
+            if (!hpack_decode_integer(&block, 7, &index) ||
+                !hpack_table_lookup(arena, table, index, &name, &value)) {
+                return 0;
+            }
+        } else if ((byte & 0xe0) == 0x20) {
+            u64 max_size = 0;
+
+            // NOTE: size updates may only open a block, and never exceed the size we advertised
+            if (!allow_size_update || !hpack_decode_integer(&block, 5, &max_size) || max_size > HPACK_TABLE_SIZE) {
+                return 0;
+            }
+
+            table->max_size = max_size;
+            hpack_table_evict(table, 0);
+            continue;
+        } else {
+            u64 index = 0;
+            is_insert = (byte & 0x40) != 0;
+
+            if (!hpack_decode_integer(&block, is_insert ? 6 : 4, &index)) {
+                return 0;
+            }
+
+            if (index != 0) {
+                String8 ignored = {0};
+
+                if (!hpack_table_lookup(arena, table, index, &name, &ignored)) {
+                    return 0;
+                }
+            } else if (!hpack_decode_string(arena, &block, &name)) {
+                return 0;
+            }
+
+            if (!hpack_decode_string(arena, &block, &value)) {
+                return 0;
+            }
+        }
+
+        allow_size_update = 0;
+        list_size += name.len + value.len + HPACK_ENTRY_OVERHEAD;
+
+        if (list_size > HPACK_MAX_HEADER_LIST_SIZE) {
+            return 0;
+        }
+
+        if (is_insert) {
+            hpack_table_insert(table, name, value);
+        }
+
+        HttpHeader *header = push_struct_zero(arena, HttpHeader);
+
+        if (!header) {
+            return 0;
+        }
+
+        header->key = name;
+        header->value = value;
+
+        if (last) {
+            last->next = header;
+        } else {
+            *headers_out = header;
+        }
+
+        last = header;
+    }
+
+    return 1;
+}
+
+//////////////////////////////
+// Encoding
+
+u64 hpack_encode_integer(u8 *out, u64 value, u32 prefix_bits, u8 first_byte) {
+    u64 max_prefix = (1u << prefix_bits) - 1;
+    u64 length = 0;
+
+    if (value < max_prefix) {
+        out[length++] = first_byte | (u8)value;
+        return length;
+    }
+
+    out[length++] = first_byte | (u8)max_prefix;
+    value -= max_prefix;
+
+    while (value >= 0x80) {
+        out[length++] = (u8)((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+
+    out[length++] = (u8)value;
+
+    return length;
+}
+
+local u64 hpack_encode_string(u8 *out, String8 string, b32 is_lowercase) {
+    u64 length = hpack_encode_integer(out, string.len, 7, 0x00);
+
+    for (u64 pos = 0; pos < string.len; ++pos) {
+        u8 c = string.data[pos];
+
+        if (is_lowercase && c >= 'A' && c <= 'Z') {
+            c += 'a' - 'A';
+        }
+
+        out[length++] = c;
+    }
+
+    return length;
+}
+
+u64 hpack_encode_status(u8 *out, u32 status) {
+    u8 digits[3] = {'0' + (status / 100) % 10, '0' + (status / 10) % 10, '0' + status % 10};
+    String8 value = {3, digits};
+
+    // NOTE: static entries 8 through 14 are the common :status values
+    for (u32 index = 8; index <= 14; ++index) {
+        if (str8_are_equal(hpack_static_table[index - 1].value, value)) {
+            return hpack_encode_integer(out, index, 7, 0x80);
+        }
+    }
+
+    u64 length = hpack_encode_integer(out, 8, 4, 0x00);
+    length += hpack_encode_string(out + length, value, 0);
+
+    return length;
+}
+
+local u32 hpack_static_name_index(String8 name) {
+    u32 result = 0;
+
+    for (u32 index = 15; index <= HPACK_STATIC_TABLE_COUNT; ++index) {
+        if (str8_are_equal_case_insensitive(hpack_static_table[index - 1].name, name)) {
+            result = index;
+            break;
+        }
+    }
+
+    return result;
+}
+
+// NOTE: responses are encoded as literals without indexing, so no encoder table has to be
+// kept in sync with the peer's SETTINGS_HEADER_TABLE_SIZE
+u64 hpack_encode_header(u8 *out, String8 name, String8 value) {
+    u32 name_index = hpack_static_name_index(name);
+    u64 length = 0;
+
+    if (name_index) {
+        length = hpack_encode_integer(out, name_index, 4, 0x00);
+    } else {
+        out[length++] = 0x00;
+        length += hpack_encode_string(out + length, name, 1);
+    }
+
+    length += hpack_encode_string(out + length, value, 0);
+
+    return length;
+}
+
+u64 hpack_encoded_header_size(String8 name, String8 value) {
+    return 1 + 10 + name.len + 10 + value.len;
+}
@@ -0,0 +1,44 @@
+#ifndef HTTP_HPACK_H
+#define HTTP_HPACK_H
+
+#include "base/base_inc.h"
+#include "http.h"
+
+#define HPACK_TABLE_SIZE 4096
+#define HPACK_ENTRY_OVERHEAD 32
+#define HPACK_MAX_ENTRIES (HPACK_TABLE_SIZE / HPACK_ENTRY_OVERHEAD)
+#define HPACK_MAX_HEADER_LIST_SIZE 8192
+#define HPACK_STATIC_TABLE_COUNT 61
+
+typedef struct HpackEntry HpackEntry;
+struct HpackEntry {
+    u32 offset;
+    u32 name_length;
+    u32 value_length;
+};
+
+// NOTE: entries form a ring with the newest last; their bytes are appended to a
+// linear buffer that is compacted when an insertion would run past its end
+typedef struct HpackTable HpackTable;
+struct HpackTable {
+    u8 *data;
+    u32 data_end;
+
+    HpackEntry entries[HPACK_MAX_ENTRIES];
+    u32 first;
+    u32 count;
+
+    u32 size;
+    u32 max_size;
+};
+
+void hpack_table_init(Arena *arena, HpackTable *table);
+
+b32 hpack_decode(Arena *arena, HpackTable *table, String8 block, HttpHeader **headers_out);
+
+u64 hpack_encode_integer(u8 *out, u64 value, u32 prefix_bits, u8 first_byte);
+u64 hpack_encode_status(u8 *out, u32 status);
+u64 hpack_encode_header(u8 *out, String8 name, String8 value);
+u64 hpack_encoded_header_size(String8 name, String8 value);
+
+#endif // HTTP_HPACK_H
@@ -3,177 +3,524 @@
 #include "base/base_os_linux.h"
 #include "base/base_string.h"
 #include "base/base_thread.h"
-
-#define REQUEST_BUFFER_SIZE 8192
-
-enum EventType {
-    EventType_Accept,
-    EventType_Read,
-    EventType_Write,
+#include "http.h"
+#include "http_access_log.h"
+#include "http_balance.h"
+#include "http_cache.h"
+#include "http_compress.h"
+#include "http_conditional.h"
+#include "http_h2.h"
+#include "http_mock.h"
+#include "http_offload.h"
+#include "http_proxy.h"
+#include "http_rate_limit.h"
+#include "http_server.h"
+#include "http_task.h"
+#include "http_trace.h"
+#include "http_ws.h"
+#include <errno.h>
+
+global String8 http_bad_request = str8_comp(
+    "HTTP/1.1 400 Bad Request\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n");
+
+global String8 http_internal_error = str8_comp(
+    "HTTP/1.1 500 Internal Server Error\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n");
+
+global String8 http_too_many_requests = str8_comp(
+    "HTTP/1.1 429 Too Many Requests\r\n"
+    "Retry-After: 1\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n");
+
+global HttpHeader hello_headers = {str8_comp("Content-Type"), str8_comp("text/plain"), 0};
+global HttpHeader static_headers = {str8_comp("Content-Type"), str8_comp("application/octet-stream"), 0};
+global String8 static_extensions[] = {str8_comp(".html"), str8_comp(".css"), str8_comp(".js"),
+                                      str8_comp(".json"), str8_comp(".svg"), str8_comp(".txt")};
+global HttpHeader static_type_headers[] = {
+    {str8_comp("Content-Type"), str8_comp("text/html; charset=utf-8"), 0},
+    {str8_comp("Content-Type"), str8_comp("text/css"), 0},
+    {str8_comp("Content-Type"), str8_comp("application/javascript"), 0},
+    {str8_comp("Content-Type"), str8_comp("application/json"), 0},
+    {str8_comp("Content-Type"), str8_comp("image/svg+xml"), 0},
+    {str8_comp("Content-Type"), str8_comp("text/plain; charset=utf-8"), 0},
 };
+// NOTE: cached responses may be compressed, so each Accept-Encoding value gets its own entry
+global HttpHeaderId cache_route_vary[] = {HttpHeaderId_AcceptEncoding};
+global b32 hello_is_quiet;
+global String8 static_root;
 
-struct Request {
-    enum EventType event_type;
+local HttpHeader *static_headers_for(String8 name) {
+    for (u32 index = 0; index < array_count(static_extensions); ++index) {
+        String8 extension = static_extensions[index];
 
-    Scratch *scratch_arena;
+        if (name.len > extension.len && str8_are_equal(str8_skip(name, name.len - extension.len), extension)) {
+            return &static_type_headers[index];
+        }
+    }
 
-    OS_Handle client_handle;
-    SockAddrIPv4 client_address;
-    u64 client_address_length;
+    return &static_headers;
+}
 
-    String8 request_buffer;
-    String8 response_buffer;
-};
+// NOTE: every message is relayed to all WebSocket clients of the worker that received it
+void handle_chat_message(WsConnection *connection, WsOpcode opcode, String8 message) {
+    ws_broadcast(connection->context, opcode, message);
+}
 
-b32 submit_read(ThreadContext *context, struct Request *request) {
-    u32 tail;
-    b32 ok = 0;
-    Scratch *scratch = request->scratch_arena;
-    IO_Uring_Submission_Entry *sqe = os_io_uring_get_sqe(&context->ring, &tail);
+global WsHandler chat_handler = {0, handle_chat_message, 0};
 
-    String8 request_buffer = {0};
-    request_buffer.data = arena_push(scratch, REQUEST_BUFFER_SIZE, 8);
-    request_buffer.len = REQUEST_BUFFER_SIZE;
-    request->request_buffer = request_buffer;
+void handle_hello(Arena *arena, HttpRequest *request, HttpResponse *response) {
+    if (str8_are_equal(request->path, str8("/ws")) && ws_accept(arena, request, response, &chat_handler)) {
+        return;
+    }
 
-    os_io_uring_prep_sqe(sqe, IORING_OP_READ);
+    if (hello_is_quiet) {
+    } else if (request->method == HTTP_METHOD_GET) {
+        log_info("GET: %.*s\n", str8_expand(request->path));
+    } else {
+        log_info("METHOD NOT IMPLEMENTED\n");
+    }
 
-    sqe->fd = request->client_handle.value;
-    sqe->addr = (u64)request->request_buffer.data;
-    sqe->len = request->request_buffer.len;
-    sqe->off = -1;
-    sqe->user_data = (u64)request;
+    String8 path = str8_split_to(request->path, "?");
+    path = str8_is_valid(path) ? path : request->path;
 
-    os_io_write_barrier(context->ring.sring_tail, tail + 1);
+    // NOTE: files under --static DIR are served from /static/; a name with ".." in it is refused
+    if (str8_is_valid(static_root) && str8_are_equal(str8_prefix(path, 8), str8("/static/"))) {
+        String8 name = str8_skip(path, 8);
 
-    i32 result = os_io_uring_enter(context->ring.ring_fd, 1, 0, 0);
+        if (name.len > 0 && str8_find_substring(name, "..") == -1 &&
+            http_response_set_file(arena, response, str8_pushf(arena, "%S/%S", static_root, name))) {
+            response->status = 200;
+            response->headers = static_headers_for(name);
+        }
 
-    if (result >= 0) {
-        ok = 1;
+        return;
     }
 
-    return ok;
+    response->status = 200;
+    response->headers = &hello_headers;
+    response->body = str8("Hello World!");
+    response->etag = http_etag_from_hash(arena, hash_string(response->body), 0);
 }
 
-b32 submit_write(ThreadContext *context, struct Request *request) {
-    u32 tail;
-    b32 ok = 0;
-    IO_Uring_Submission_Entry *sqe = os_io_uring_get_sqe(&context->ring, &tail);
+// NOTE: stands in for rendering or hashing that would stall every connection on the worker;
+// the megabyte it hashes over lives in the job's own arena
+i32 offload_digest(OffloadJob *job) {
+    String8 buffer = {0};
+    u64 digest = 0;
 
-    os_io_uring_prep_sqe(sqe, IORING_OP_WRITE);
+    buffer.len = megabyte;
+    buffer.data = arena_push(job->arena, buffer.len, 64);
 
-    sqe->fd = request->client_handle.value;
-    sqe->addr = (u64)request->response_buffer.data;
-    sqe->len = request->response_buffer.len;
-    sqe->off = -1;
-    sqe->user_data = (u64)request;
+    if (!buffer.data) {
+        return -ENOMEM;
+    }
 
-    os_io_write_barrier(context->ring.sring_tail, tail + 1);
+    for (u64 index = 0; index < buffer.len; ++index) {
+        buffer.data[index] = (u8)(index * 31);
+    }
 
-    u32 result = os_io_uring_enter(context->ring.ring_fd, 1, 0, 0);
+    for (u32 round = 0; round < 16; ++round) {
+        digest = hash_string_seeded(buffer, digest);
+        buffer.data[round] ^= (u8)digest;
+    }
+
+    job->output = str8_pushf(job->arena, "%016llx\n", (unsigned long long)digest);
+
+    return 0;
+}
 
-    if (result >= 0) {
-        ok = 1;
+// NOTE: the same handler on a coroutine; /slow waits on the ring for 50ms first, so concurrent
+// requests to it overlap on one worker. /offload runs offload_digest on the offload pool and
+// /offload/metrics reports the pool's counters
+void handle_hello_task(HttpTask *task, HttpRequest *request, HttpResponse *response) {
+    String8 path = str8_split_to(request->path, "?");
+    path = str8_is_valid(path) ? path : request->path;
+
+    if (str8_are_equal(path, str8("/slow"))) {
+        http_await_sleep(task, 50);
     }
 
-    return ok;
+    if (str8_are_equal(path, str8("/offload"))) {
+        String8 output = {0};
+        i32 result = http_await_offload(task, offload_digest, 0, &output);
+
+        response->headers = &hello_headers;
+        response->status = result == 0 ? 200 : result == -EBUSY ? 503 : 500;
+        response->body = result == 0 ? output : str8("");
+        return;
+    }
+
+    if (str8_are_equal(path, str8("/offload/metrics"))) {
+        response->headers = &hello_headers;
+        response->status = 200;
+        response->body = offload_metrics_string(task->arena);
+        return;
+    }
+
+    handle_hello(task->arena, request, response);
+}
+
+b32 is_h2c_upgrade(HttpRequest *http_request) {
+    String8 upgrade = http_headers_get(&http_request->headers, HttpHeaderId_Upgrade);
+    String8 content_length = http_headers_get(&http_request->headers, HttpHeaderId_ContentLength);
+    String8 transfer_encoding = http_headers_get(&http_request->headers, HttpHeaderId_TransferEncoding);
+
+    // NOTE: only bodiless requests are upgraded, so the body never has to be carried over
+    return str8_are_equal_case_insensitive(upgrade, str8("h2c")) && !str8_is_valid(transfer_encoding) &&
+           (!str8_is_valid(content_length) || str8_are_equal(content_length, str8("0")));
 }
 
-b32 submit_accept(ThreadContext *context) {
-    u32 tail;
-    b32 ok = 0;
-    IO_Uring_Submission_Entry *sqe = os_io_uring_get_sqe(&context->ring, &tail);
-    Scratch *scratch = thread_scratch_alloc(context);
-    struct Request *request = arena_push(scratch, sizeof(struct Request), 8);
-    request->event_type = EventType_Accept;
-    request->client_address_length = sizeof(SockAddrIPv4);
-    request->scratch_arena = scratch;
+void handle_response(ThreadContext *context, struct Request *request, HttpRequest *http_request,
+                     HttpResponse *http_response, MicroCacheResult cache_result, MicroCacheEntry *cache_entry) {
+    if (http_response->websocket && http_response->status == 101) {
+        u64 head_length = http_request->body.data - request->request_buffer.data;
+        request->response_buffer = http_serialize_response(request->scratch_arena, http_response, 0);
+
+        if (str8_is_valid(request->response_buffer)) {
+            if (cache_result == MicroCacheResult_Miss) {
+                micro_cache_fill(context, cache_entry, 0, (String8){0}, 0);
+            }
+
+            access_log_record(request, request->accept_time, 0, http_request->method, http_request->path, 101,
+                              request->response_buffer.len);
+            ws_begin(context, request, http_response->websocket, head_length);
+            return;
+        }
+
+        *http_response = (HttpResponse){0};
+        http_response->status = 500;
+    }
+
+    http_prepare_response(request->scratch_arena, http_request, http_response);
+
+    // NOTE: handler headers may live in static storage, so the extra header goes in front
+    // instead of being linked behind the handler's last one
+    HttpHeader *connection_header = push_struct_zero(request->scratch_arena, HttpHeader);
+
+    if (connection_header) {
+        connection_header->key = str8("Connection");
+        connection_header->value = str8("close");
+        connection_header->next = http_response->headers;
+        http_response->headers = connection_header;
+    }
+
+    // NOTE: a file body, or one too large to copy in behind the head, is written after it
+    b32 include_body = http_request->method != HTTP_METHOD_HEAD;
+    ResponseBody body = {0};
+
+    if (include_body && http_response->file.value) {
+        body.file = http_response->file;
+        body.offset = http_response->file_offset;
+        body.remaining = http_response->file_length;
+    } else if (include_body && http_response->body.len > SERVER_INLINE_BODY_SIZE) {
+        body.data = http_response->body;
+        body.variant = http_response->compress_variant;
+        http_response->compress_variant = 0;
+    }
+
+    request->response_buffer = http_serialize_response(request->scratch_arena, http_response,
+                                                       include_body && body.data.len == 0);
 
-    os_io_uring_prep_sqe(sqe, IORING_OP_ACCEPT);
+    if (!str8_is_valid(request->response_buffer)) {
+        request->response_buffer = http_internal_error;
+        http_response->status = 500;
 
-    sqe->fd = context->server_handle.value;
-    sqe->addr = (u64)&request->client_address;
-    sqe->addr2 = (u64)&request->client_address_length;
-    sqe->user_data = (u64)request;
+        if (body.file.value) {
+            os_close(body.file);
+        }
 
-    os_io_write_barrier(context->ring.sring_tail, tail + 1);
+        if (body.variant) {
+            compress_variant_release(body.variant);
+        }
+
+        body = (ResponseBody){0};
+    }
 
-    u32 result = os_io_uring_enter(context->ring.ring_fd, 1, 0, 0);
+    if (cache_result == MicroCacheResult_Miss) {
+        micro_cache_fill(context, cache_entry, http_response, request->response_buffer, &body);
+    }
 
-    if (result >= 0) {
-        ok = 1;
+    // NOTE: a variant not sent behind the head has been copied in with it, or not sent at all
+    if (http_response->compress_variant) {
+        compress_variant_release(http_response->compress_variant);
     }
 
-    return ok;
+    access_log_record(request, request->accept_time, 0, http_request->method, http_request->path,
+                      http_response->status, request->response_buffer.len + body.data.len + body.remaining);
+
+    if (body.data.len > 0 || body.file.value) {
+        submit_write_body(context, request, body);
+    } else {
+        submit_write(context, request);
+    }
 }
 
 void handle_request(ThreadContext *context, struct Request *request) {
-    // TODO: parser the request: METHOD, PATH, HTTPVER
+    String8 request_buffer = str8_prefix(request->request_buffer, request->request_length);
 
-    String8 req = request->request_buffer;
+    trace_begin(request, TraceStage_Parse);
+    HttpRequest http_request = http_parse_request(request->scratch_arena, request_buffer);
+    trace_end(request, TraceStage_Parse);
 
-    String8 method = str8_read_to(&req, " ");
-    String8 path = str8_read_to(&req, " ");
-    String8 http_version = str8_read_to(&req, " ");
+    if (!http_request.is_valid) {
+        request->response_buffer = http_bad_request;
+        access_log_record(request, request->accept_time, 0, HTTP_METHOD_UNKNOWN, http_request.path, 400, http_bad_request.len);
+        submit_write(context, request);
+        return;
+    }
 
-    if (str8_are_equal(method, str8("GET"))) {
+    if (!rate_limit_allow_request(request, http_request.path)) {
+        request->response_buffer = http_too_many_requests;
+        access_log_record(request, request->accept_time, 0, http_request.method, http_request.path, 429,
+                          http_too_many_requests.len);
+        submit_write(context, request);
+        return;
+    }
 
-        log_info("%.*s: %.*s\n", str8_expand(method), str8_expand(path));
-    } else {
-        log_info("METHOD NOT IMPLEMENTED\n");
+    if (proxy_is_enabled()) {
+        proxy_begin(context, request, &http_request);
+        return;
     }
 
-    String8 http_response = str8(
-        "HTTP/1.1 200 OK\r\n"
-        "Content-Type: text/plain\r\n"
-        "Content-Length: 12\r\n"
-        "Connection: close\r\n"
-        "\r\n"
-        "Hello World!");
+    if (is_h2c_upgrade(&http_request)) {
+        u64 head_length = http_request.body.data - request_buffer.data;
 
-    request->response_buffer = http_response;
+        if (h2_begin_upgrade(context, request, &http_request, head_length)) {
+            return;
+        }
+    }
 
-    // log_info("GET: %s\n", request->request_buffer.data);
+    MicroCacheEntry *cache_entry = 0;
+    MicroCacheResult cache_result = micro_cache_begin(context, request, &http_request, &cache_entry);
+
+    if (cache_result == MicroCacheResult_Hit) {
+        micro_cache_respond(context, request, cache_entry);
+        return;
+    }
+
+    // NOTE: another request for the same key is running the handler and answers this one too
+    if (cache_result == MicroCacheResult_Waiting) {
+        return;
+    }
 
-    submit_write(context, request);
+    HttpResponse http_response = {0};
+
+    if (http_task_is_enabled()) {
+        HttpTask *task = http_task_start(context, request, &http_request, cache_result, cache_entry);
+
+        // NOTE: the handler suspended and finishes from EventType_Task completions
+        if (task && !task->is_finished) {
+            return;
+        }
+
+        if (task) {
+            http_response = task->http_response;
+        } else {
+            http_response.is_valid = 1;
+            http_response.version = http_request.version;
+            http_response.status = 503;
+        }
+    } else {
+        trace_begin(request, TraceStage_Handler);
+        server_run_handler(request->scratch_arena, &http_request, &http_response);
+        trace_end(request, TraceStage_Handler);
+    }
+
+    handle_response(context, request, &http_request, &http_response, cache_result, cache_entry);
 }
 
-void entrypoint(u32 thread_id, OS_Handle server_handle) {
+void entrypoint(u32 thread_id, OS_Handle *listener_handles, u32 listener_count) {
     IO_Uring_Completion_Entry *cqe;
     ThreadContext *context = thread_context_alloc(thread_id);
-    context->server_handle = server_handle;
+    context->listener_count = listener_count;
+
+    memcpy(context->listener_handles, listener_handles, sizeof(OS_Handle) * listener_count);
 
     if (os_io_uring_init_ring(&context->ring)) {
         log_fatal("Failed to initialize io_uring - %d\n");
         os_abort(1);
     }
 
-    submit_accept(context);
+    if (proxy_is_enabled()) {
+        proxy_thread_init(context);
+    }
+
+    server_thread_init(context);
+    balance_thread_init(context);
+    trace_thread_init(context);
+    access_log_thread_init(context);
+    micro_cache_thread_init(context);
+    rate_limit_thread_init(context);
+    compress_thread_init(context);
+
+    for (u32 listener_index = 0; listener_index < context->listener_count; ++listener_index) {
+        submit_accept(context, listener_index);
+    }
 
     for (;;) {
-        i32 result = os_io_uring_wait_cqe(&context->ring, &cqe);
+        i32 result = server_wait_completion(context, &cqe);
+
+        trace_poll();
+
+        // NOTE: the mock transport has replayed its corpus and nothing is left in flight; the
+        // access log is written out and its writes completed before the run ends
+        if (result == -ENODATA && mock_transport_is_enabled()) {
+            if (access_log_drain()) {
+                continue;
+            }
+
+            return;
+        }
+
+        // NOTE: a signal such as a trace dump request interrupted the wait
+        if (result == -EINTR) {
+            continue;
+        }
 
         if (result != 0) {
             log_fatal("Error while getting entry from completion queue\n");
             os_abort(1);
         }
 
-        struct Request *request = (struct Request *)cqe->user_data;
+        balance_publish(context);
+
+        if (balance_is_message(cqe->user_data)) {
+            balance_on_message(context, cqe->user_data, cqe->res);
+            continue;
+        }
+
+        if (access_log_is_completion(cqe->user_data)) {
+            access_log_on_completion(context, cqe->user_data, cqe->res);
+            continue;
+        }
+
+        enum EventType event_type;
+        struct Request *request = request_from_user_data(cqe->user_data, &event_type);
+
+        // NOTE: the completion belongs to a connection whose slot has since been released
+        if (!request) {
+            continue;
+        }
 
-        switch (request->event_type) {
+        trace_complete(request, event_type, cqe->res);
+
+        switch (event_type) {
         case EventType_Accept:
-            submit_accept(context);
-            request->event_type = EventType_Read;
+            submit_accept(context, request->listener_index);
+
+            if (cqe->res < 0) {
+                request_release(context, request);
+                break;
+            }
+
             request->client_handle = os_handle_from_fd(cqe->res);
+
+            // NOTE: refused before the connection is handed over or read from
+            if (!rate_limit_allow_connection(request)) {
+                balance_connection_opened(context);
+                access_log_start(request);
+                request->response_buffer = http_too_many_requests;
+                request->event_type = EventType_Write;
+                access_log_record(request, request->accept_time, 0, HTTP_METHOD_UNKNOWN, (String8){0}, 429,
+                                  http_too_many_requests.len);
+                submit_write(context, request);
+                break;
+            }
+
+            if (balance_try_handoff(context, request->client_handle)) {
+                request_release(context, request);
+                break;
+            }
+
+            balance_connection_opened(context);
+            access_log_start(request);
+            trace_sample(request);
+            trace_instant(request, TraceStage_Accept, cqe->res);
+            request->event_type = EventType_Read;
             submit_read(context, request);
             break;
-        case EventType_Read:
+        case EventType_Read: {
+            if (cqe->res <= 0) {
+                request_close(context, request);
+                break;
+            }
+
+            request->request_length += cqe->res;
+
+            String8 received = str8_prefix(request->request_buffer, request->request_length);
+            b32 has_space = request->request_length < request->request_buffer.len;
+
+            if (!proxy_is_enabled() && h2_matches_preface(received)) {
+                if (request->request_length >= H2_PREFACE_SIZE) {
+                    h2_begin(context, request);
+                } else if (has_space) {
+                    submit_read(context, request);
+                } else {
+                    request_close(context, request);
+                }
+                break;
+            }
+
+            if (http_find_head_end(received) == -1 && has_space) {
+                submit_read(context, request);
+                break;
+            }
+
             request->event_type = EventType_Write;
             handle_request(context, request);
-            break;
+        } break;
         case EventType_Write:
-            os_close(request->client_handle);
-            thread_scratch_release(context, request->scratch_arena);
+            request_close(context, request);
+            break;
+        case EventType_WriteBody:
+            request_on_write_body(context, request, cqe->res);
+            break;
+        case EventType_Close:
+            // NOTE: cancelled when the write ahead of it failed; whichever of the two completions
+            // comes first closes the connection, the other finds its slot released
+            if (cqe->res == -ECANCELED) {
+                request_close(context, request);
+            } else {
+                request_closed(context, request);
+            }
+            break;
+        case EventType_Task:
+            if (http_task_resume(context, request, cqe->res)) {
+                HttpTask *task = request->task;
+                handle_response(context, request, &task->http_request, &task->http_response, task->cache_result,
+                                task->cache_entry);
+            }
+            break;
+        case EventType_ProxyConnect:
+        case EventType_ProxySendRequest:
+        case EventType_ProxyBodyToPipe:
+        case EventType_ProxyBodyFromPipe:
+        case EventType_ProxyRecvHead:
+        case EventType_ProxySendResponse:
+        case EventType_ProxyRelayRecv:
+        case EventType_ProxyRelaySend:
+        case EventType_ProxyResponseToPipe:
+        case EventType_ProxyResponseFromPipe:
+            proxy_on_completion(context, request, cqe->res);
+            break;
+        case EventType_H2Read:
+            h2_on_read(context, request, cqe->res);
+            break;
+        case EventType_H2Write:
+            h2_on_write(context, request, cqe->res);
+            break;
+        case EventType_WsRead:
+            ws_on_read(context, request, cqe->res);
+            break;
+        case EventType_WsWrite:
+            ws_on_write(context, request, cqe->res);
             break;
         default:
             break;
@@ -181,35 +528,400 @@ void entrypoint(u32 thread_id, OS_Handle server_handle) {
     }
 }
 
-OS_Handle bind_and_listen(u32 port, u32 backlog) {
-    OS_Handle handle = os_socket_ipv4();
+typedef struct WorkerParams WorkerParams;
+struct WorkerParams {
+    u32 thread_id;
+    OS_Handle *listener_handles;
+    u32 listener_count;
+    i32 processor;
+};
 
-    if (!os_bind_ipv4(handle, port)) {
-        log_fatal("failed to bind to port %d\n", port);
-        os_abort(1);
+void *worker_thread_entry(void *params) {
+    WorkerParams *worker = (WorkerParams *)params;
+
+    if (worker->processor >= 0 && !os_set_thread_processor(worker->processor)) {
+        log_warn("failed to pin worker %d to processor %d\n", worker->thread_id, worker->processor);
     }
 
-    if (!os_listen(handle, backlog)) {
-        log_fatal("listen failed\n");
-        os_abort(1);
+    entrypoint(worker->thread_id, worker->listener_handles, worker->listener_count);
+
+    return 0;
+}
+
+// NOTE: RATE[:BURST] in requests per second
+b32 parse_rate_rule(String8 value, u32 *rate_out, u32 *burst_out) {
+    String8 rate = str8_split_to(value, ":");
+    u64 rate_value = 0;
+    u64 burst_value = 0;
+
+    if (!str8_is_valid(rate)) {
+        rate = value;
+    } else if (!str8_to_u64(str8_skip(value, rate.len + 1), &burst_value) || burst_value > 0xffffffff) {
+        return 0;
     }
 
-    return handle;
+    if (!str8_to_u64(rate, &rate_value) || rate_value > 0xffffffff) {
+        return 0;
+    }
+
+    *rate_out = (u32)rate_value;
+    *burst_out = (u32)burst_value;
+
+    return 1;
 }
 
-i32 main(void) {
-    u32 port = 8080;
-    u32 backlog = 3;
-    OS_Handle server_handle = bind_and_listen(port, backlog);
+i32 main(i32 argc, char **argv) {
+    String8 listen_addresses[THREAD_MAX_LISTENERS];
+    u32 listener_count = 0;
+    ServerSocketOptions socket_options = {.backlog = SERVER_DEFAULT_BACKLOG, .no_delay = 1};
+    u32 processor_count = os_processor_count();
+    u32 worker_count = processor_count;
+    u32 trace_interval = 0;
+    String8 trace_path = str8("trace.json");
+    String8 access_log_path = {0};
+    u64 access_log_rotate_size = 0;
+    u64 compress_budget_size = 0;
+    b32 use_tasks = 0;
+    u64 offload_thread_count = 0;
+    u64 offload_queue_limit = OFFLOAD_DEFAULT_QUEUE_LIMIT;
+    b32 use_mock = 0;
+    String8 mock_corpus_path = {0};
+    String8 mock_capture_path = {0};
+    u64 mock_fragment_size = 0;
+    u64 mock_connections = 0;
+
+    for (i32 arg_index = 1; arg_index < argc; ++arg_index) {
+        String8 arg = str8_from_cstring(argv[arg_index]);
+        b32 has_value = arg_index + 1 < argc;
+
+        if ((str8_are_equal(arg, str8("--port")) || str8_are_equal(arg, str8("--listen"))) && has_value) {
+            if (listener_count == THREAD_MAX_LISTENERS) {
+                log_fatal("at most %d listeners are supported\n", THREAD_MAX_LISTENERS);
+                os_abort(1);
+            }
+
+            listen_addresses[listener_count++] = str8_from_cstring(argv[++arg_index]);
+        } else if (str8_are_equal(arg, str8("--workers")) && has_value) {
+            u64 worker_value = 0;
+
+            if (!str8_to_u64(str8_from_cstring(argv[++arg_index]), &worker_value) ||
+                worker_value == 0 || worker_value > BALANCE_MAX_WORKERS) {
+                log_fatal("invalid worker count %s\n", argv[arg_index]);
+                os_abort(1);
+            }
+
+            worker_count = worker_value;
+        } else if (str8_are_equal(arg, str8("--backlog")) && has_value) {
+            u64 backlog = 0;
+
+            if (!str8_to_u64(str8_from_cstring(argv[++arg_index]), &backlog) || backlog == 0 || backlog > 65535) {
+                log_fatal("invalid backlog %s\n", argv[arg_index]);
+                os_abort(1);
+            }
+
+            socket_options.backlog = backlog;
+        } else if (str8_are_equal(arg, str8("--reuseport"))) {
+            socket_options.reuse_port = 1;
+        } else if (str8_are_equal(arg, str8("--incoming-cpu"))) {
+            socket_options.reuse_port = 1;
+            socket_options.use_incoming_cpu = 1;
+        } else if (str8_are_equal(arg, str8("--no-nodelay"))) {
+            socket_options.no_delay = 0;
+        } else if (str8_are_equal(arg, str8("--defer-accept")) && has_value) {
+            u64 seconds = 0;
+
+            if (!str8_to_u64(str8_from_cstring(argv[++arg_index]), &seconds) || seconds == 0 || seconds > 3600) {
+                log_fatal("invalid defer accept timeout %s\n", argv[arg_index]);
+                os_abort(1);
+            }
+
+            socket_options.defer_accept_seconds = seconds;
+        } else if (str8_are_equal(arg, str8("--fastopen")) && has_value) {
+            u64 queue_length = 0;
+
+            if (!str8_to_u64(str8_from_cstring(argv[++arg_index]), &queue_length) || queue_length == 0 ||
+                queue_length > 65535) {
+                log_fatal("invalid fast open queue length %s\n", argv[arg_index]);
+                os_abort(1);
+            }
+
+            socket_options.fast_open_queue_length = queue_length;
+        } else if ((str8_are_equal(arg, str8("--sndbuf")) || str8_are_equal(arg, str8("--rcvbuf"))) && has_value) {
+            u64 kilobytes = 0;
+
+            if (!str8_to_u64(str8_from_cstring(argv[++arg_index]), &kilobytes) || kilobytes == 0 ||
+                kilobytes > 1024 * 1024) {
+                log_fatal("invalid socket buffer size %s\n", argv[arg_index]);
+                os_abort(1);
+            }
+
+            if (str8_are_equal(arg, str8("--sndbuf"))) {
+                socket_options.send_buffer_size = kilobytes * kilobyte;
+            } else {
+                socket_options.receive_buffer_size = kilobytes * kilobyte;
+            }
+        } else if (str8_are_equal(arg, str8("--upstream")) && has_value) {
+            String8 address = str8_from_cstring(argv[++arg_index]);
+
+            if (!proxy_add_backend(address)) {
+                log_fatal("invalid upstream address %.*s\n", str8_expand(address));
+                os_abort(1);
+            }
+        } else if (str8_are_equal(arg, str8("--trace-sample")) && has_value) {
+            u64 interval_value = 0;
+
+            if (!str8_to_u64(str8_from_cstring(argv[++arg_index]), &interval_value) || interval_value > 0xffffffff) {
+                log_fatal("invalid trace sample interval %s\n", argv[arg_index]);
+                os_abort(1);
+            }
+
+            trace_interval = interval_value;
+        } else if (str8_are_equal(arg, str8("--trace-file")) && has_value) {
+            trace_path = str8_from_cstring(argv[++arg_index]);
+        } else if (str8_are_equal(arg, str8("--cache-route")) && has_value) {
+            String8 route = str8_from_cstring(argv[++arg_index]);
+            u64 ttl_ms = 0;
+            u64 separator = route.len;
+
+            while (separator > 0 && route.data[separator - 1] != ':') {
+                separator -= 1;
+            }
+
+            if (separator > 0) {
+                if (!str8_to_u64(str8_skip(route, separator), &ttl_ms) || ttl_ms == 0 || ttl_ms > 60000) {
+                    log_fatal("invalid cache ttl in %s\n", argv[arg_index]);
+                    os_abort(1);
+                }
+
+                route = str8_prefix(route, separator - 1);
+            }
+
+            if (!micro_cache_add_route(route, ttl_ms, cache_route_vary, array_count(cache_route_vary))) {
+                log_fatal("invalid cache route %s\n", argv[arg_index]);
+                os_abort(1);
+            }
+        } else if (str8_are_equal(arg, str8("--cache-budget")) && has_value) {
+            u64 megabytes = 0;
+
+            if (!str8_to_u64(str8_from_cstring(argv[++arg_index]), &megabytes) || megabytes == 0 ||
+                megabytes > 1024 * 1024) {
+                log_fatal("invalid cache budget %s\n", argv[arg_index]);
+                os_abort(1);
+            }
+
+            micro_cache_set_budget(megabytes * megabyte);
+        } else if (str8_are_equal(arg, str8("--rate-limit")) && has_value) {
+            u32 rate = 0;
+            u32 burst = 0;
+
+            if (!parse_rate_rule(str8_from_cstring(argv[++arg_index]), &rate, &burst) ||
+                !rate_limit_set_client_rule(rate, burst)) {
+                log_fatal("invalid rate limit %s\n", argv[arg_index]);
+                os_abort(1);
+            }
+        } else if (str8_are_equal(arg, str8("--rate-limit-route")) && has_value) {
+            String8 value = str8_from_cstring(argv[++arg_index]);
+            String8 route = str8_split_to(value, ":");
+            u32 rate = 0;
+            u32 burst = 0;
+
+            if (!str8_is_valid(route) || !parse_rate_rule(str8_skip(value, route.len + 1), &rate, &burst) ||
+                !rate_limit_add_route(route, rate, burst)) {
+                log_fatal("invalid route rate limit %s\n", argv[arg_index]);
+                os_abort(1);
+            }
+        } else if (str8_are_equal(arg, str8("--tasks"))) {
+            use_tasks = 1;
+        } else if (str8_are_equal(arg, str8("--offload-threads")) && has_value) {
+            if (!str8_to_u64(str8_from_cstring(argv[++arg_index]), &offload_thread_count) ||
+                offload_thread_count == 0 || offload_thread_count > OFFLOAD_MAX_THREADS) {
+                log_fatal("invalid offload thread count %s\n", argv[arg_index]);
+                os_abort(1);
+            }
+
+            use_tasks = 1;
+        } else if (str8_are_equal(arg, str8("--offload-queue")) && has_value) {
+            if (!str8_to_u64(str8_from_cstring(argv[++arg_index]), &offload_queue_limit) ||
+                offload_queue_limit == 0 || offload_queue_limit > OFFLOAD_MAX_QUEUE_LIMIT) {
+                log_fatal("invalid offload queue limit %s\n", argv[arg_index]);
+                os_abort(1);
+            }
+        } else if (str8_are_equal(arg, str8("--task-stack")) && has_value) {
+            u64 kilobytes = 0;
+
+            if (!str8_to_u64(str8_from_cstring(argv[++arg_index]), &kilobytes) || kilobytes < 16 ||
+                kilobytes > 64 * 1024) {
+                log_fatal("invalid task stack size %s\n", argv[arg_index]);
+                os_abort(1);
+            }
+
+            coroutine_set_stack_size(kilobytes * kilobyte);
+        } else if (str8_are_equal(arg, str8("--static")) && has_value) {
+            static_root = str8_from_cstring(argv[++arg_index]);
+        } else if (str8_are_equal(arg, str8("--compress"))) {
+            compress_budget_size = Max(compress_budget_size, COMPRESS_DEFAULT_BUDGET);
+        } else if (str8_are_equal(arg, str8("--compress-budget")) && has_value) {
+            u64 megabytes = 0;
+
+            if (!str8_to_u64(str8_from_cstring(argv[++arg_index]), &megabytes) || megabytes == 0 ||
+                megabytes > 1024 * 1024) {
+                log_fatal("invalid compression cache budget %s\n", argv[arg_index]);
+                os_abort(1);
+            }
+
+            compress_budget_size = megabytes * megabyte;
+        } else if (str8_are_equal(arg, str8("--quiet"))) {
+            hello_is_quiet = 1;
+        } else if (str8_are_equal(arg, str8("--mock"))) {
+            use_mock = 1;
+        } else if (str8_are_equal(arg, str8("--mock-corpus")) && has_value) {
+            use_mock = 1;
+            mock_corpus_path = str8_from_cstring(argv[++arg_index]);
+        } else if (str8_are_equal(arg, str8("--mock-capture")) && has_value) {
+            mock_capture_path = str8_from_cstring(argv[++arg_index]);
+        } else if (str8_are_equal(arg, str8("--mock-fragment")) && has_value) {
+            if (!str8_to_u64(str8_from_cstring(argv[++arg_index]), &mock_fragment_size) ||
+                mock_fragment_size > REQUEST_BUFFER_SIZE) {
+                log_fatal("invalid mock fragment size %s\n", argv[arg_index]);
+                os_abort(1);
+            }
+        } else if (str8_are_equal(arg, str8("--mock-connections")) && has_value) {
+            if (!str8_to_u64(str8_from_cstring(argv[++arg_index]), &mock_connections)) {
+                log_fatal("invalid mock connection count %s\n", argv[arg_index]);
+                os_abort(1);
+            }
+        } else if (str8_are_equal(arg, str8("--access-log")) && has_value) {
+            access_log_path = str8_from_cstring(argv[++arg_index]);
+
+            if (access_log_path.len == 0 || access_log_path.len > ACCESS_LOG_MAX_PREFIX_SIZE) {
+                log_fatal("invalid access log prefix %s\n", argv[arg_index]);
+                os_abort(1);
+            }
+        } else if (str8_are_equal(arg, str8("--access-log-rotate")) && has_value) {
+            u64 megabytes = 0;
+
+            if (!str8_to_u64(str8_from_cstring(argv[++arg_index]), &megabytes) || megabytes == 0 ||
+                megabytes > 1024 * 1024) {
+                log_fatal("invalid access log rotation size %s\n", argv[arg_index]);
+                os_abort(1);
+            }
+
+            access_log_rotate_size = megabytes * megabyte;
+        } else {
+            log_fatal("usage: %s [--listen address]... [--workers count] [--upstream address]...\n"
+                      "          [--backlog N] [--reuseport] [--incoming-cpu] [--no-nodelay]\n"
+                      "          [--defer-accept seconds] [--fastopen N] [--sndbuf KB] [--rcvbuf KB]\n"
+                      "          [--trace-sample N] [--trace-file path]\n"
+                      "          [--access-log prefix] [--access-log-rotate MB]\n"
+                      "          [--cache-route path[:ttl_ms]]... [--cache-budget MB]\n"
+                      "          [--rate-limit rate[:burst]] [--rate-limit-route path:rate[:burst]]...\n"
+                      "          [--tasks] [--task-stack KB] [--offload-threads N] [--offload-queue N]\n"
+                      "          [--quiet] [--static dir]\n"
+                      "          [--compress] [--compress-budget MB]\n"
+                      "          [--mock | --mock-corpus file] [--mock-fragment bytes] [--mock-connections N]\n"
+                      "          [--mock-capture file]\n"
+                      "  address: port | host:port | [ipv6]:port | unix:path | unix:@abstract\n", argv[0]);
+            os_abort(1);
+        }
+    }
+
+    os_ignore_broken_pipe();
+    compress_init(compress_budget_size);
+
+    if (trace_interval) {
+        trace_init(trace_interval, trace_path);
+    }
+
+    if (str8_is_valid(access_log_path)) {
+        access_log_init(access_log_path, access_log_rotate_size);
+    }
+
+    server_set_handler(handle_hello);
+
+    if (use_tasks) {
+        http_task_set_handler(handle_hello_task);
+    }
 
-    if (server_handle.value == 0) {
-        log_fatal("failed to bind and listen to port %d\n", port);
+    if (offload_thread_count && !offload_init((u32)offload_thread_count, (u32)offload_queue_limit)) {
+        log_fatal("failed to start the offload threads\n");
         os_abort(1);
     }
 
-    log_info("Starting server - listening on port %d\n", port);
+    // NOTE: replays the corpus through the request path on this thread, without sockets
+    if (use_mock) {
+        Arena *corpus_arena = arena_alloc(64 * megabyte, 64 * kilobyte, 0, 1);
+        String8 corpus = {0};
+
+        if (str8_is_valid(mock_corpus_path)) {
+            corpus = os_read_entire_file(corpus_arena, mock_corpus_path);
+
+            if (!str8_is_valid(corpus)) {
+                log_fatal("failed to read the mock corpus %.*s\n", str8_expand(mock_corpus_path));
+                os_abort(1);
+            }
+        }
+
+        if (!mock_transport_init(corpus, mock_fragment_size, mock_connections, str8_is_valid(mock_capture_path))) {
+            log_fatal("the mock corpus is empty\n");
+            os_abort(1);
+        }
+
+        OS_Handle mock_listener = {0};
+        balance_init(1);
+        entrypoint(0, &mock_listener, 1);
+        mock_transport_report(mock_capture_path);
+
+        return 0;
+    }
+
+    if (listener_count == 0) {
+        listen_addresses[listener_count++] = str8("8080");
+    }
+
+    worker_count = ClampTop(worker_count, BALANCE_MAX_WORKERS);
+
+    // NOTE: with SO_REUSEPORT every worker gets listeners of its own, so the kernel spreads
+    // connections over their accept queues; otherwise all workers accept from one set. A unix
+    // socket cannot join a reuseport group and stays shared
+    local OS_Handle listener_handles[BALANCE_MAX_WORKERS][THREAD_MAX_LISTENERS];
+
+    for (u32 listener_index = 0; listener_index < listener_count; ++listener_index) {
+        String8 address = listen_addresses[listener_index];
+        b32 is_shared = !socket_options.reuse_port || str8_are_equal(str8_prefix(address, 5), str8("unix:"));
+
+        for (u32 thread_id = 0; thread_id < worker_count; ++thread_id) {
+            i32 processor = socket_options.use_incoming_cpu ? (i32)(thread_id % processor_count) : -1;
+
+            if (is_shared && thread_id > 0) {
+                listener_handles[thread_id][listener_index] = listener_handles[0][listener_index];
+            } else {
+                listener_handles[thread_id][listener_index] = server_listen(address, &socket_options, processor);
+            }
+        }
+
+        log_info("Listening on %.*s\n", str8_expand(address));
+    }
+
+    balance_init(worker_count);
+
+    log_info("Starting server with %d workers\n", worker_count);
+
+    // NOTE: SO_INCOMING_CPU only keeps a connection on one core when its worker runs there too
+    local WorkerParams workers[BALANCE_MAX_WORKERS];
+
+    for (u32 thread_id = 0; thread_id < worker_count; ++thread_id) {
+        workers[thread_id].thread_id = thread_id;
+        workers[thread_id].listener_handles = listener_handles[thread_id];
+        workers[thread_id].listener_count = listener_count;
+        workers[thread_id].processor = socket_options.use_incoming_cpu ? (i32)(thread_id % processor_count) : -1;
+
+        if (thread_id > 0 && !thread_launch(worker_thread_entry, &workers[thread_id])) {
+            log_fatal("failed to launch worker %d\n", thread_id);
+            os_abort(1);
+        }
+    }
 
-    entrypoint(0, server_handle);
+    worker_thread_entry(&workers[0]);
 
     return 0;
 }
@@ -0,0 +1,315 @@
+#include "http_mock.h"
+#include <errno.h>
+#include <stdio.h>
+
+global MockTransport *mock_transport;
+
+// NOTE: a handful of representative requests, used when no corpus file is given
+global String8 mock_default_corpus = str8_comp(
+    "GET / HTTP/1.1\r\n"
+    "Host: localhost\r\n"
+    "\r\n"
+    "GET /api/v1/items?page=2&sort=desc HTTP/1.1\r\n"
+    "Host: example.com\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Cookie: session=0123456789abcdef; theme=dark\r\n"
+    "Cache-Control: no-cache\r\n"
+    "\r\n"
+    "POST /submit HTTP/1.1\r\n"
+    "Host: example.com\r\n"
+    "Content-Type: application/x-www-form-urlencoded\r\n"
+    "Content-Length: 27\r\n"
+    "\r\n"
+    "name=mock&value=transport42"
+    "HEAD /index.html HTTP/1.1\r\n"
+    "Host: localhost\r\n"
+    "\r\n"
+    "GET /missing-version\r\n"
+    "\r\n");
+
+//////////////////////////////
+// Corpus
+
+// NOTE: the corpus is raw requests back to back, as captured off the wire; each becomes the
+// byte stream of one connection, its body sized by Content-Length. Bytes after the last
+// complete head form a final stream of their own
+local u32 mock_split_corpus(Arena *arena, String8 corpus, String8 **streams_out) {
+    String8List streams = {0};
+    Scratch *scratch = arena_alloc(64 * kilobyte, 64 * kilobyte, 0, 0);
+
+    while (corpus.len > 0) {
+        i64 head_end = http_find_head_end(corpus);
+        u64 stream_length = corpus.len;
+
+        if (head_end != -1) {
+            HttpRequest request = http_parse_request(scratch, str8_prefix(corpus, head_end));
+            String8 content_length = http_headers_get(&request.headers, HttpHeaderId_ContentLength);
+            u64 body_length = 0;
+
+            if (str8_is_valid(content_length)) {
+                str8_to_u64(content_length, &body_length);
+            }
+
+            stream_length = Min(head_end + body_length, corpus.len);
+            arena_clear(scratch);
+        }
+
+        str8_list_push(arena, &streams, str8_prefix(corpus, stream_length));
+        corpus = str8_skip(corpus, stream_length);
+    }
+
+    arena_release(scratch);
+
+    String8 *result = push_array(arena, String8, Max(streams.node_count, 1));
+    u32 index = 0;
+
+    for (String8Node *node = streams.first; node; node = node->next) {
+        result[index++] = node->string;
+    }
+
+    *streams_out = result;
+
+    return index;
+}
+
+b32 mock_transport_init(String8 corpus, u32 fragment_size, u64 connection_target, b32 is_capturing) {
+    Arena *arena = arena_alloc(64 * megabyte, 64 * kilobyte, 0, 1);
+    MockTransport *mock = push_struct_zero(arena, MockTransport);
+
+    mock->arena = arena;
+    mock->stream_count = mock_split_corpus(arena, str8_is_valid(corpus) ? corpus : mock_default_corpus, &mock->streams);
+    mock->fragment_size = fragment_size;
+    mock->connection_target = connection_target ? connection_target : mock->stream_count;
+    mock->queue = push_array_zero(arena, IO_Uring_Completion_Entry, MOCK_QUEUE_SIZE);
+    mock->connections = push_array_zero(arena, MockConnection, SERVER_MAX_CONNECTIONS);
+    mock->free_connections = push_array(arena, u32, SERVER_MAX_CONNECTIONS);
+
+    if (mock->stream_count == 0) {
+        arena_release(arena);
+        return 0;
+    }
+
+    for (u32 index = 0; index < SERVER_MAX_CONNECTIONS; ++index) {
+        mock->free_connections[index] = SERVER_MAX_CONNECTIONS - 1 - index;
+    }
+
+    mock->free_count = SERVER_MAX_CONNECTIONS;
+
+    mock->is_capturing = is_capturing;
+    mock_transport = mock;
+
+    return 1;
+}
+
+b32 mock_transport_is_enabled(void) {
+    return mock_transport != 0;
+}
+
+//////////////////////////////
+// Operations
+
+// NOTE: honours the two flags linked chains use: a failed entry breaks its link, and a
+// successful one asking to skip its completion posts nothing
+local void mock_complete(MockTransport *mock, IO_Uring_Submission_Entry *sqe, i32 result) {
+    mock->is_link_broken = (sqe->flags & IOSQE_IO_LINK) && result < 0;
+
+    if (result >= 0 && (sqe->flags & IOSQE_CQE_SKIP_SUCCESS)) {
+        return;
+    }
+
+    if (mock->queue_tail - mock->queue_head == MOCK_QUEUE_SIZE) {
+        log_fatal("mock completion queue overflow\n");
+        os_abort(1);
+    }
+
+    IO_Uring_Completion_Entry *cqe = &mock->queue[mock->queue_tail++ & (MOCK_QUEUE_SIZE - 1)];
+    cqe->user_data = sqe->user_data;
+    cqe->res = result;
+    cqe->flags = 0;
+}
+
+local MockConnection *mock_connection(MockTransport *mock, i32 fd) {
+    u32 index = (u32)(fd - MOCK_FD_BASE);
+
+    return index < SERVER_MAX_CONNECTIONS ? &mock->connections[index] : 0;
+}
+
+local void mock_accept(MockTransport *mock, IO_Uring_Submission_Entry *sqe) {
+    // NOTE: the accept stays pending once the target is reached, which lets the queue drain
+    if (mock->accepted == mock->connection_target || mock->free_count == 0) {
+        return;
+    }
+
+    u32 index = mock->free_connections[--mock->free_count];
+    MockConnection *connection = &mock->connections[index];
+    connection->stream_index = (u32)(mock->accepted % mock->stream_count);
+    connection->offset = 0;
+    connection->sequence = mock->accepted;
+    connection->response_hash = 0;
+
+    SockAddrIPv4 *address = (SockAddrIPv4 *)sqe->addr;
+    address->family = AF_INET;
+    address->port = network_byte_order((u16)(1024 + mock->accepted % 60000));
+    address->addr = 0x0100007f;
+    *(u32 *)sqe->addr2 = sizeof(SockAddrIPv4);
+
+    if (mock->accepted == 0) {
+        mock->begin_time = os_now_nanoseconds();
+    }
+
+    mock->accepted += 1;
+    mock_complete(mock, sqe, MOCK_FD_BASE + index);
+}
+
+local void mock_read(MockTransport *mock, IO_Uring_Submission_Entry *sqe) {
+    MockConnection *connection = mock_connection(mock, sqe->fd);
+
+    if (!connection) {
+        mock_complete(mock, sqe, -EBADF);
+        return;
+    }
+
+    String8 remaining = str8_skip(mock->streams[connection->stream_index], connection->offset);
+    u64 length = Min(remaining.len, sqe->len);
+
+    if (mock->fragment_size) {
+        length = Min(length, mock->fragment_size);
+    }
+
+    memcpy((u8 *)sqe->addr, remaining.data, length);
+    connection->offset += length;
+    mock->reads += 1;
+    mock->bytes_read += length;
+
+    mock_complete(mock, sqe, (i32)length);
+}
+
+local void mock_write(MockTransport *mock, IO_Uring_Submission_Entry *sqe) {
+    MockConnection *connection = mock_connection(mock, sqe->fd);
+
+    // NOTE: a descriptor below the mock range is a real file, the access log's, written in place
+    if (!connection && sqe->fd >= 0 && sqe->fd < MOCK_FD_BASE) {
+        i64 written = os_write_at(os_handle_from_fd(sqe->fd), (u8 *)sqe->addr, sqe->len, sqe->off);
+        mock_complete(mock, sqe, (i32)written);
+        return;
+    }
+
+    if (!connection) {
+        mock_complete(mock, sqe, -EBADF);
+        return;
+    }
+
+    String8 data = {sqe->len, (u8 *)sqe->addr};
+    connection->response_hash = hash_string_seeded(data, connection->response_hash);
+    mock->bytes_written += data.len;
+
+    // NOTE: only the first pass over the corpus is captured, so the capture stays the size of
+    // one response per stream however long the run
+    if (mock->is_capturing && connection->sequence < mock->stream_count) {
+        str8_list_push(mock->arena, &mock->capture, str8_pushf(mock->arena, "### %llu\n", connection->sequence));
+        str8_list_push(mock->arena, &mock->capture, str8_push_copy(mock->arena, data));
+
+        if (data.len > 0 && data.data[data.len - 1] != '\n') {
+            str8_list_push(mock->arena, &mock->capture, str8("\n"));
+        }
+    }
+
+    mock_complete(mock, sqe, (i32)data.len);
+}
+
+local void mock_close(MockTransport *mock, IO_Uring_Submission_Entry *sqe) {
+    OS_Handle handle = os_handle_from_fd(sqe->fd);
+
+    if (!mock_connection(mock, sqe->fd)) {
+        mock_complete(mock, sqe, -EBADF);
+        return;
+    }
+
+    mock_transport_close(handle);
+    mock_complete(mock, sqe, 0);
+}
+
+// NOTE: takes the place of the ring for an SQE the server has prepared; operations other than
+// accept, read, write and close are not modelled and fail the submission, so timers, upstream
+// connections, WebSocket writes and ring messages never reach the kernel
+b32 mock_transport_submit(IO_Uring_Submission_Entry *sqe) {
+    MockTransport *mock = mock_transport;
+
+    if (mock->is_link_broken) {
+        mock_complete(mock, sqe, -ECANCELED);
+        return 1;
+    }
+
+    switch (sqe->opcode) {
+    case IORING_OP_ACCEPT:
+        mock_accept(mock, sqe);
+        return 1;
+    case IORING_OP_READ:
+        mock_read(mock, sqe);
+        return 1;
+    case IORING_OP_WRITE:
+        mock_write(mock, sqe);
+        return 1;
+    case IORING_OP_CLOSE:
+        mock_close(mock, sqe);
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+i32 mock_transport_wait(IO_Uring_Completion_Entry **cqe_out) {
+    MockTransport *mock = mock_transport;
+
+    if (mock->queue_head == mock->queue_tail) {
+        mock->end_time = os_now_nanoseconds();
+        return -ENODATA;
+    }
+
+    *cqe_out = &mock->queue[mock->queue_head++ & (MOCK_QUEUE_SIZE - 1)];
+
+    return 0;
+}
+
+void mock_transport_close(OS_Handle handle) {
+    MockTransport *mock = mock_transport;
+    MockConnection *connection = mock_connection(mock, handle.value);
+
+    // NOTE: connections finish in whatever order the server gets to them, so their hashes are
+    // summed rather than chained, keeping the total independent of fragment size
+    if (connection) {
+        mock->response_hash += connection->response_hash;
+        mock->free_connections[mock->free_count++] = (u32)(connection - mock->connections);
+        mock->closed += 1;
+    }
+}
+
+//////////////////////////////
+// Report
+
+void mock_transport_report(String8 capture_path) {
+    MockTransport *mock = mock_transport;
+    f64 seconds = (f64)(mock->end_time - mock->begin_time) / 1e9;
+
+    fprintf(stderr, "streams %u, fragment %u, connections %llu, unfinished %llu\n", mock->stream_count, mock->fragment_size,
+                    (unsigned long long)mock->accepted, (unsigned long long)(mock->accepted - mock->closed));
+    fprintf(stderr, "%.3f s, %.0f requests/s, %.1f ns/request, %.2f reads/request\n", seconds, mock->accepted / seconds,
+                    seconds * 1e9 / Max(mock->accepted, 1), (f64)mock->reads / Max(mock->accepted, 1));
+    fprintf(stderr, "read %llu bytes, wrote %llu bytes, response hash %016llx\n", (unsigned long long)mock->bytes_read,
+                    (unsigned long long)mock->bytes_written, (unsigned long long)mock->response_hash);
+
+    if (str8_is_valid(capture_path)) {
+        OS_Handle file = os_create_file(capture_path);
+
+        if (!file.value || !os_write_all(file, str8_list_join(mock->arena, &mock->capture, str8("")))) {
+            log_error("failed to write the capture to %.*s\n", str8_expand(capture_path));
+        }
+
+        if (file.value) {
+            os_close(file);
+        }
+    }
+}
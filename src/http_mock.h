@@ -0,0 +1,64 @@
+#ifndef HTTP_MOCK_H
+#define HTTP_MOCK_H
+
+#include "http_server.h"
+
+// NOTE: mock connections get descriptors far above any real one, so nothing that slips past
+// the transport reaches a real file
+#define MOCK_FD_BASE (1 << 24)
+#define MOCK_QUEUE_SIZE (SERVER_MAX_CONNECTIONS * 4)
+
+typedef struct MockConnection MockConnection;
+struct MockConnection {
+    u32 stream_index;
+    u32 offset;
+    u64 sequence;
+    u64 response_hash;
+};
+
+// NOTE: an in-memory backend for the server's ring operations. Accepts hand out connections
+// that replay the corpus streams in order, reads return the next fragment of the stream (at
+// most fragment_size bytes, zero meaning whole), writes are hashed per connection and optionally captured,
+// and every operation completes through a FIFO queue the completion loop drains instead of the
+// ring. Writes to a real file, the access log's, are done in place. The run ends once the queue
+// is empty, after connection_target accepts
+typedef struct MockTransport MockTransport;
+struct MockTransport {
+    Arena *arena;
+    String8 *streams;
+    u32 stream_count;
+    u32 fragment_size;
+    u64 connection_target;
+
+    IO_Uring_Completion_Entry *queue;
+    u32 queue_head;
+    u32 queue_tail;
+
+    MockConnection *connections;
+    u32 *free_connections;
+    u32 free_count;
+
+    u64 accepted;
+    u64 closed;
+    u64 reads;
+    u64 bytes_read;
+    u64 bytes_written;
+    u64 response_hash;
+    u64 begin_time;
+    u64 end_time;
+
+    b32 is_link_broken;
+    b32 is_capturing;
+    String8List capture;
+};
+
+b32 mock_transport_init(String8 corpus, u32 fragment_size, u64 connection_target, b32 is_capturing);
+b32 mock_transport_is_enabled(void);
+
+b32 mock_transport_submit(IO_Uring_Submission_Entry *sqe);
+i32 mock_transport_wait(IO_Uring_Completion_Entry **cqe_out);
+void mock_transport_close(OS_Handle handle);
+
+void mock_transport_report(String8 capture_path);
+
+#endif // HTTP_MOCK_H
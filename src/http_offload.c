@@ -0,0 +1,286 @@
+#include "http_offload.h"
+#include <errno.h>
+
+global OffloadThread offload_threads[OFFLOAD_MAX_THREADS];
+global u32 offload_thread_count;
+global u32 offload_queue_limit;
+global b32 offload_is_disabled;
+global u64 offload_rejected;
+global u64 offload_failed;
+
+// NOTE: job arenas are taken and given back by the worker that submits the job, so each worker
+// keeps its own free list and the offload threads never allocate
+thread_static Arena *offload_free_arena;
+thread_static u32 offload_free_arena_count;
+thread_static u32 offload_next_thread;
+
+//////////////////////////////
+// Offload threads
+
+local void offload_job_run(OffloadJob *job) {
+    job->result = job->function(job);
+    __atomic_store_n(&job->is_done, 1, __ATOMIC_RELEASE);
+}
+
+// NOTE: once the reply is delivered the worker may resume and drop the job, so only a failed
+// reply, which the worker never saw, comes back here to be sent again
+local void offload_reply(OffloadThread *thread, OffloadJob *job) {
+    u32 tail;
+    IO_Uring_Submission_Entry *sqe = os_io_uring_get_sqe(&thread->ring, &tail);
+
+    os_io_uring_prep_sqe(sqe, IORING_OP_MSG_RING);
+
+    sqe->fd = job->reply_ring_fd;
+    sqe->addr = IORING_MSG_DATA;
+    sqe->len = (u32)job->result;
+    sqe->off = job->reply_user_data;
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    sqe->user_data = (u64)job | OFFLOAD_USER_DATA_REPLY;
+
+    os_io_write_barrier(thread->ring.sring_tail, tail + 1);
+
+    if (os_io_uring_enter(thread->ring.ring_fd, 1, 0, 0) < 0) {
+        log_error("offload thread %u failed to submit a reply\n", thread->index);
+    }
+}
+
+local void *offload_thread_entry(void *params) {
+    OffloadThread *thread = (OffloadThread *)params;
+    IO_Uring_Completion_Entry *cqe;
+
+    for (;;) {
+        i32 result = os_io_uring_wait_cqe(&thread->ring, &cqe);
+
+        if (result == -EINTR) {
+            continue;
+        }
+
+        if (result < 0) {
+            log_fatal("offload thread %u failed to wait for jobs - %d\n", thread->index, result);
+            os_abort(1);
+        }
+
+        u64 user_data = cqe->user_data;
+        OffloadJob *job = (OffloadJob *)(user_data & ~(u64)OFFLOAD_USER_DATA_REPLY);
+
+        if (user_data & OFFLOAD_USER_DATA_REPLY) {
+            __atomic_store_n(&thread->reply_retries, thread->reply_retries + 1, __ATOMIC_RELAXED);
+            offload_reply(thread, job);
+            continue;
+        }
+
+        u64 start_time = os_now_nanoseconds();
+        offload_job_run(job);
+        u64 end_time = os_now_nanoseconds();
+
+        __atomic_store_n(&thread->queue_nanoseconds, thread->queue_nanoseconds + (start_time - job->submit_time),
+                         __ATOMIC_RELAXED);
+        __atomic_store_n(&thread->run_nanoseconds, thread->run_nanoseconds + (end_time - start_time), __ATOMIC_RELAXED);
+        __atomic_store_n(&thread->completed, thread->completed + 1, __ATOMIC_RELAXED);
+
+        // NOTE: the job counts against the queue limit until its reply has been submitted
+        offload_reply(thread, job);
+        __atomic_sub_fetch(&thread->queued, 1, __ATOMIC_RELAXED);
+    }
+
+    return 0;
+}
+
+// NOTE: the rings are set up here, before any worker starts, so every thread can take jobs as
+// soon as the server accepts
+b32 offload_init(u32 thread_count, u32 queue_limit) {
+    thread_count = ClampTop(thread_count, OFFLOAD_MAX_THREADS);
+    offload_queue_limit = ClampBottom(ClampTop(queue_limit, OFFLOAD_MAX_QUEUE_LIMIT), 1);
+
+    for (u32 thread_index = 0; thread_index < thread_count; ++thread_index) {
+        OffloadThread *thread = &offload_threads[thread_index];
+        thread->index = thread_index;
+
+        if (os_io_uring_init_ring(&thread->ring)) {
+            return 0;
+        }
+
+        if (!thread_launch(offload_thread_entry, thread)) {
+            return 0;
+        }
+
+        offload_thread_count = thread_index + 1;
+    }
+
+    return 1;
+}
+
+b32 offload_is_enabled(void) {
+    return offload_thread_count > 0 && !offload_is_disabled;
+}
+
+//////////////////////////////
+// Jobs
+
+local Arena *offload_arena_alloc(void) {
+    Arena *result = offload_free_arena;
+
+    if (result) {
+        offload_free_arena = result->next_free;
+        offload_free_arena_count -= 1;
+        return result;
+    }
+
+    return arena_alloc(OFFLOAD_ARENA_RESERVE_SIZE, OFFLOAD_ARENA_COMMIT_SIZE, 0, 1);
+}
+
+local void offload_arena_release(Arena *arena) {
+    if (offload_free_arena_count == OFFLOAD_MAX_FREE_ARENAS) {
+        arena_release(arena);
+        return;
+    }
+
+    arena_clear(arena);
+    arena->next_free = offload_free_arena;
+    offload_free_arena = arena;
+    offload_free_arena_count += 1;
+}
+
+// NOTE: the record goes in arena, which has to outlive the job, and the job gets an arena of
+// its own; zero when either is unavailable
+OffloadJob *offload_job_alloc(Arena *arena, OffloadFunction *function, void *input) {
+    OffloadJob *job = push_struct_zero(arena, OffloadJob);
+
+    if (!job) {
+        return 0;
+    }
+
+    job->arena = offload_arena_alloc();
+
+    if (!job->arena) {
+        return 0;
+    }
+
+    job->function = function;
+    job->input = input;
+
+    return job;
+}
+
+// NOTE: fills sqe, taken from the worker's ring with the user_data the reply should carry, to
+// send the job to the least loaded offload thread. Without the pool the job runs right here;
+// with every queue at its limit nothing is sent and the caller fails fast with -EBUSY
+b32 offload_prep_job(OffloadJob *job, IO_Uring_Submission_Entry *sqe, i32 reply_ring_fd) {
+    OffloadThread *target = 0;
+    u32 target_queued = offload_queue_limit;
+
+    if (!offload_is_enabled()) {
+        offload_job_run(job);
+        return 0;
+    }
+
+    for (u32 step = 0; step < offload_thread_count; ++step) {
+        OffloadThread *thread = &offload_threads[(offload_next_thread + step) % offload_thread_count];
+        u32 queued = __atomic_load_n(&thread->queued, __ATOMIC_RELAXED);
+
+        if (queued < target_queued) {
+            target = thread;
+            target_queued = queued;
+        }
+    }
+
+    offload_next_thread += 1;
+
+    // NOTE: the count is raised before the job is sent, so concurrent workers cannot overshoot
+    if (!target || __atomic_add_fetch(&target->queued, 1, __ATOMIC_RELAXED) > offload_queue_limit) {
+        if (target) {
+            __atomic_sub_fetch(&target->queued, 1, __ATOMIC_RELAXED);
+        }
+
+        __atomic_add_fetch(&offload_rejected, 1, __ATOMIC_RELAXED);
+
+        return 0;
+    }
+
+    __atomic_add_fetch(&target->submitted, 1, __ATOMIC_RELAXED);
+
+    job->reply_ring_fd = reply_ring_fd;
+    job->reply_user_data = sqe->user_data;
+    job->thread_index = target->index;
+    job->submit_time = os_now_nanoseconds();
+
+    // NOTE: IORING_MSG_DATA posts a completion on the offload ring with user_data = off
+    sqe->fd = target->ring.ring_fd;
+    sqe->addr = IORING_MSG_DATA;
+    sqe->len = 0;
+    sqe->off = (u64)job;
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+
+    return 1;
+}
+
+// NOTE: result is the completion that woke the submitter: the reply carrying the job's result,
+// or the failure of the send, in which case the job never ran and is counted out here. The
+// output is copied into arena before the job's own arena is recycled
+i32 offload_job_finish(OffloadJob *job, i32 result, Arena *arena, String8 *output_out) {
+    if (__atomic_load_n(&job->is_done, __ATOMIC_ACQUIRE)) {
+        result = job->result;
+
+        if (output_out && str8_is_valid(job->output)) {
+            *output_out = str8_push_copy(arena, job->output);
+            result = str8_is_valid(*output_out) ? result : -ENOMEM;
+        }
+    } else if (job->submit_time) {
+        __atomic_sub_fetch(&offload_threads[job->thread_index].queued, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&offload_failed, 1, __ATOMIC_RELAXED);
+
+        if (result == -EINVAL || result == -EOPNOTSUPP) {
+            log_warn("IORING_OP_MSG_RING unsupported, running offload jobs on the workers\n");
+            offload_is_disabled = 1;
+        }
+    } else {
+        result = -EBUSY;
+    }
+
+    offload_arena_release(job->arena);
+    job->arena = 0;
+
+    return result;
+}
+
+//////////////////////////////
+// Metrics
+
+void offload_metrics(OffloadMetrics *metrics_out) {
+    OffloadMetrics metrics = {0};
+
+    metrics.thread_count = offload_thread_count;
+    metrics.queue_limit = offload_queue_limit;
+    metrics.rejected = __atomic_load_n(&offload_rejected, __ATOMIC_RELAXED);
+    metrics.failed = __atomic_load_n(&offload_failed, __ATOMIC_RELAXED);
+
+    for (u32 thread_index = 0; thread_index < offload_thread_count; ++thread_index) {
+        OffloadThread *thread = &offload_threads[thread_index];
+
+        metrics.queued += __atomic_load_n(&thread->queued, __ATOMIC_RELAXED);
+        metrics.submitted += __atomic_load_n(&thread->submitted, __ATOMIC_RELAXED);
+        metrics.completed += __atomic_load_n(&thread->completed, __ATOMIC_RELAXED);
+        metrics.queue_nanoseconds += __atomic_load_n(&thread->queue_nanoseconds, __ATOMIC_RELAXED);
+        metrics.run_nanoseconds += __atomic_load_n(&thread->run_nanoseconds, __ATOMIC_RELAXED);
+        metrics.reply_retries += __atomic_load_n(&thread->reply_retries, __ATOMIC_RELAXED);
+    }
+
+    *metrics_out = metrics;
+}
+
+// NOTE: one "name value" pair per line, times as per-job averages in microseconds
+String8 offload_metrics_string(Arena *arena) {
+    OffloadMetrics metrics;
+    offload_metrics(&metrics);
+
+    u64 completed = ClampBottom(metrics.completed, 1);
+
+    return str8_pushf(arena,
+                      "threads %u\nqueue_limit %u\nqueued %u\nsubmitted %llu\ncompleted %llu\nrejected %llu\n"
+                      "failed %llu\nreply_retries %llu\nqueue_us_avg %llu\nrun_us_avg %llu\n",
+                      metrics.thread_count, metrics.queue_limit, metrics.queued, (unsigned long long)metrics.submitted,
+                      (unsigned long long)metrics.completed, (unsigned long long)metrics.rejected,
+                      (unsigned long long)metrics.failed, (unsigned long long)metrics.reply_retries,
+                      (unsigned long long)(metrics.queue_nanoseconds / completed / 1000),
+                      (unsigned long long)(metrics.run_nanoseconds / completed / 1000));
+}
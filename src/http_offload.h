@@ -0,0 +1,77 @@
+#ifndef HTTP_OFFLOAD_H
+#define HTTP_OFFLOAD_H
+
+#include "http_server.h"
+
+#define OFFLOAD_MAX_THREADS 64
+#define OFFLOAD_DEFAULT_QUEUE_LIMIT 64
+#define OFFLOAD_MAX_QUEUE_LIMIT 256
+#define OFFLOAD_MAX_FREE_ARENAS 16
+#define OFFLOAD_ARENA_RESERVE_SIZE (64 * megabyte)
+#define OFFLOAD_ARENA_COMMIT_SIZE (64 * kilobyte)
+
+// NOTE: odd user_data on an offload thread's ring is a reply that did not reach its worker
+#define OFFLOAD_USER_DATA_REPLY 0x1
+
+typedef struct OffloadJob OffloadJob;
+typedef i32 OffloadFunction(OffloadJob *job);
+
+// NOTE: blocking or CPU-heavy work run on an offload thread. The function reads input, does
+// its work in arena, which belongs to this job alone, and leaves any result in output. The
+// record lives in the submitting connection's arena, untouched by its worker until the reply
+struct OffloadJob {
+    OffloadFunction *function;
+    void *input;
+    Arena *arena;
+    String8 output;
+    i32 result;
+    b32 is_done;
+
+    i32 reply_ring_fd;
+    u32 thread_index;
+    u64 reply_user_data;
+    u64 submit_time;
+};
+
+// NOTE: one per offload thread. Jobs arrive on its ring as IORING_OP_MSG_RING completions
+// carrying the job pointer, and the result goes back the same way to the ring of the worker
+// that submitted it. queued is raised by workers before sending and lowered by the thread once
+// the reply is submitted, so it bounds the jobs waiting on the thread or on their reply
+typedef struct OffloadThread OffloadThread;
+struct OffloadThread {
+    IO_Uring ring;
+    u32 index;
+    u32 queued;
+
+    u64 submitted;
+    u64 completed;
+    u64 queue_nanoseconds;
+    u64 run_nanoseconds;
+    u64 reply_retries;
+} __attribute__((aligned(64)));
+
+typedef struct OffloadMetrics OffloadMetrics;
+struct OffloadMetrics {
+    u32 thread_count;
+    u32 queue_limit;
+    u32 queued;
+    u64 submitted;
+    u64 completed;
+    u64 rejected;
+    u64 failed;
+    u64 queue_nanoseconds;
+    u64 run_nanoseconds;
+    u64 reply_retries;
+};
+
+b32 offload_init(u32 thread_count, u32 queue_limit);
+b32 offload_is_enabled(void);
+
+OffloadJob *offload_job_alloc(Arena *arena, OffloadFunction *function, void *input);
+b32 offload_prep_job(OffloadJob *job, IO_Uring_Submission_Entry *sqe, i32 reply_ring_fd);
+i32 offload_job_finish(OffloadJob *job, i32 result, Arena *arena, String8 *output_out);
+
+void offload_metrics(OffloadMetrics *metrics_out);
+String8 offload_metrics_string(Arena *arena);
+
+#endif // HTTP_OFFLOAD_H
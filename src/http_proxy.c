@@ -0,0 +1,874 @@
+#include "http_proxy.h"
+#include "http_access_log.h"
+#include "http_trace.h"
+
+global ProxyBackend proxy_backend_configs[PROXY_MAX_BACKENDS];
+global u32 proxy_backend_config_count;
+
+thread_static ProxyPool *proxy_pool;
+
+global String8 proxy_bad_gateway = str8_comp(
+    "HTTP/1.1 502 Bad Gateway\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n");
+
+global String8 proxy_length_required = str8_comp(
+    "HTTP/1.1 411 Length Required\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n");
+
+global String8 proxy_request_hop_headers[] = {
+    str8_comp("Connection"),
+    str8_comp("Keep-Alive"),
+    str8_comp("Proxy-Connection"),
+    str8_comp("Proxy-Authorization"),
+    str8_comp("TE"),
+    str8_comp("Trailer"),
+    str8_comp("Upgrade"),
+    str8_comp("Expect"),
+};
+
+global String8 proxy_response_hop_headers[] = {
+    str8_comp("Connection"),
+    str8_comp("Keep-Alive"),
+    str8_comp("Proxy-Connection"),
+    str8_comp("Proxy-Authenticate"),
+    str8_comp("Upgrade"),
+};
+
+//////////////////////////////
+// Configuration
+
+b32 proxy_add_backend(String8 address) {
+    b32 ok = 0;
+
+    if (proxy_backend_config_count >= PROXY_MAX_BACKENDS) {
+        return ok;
+    }
+
+    ProxyBackend *backend = &proxy_backend_configs[proxy_backend_config_count];
+    memset(backend, 0, sizeof(*backend));
+
+    ok = os_sockaddr_from_string(address, &backend->addr, &backend->addr_length);
+
+    if (ok) {
+        proxy_backend_config_count++;
+    }
+
+    return ok;
+}
+
+b32 proxy_is_enabled(void) {
+    return proxy_backend_config_count > 0;
+}
+
+void proxy_thread_init(ThreadContext *context) {
+    proxy_pool = push_struct_zero(context->permanent_arena, ProxyPool);
+    proxy_pool->backend_count = proxy_backend_config_count;
+
+    memcpy(proxy_pool->backends, proxy_backend_configs, sizeof(proxy_backend_configs));
+}
+
+//////////////////////////////
+// Upstream connections
+
+local ProxyBackend *proxy_pick_backend(void) {
+    ProxyPool *pool = proxy_pool;
+    ProxyBackend *result = 0;
+
+    // NOTE: least outstanding requests, ties broken round-robin
+    for (u32 offset = 0; offset < pool->backend_count; ++offset) {
+        u32 index = (pool->next_backend + offset) % pool->backend_count;
+        ProxyBackend *backend = &pool->backends[index];
+
+        if (result == 0 || backend->outstanding < result->outstanding) {
+            result = backend;
+        }
+    }
+
+    pool->next_backend = (pool->next_backend + 1) % pool->backend_count;
+
+    return result;
+}
+
+local void proxy_connection_destroy(ProxyConnection *connection) {
+    if (connection->handle.value) {
+        os_close(connection->handle);
+    }
+
+    if (connection->pipe_read.value) {
+        os_close(connection->pipe_read);
+        os_close(connection->pipe_write);
+    }
+
+    connection->next = proxy_pool->free_connections;
+    proxy_pool->free_connections = connection;
+}
+
+local ProxyConnection *proxy_connection_alloc(ThreadContext *context, ProxyBackend *backend) {
+    ProxyConnection *connection = proxy_pool->free_connections;
+
+    if (connection) {
+        proxy_pool->free_connections = connection->next;
+    } else {
+        connection = push_struct(context->permanent_arena, ProxyConnection);
+    }
+
+    memset(connection, 0, sizeof(*connection));
+    connection->backend = backend;
+    connection->handle = os_socket(backend->addr.family);
+
+    if (connection->handle.value == 0 || !os_pipe(&connection->pipe_read, &connection->pipe_write)) {
+        log_error("failed to create upstream socket\n");
+        proxy_connection_destroy(connection);
+        return 0;
+    }
+
+    return connection;
+}
+
+local void proxy_connection_release(ProxyConnection *connection, b32 is_reusable) {
+    ProxyBackend *backend = connection->backend;
+
+    if (is_reusable && backend->idle_count < PROXY_MAX_IDLE_CONNECTIONS) {
+        connection->is_reused = 1;
+        connection->next = backend->idle;
+        backend->idle = connection;
+        backend->idle_count++;
+    } else {
+        proxy_connection_destroy(connection);
+    }
+}
+
+//////////////////////////////
+// Submission
+
+local void proxy_fail(ThreadContext *context, struct Request *request);
+
+// NOTE: a refused submission fails the exchange like a failed completion would, answering 502
+// or closing the connection and releasing the upstream either way
+local b32 proxy_submit(ThreadContext *context, struct Request *request, IO_Uring_Submission_Entry *sqe, u32 tail) {
+    sqe->user_data = request_user_data(request, request->event_type);
+    trace_submit(request, request->event_type);
+
+    if (!server_submit(context, sqe, tail)) {
+        proxy_fail(context, request);
+        return 0;
+    }
+
+    return 1;
+}
+
+local b32 proxy_submit_connect(ThreadContext *context, struct Request *request, ProxyConnection *connection) {
+    u32 tail;
+    ProxyBackend *backend = connection->backend;
+    IO_Uring_Submission_Entry *sqe = os_io_uring_get_sqe(&context->ring, &tail);
+
+    os_io_uring_prep_sqe(sqe, IORING_OP_CONNECT);
+
+    sqe->fd = connection->handle.value;
+    sqe->addr = (u64)&backend->addr;
+    sqe->off = backend->addr_length;
+
+    return proxy_submit(context, request, sqe, tail);
+}
+
+local b32 proxy_submit_send(ThreadContext *context, struct Request *request, OS_Handle handle, String8 data) {
+    u32 tail;
+    IO_Uring_Submission_Entry *sqe = os_io_uring_get_sqe(&context->ring, &tail);
+
+    os_io_uring_prep_sqe(sqe, IORING_OP_SEND);
+
+    sqe->fd = handle.value;
+    sqe->addr = (u64)data.data;
+    sqe->len = data.len;
+    sqe->msg_flags = MSG_NOSIGNAL;
+
+    return proxy_submit(context, request, sqe, tail);
+}
+
+local b32 proxy_submit_recv(ThreadContext *context, struct Request *request, OS_Handle handle, String8 buffer) {
+    u32 tail;
+    IO_Uring_Submission_Entry *sqe = os_io_uring_get_sqe(&context->ring, &tail);
+
+    os_io_uring_prep_sqe(sqe, IORING_OP_RECV);
+
+    sqe->fd = handle.value;
+    sqe->addr = (u64)buffer.data;
+    sqe->len = buffer.len;
+
+    return proxy_submit(context, request, sqe, tail);
+}
+
+local b32 proxy_submit_splice(ThreadContext *context, struct Request *request, OS_Handle in, OS_Handle out, u64 size) {
+    u32 tail;
+    IO_Uring_Submission_Entry *sqe = os_io_uring_get_sqe(&context->ring, &tail);
+
+    os_io_uring_prep_sqe(sqe, IORING_OP_SPLICE);
+
+    sqe->fd = out.value;
+    sqe->len = ClampTop(size, PROXY_SPLICE_CHUNK_SIZE);
+    sqe->off = -1;
+    sqe->splice_off_in = -1;
+    sqe->splice_fd_in = in.value;
+
+    return proxy_submit(context, request, sqe, tail);
+}
+
+//////////////////////////////
+// Message rewriting
+
+local b32 proxy_is_hop_header(String8 key, String8 *hop_headers, u32 hop_header_count) {
+    for (u32 index = 0; index < hop_header_count; ++index) {
+        if (str8_are_equal_case_insensitive(key, hop_headers[index])) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+local void proxy_append(String8 *buffer, String8 string) {
+    memcpy(buffer->data + buffer->len, string.data, string.len);
+    buffer->len += string.len;
+}
+
+local void proxy_append_header(String8 *buffer, String8 key, String8 value) {
+    proxy_append(buffer, key);
+    proxy_append(buffer, str8(": "));
+    proxy_append(buffer, value);
+    proxy_append(buffer, str8("\r\n"));
+}
+
+local String8 proxy_build_request(Arena *arena, struct Request *request, HttpRequest *http_request, String8 body_prefix) {
+    String8 request_line = str8_split_to(request->request_buffer, "\r\n");
+    String8 method = str8_split_to(request_line, " ");
+    u8 address_buffer[OS_ADDRESS_STRING_SIZE];
+    String8 client_address = os_sockaddr_host_string(request->client_address, address_buffer);
+    String8 forwarded_key = str8("X-Forwarded-For");
+    u64 capacity = request_line.len + 64 + client_address.len + body_prefix.len;
+
+    for (u32 index = 0; index < http_request->headers.count; ++index) {
+        HttpHeader *header = &http_request->headers.items[index];
+        capacity += header->key.len + header->value.len + 4;
+    }
+
+    String8 result = {0};
+    result.data = arena_push(arena, capacity, 8);
+
+    if (!result.data) {
+        return result;
+    }
+
+    proxy_append(&result, method);
+    proxy_append(&result, str8(" "));
+    proxy_append(&result, http_request->path);
+    proxy_append(&result, str8(" HTTP/1.1\r\n"));
+
+    for (u32 index = 0; index < http_request->headers.count; ++index) {
+        HttpHeader *header = &http_request->headers.items[index];
+
+        if (str8_are_equal_case_insensitive(header->key, forwarded_key)) {
+            continue;
+        }
+
+        if (!proxy_is_hop_header(header->key, proxy_request_hop_headers, array_count(proxy_request_hop_headers))) {
+            proxy_append_header(&result, header->key, header->value);
+        }
+    }
+
+    // NOTE: the incoming chain, its fields joined in order, and this client go out as one
+    // X-Forwarded-For; a unix socket client adds no address of its own
+    u32 forwarded_count = 0;
+
+    for (u32 index = 0; index < http_request->headers.count; ++index) {
+        HttpHeader *header = &http_request->headers.items[index];
+
+        if (!str8_are_equal_case_insensitive(header->key, forwarded_key) || header->value.len == 0) {
+            continue;
+        }
+
+        proxy_append(&result, forwarded_count == 0 ? str8("X-Forwarded-For: ") : str8(", "));
+        proxy_append(&result, header->value);
+        forwarded_count += 1;
+    }
+
+    if (request->client_address->family != AF_UNIX) {
+        proxy_append(&result, forwarded_count == 0 ? str8("X-Forwarded-For: ") : str8(", "));
+        proxy_append(&result, client_address);
+        forwarded_count += 1;
+    }
+
+    if (forwarded_count > 0) {
+        proxy_append(&result, str8("\r\n"));
+    }
+
+    proxy_append_header(&result, str8("Connection"), str8("keep-alive"));
+    proxy_append(&result, str8("\r\n"));
+    proxy_append(&result, body_prefix);
+
+    return result;
+}
+
+local String8 proxy_build_response(Arena *arena, String8 status_line, HttpResponse *response, String8 body_prefix) {
+    u64 capacity = status_line.len + 32 + body_prefix.len;
+
+    for (HttpHeader *header = response->headers; header != 0; header = header->next) {
+        capacity += header->key.len + header->value.len + 4;
+    }
+
+    String8 result = {0};
+    result.data = arena_push(arena, capacity, 8);
+
+    if (!result.data) {
+        return result;
+    }
+
+    proxy_append(&result, status_line);
+    proxy_append(&result, str8("\r\n"));
+
+    for (HttpHeader *header = response->headers; header != 0; header = header->next) {
+        if (!proxy_is_hop_header(header->key, proxy_response_hop_headers, array_count(proxy_response_hop_headers))) {
+            proxy_append_header(&result, header->key, header->value);
+        }
+    }
+
+    proxy_append_header(&result, str8("Connection"), str8("close"));
+    proxy_append(&result, str8("\r\n"));
+    proxy_append(&result, body_prefix);
+
+    return result;
+}
+
+local u64 proxy_chunk_scan(ProxyExchange *exchange, String8 data) {
+    u64 pos = 0;
+
+    while (pos < data.len && exchange->chunk_state < ProxyChunkState_Done) {
+        u8 c = data.data[pos];
+
+        switch (exchange->chunk_state) {
+        case ProxyChunkState_Size:
+            if (c >= '0' && c <= '9' && exchange->chunk_remaining < (1ull << 56)) {
+                exchange->chunk_remaining = exchange->chunk_remaining * 16 + (c - '0');
+            } else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f' && exchange->chunk_remaining < (1ull << 56)) {
+                exchange->chunk_remaining = exchange->chunk_remaining * 16 + ((c | 0x20) - 'a' + 10);
+            } else if (c == ';' || c == ' ') {
+                exchange->chunk_state = ProxyChunkState_Extension;
+            } else if (c == '\r') {
+                exchange->chunk_state = ProxyChunkState_SizeLF;
+            } else {
+                exchange->chunk_state = ProxyChunkState_Invalid;
+            }
+            break;
+        case ProxyChunkState_Extension:
+            if (c == '\r') {
+                exchange->chunk_state = ProxyChunkState_SizeLF;
+            }
+            break;
+        case ProxyChunkState_SizeLF:
+            if (c != '\n') {
+                exchange->chunk_state = ProxyChunkState_Invalid;
+            } else if (exchange->chunk_remaining == 0) {
+                exchange->chunk_state = ProxyChunkState_TrailerStart;
+            } else {
+                exchange->chunk_state = ProxyChunkState_Data;
+            }
+            break;
+        case ProxyChunkState_Data: {
+            u64 size = Min(exchange->chunk_remaining, data.len - pos);
+            exchange->chunk_remaining -= size;
+            pos += size;
+
+            if (exchange->chunk_remaining == 0) {
+                exchange->chunk_state = ProxyChunkState_DataCR;
+            }
+            continue;
+        }
+        case ProxyChunkState_DataCR:
+            exchange->chunk_state = (c == '\r') ? ProxyChunkState_DataLF : ProxyChunkState_Invalid;
+            break;
+        case ProxyChunkState_DataLF:
+            exchange->chunk_state = (c == '\n') ? ProxyChunkState_Size : ProxyChunkState_Invalid;
+            break;
+        case ProxyChunkState_TrailerStart:
+            exchange->chunk_state = (c == '\r') ? ProxyChunkState_FinalLF : ProxyChunkState_Trailer;
+            break;
+        case ProxyChunkState_Trailer:
+            if (c == '\n') {
+                exchange->chunk_state = ProxyChunkState_TrailerStart;
+            }
+            break;
+        case ProxyChunkState_FinalLF:
+            exchange->chunk_state = (c == '\n') ? ProxyChunkState_Done : ProxyChunkState_Invalid;
+            break;
+        default:
+            break;
+        }
+
+        pos++;
+    }
+
+    return pos;
+}
+
+//////////////////////////////
+// Exchange
+
+local void proxy_release_upstream(ProxyExchange *exchange, b32 is_reusable) {
+    if (exchange->connection) {
+        proxy_connection_release(exchange->connection, is_reusable);
+        exchange->connection = 0;
+    }
+}
+
+local void proxy_finish(ThreadContext *context, struct Request *request) {
+    ProxyExchange *exchange = request->proxy;
+
+    proxy_release_upstream(exchange, exchange->upstream_reusable);
+    exchange->backend->outstanding--;
+
+    request_close(context, request);
+}
+
+local void proxy_fail(ThreadContext *context, struct Request *request) {
+    ProxyExchange *exchange = request->proxy;
+
+    proxy_release_upstream(exchange, 0);
+    exchange->backend->outstanding--;
+
+    if (exchange->response_started) {
+        request_close(context, request);
+        return;
+    }
+
+    access_log_record(request, request->accept_time, AccessLogFlag_Proxy, exchange->method, exchange->log_path, 502,
+                      proxy_bad_gateway.len);
+    request->response_buffer = proxy_bad_gateway;
+    request->event_type = EventType_Write;
+    submit_write(context, request);
+}
+
+local void proxy_send_request(ThreadContext *context, struct Request *request) {
+    ProxyExchange *exchange = request->proxy;
+    String8 pending = str8_skip(exchange->upstream_request, exchange->send_offset);
+
+    request->event_type = EventType_ProxySendRequest;
+    proxy_submit_send(context, request, exchange->connection->handle, pending);
+}
+
+local void proxy_connect(ThreadContext *context, struct Request *request, b32 allow_idle) {
+    ProxyExchange *exchange = request->proxy;
+    ProxyBackend *backend = exchange->backend;
+
+    exchange->send_offset = 0;
+    exchange->head_length = 0;
+
+    if (allow_idle && backend->idle) {
+        exchange->connection = backend->idle;
+        backend->idle = exchange->connection->next;
+        backend->idle_count--;
+
+        proxy_send_request(context, request);
+        return;
+    }
+
+    exchange->connection = proxy_connection_alloc(context, backend);
+
+    if (exchange->connection == 0) {
+        proxy_fail(context, request);
+        return;
+    }
+
+    request->event_type = EventType_ProxyConnect;
+    proxy_submit_connect(context, request, exchange->connection);
+}
+
+local void proxy_retry(ThreadContext *context, struct Request *request) {
+    ProxyExchange *exchange = request->proxy;
+
+    // NOTE: an idle upstream connection may have been closed by the backend;
+    // replay once on a fresh connection as long as nothing was streamed yet
+    exchange->has_retried = 1;
+    proxy_release_upstream(exchange, 0);
+    proxy_connect(context, request, 0);
+}
+
+local void proxy_recv_head(ThreadContext *context, struct Request *request) {
+    ProxyExchange *exchange = request->proxy;
+    String8 free_space = str8_skip(exchange->head_buffer, exchange->head_length);
+
+    request->event_type = EventType_ProxyRecvHead;
+    proxy_submit_recv(context, request, exchange->connection->handle, free_space);
+}
+
+local void proxy_after_request_sent(ThreadContext *context, struct Request *request) {
+    ProxyExchange *exchange = request->proxy;
+
+    if (exchange->body_remaining > 0) {
+        exchange->body_was_streamed = 1;
+        request->event_type = EventType_ProxyBodyToPipe;
+        proxy_submit_splice(context, request, request->client_handle, exchange->connection->pipe_write, exchange->body_remaining);
+    } else {
+        proxy_recv_head(context, request);
+    }
+}
+
+local b32 proxy_response_is_complete(ProxyExchange *exchange) {
+    b32 result = 0;
+
+    switch (exchange->framing) {
+    case ProxyFraming_None:
+        result = 1;
+        break;
+    case ProxyFraming_Length:
+        result = (exchange->response_remaining == 0);
+        break;
+    case ProxyFraming_Chunked:
+        result = (exchange->chunk_state == ProxyChunkState_Done);
+        break;
+    case ProxyFraming_Close:
+        result = 0;
+        break;
+    }
+
+    return result;
+}
+
+local void proxy_continue_response(ThreadContext *context, struct Request *request) {
+    ProxyExchange *exchange = request->proxy;
+    ProxyConnection *connection = exchange->connection;
+
+    if (proxy_response_is_complete(exchange)) {
+        proxy_finish(context, request);
+    } else if (exchange->framing == ProxyFraming_Length) {
+        request->event_type = EventType_ProxyResponseToPipe;
+        proxy_submit_splice(context, request, connection->handle, connection->pipe_write, exchange->response_remaining);
+    } else {
+        request->event_type = EventType_ProxyRelayRecv;
+        proxy_submit_recv(context, request, connection->handle, exchange->head_buffer);
+    }
+}
+
+local void proxy_on_head(ThreadContext *context, struct Request *request, i64 head_end) {
+    ProxyExchange *exchange = request->proxy;
+    Arena *arena = request->scratch_arena;
+    String8 received = str8_prefix(exchange->head_buffer, exchange->head_length);
+    HttpResponse response = http_parse_response(arena, received);
+
+    if (!response.is_valid || response.status == 101) {
+        proxy_fail(context, request);
+        return;
+    }
+
+    String8 status_line = str8_split_to(received, "\r\n");
+    String8 connection_header = http_header_find(response.headers, str8("Connection"));
+    String8 transfer_encoding = http_header_find(response.headers, str8("Transfer-Encoding"));
+    String8 content_length = http_header_find(response.headers, str8("Content-Length"));
+    String8 body_prefix = response.body;
+
+    if (exchange->is_head_request || response.status == 204 || response.status == 304) {
+        exchange->framing = ProxyFraming_None;
+        body_prefix.len = 0;
+    } else if (str8_is_valid(transfer_encoding)) {
+        exchange->framing = str8_are_equal_case_insensitive(transfer_encoding, str8("chunked")) ? ProxyFraming_Chunked : ProxyFraming_Close;
+    } else if (str8_is_valid(content_length)) {
+        exchange->framing = ProxyFraming_Length;
+
+        if (!str8_to_u64(content_length, &exchange->response_remaining)) {
+            proxy_fail(context, request);
+            return;
+        }
+    } else {
+        exchange->framing = ProxyFraming_Close;
+    }
+
+    exchange->upstream_reusable = response.version == HTTP_VERSION_11 &&
+                                  exchange->framing != ProxyFraming_Close &&
+                                  !str8_are_equal_case_insensitive(connection_header, str8("close"));
+
+    if (exchange->framing == ProxyFraming_Length) {
+        body_prefix.len = Min(body_prefix.len, exchange->response_remaining);
+        exchange->response_remaining -= body_prefix.len;
+    } else if (exchange->framing == ProxyFraming_Chunked) {
+        body_prefix.len = proxy_chunk_scan(exchange, body_prefix);
+
+        if (exchange->chunk_state == ProxyChunkState_Invalid) {
+            proxy_fail(context, request);
+            return;
+        }
+    }
+
+    // NOTE: bytes past the end of the response mean the upstream is out of sync
+    if (head_end + body_prefix.len < exchange->head_length) {
+        exchange->upstream_reusable = 0;
+    }
+
+    exchange->client_response = proxy_build_response(arena, status_line, &response, body_prefix);
+
+    if (!str8_is_valid(exchange->client_response)) {
+        proxy_fail(context, request);
+        return;
+    }
+
+    exchange->send_offset = 0;
+    exchange->response_started = 1;
+
+    // NOTE: the body is relayed without being counted, so only a known length is included
+    u64 response_bytes = exchange->client_response.len;
+
+    if (exchange->framing == ProxyFraming_Length) {
+        response_bytes += exchange->response_remaining;
+    }
+
+    access_log_record(request, request->accept_time, AccessLogFlag_Proxy, exchange->method, exchange->log_path,
+                      response.status, response_bytes);
+
+    request->event_type = EventType_ProxySendResponse;
+    proxy_submit_send(context, request, request->client_handle, exchange->client_response);
+}
+
+void proxy_begin(ThreadContext *context, struct Request *request, HttpRequest *http_request) {
+    Arena *arena = request->scratch_arena;
+    String8 transfer_encoding = http_headers_get(&http_request->headers, HttpHeaderId_TransferEncoding);
+    String8 content_length_string = http_headers_get(&http_request->headers, HttpHeaderId_ContentLength);
+    u64 content_length = 0;
+
+    // NOTE: request bodies are spliced, so their length has to be known up front
+    if (str8_is_valid(transfer_encoding) ||
+        (str8_is_valid(content_length_string) && !str8_to_u64(content_length_string, &content_length))) {
+        access_log_record(request, request->accept_time, AccessLogFlag_Proxy, http_request->method, http_request->path,
+                          411, proxy_length_required.len);
+        request->response_buffer = proxy_length_required;
+        request->event_type = EventType_Write;
+        submit_write(context, request);
+        return;
+    }
+
+    ProxyExchange *exchange = push_struct_zero(arena, ProxyExchange);
+    String8 body_prefix = str8_prefix(http_request->body, content_length);
+
+    if (!exchange) {
+        access_log_record(request, request->accept_time, AccessLogFlag_Proxy, http_request->method, http_request->path,
+                          502, proxy_bad_gateway.len);
+        request->response_buffer = proxy_bad_gateway;
+        request->event_type = EventType_Write;
+        submit_write(context, request);
+        return;
+    }
+
+    exchange->is_head_request = (http_request->method == HTTP_METHOD_HEAD);
+    exchange->method = http_request->method;
+    exchange->body_remaining = content_length - body_prefix.len;
+    exchange->upstream_request = proxy_build_request(arena, request, http_request, body_prefix);
+
+    // NOTE: the path would be overwritten along with the request buffer
+    if (access_log_enabled) {
+        exchange->log_path = str8_push_copy(arena, http_request->path);
+    }
+
+    // NOTE: the request buffer is dead once the upstream request is built, reuse it for the response head
+    exchange->head_buffer = request->request_buffer;
+    exchange->backend = proxy_pick_backend();
+    exchange->backend->outstanding++;
+
+    request->proxy = exchange;
+
+    // NOTE: a head too large for the connection's arena cannot be forwarded
+    if (!str8_is_valid(exchange->upstream_request)) {
+        proxy_fail(context, request);
+        return;
+    }
+
+    proxy_connect(context, request, 1);
+}
+
+void proxy_on_completion(ThreadContext *context, struct Request *request, i32 result) {
+    ProxyExchange *exchange = request->proxy;
+    ProxyConnection *connection = exchange->connection;
+
+    switch (request->event_type) {
+    case EventType_ProxyConnect:
+        if (result < 0) {
+            log_error("failed to connect to upstream - %d\n", result);
+            proxy_fail(context, request);
+            break;
+        }
+
+        proxy_send_request(context, request);
+        break;
+    case EventType_ProxySendRequest:
+        if (result <= 0) {
+            if (connection->is_reused && !exchange->has_retried) {
+                proxy_retry(context, request);
+            } else {
+                proxy_fail(context, request);
+            }
+            break;
+        }
+
+        exchange->send_offset += result;
+
+        if (exchange->send_offset < exchange->upstream_request.len) {
+            proxy_send_request(context, request);
+        } else {
+            proxy_after_request_sent(context, request);
+        }
+        break;
+    case EventType_ProxyBodyToPipe:
+        if (result <= 0) {
+            proxy_fail(context, request);
+            break;
+        }
+
+        exchange->pipe_pending = result;
+        exchange->body_remaining -= result;
+
+        request->event_type = EventType_ProxyBodyFromPipe;
+        proxy_submit_splice(context, request, connection->pipe_read, connection->handle, exchange->pipe_pending);
+        break;
+    case EventType_ProxyBodyFromPipe:
+        if (result <= 0) {
+            proxy_fail(context, request);
+            break;
+        }
+
+        exchange->pipe_pending -= result;
+
+        if (exchange->pipe_pending > 0) {
+            proxy_submit_splice(context, request, connection->pipe_read, connection->handle, exchange->pipe_pending);
+        } else {
+            proxy_after_request_sent(context, request);
+        }
+        break;
+    case EventType_ProxyRecvHead: {
+        if (result <= 0) {
+            if (connection->is_reused && !exchange->has_retried && !exchange->body_was_streamed && exchange->head_length == 0) {
+                proxy_retry(context, request);
+            } else {
+                proxy_fail(context, request);
+            }
+            break;
+        }
+
+        exchange->head_length += result;
+
+        for (;;) {
+            String8 received = str8_prefix(exchange->head_buffer, exchange->head_length);
+            i64 head_end = http_find_head_end(received);
+
+            if (head_end == -1) {
+                if (exchange->head_length == exchange->head_buffer.len) {
+                    proxy_fail(context, request);
+                } else {
+                    proxy_recv_head(context, request);
+                }
+                break;
+            }
+
+            // NOTE: interim 1xx responses are dropped, the final response follows them
+            b32 is_interim = received.len > 9 && received.data[9] == '1' &&
+                             !str8_are_equal(str8_prefix(str8_skip(received, 9), 3), str8("101"));
+
+            if (!is_interim) {
+                proxy_on_head(context, request, head_end);
+                break;
+            }
+
+            memmove(exchange->head_buffer.data, exchange->head_buffer.data + head_end, exchange->head_length - head_end);
+            exchange->head_length -= head_end;
+        }
+    } break;
+    case EventType_ProxySendResponse:
+        if (result <= 0) {
+            proxy_fail(context, request);
+            break;
+        }
+
+        exchange->send_offset += result;
+
+        if (exchange->send_offset < exchange->client_response.len) {
+            String8 pending = str8_skip(exchange->client_response, exchange->send_offset);
+            proxy_submit_send(context, request, request->client_handle, pending);
+        } else {
+            proxy_continue_response(context, request);
+        }
+        break;
+    case EventType_ProxyResponseToPipe:
+        if (result <= 0) {
+            proxy_fail(context, request);
+            break;
+        }
+
+        exchange->pipe_pending = result;
+        exchange->response_remaining -= result;
+
+        request->event_type = EventType_ProxyResponseFromPipe;
+        proxy_submit_splice(context, request, connection->pipe_read, request->client_handle, exchange->pipe_pending);
+        break;
+    case EventType_ProxyResponseFromPipe:
+        if (result <= 0) {
+            proxy_fail(context, request);
+            break;
+        }
+
+        exchange->pipe_pending -= result;
+
+        if (exchange->pipe_pending > 0) {
+            proxy_submit_splice(context, request, connection->pipe_read, request->client_handle, exchange->pipe_pending);
+        } else {
+            proxy_continue_response(context, request);
+        }
+        break;
+    case EventType_ProxyRelayRecv: {
+        if (result < 0 || (result == 0 && exchange->framing != ProxyFraming_Close)) {
+            proxy_fail(context, request);
+            break;
+        }
+
+        if (result == 0) {
+            proxy_finish(context, request);
+            break;
+        }
+
+        String8 relay = str8_prefix(exchange->head_buffer, result);
+
+        if (exchange->framing == ProxyFraming_Chunked) {
+            relay.len = proxy_chunk_scan(exchange, relay);
+
+            if (exchange->chunk_state == ProxyChunkState_Invalid) {
+                proxy_fail(context, request);
+                break;
+            }
+
+            if (relay.len < (u64)result) {
+                exchange->upstream_reusable = 0;
+            }
+        }
+
+        exchange->client_response = relay;
+        exchange->send_offset = 0;
+
+        request->event_type = EventType_ProxyRelaySend;
+        proxy_submit_send(context, request, request->client_handle, relay);
+    } break;
+    case EventType_ProxyRelaySend:
+        if (result <= 0) {
+            proxy_fail(context, request);
+            break;
+        }
+
+        exchange->send_offset += result;
+
+        if (exchange->send_offset < exchange->client_response.len) {
+            String8 pending = str8_skip(exchange->client_response, exchange->send_offset);
+            proxy_submit_send(context, request, request->client_handle, pending);
+        } else {
+            proxy_continue_response(context, request);
+        }
+        break;
+    default:
+        break;
+    }
+}
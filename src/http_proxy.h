@@ -0,0 +1,95 @@
+#ifndef HTTP_PROXY_H
+#define HTTP_PROXY_H
+
+#include "http_server.h"
+
+#define PROXY_MAX_BACKENDS 16
+#define PROXY_MAX_IDLE_CONNECTIONS 64
+#define PROXY_HEAD_BUFFER_SIZE 8192
+#define PROXY_SPLICE_CHUNK_SIZE 65536
+
+typedef struct ProxyBackend ProxyBackend;
+typedef struct ProxyConnection ProxyConnection;
+
+struct ProxyConnection {
+    ProxyConnection *next;
+    ProxyBackend *backend;
+    OS_Handle handle;
+    OS_Handle pipe_read;
+    OS_Handle pipe_write;
+    b32 is_reused;
+};
+
+struct ProxyBackend {
+    SockAddr addr;
+    u32 addr_length;
+
+    u32 outstanding;
+    u32 idle_count;
+    ProxyConnection *idle;
+};
+
+typedef struct ProxyPool ProxyPool;
+struct ProxyPool {
+    ProxyBackend backends[PROXY_MAX_BACKENDS];
+    u32 backend_count;
+    u32 next_backend;
+    ProxyConnection *free_connections;
+};
+
+typedef enum ProxyFraming {
+    ProxyFraming_None,
+    ProxyFraming_Length,
+    ProxyFraming_Chunked,
+    ProxyFraming_Close,
+} ProxyFraming;
+
+typedef enum ProxyChunkState {
+    ProxyChunkState_Size,
+    ProxyChunkState_Extension,
+    ProxyChunkState_SizeLF,
+    ProxyChunkState_Data,
+    ProxyChunkState_DataCR,
+    ProxyChunkState_DataLF,
+    ProxyChunkState_TrailerStart,
+    ProxyChunkState_Trailer,
+    ProxyChunkState_FinalLF,
+    ProxyChunkState_Done,
+    ProxyChunkState_Invalid,
+} ProxyChunkState;
+
+struct ProxyExchange {
+    ProxyBackend *backend;
+    ProxyConnection *connection;
+    HttpMethod method;
+    String8 log_path;
+    b32 is_head_request;
+    b32 has_retried;
+    b32 body_was_streamed;
+    b32 response_started;
+    b32 upstream_reusable;
+
+    String8 upstream_request;
+    u64 send_offset;
+    u64 body_remaining;
+    u64 pipe_pending;
+
+    String8 head_buffer;
+    u64 head_length;
+
+    String8 client_response;
+    ProxyFraming framing;
+    u64 response_remaining;
+    ProxyChunkState chunk_state;
+    u64 chunk_remaining;
+};
+
+b32 proxy_add_backend(String8 address);
+b32 proxy_is_enabled(void);
+
+void proxy_thread_init(ThreadContext *context);
+
+void proxy_begin(ThreadContext *context, struct Request *request, HttpRequest *http_request);
+void proxy_on_completion(ThreadContext *context, struct Request *request, i32 result);
+
+#endif // HTTP_PROXY_H
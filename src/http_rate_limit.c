@@ -0,0 +1,199 @@
+#include "http_rate_limit.h"
+
+#define RATE_LIMIT_MAX_RULE 1000000
+
+global RateLimitRule rate_limit_client_rule;
+global RateLimitRoute rate_limit_routes[RATE_LIMIT_MAX_ROUTES];
+global u32 rate_limit_route_count;
+thread_static RateLimiter *rate_limiter;
+
+//////////////////////////////
+// Configuration
+
+local b32 rate_limit_rule_is_valid(u32 rate, u32 burst) {
+    return rate > 0 && rate <= RATE_LIMIT_MAX_RULE && burst <= RATE_LIMIT_MAX_RULE;
+}
+
+// NOTE: a burst of zero allows one second worth of requests at once
+b32 rate_limit_set_client_rule(u32 rate, u32 burst) {
+    if (!rate_limit_rule_is_valid(rate, burst)) {
+        return 0;
+    }
+
+    rate_limit_client_rule.rate = rate;
+    rate_limit_client_rule.burst = burst ? burst : rate;
+
+    return 1;
+}
+
+// NOTE: like micro-cache routes, added before the workers start and matched on the path without
+// its query, exactly or as a prefix when the path ends in '*'
+b32 rate_limit_add_route(String8 path, u32 rate, u32 burst) {
+    if (rate_limit_route_count == RATE_LIMIT_MAX_ROUTES || path.len == 0 || !rate_limit_rule_is_valid(rate, burst)) {
+        return 0;
+    }
+
+    RateLimitRoute *route = &rate_limit_routes[rate_limit_route_count++];
+    route->is_prefix = path.data[path.len - 1] == '*';
+    route->path = route->is_prefix ? str8_prefix(path, path.len - 1) : path;
+    route->rule.rate = rate;
+    route->rule.burst = burst ? burst : rate;
+
+    return 1;
+}
+
+b32 rate_limit_is_enabled(void) {
+    return rate_limit_client_rule.rate > 0 || rate_limit_route_count > 0;
+}
+
+void rate_limit_thread_init(ThreadContext *context) {
+    if (!rate_limit_is_enabled()) {
+        return;
+    }
+
+    RateLimiter *limiter = push_struct_zero(context->permanent_arena, RateLimiter);
+    limiter->sets = arena_push_zero(context->permanent_arena, sizeof(RateLimitSet) * RATE_LIMIT_SETS, 64);
+
+    if (!limiter->sets) {
+        log_fatal("failed to allocate the rate limit table\n");
+        os_abort(1);
+    }
+
+    // NOTE: a per-worker seed keeps clients from picking addresses that all land in one set
+    limiter->seed = hash_u64(os_now_nanoseconds() ^ ((u64)context->thread_id << 32));
+
+    rate_limiter = limiter;
+}
+
+//////////////////////////////
+// Buckets
+
+// NOTE: IPv6 clients are limited per /64, the smallest prefix a host is usually given; unix
+// socket peers are not limited. Zero means the client has no key
+local u64 rate_limit_key(RateLimiter *limiter, SockAddr *client_address, u32 scope) {
+    String8 address = {0};
+
+    if (!client_address) {
+        return 0;
+    }
+
+    if (client_address->family == AF_INET) {
+        address = (String8){4, (u8 *)&((SockAddrIPv4 *)client_address)->addr};
+    } else if (client_address->family == AF_INET6) {
+        u8 *bytes = ((SockAddrIPv6 *)client_address)->addr;
+        u8 mapped_prefix[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, (u8)0xff, (u8)0xff};
+
+        address = memcmp(bytes, mapped_prefix, sizeof(mapped_prefix)) == 0 ? (String8){4, bytes + 12} : (String8){8, bytes};
+    } else {
+        return 0;
+    }
+
+    u64 key = hash_string_seeded(address, limiter->seed + scope);
+
+    return key ? key : 1;
+}
+
+local b32 rate_limit_take(RateLimiter *limiter, u64 key, RateLimitRule *rule, u32 cost) {
+    RateLimitSet *set = &limiter->sets[key & (RATE_LIMIT_SETS - 1)];
+    RateLimitBucket *bucket = 0;
+    RateLimitBucket *victim = &set->ways[0];
+    u32 now = (u32)(os_now_nanoseconds() / 1000000);
+    u32 capacity = rule->burst * RATE_LIMIT_TOKEN;
+
+    for (u32 way = 0; way < RATE_LIMIT_WAYS; ++way) {
+        RateLimitBucket *candidate = &set->ways[way];
+
+        if (candidate->key == key) {
+            bucket = candidate;
+            break;
+        }
+
+        if (victim->key != 0 && (candidate->key == 0 || now - candidate->updated > now - victim->updated)) {
+            victim = candidate;
+        }
+    }
+
+    if (bucket) {
+        u64 tokens = bucket->tokens + (u64)(now - bucket->updated) * rule->rate;
+        bucket->tokens = (u32)Min(tokens, capacity);
+    } else {
+        if (victim->key != 0) {
+            limiter->evictions += 1;
+        }
+
+        bucket = victim;
+        bucket->key = key;
+        bucket->tokens = capacity;
+    }
+
+    bucket->updated = now;
+
+    if (bucket->tokens < RATE_LIMIT_TOKEN) {
+        return 0;
+    }
+
+    bucket->tokens -= cost;
+
+    return 1;
+}
+
+//////////////////////////////
+// Checks
+
+// NOTE: only looks at the client's bucket, so a connection is refused while the client has no
+// token left but costs nothing otherwise; the request on it pays
+b32 rate_limit_allow_connection(struct Request *request) {
+    RateLimiter *limiter = rate_limiter;
+
+    if (!limiter || !rate_limit_client_rule.rate) {
+        return 1;
+    }
+
+    u64 key = rate_limit_key(limiter, request->client_address, 0);
+
+    if (key && !rate_limit_take(limiter, key, &rate_limit_client_rule, 0)) {
+        limiter->rejected_connections += 1;
+        return 0;
+    }
+
+    return 1;
+}
+
+b32 rate_limit_allow_request(struct Request *request, String8 path) {
+    RateLimiter *limiter = rate_limiter;
+    b32 allowed = 1;
+
+    if (!limiter) {
+        return allowed;
+    }
+
+    if (rate_limit_client_rule.rate) {
+        u64 key = rate_limit_key(limiter, request->client_address, 0);
+        allowed = !key || rate_limit_take(limiter, key, &rate_limit_client_rule, RATE_LIMIT_TOKEN);
+    }
+
+    if (allowed && rate_limit_route_count > 0) {
+        String8 route_path = str8_split_to(path, "?");
+
+        if (!str8_is_valid(route_path)) {
+            route_path = path;
+        }
+
+        for (u32 index = 0; index < rate_limit_route_count; ++index) {
+            RateLimitRoute *route = &rate_limit_routes[index];
+
+            if (route->is_prefix ? str8_are_equal(str8_prefix(route_path, route->path.len), route->path)
+                                 : str8_are_equal(route_path, route->path)) {
+                u64 key = rate_limit_key(limiter, request->client_address, index + 1);
+                allowed = !key || rate_limit_take(limiter, key, &route->rule, RATE_LIMIT_TOKEN);
+                break;
+            }
+        }
+    }
+
+    if (!allowed) {
+        limiter->rejected_requests += 1;
+    }
+
+    return allowed;
+}
@@ -0,0 +1,61 @@
+#ifndef HTTP_RATE_LIMIT_H
+#define HTTP_RATE_LIMIT_H
+
+#include "http_server.h"
+
+#define RATE_LIMIT_MAX_ROUTES 16
+#define RATE_LIMIT_WAYS 4
+#define RATE_LIMIT_SETS 4096
+#define RATE_LIMIT_TOKEN 1000
+
+// NOTE: a token bucket refilled at rate tokens per second up to burst tokens
+typedef struct RateLimitRule RateLimitRule;
+struct RateLimitRule {
+    u32 rate;
+    u32 burst;
+};
+
+typedef struct RateLimitRoute RateLimitRoute;
+struct RateLimitRoute {
+    String8 path;
+    b32 is_prefix;
+    RateLimitRule rule;
+};
+
+// NOTE: tokens are kept in thousandths so a millisecond of refill is exact for any whole rate;
+// updated is the worker clock in milliseconds and wraps after 49 days, which at worst refills a
+// bucket idle for that long as if it had been idle for less. A key of zero marks a free way
+typedef struct RateLimitBucket RateLimitBucket;
+struct RateLimitBucket {
+    u64 key;
+    u32 tokens;
+    u32 updated;
+};
+
+// NOTE: four buckets fill one cache line, so a lookup touches a single line; a client that is
+// not in its set replaces the least recently updated way, an approximate LRU over the table
+typedef struct RateLimitSet RateLimitSet;
+struct RateLimitSet {
+    RateLimitBucket ways[RATE_LIMIT_WAYS];
+} __attribute__((aligned(64)));
+
+typedef struct RateLimiter RateLimiter;
+struct RateLimiter {
+    RateLimitSet *sets;
+    u64 seed;
+
+    u64 rejected_connections;
+    u64 rejected_requests;
+    u64 evictions;
+};
+
+b32 rate_limit_set_client_rule(u32 rate, u32 burst);
+b32 rate_limit_add_route(String8 path, u32 rate, u32 burst);
+b32 rate_limit_is_enabled(void);
+
+void rate_limit_thread_init(ThreadContext *context);
+
+b32 rate_limit_allow_connection(struct Request *request);
+b32 rate_limit_allow_request(struct Request *request, String8 path);
+
+#endif // HTTP_RATE_LIMIT_H
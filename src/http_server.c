@@ -0,0 +1,508 @@
+#include "http_server.h"
+#include "http_balance.h"
+#include "http_cache.h"
+#include "http_compress.h"
+#include "http_mock.h"
+#include "http_trace.h"
+#include <errno.h>
+
+global HttpHandler *server_handler;
+thread_static ConnectionSlab server_slab;
+
+void server_set_handler(HttpHandler *handler) {
+    server_handler = handler;
+}
+
+void server_run_handler(Arena *arena, HttpRequest *request, HttpResponse *response) {
+    memset(response, 0, sizeof(HttpResponse));
+    response->is_valid = 1;
+    response->version = request->version;
+    response->status = 404;
+
+    if (server_handler) {
+        server_handler(arena, request, response);
+    }
+}
+
+//////////////////////////////
+// Transport
+
+// NOTE: every operation on a worker's ring goes through here, so the mock transport can take
+// the ring's place, serving the accept, read, write path and refusing the rest. tail is that
+// of the last entry prepared, so a linked chain is published and submitted whole.
+// Each connection operation is counted until its completion is reaped, skipped ones included:
+// an offload job's reply always comes back, and a linked write is settled by its close. A
+// handoff to another worker is not, its completion, if any, is a message
+b32 server_submit(ThreadContext *context, IO_Uring_Submission_Entry *sqe, u32 tail) {
+    IO_Uring *ring = &context->ring;
+    u32 count = tail + 1 - *ring->sring_tail;
+
+    if (mock_transport_is_enabled()) {
+        b32 ok = 1;
+
+        for (u32 entry = *ring->sring_tail; entry != tail + 1; ++entry) {
+            IO_Uring_Submission_Entry *entry_sqe = &ring->sqes[ring->sring_array[entry & *ring->sring_mask]];
+
+            if (mock_transport_submit(entry_sqe)) {
+                server_slab.pending_completions += !balance_is_message(entry_sqe->user_data);
+            } else {
+                ok = 0;
+            }
+        }
+
+        return ok;
+    }
+
+    // NOTE: published entries stay in the submission queue when the enter fails, and are
+    // submitted by the next one, so they are counted either way
+    for (u32 entry = *ring->sring_tail; entry != tail + 1; ++entry) {
+        IO_Uring_Submission_Entry *entry_sqe = &ring->sqes[ring->sring_array[entry & *ring->sring_mask]];
+
+        server_slab.pending_completions += !balance_is_message(entry_sqe->user_data);
+    }
+
+    os_io_write_barrier(ring->sring_tail, tail + 1);
+
+    return os_io_uring_enter(ring->ring_fd, count, 0, 0) >= 0;
+}
+
+// NOTE: skipping the CQE of a successful link needs 5.17; older kernels get a completion for
+// the write and close synchronously after it
+local b32 server_can_link_close(ThreadContext *context) {
+    return mock_transport_is_enabled() || (context->ring.features & IORING_FEAT_CQE_SKIP);
+}
+
+i32 server_wait_completion(ThreadContext *context, IO_Uring_Completion_Entry **cqe_out) {
+    i32 result;
+
+    if (mock_transport_is_enabled()) {
+        result = mock_transport_wait(cqe_out);
+    } else {
+        result = os_io_uring_wait_cqe(&context->ring, cqe_out);
+    }
+
+    if (result == 0 && !balance_is_message((*cqe_out)->user_data)) {
+        u64 user_data = (*cqe_out)->user_data;
+        b32 is_close = ((user_data >> 1) & 0x7f) == EventType_Close;
+
+        // NOTE: a close that ran means the write linked before it succeeded without a completion
+        server_slab.pending_completions -= 1 + (is_close && (*cqe_out)->res != -ECANCELED);
+    }
+
+    return result;
+}
+
+// NOTE: operations submitted on this worker's ring whose completion is still to be reaped
+u32 server_pending_completions(void) {
+    return server_slab.pending_completions;
+}
+
+void server_close_handle(OS_Handle handle) {
+    if (mock_transport_is_enabled()) {
+        mock_transport_close(handle);
+        return;
+    }
+
+    os_close(handle);
+}
+
+//////////////////////////////
+// Submission
+
+b32 submit_read(ThreadContext *context, struct Request *request) {
+    u32 tail;
+    Scratch *scratch = request->scratch_arena;
+    IO_Uring_Submission_Entry *sqe = os_io_uring_get_sqe(&context->ring, &tail);
+
+    if (!str8_is_valid(request->request_buffer)) {
+        String8 request_buffer = {0};
+        request_buffer.data = arena_push(scratch, REQUEST_BUFFER_SIZE, 8);
+        request_buffer.len = REQUEST_BUFFER_SIZE;
+        request->request_buffer = request_buffer;
+        request->request_length = 0;
+    }
+
+    os_io_uring_prep_sqe(sqe, IORING_OP_READ);
+
+    sqe->fd = request->client_handle.value;
+    sqe->addr = (u64)(request->request_buffer.data + request->request_length);
+    sqe->len = request->request_buffer.len - request->request_length;
+    sqe->off = -1;
+    sqe->user_data = request_user_data(request, request->event_type);
+
+    trace_submit(request, request->event_type);
+
+    return server_submit(context, sqe, tail);
+}
+
+// NOTE: writes the final response of a connection. The close is linked behind the write and
+// the write's own completion is skipped when it succeeds, so a served connection costs one
+// EventType_Close completion. A failed or short write breaks the link: its EventType_Write
+// completion arrives and the close is cancelled
+b32 submit_write(ThreadContext *context, struct Request *request) {
+    u32 tail;
+    IO_Uring_Submission_Entry *sqe = os_io_uring_get_sqe(&context->ring, &tail);
+
+    os_io_uring_prep_sqe(sqe, IORING_OP_WRITE);
+
+    sqe->fd = request->client_handle.value;
+    sqe->addr = (u64)request->response_buffer.data;
+    sqe->len = request->response_buffer.len;
+    sqe->off = -1;
+    sqe->user_data = request_user_data(request, request->event_type);
+
+    trace_submit(request, request->event_type);
+
+    if (server_can_link_close(context)) {
+        sqe->flags = IOSQE_IO_LINK | IOSQE_CQE_SKIP_SUCCESS;
+
+        IO_Uring_Submission_Entry *close_sqe = os_io_uring_get_next_sqe(&context->ring, &tail);
+        os_io_uring_prep_sqe(close_sqe, IORING_OP_CLOSE);
+
+        close_sqe->fd = request->client_handle.value;
+        close_sqe->user_data = request_user_data(request, EventType_Close);
+
+        trace_submit(request, EventType_Close);
+    }
+
+    return server_submit(context, sqe, tail);
+}
+
+b32 submit_send(ThreadContext *context, struct Request *request) {
+    u32 tail;
+    IO_Uring_Submission_Entry *sqe = os_io_uring_get_sqe(&context->ring, &tail);
+
+    os_io_uring_prep_sqe(sqe, IORING_OP_WRITE);
+
+    sqe->fd = request->client_handle.value;
+    sqe->addr = (u64)request->response_buffer.data;
+    sqe->len = request->response_buffer.len;
+    sqe->off = -1;
+    sqe->user_data = request_user_data(request, request->send_event_type);
+
+    trace_submit(request, request->send_event_type);
+
+    return server_submit(context, sqe, tail);
+}
+
+// NOTE: sends the head in response_buffer, then the body: one more write for a body in memory,
+// or chunks of a file read into the request buffer, which the request no longer needs once it
+// is answered. Chunks are read with pread on the worker, as the file is open already and mostly
+// in the page cache
+b32 submit_write_body(ThreadContext *context, struct Request *request, ResponseBody body) {
+    server_slab.response_bodies[request->slot_index] = body;
+    request->send_event_type = EventType_WriteBody;
+
+    return submit_send(context, request);
+}
+
+b32 submit_accept(ThreadContext *context, u32 listener_index) {
+    u32 tail;
+    b32 ok = 0;
+    struct Request *request = request_alloc(context);
+
+    // NOTE: with every slot in use the accept is re-armed once a connection is released
+    if (!request) {
+        server_slab.pending_accepts |= 1 << listener_index;
+        return ok;
+    }
+
+    IO_Uring_Submission_Entry *sqe = os_io_uring_get_sqe(&context->ring, &tail);
+    request->event_type = EventType_Accept;
+    request->listener_index = listener_index;
+
+    os_io_uring_prep_sqe(sqe, IORING_OP_ACCEPT);
+
+    sqe->fd = context->listener_handles[listener_index].value;
+    sqe->addr = (u64)request->client_address;
+    sqe->addr2 = (u64)&request->client_address_length;
+    sqe->user_data = request_user_data(request, request->event_type);
+
+    return server_submit(context, sqe, tail);
+}
+
+//////////////////////////////
+// Listeners
+
+local void server_set_socket_option(OS_Handle handle, i32 level, i32 name, i32 value, char *option_name) {
+    if (!os_set_socket_option(handle, level, name, value)) {
+        log_warn("failed to set %s to %d\n", option_name, value);
+    }
+}
+
+// NOTE: processor, when not negative, is set as SO_INCOMING_CPU, which steers a connection to
+// the listener of the reuseport group whose worker runs on the processor that took its packets.
+// Options that shape the handshake, the buffers and the window scale included, only apply when
+// set before listen
+OS_Handle server_listen(String8 address, ServerSocketOptions *options, i32 processor) {
+    SockAddr addr = {0};
+    u32 addr_length = 0;
+
+    if (!os_sockaddr_from_string(address, &addr, &addr_length)) {
+        log_fatal("invalid listen address %.*s\n", str8_expand(address));
+        os_abort(1);
+    }
+
+    OS_Handle handle = os_socket(addr.family);
+    b32 is_tcp = addr.family != AF_UNIX;
+
+    if (!handle.value) {
+        log_fatal("failed to create a socket for %.*s\n", str8_expand(address));
+        os_abort(1);
+    }
+
+    if (addr.family == AF_INET6) {
+        os_set_ipv6_only(handle, 0);
+    }
+
+    if (is_tcp) {
+        // NOTE: a restarted server can bind while connections of the last run sit in TIME_WAIT
+        server_set_socket_option(handle, SOL_SOCKET, SO_REUSEADDR, 1, "SO_REUSEADDR");
+
+        if (options->reuse_port && !os_set_socket_option(handle, SOL_SOCKET, SO_REUSEPORT, 1)) {
+            log_fatal("failed to set SO_REUSEPORT on %.*s\n", str8_expand(address));
+            os_abort(1);
+        }
+
+        if (processor >= 0) {
+            server_set_socket_option(handle, SOL_SOCKET, SO_INCOMING_CPU, processor, "SO_INCOMING_CPU");
+        }
+    }
+
+    // NOTE: a socket file left behind by a previous run would make bind fail. It is told apart
+    // from the socket of a running server by connecting to it: only a refused connection means
+    // nobody listens there anymore. Anything else at the path is left alone and the bind fails
+    if (addr.family == AF_UNIX && ((SockAddrUnix *)&addr)->path[0] != 0) {
+        String8 path = str8_from_cstring(((SockAddrUnix *)&addr)->path);
+        OS_FileInfo info = {0};
+
+        if (os_path_info(path, &info)) {
+            if (!info.is_socket) {
+                log_fatal("refusing to replace %.*s, which is not a socket\n", str8_expand(path));
+                os_abort(1);
+            }
+
+            OS_Handle probe = os_socket_unix();
+            i32 result = os_connect(probe, &addr, addr_length);
+
+            if (probe.value) {
+                os_close(probe);
+            }
+
+            if (result == 0) {
+                log_fatal("failed to bind to %.*s, address in use\n", str8_expand(address));
+                os_abort(1);
+            }
+
+            if (result == -ECONNREFUSED) {
+                os_delete_file(path);
+            }
+        }
+    }
+
+    if (!os_bind(handle, &addr, addr_length)) {
+        log_fatal("failed to bind to %.*s\n", str8_expand(address));
+        os_abort(1);
+    }
+
+    if (is_tcp && options->no_delay) {
+        server_set_socket_option(handle, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+    }
+
+    // NOTE: the accept completes once the request arrives, or the connection is dropped when the
+    // client sends nothing within the timeout
+    if (is_tcp && options->defer_accept_seconds) {
+        server_set_socket_option(handle, IPPROTO_TCP, TCP_DEFER_ACCEPT, options->defer_accept_seconds,
+                                 "TCP_DEFER_ACCEPT");
+    }
+
+    if (is_tcp && options->fast_open_queue_length) {
+        server_set_socket_option(handle, IPPROTO_TCP, TCP_FASTOPEN, options->fast_open_queue_length, "TCP_FASTOPEN");
+    }
+
+    if (options->send_buffer_size) {
+        server_set_socket_option(handle, SOL_SOCKET, SO_SNDBUF, options->send_buffer_size, "SO_SNDBUF");
+    }
+
+    if (options->receive_buffer_size) {
+        server_set_socket_option(handle, SOL_SOCKET, SO_RCVBUF, options->receive_buffer_size, "SO_RCVBUF");
+    }
+
+    // NOTE: the kernel caps the backlog at net.core.somaxconn
+    if (!os_listen(handle, options->backlog)) {
+        log_fatal("listen failed\n");
+        os_abort(1);
+    }
+
+    return handle;
+}
+
+//////////////////////////////
+// Connection slab
+
+void server_thread_init(ThreadContext *context) {
+    server_slab.records = push_array_zero(context->permanent_arena, struct Request, SERVER_MAX_CONNECTIONS);
+    server_slab.response_bodies = push_array_zero(context->permanent_arena, ResponseBody, SERVER_MAX_CONNECTIONS);
+    server_slab.free_indices = push_array(context->permanent_arena, u32, SERVER_MAX_CONNECTIONS);
+
+    if (!server_slab.records || !server_slab.response_bodies || !server_slab.free_indices) {
+        log_fatal("failed to allocate the connection slab\n");
+        os_abort(1);
+    }
+
+    // NOTE: slots are handed out from the low end first, so a lightly loaded worker keeps its
+    // connections on few cache lines
+    for (u32 index = 0; index < SERVER_MAX_CONNECTIONS; ++index) {
+        server_slab.records[index].slot_index = index;
+        server_slab.free_indices[index] = SERVER_MAX_CONNECTIONS - 1 - index;
+    }
+
+    server_slab.free_count = SERVER_MAX_CONNECTIONS;
+}
+
+struct Request *request_alloc(ThreadContext *context) {
+    if (server_slab.free_count == 0) {
+        return 0;
+    }
+
+    Scratch *scratch = thread_scratch_alloc(context);
+    SockAddr *client_address = push_struct_zero(scratch, SockAddr);
+
+    if (!client_address) {
+        thread_scratch_release(context, scratch);
+        return 0;
+    }
+
+    u32 slot_index = server_slab.free_indices[--server_slab.free_count];
+    struct Request *request = &server_slab.records[slot_index];
+    u32 generation = request->generation;
+
+    memset(request, 0, sizeof(struct Request));
+    request->generation = generation;
+    request->slot_index = slot_index;
+    request->scratch_arena = scratch;
+    request->client_address = client_address;
+    request->client_address_length = sizeof(SockAddr);
+
+    return request;
+}
+
+struct Request *request_from_user_data(u64 user_data, enum EventType *event_type_out) {
+    u32 slot_index = (user_data >> 8) & ((1 << REQUEST_USER_DATA_SLOT_BITS) - 1);
+    struct Request *result = request_from_slot(slot_index, (u32)(user_data >> 32));
+
+    if (result) {
+        *event_type_out = (enum EventType)((user_data >> 1) & 0x7f);
+    }
+
+    return result;
+}
+
+struct Request *request_from_slot(u32 slot_index, u32 generation) {
+    struct Request *result = 0;
+
+    if (slot_index < SERVER_MAX_CONNECTIONS && server_slab.records[slot_index].generation == generation) {
+        result = &server_slab.records[slot_index];
+    }
+
+    return result;
+}
+
+void request_release(ThreadContext *context, struct Request *request) {
+    ResponseBody *body = &server_slab.response_bodies[request->slot_index];
+
+    if (request->cached_response) {
+        micro_cache_release(context, request->cached_response);
+    }
+
+    if (body->file.value) {
+        os_close(body->file);
+    }
+
+    if (body->variant) {
+        compress_variant_release(body->variant);
+    }
+
+    *body = (ResponseBody){0};
+
+    thread_scratch_release(context, request->scratch_arena);
+
+    request->generation += 1;
+    request->scratch_arena = 0;
+    server_slab.free_indices[server_slab.free_count++] = request->slot_index;
+
+    if (server_slab.pending_accepts) {
+        u32 pending_accepts = server_slab.pending_accepts;
+        server_slab.pending_accepts = 0;
+
+        for (u32 listener_index = 0; listener_index < context->listener_count; ++listener_index) {
+            if (pending_accepts & (1 << listener_index)) {
+                submit_accept(context, listener_index);
+            }
+        }
+    }
+}
+
+void request_close(ThreadContext *context, struct Request *request) {
+    server_close_handle(request->client_handle);
+    request_closed(context, request);
+}
+
+// NOTE: for a connection whose descriptor is already closed, such as by a linked close
+void request_closed(ThreadContext *context, struct Request *request) {
+    trace_instant(request, TraceStage_Close, 0);
+    request_release(context, request);
+    balance_connection_closed(context);
+}
+
+// NOTE: a short write sends the rest of its buffer first. The last piece of the body goes out
+// like any other final response, with the close linked behind it. A file that shrank since its
+// length was sent cannot finish the body, so the connection is dropped
+void request_on_write_body(ThreadContext *context, struct Request *request, i32 result) {
+    ResponseBody *body = &server_slab.response_bodies[request->slot_index];
+
+    if (result <= 0) {
+        request_close(context, request);
+        return;
+    }
+
+    if ((u64)result < request->response_buffer.len) {
+        request->response_buffer = str8_skip(request->response_buffer, result);
+        submit_send(context, request);
+        return;
+    }
+
+    // NOTE: a body in memory is sent by itself but for its tail, so a short write of it is
+    // resumed here; only the tail goes out in the final write, linked to the close
+    if (body->data.len > 0) {
+        u64 length = body->data.len > SERVER_INLINE_BODY_SIZE ? body->data.len - SERVER_INLINE_BODY_SIZE : body->data.len;
+        request->response_buffer = str8_prefix(body->data, length);
+        body->data = str8_skip(body->data, length);
+    } else {
+        u64 length = Min(body->remaining, request->request_buffer.len);
+        i64 read = body->file.value ? os_read_at(body->file, request->request_buffer.data, length, body->offset) : 0;
+
+        if (read <= 0) {
+            request_close(context, request);
+            return;
+        }
+
+        body->offset += read;
+        body->remaining -= read;
+        request->response_buffer = str8_prefix(request->request_buffer, read);
+    }
+
+    if (body->data.len > 0 || body->remaining > 0) {
+        submit_send(context, request);
+        return;
+    }
+
+    // NOTE: a cached variant the final write still points into is released with the connection
+    if (body->file.value) {
+        os_close(body->file);
+        body->file = (OS_Handle){0};
+    }
+
+    request->event_type = EventType_Write;
+    submit_write(context, request);
+}
@@ -0,0 +1,147 @@
+#ifndef HTTP_SERVER_H
+#define HTTP_SERVER_H
+
+#include "base/base_inc.h"
+#include "http.h"
+
+#define REQUEST_BUFFER_SIZE 8192
+#define SERVER_MAX_CONNECTIONS 4096
+#define SERVER_DEFAULT_BACKLOG 4096
+
+enum EventType {
+    EventType_Accept,
+    EventType_Read,
+    EventType_Write,
+    EventType_WriteBody,
+    EventType_ProxyConnect,
+    EventType_ProxySendRequest,
+    EventType_ProxyBodyToPipe,
+    EventType_ProxyBodyFromPipe,
+    EventType_ProxyRecvHead,
+    EventType_ProxySendResponse,
+    EventType_ProxyRelayRecv,
+    EventType_ProxyRelaySend,
+    EventType_ProxyResponseToPipe,
+    EventType_ProxyResponseFromPipe,
+    EventType_H2Read,
+    EventType_H2Write,
+    EventType_WsRead,
+    EventType_WsWrite,
+    EventType_AccessLogWrite,
+    EventType_AccessLogTimer,
+    EventType_Task,
+    EventType_Close,
+};
+
+typedef struct ProxyExchange ProxyExchange;
+typedef struct H2Connection H2Connection;
+typedef struct WsConnection WsConnection;
+typedef struct MicroCacheEntry MicroCacheEntry;
+typedef struct HttpTask HttpTask;
+
+// NOTE: connections live in a per-worker slab of fixed 128 byte records, fields touched on
+// every completion first; anything large sits in the connection's scratch arena. Event types
+// are stored in a byte each to keep the record at two cache lines
+struct Request {
+    u32 generation;
+    u32 slot_index;
+    u8 event_type;
+    u8 send_event_type;
+    u16 listener_index;
+    u32 trace_id;
+    OS_Handle client_handle;
+    Scratch *scratch_arena;
+
+    String8 request_buffer;
+    u32 request_length;
+    u32 client_address_length;
+    String8 response_buffer;
+
+    ProxyExchange *proxy;
+    H2Connection *h2;
+    WsConnection *websocket;
+    MicroCacheEntry *cached_response;
+    HttpTask *task;
+
+    SockAddr *client_address;
+    u64 accept_time;
+} __attribute__((aligned(64)));
+
+_Static_assert(sizeof(struct Request) == 128, "struct Request must stay two cache lines");
+
+// NOTE: bodies up to this size are copied in behind the head and go out in the same write
+#define SERVER_INLINE_BODY_SIZE (4 * kilobyte)
+
+// NOTE: what is still to be sent behind a response head: a body in memory, or the remaining
+// bytes of a file. Kept beside the record of its connection rather than in it; a body that is
+// a cached compressed variant holds a reference on it until the connection is released
+typedef struct ResponseBody ResponseBody;
+struct ResponseBody {
+    String8 data;
+    OS_Handle file;
+    u64 offset;
+    u64 remaining;
+    CompressVariant *variant;
+};
+
+typedef struct ConnectionSlab ConnectionSlab;
+struct ConnectionSlab {
+    struct Request *records;
+    ResponseBody *response_bodies;
+    u32 *free_indices;
+    u32 free_count;
+    u32 pending_accepts;
+    u32 pending_completions;
+};
+
+// NOTE: user_data of connection operations: bit 0 clear (odd values are worker messages),
+// bits 1-7 the EventType, bits 8-31 the slab slot and bits 32-63 the slot generation, so a
+// completion that arrives after its slot was recycled is recognised and dropped
+#define REQUEST_USER_DATA_SLOT_BITS 24
+
+#define request_user_data(request, event_type) \
+    (((u64)(request)->generation << 32) | ((u64)(request)->slot_index << 8) | ((u64)(event_type) << 1))
+
+// NOTE: set on listening sockets only. Accepted connections inherit TCP_NODELAY and the buffer
+// sizes from their listener, so tuning costs no system calls per connection. Zero leaves a
+// setting at the kernel default
+typedef struct ServerSocketOptions ServerSocketOptions;
+struct ServerSocketOptions {
+    u32 backlog;
+    b32 no_delay;
+    b32 reuse_port;
+    b32 use_incoming_cpu;
+    u32 defer_accept_seconds;
+    u32 fast_open_queue_length;
+    u32 send_buffer_size;
+    u32 receive_buffer_size;
+};
+
+typedef void HttpHandler(Arena *arena, HttpRequest *request, HttpResponse *response);
+
+void server_set_handler(HttpHandler *handler);
+void server_run_handler(Arena *arena, HttpRequest *request, HttpResponse *response);
+
+b32 server_submit(ThreadContext *context, IO_Uring_Submission_Entry *sqe, u32 tail);
+i32 server_wait_completion(ThreadContext *context, IO_Uring_Completion_Entry **cqe_out);
+u32 server_pending_completions(void);
+void server_close_handle(OS_Handle handle);
+
+b32 submit_read(ThreadContext *context, struct Request *request);
+b32 submit_write(ThreadContext *context, struct Request *request);
+b32 submit_send(ThreadContext *context, struct Request *request);
+b32 submit_write_body(ThreadContext *context, struct Request *request, ResponseBody body);
+b32 submit_accept(ThreadContext *context, u32 listener_index);
+
+OS_Handle server_listen(String8 address, ServerSocketOptions *options, i32 processor);
+void server_thread_init(ThreadContext *context);
+
+struct Request *request_alloc(ThreadContext *context);
+struct Request *request_from_user_data(u64 user_data, enum EventType *event_type_out);
+struct Request *request_from_slot(u32 slot_index, u32 generation);
+void request_release(ThreadContext *context, struct Request *request);
+void request_close(ThreadContext *context, struct Request *request);
+void request_closed(ThreadContext *context, struct Request *request);
+void request_on_write_body(ThreadContext *context, struct Request *request, i32 result);
+
+#endif // HTTP_SERVER_H
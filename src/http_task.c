@@ -0,0 +1,311 @@
+#include "http_task.h"
+#include "http_trace.h"
+#include <errno.h>
+
+global HttpTaskHandler *http_task_handler;
+
+void http_task_set_handler(HttpTaskHandler *handler) {
+    http_task_handler = handler;
+}
+
+b32 http_task_is_enabled(void) {
+    return http_task_handler != 0;
+}
+
+//////////////////////////////
+// Tasks
+
+local void http_task_entry(void *user) {
+    HttpTask *task = (HttpTask *)user;
+    HttpResponse *response = &task->http_response;
+
+    memset(response, 0, sizeof(HttpResponse));
+    response->is_valid = 1;
+    response->version = task->http_request.version;
+    response->status = 404;
+
+    trace_begin(task->request, TraceStage_Handler);
+    http_task_handler(task, &task->http_request, response);
+    trace_end(task->request, TraceStage_Handler);
+}
+
+local void http_task_run(HttpTask *task) {
+    coroutine_resume(task->coroutine);
+
+    if (task->coroutine->is_finished) {
+        coroutine_release(task->coroutine);
+        task->coroutine = 0;
+        task->is_finished = 1;
+    }
+}
+
+// NOTE: runs the handler up to its first suspension; zero when no coroutine could be set up
+HttpTask *http_task_start(ThreadContext *context, struct Request *request, HttpRequest *http_request,
+                          MicroCacheResult cache_result, MicroCacheEntry *cache_entry) {
+    HttpTask *task = push_struct_zero(request->scratch_arena, HttpTask);
+
+    if (!task) {
+        return 0;
+    }
+
+    task->coroutine = coroutine_alloc(http_task_entry, task);
+
+    if (!task->coroutine) {
+        return 0;
+    }
+
+    task->context = context;
+    task->request = request;
+    task->arena = request->scratch_arena;
+    task->http_request = *http_request;
+    task->cache_result = cache_result;
+    task->cache_entry = cache_entry;
+    request->task = task;
+
+    http_task_run(task);
+
+    return task;
+}
+
+// NOTE: returns 1 once the handler has returned and the response can be written
+b32 http_task_resume(ThreadContext *context, struct Request *request, i32 result) {
+    HttpTask *task = request->task;
+
+    if (!task || !task->coroutine) {
+        return 0;
+    }
+
+    task->result = result;
+    http_task_run(task);
+
+    return task->is_finished;
+}
+
+//////////////////////////////
+// Awaitable operations
+
+local IO_Uring_Submission_Entry *http_task_get_sqe(HttpTask *task, u8 opcode, u32 *tail_out) {
+    IO_Uring_Submission_Entry *sqe = os_io_uring_get_sqe(&task->context->ring, tail_out);
+
+    os_io_uring_prep_sqe(sqe, opcode);
+    sqe->user_data = request_user_data(task->request, EventType_Task);
+
+    return sqe;
+}
+
+// NOTE: a submission the ring, or the mock transport, refuses fails the operation with -EIO
+local i32 http_task_await(HttpTask *task, IO_Uring_Submission_Entry *sqe, u32 tail) {
+    trace_submit(task->request, EventType_Task);
+
+    if (!server_submit(task->context, sqe, tail)) {
+        return -EIO;
+    }
+
+    coroutine_yield();
+
+    return task->result;
+}
+
+i32 http_await_sleep(HttpTask *task, u64 milliseconds) {
+    u32 tail;
+    IO_Uring_Submission_Entry *sqe = http_task_get_sqe(task, IORING_OP_TIMEOUT, &tail);
+
+    task->timeout.tv_sec = milliseconds / 1000;
+    task->timeout.tv_nsec = (milliseconds % 1000) * 1000000;
+
+    sqe->fd = -1;
+    sqe->addr = (u64)&task->timeout;
+    sqe->len = 1;
+
+    i32 result = http_task_await(task, sqe, tail);
+
+    return result == -ETIME ? 0 : result;
+}
+
+OS_Handle http_await_open(HttpTask *task, String8 path) {
+    OS_Handle result = {0};
+    u8 *path_cstring = arena_push(task->arena, path.len + 1, 1);
+
+    if (!path_cstring) {
+        return result;
+    }
+
+    memcpy(path_cstring, path.data, path.len);
+    path_cstring[path.len] = 0;
+
+    u32 tail;
+    IO_Uring_Submission_Entry *sqe = http_task_get_sqe(task, IORING_OP_OPENAT, &tail);
+
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (u64)path_cstring;
+    sqe->open_flags = O_RDONLY | O_CLOEXEC;
+
+    i32 fd = http_task_await(task, sqe, tail);
+
+    if (fd >= 0) {
+        result.value = fd;
+    }
+
+    return result;
+}
+
+i64 http_await_read(HttpTask *task, OS_Handle handle, u8 *buffer, u64 size, u64 offset) {
+    u32 tail;
+    IO_Uring_Submission_Entry *sqe = http_task_get_sqe(task, IORING_OP_READ, &tail);
+
+    sqe->fd = handle.value;
+    sqe->addr = (u64)buffer;
+    sqe->len = (u32)ClampTop(size, 0x7ffff000);
+    sqe->off = offset;
+
+    return http_task_await(task, sqe, tail);
+}
+
+i64 http_await_write(HttpTask *task, OS_Handle handle, String8 data, u64 offset) {
+    u32 tail;
+    IO_Uring_Submission_Entry *sqe = http_task_get_sqe(task, IORING_OP_WRITE, &tail);
+
+    sqe->fd = handle.value;
+    sqe->addr = (u64)data.data;
+    sqe->len = (u32)ClampTop(data.len, 0x7ffff000);
+    sqe->off = offset;
+
+    return http_task_await(task, sqe, tail);
+}
+
+i32 http_await_connect(HttpTask *task, OS_Handle handle, SockAddr *address, u32 address_length) {
+    u32 tail;
+    IO_Uring_Submission_Entry *sqe = http_task_get_sqe(task, IORING_OP_CONNECT, &tail);
+
+    sqe->fd = handle.value;
+    sqe->addr = (u64)address;
+    sqe->off = address_length;
+
+    return http_task_await(task, sqe, tail);
+}
+
+i32 http_await_close(HttpTask *task, OS_Handle handle) {
+    u32 tail;
+    IO_Uring_Submission_Entry *sqe = http_task_get_sqe(task, IORING_OP_CLOSE, &tail);
+
+    sqe->fd = handle.value;
+
+    return http_task_await(task, sqe, tail);
+}
+
+// NOTE: runs function on an offload thread while the connection waits, returning its result and
+// a copy of its output in the task arena. -EBUSY when every offload queue is full, so the
+// handler can shed the request at once; without an offload pool the job runs inline
+i32 http_await_offload(HttpTask *task, OffloadFunction *function, void *input, String8 *output_out) {
+    OffloadJob *job = offload_job_alloc(task->arena, function, input);
+    i32 result = -EBUSY;
+
+    if (!job) {
+        return -ENOMEM;
+    }
+
+    u32 tail;
+    IO_Uring_Submission_Entry *sqe = http_task_get_sqe(task, IORING_OP_MSG_RING, &tail);
+
+    if (offload_prep_job(job, sqe, task->context->ring.ring_fd)) {
+        result = http_task_await(task, sqe, tail);
+    }
+
+    return offload_job_finish(job, result, task->arena, output_out);
+}
+
+// NOTE: reads the rest of a Content-Length body into the connection's scratch arena; a body
+// that does not fit there, a chunked one or a failed read give an invalid string
+String8 http_await_body(HttpTask *task) {
+    String8 result = {0};
+    HttpRequest *http_request = &task->http_request;
+    String8 content_length = http_headers_get(&http_request->headers, HttpHeaderId_ContentLength);
+    u64 length = 0;
+
+    if (!str8_is_valid(content_length)) {
+        if (!str8_is_valid(http_headers_get(&http_request->headers, HttpHeaderId_TransferEncoding))) {
+            result = str8("");
+        }
+
+        return result;
+    }
+
+    if (!str8_to_u64(content_length, &length)) {
+        return result;
+    }
+
+    u64 received = Min(http_request->body.len, length);
+
+    if (received == length) {
+        return str8_prefix(http_request->body, length);
+    }
+
+    u8 *body = arena_push(task->arena, length, 1);
+
+    if (!body) {
+        return result;
+    }
+
+    memcpy(body, http_request->body.data, received);
+
+    while (received < length) {
+        i64 read = http_await_read(task, task->request->client_handle, body + received, length - received, (u64)-1);
+
+        if (read <= 0) {
+            return result;
+        }
+
+        received += read;
+    }
+
+    result.data = body;
+    result.len = length;
+    http_request->body = result;
+
+    return result;
+}
+
+// NOTE: one request over a fresh connection, reading the reply until the upstream closes or
+// the buffer is full; returns the bytes read
+i64 http_await_upstream(HttpTask *task, String8 address, String8 request, u8 *buffer, u64 size) {
+    SockAddr *upstream_address = push_struct_zero(task->arena, SockAddr);
+    u32 address_length = 0;
+
+    if (!upstream_address || !os_sockaddr_from_string(address, upstream_address, &address_length)) {
+        return -EINVAL;
+    }
+
+    OS_Handle handle = os_socket(upstream_address->family);
+
+    if (!handle.value) {
+        return -EMFILE;
+    }
+
+    i64 result = http_await_connect(task, handle, upstream_address, address_length);
+
+    while (result >= 0 && request.len > 0) {
+        result = http_await_write(task, handle, request, (u64)-1);
+
+        if (result > 0) {
+            request = str8_skip(request, result);
+        } else if (result == 0) {
+            result = -EPIPE;
+        }
+    }
+
+    u64 received = 0;
+
+    while (result >= 0 && received < size) {
+        result = http_await_read(task, handle, buffer + received, size - received, (u64)-1);
+
+        if (result <= 0) {
+            break;
+        }
+
+        received += result;
+    }
+
+    http_await_close(task, handle);
+
+    return result < 0 ? result : (i64)received;
+}
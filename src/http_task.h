@@ -0,0 +1,56 @@
+#ifndef HTTP_TASK_H
+#define HTTP_TASK_H
+
+#include "base/base_coroutine.h"
+#include "http_cache.h"
+#include "http_offload.h"
+#include "http_server.h"
+
+// NOTE: an HTTP/1.1 request whose handler runs on a coroutine. Awaiting an operation submits
+// it to the worker's ring tagged EventType_Task and yields; the completion loop resumes the
+// coroutine with the result, and once the handler returns the response is written as for a
+// synchronous handler. The connection has nothing else in flight meanwhile, so the task is
+// its sole owner until it finishes
+struct HttpTask {
+    ThreadContext *context;
+    struct Request *request;
+    Coroutine *coroutine;
+    Arena *arena;
+
+    HttpRequest http_request;
+    HttpResponse http_response;
+    MicroCacheResult cache_result;
+    MicroCacheEntry *cache_entry;
+
+    b32 is_finished;
+    i32 result;
+    IO_Uring_Timespec timeout;
+};
+
+typedef void HttpTaskHandler(HttpTask *task, HttpRequest *request, HttpResponse *response);
+
+void http_task_set_handler(HttpTaskHandler *handler);
+b32 http_task_is_enabled(void);
+
+HttpTask *http_task_start(ThreadContext *context, struct Request *request, HttpRequest *http_request,
+                          MicroCacheResult cache_result, MicroCacheEntry *cache_entry);
+b32 http_task_resume(ThreadContext *context, struct Request *request, i32 result);
+
+//////////////////////////////
+// Awaitable operations
+
+// NOTE: only valid on the task's own coroutine. Results are those of the ring operation:
+// byte counts or zero on success, negative errno values on failure
+i32 http_await_sleep(HttpTask *task, u64 milliseconds);
+OS_Handle http_await_open(HttpTask *task, String8 path);
+i64 http_await_read(HttpTask *task, OS_Handle handle, u8 *buffer, u64 size, u64 offset);
+i64 http_await_write(HttpTask *task, OS_Handle handle, String8 data, u64 offset);
+i32 http_await_connect(HttpTask *task, OS_Handle handle, SockAddr *address, u32 address_length);
+i32 http_await_close(HttpTask *task, OS_Handle handle);
+
+i32 http_await_offload(HttpTask *task, OffloadFunction *function, void *input, String8 *output_out);
+
+String8 http_await_body(HttpTask *task);
+i64 http_await_upstream(HttpTask *task, String8 address, String8 request, u8 *buffer, u64 size);
+
+#endif // HTTP_TASK_H
@@ -0,0 +1,228 @@
+#include "http_trace.h"
+#include <signal.h>
+#include <stdio.h>
+
+#define TRACE_MAX_PATH_SIZE 4096
+
+u32 trace_sample_interval;
+volatile i32 trace_dump_pending;
+
+global TraceRing *trace_rings[TRACE_MAX_THREADS];
+global char trace_dump_path[TRACE_MAX_PATH_SIZE];
+thread_static TraceRing *trace_thread_ring;
+
+global char *trace_stage_names[] = {
+    [TraceStage_Accept] = "accept",
+    [TraceStage_Parse] = "parse",
+    [TraceStage_Handler] = "handler",
+    [TraceStage_Close] = "close",
+};
+
+global char *trace_event_type_names[] = {
+    [EventType_Accept] = "accept",
+    [EventType_Read] = "read",
+    [EventType_Write] = "write",
+    [EventType_WriteBody] = "write_body",
+    [EventType_ProxyConnect] = "proxy_connect",
+    [EventType_ProxySendRequest] = "proxy_send_request",
+    [EventType_ProxyBodyToPipe] = "proxy_body_to_pipe",
+    [EventType_ProxyBodyFromPipe] = "proxy_body_from_pipe",
+    [EventType_ProxyRecvHead] = "proxy_recv_head",
+    [EventType_ProxySendResponse] = "proxy_send_response",
+    [EventType_ProxyRelayRecv] = "proxy_relay_recv",
+    [EventType_ProxyRelaySend] = "proxy_relay_send",
+    [EventType_ProxyResponseToPipe] = "proxy_response_to_pipe",
+    [EventType_ProxyResponseFromPipe] = "proxy_response_from_pipe",
+    [EventType_H2Read] = "h2_read",
+    [EventType_H2Write] = "h2_write",
+    [EventType_WsRead] = "ws_read",
+    [EventType_WsWrite] = "ws_write",
+    [EventType_AccessLogWrite] = "access_log_write",
+    [EventType_AccessLogTimer] = "access_log_timer",
+    [EventType_Task] = "task",
+    [EventType_Close] = "close",
+};
+
+local void trace_on_signal(i32 signal_number) {
+    trace_dump_pending = 1;
+}
+
+void trace_init(u32 sample_interval, String8 dump_path) {
+    trace_sample_interval = sample_interval;
+
+    u64 length = Min(dump_path.len, TRACE_MAX_PATH_SIZE - 1);
+    memcpy(trace_dump_path, dump_path.data, length);
+    trace_dump_path[length] = 0;
+
+    if (!os_set_signal_handler(SIGUSR1, trace_on_signal)) {
+        log_warn("failed to install the SIGUSR1 trace dump handler\n");
+    }
+}
+
+void trace_thread_init(ThreadContext *context) {
+    if (!trace_sample_interval || context->thread_id >= TRACE_MAX_THREADS) {
+        return;
+    }
+
+    TraceRing *ring = push_struct_zero(context->permanent_arena, TraceRing);
+
+    if (ring) {
+        ring->thread_id = context->thread_id;
+        trace_thread_ring = ring;
+        __atomic_store_n(&trace_rings[context->thread_id], ring, __ATOMIC_RELEASE);
+    }
+}
+
+void trace_sample_connection(struct Request *request) {
+    TraceRing *ring = trace_thread_ring;
+
+    if (ring && ++ring->connection_count % trace_sample_interval == 0) {
+        request->trace_id = ++ring->last_trace_id;
+
+        if (request->trace_id == 0) {
+            request->trace_id = ++ring->last_trace_id;
+        }
+    }
+}
+
+void trace_push(u32 trace_id, TraceEventKind kind, u32 name, i32 result) {
+    TraceRing *ring = trace_thread_ring;
+
+    if (!ring) {
+        return;
+    }
+
+    TraceEvent *event = &ring->events[ring->event_count & (TRACE_RING_SIZE - 1)];
+    event->timestamp = os_now_nanoseconds();
+    event->trace_id = trace_id;
+    event->kind = kind;
+    event->name = name;
+    event->result = result;
+
+    __atomic_store_n(&ring->event_count, ring->event_count + 1, __ATOMIC_RELEASE);
+}
+
+//////////////////////////////
+// Export
+
+void trace_request_dump(void) {
+    trace_dump_pending = 1;
+}
+
+void trace_dump_requested(void) {
+    // NOTE: whichever worker notices the request first writes out the buffers of all of them
+    if (__atomic_exchange_n(&trace_dump_pending, 0, __ATOMIC_ACQ_REL)) {
+        String8 path = str8_from_cstring((u8 *)trace_dump_path);
+
+        if (trace_dump(path)) {
+            log_info("trace written to %.*s\n", str8_expand(path));
+        } else {
+            log_error("failed to write trace to %.*s\n", str8_expand(path));
+        }
+    }
+}
+
+local void trace_write_event(FILE *file, u32 thread_id, TraceEvent *event, b32 *is_first) {
+    char *separator = *is_first ? "" : ",\n";
+    u64 micros = event->timestamp / 1000;
+    u32 nanos = event->timestamp % 1000;
+
+    switch (event->kind) {
+    case TraceEventKind_Submit:
+    case TraceEventKind_Complete: {
+        char *name = event->name < array_count(trace_event_type_names) ? trace_event_type_names[event->name] : 0;
+        b32 is_submit = event->kind == TraceEventKind_Submit;
+
+        fprintf(file, "%s{\"name\":\"%s\",\"cat\":\"io\",\"ph\":\"%s\",\"id\":\"%u.%u\",\"ts\":%llu.%03u,\"pid\":%u,\"tid\":%u",
+                separator, name ? name : "unknown", is_submit ? "b" : "e", thread_id, event->trace_id,
+                (unsigned long long)micros, nanos, thread_id, event->trace_id);
+
+        if (!is_submit) {
+            fprintf(file, ",\"args\":{\"res\":%d}", event->result);
+        }
+
+        fprintf(file, "}");
+    } break;
+    case TraceEventKind_Begin:
+    case TraceEventKind_End:
+    case TraceEventKind_Instant: {
+        char *name = event->name < array_count(trace_stage_names) ? trace_stage_names[event->name] : "unknown";
+        char *phase = event->kind == TraceEventKind_Begin ? "B" : event->kind == TraceEventKind_End ? "E" : "i";
+
+        fprintf(file, "%s{\"name\":\"%s\",\"cat\":\"request\",\"ph\":\"%s\",\"ts\":%llu.%03u,\"pid\":%u,\"tid\":%u",
+                separator, name, phase, (unsigned long long)micros, nanos, thread_id, event->trace_id);
+
+        if (event->kind == TraceEventKind_Instant) {
+            fprintf(file, ",\"s\":\"t\",\"args\":{\"res\":%d}", event->result);
+        }
+
+        fprintf(file, "}");
+    } break;
+    default:
+        return;
+    }
+
+    *is_first = 0;
+}
+
+b32 trace_dump(String8 path) {
+    b32 ok = 0;
+    char path_buffer[TRACE_MAX_PATH_SIZE];
+
+    if (path.len >= sizeof(path_buffer)) {
+        return ok;
+    }
+
+    memcpy(path_buffer, path.data, path.len);
+    path_buffer[path.len] = 0;
+
+    FILE *file = fopen(path_buffer, "w");
+
+    if (!file) {
+        return ok;
+    }
+
+    b32 is_first = 1;
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+    for (u32 thread_id = 0; thread_id < TRACE_MAX_THREADS; ++thread_id) {
+        TraceRing *ring = __atomic_load_n(&trace_rings[thread_id], __ATOMIC_ACQUIRE);
+
+        if (!ring) {
+            continue;
+        }
+
+        fprintf(file, "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"name\":\"worker %u\"}}",
+                is_first ? "" : ",\n", thread_id, thread_id);
+        is_first = 0;
+
+        // NOTE: the owning worker keeps recording while the ring is read, so every event is
+        // copied first and dropped if the writer lapped it in the meantime
+        u64 end = __atomic_load_n(&ring->event_count, __ATOMIC_ACQUIRE);
+        u64 begin = end > TRACE_RING_SIZE ? end - TRACE_RING_SIZE : 0;
+
+        for (u64 index = begin; index < end; ++index) {
+            TraceEvent event = ring->events[index & (TRACE_RING_SIZE - 1)];
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            u64 count = __atomic_load_n(&ring->event_count, __ATOMIC_RELAXED);
+
+            if (count - index >= TRACE_RING_SIZE) {
+                continue;
+            }
+
+            trace_write_event(file, thread_id, &event, &is_first);
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+
+    if (!ferror(file)) {
+        ok = 1;
+    }
+
+    if (fclose(file) != 0) {
+        ok = 0;
+    }
+
+    return ok;
+}
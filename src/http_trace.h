@@ -0,0 +1,85 @@
+#ifndef HTTP_TRACE_H
+#define HTTP_TRACE_H
+
+#include "http_server.h"
+
+#define TRACE_MAX_THREADS 64
+#define TRACE_RING_SIZE 16384
+
+typedef enum TraceEventKind {
+    TraceEventKind_Submit,
+    TraceEventKind_Complete,
+    TraceEventKind_Begin,
+    TraceEventKind_End,
+    TraceEventKind_Instant,
+} TraceEventKind;
+
+typedef enum TraceStage {
+    TraceStage_Accept,
+    TraceStage_Parse,
+    TraceStage_Handler,
+    TraceStage_Close,
+} TraceStage;
+
+// NOTE: name is the EventType of the operation for Submit/Complete and a TraceStage otherwise
+typedef struct TraceEvent TraceEvent;
+struct TraceEvent {
+    u64 timestamp;
+    u32 trace_id;
+    u16 kind;
+    u16 name;
+    i32 result;
+};
+
+typedef struct TraceRing TraceRing;
+struct TraceRing {
+    u32 thread_id;
+    u32 connection_count;
+    u32 last_trace_id;
+    u64 event_count;
+    TraceEvent events[TRACE_RING_SIZE];
+};
+
+extern u32 trace_sample_interval;
+extern volatile i32 trace_dump_pending;
+
+// NOTE: a connection is traced when trace_id is non-zero, which is only ever the case while
+// sampling is enabled; unsampled requests pay a single predictable branch per trace point
+#define trace_record(request, kind, name, result)                     \
+    do {                                                               \
+        if ((request)->trace_id) {                                     \
+            trace_push((request)->trace_id, (kind), (name), (result)); \
+        }                                                              \
+    } while (0)
+
+#define trace_submit(request, event_type) trace_record(request, TraceEventKind_Submit, event_type, 0)
+#define trace_complete(request, event_type, result) trace_record(request, TraceEventKind_Complete, event_type, result)
+#define trace_begin(request, stage) trace_record(request, TraceEventKind_Begin, stage, 0)
+#define trace_end(request, stage) trace_record(request, TraceEventKind_End, stage, 0)
+#define trace_instant(request, stage, result) trace_record(request, TraceEventKind_Instant, stage, result)
+
+#define trace_sample(request)                  \
+    do {                                       \
+        if (trace_sample_interval) {           \
+            trace_sample_connection(request);  \
+        }                                      \
+    } while (0)
+
+#define trace_poll()                           \
+    do {                                       \
+        if (trace_dump_pending) {              \
+            trace_dump_requested();            \
+        }                                      \
+    } while (0)
+
+void trace_init(u32 sample_interval, String8 dump_path);
+void trace_thread_init(ThreadContext *context);
+
+void trace_sample_connection(struct Request *request);
+void trace_push(u32 trace_id, TraceEventKind kind, u32 name, i32 result);
+
+void trace_request_dump(void);
+void trace_dump_requested(void);
+b32 trace_dump(String8 path);
+
+#endif // HTTP_TRACE_H
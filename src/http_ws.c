@@ -0,0 +1,622 @@
+#include "http_ws.h"
+#include "http_trace.h"
+#include <immintrin.h>
+
+global String8 ws_guid = str8_comp("258EAFA5-E914-47DA-95CA-C5AB0DC85B11");
+
+thread_static WsConnection *ws_connections;
+
+local void ws_resume(WsConnection *connection);
+local void ws_teardown(WsConnection *connection);
+
+//////////////////////////////
+// Handshake
+
+local b32 ws_has_token(String8 value, String8 token) {
+    while (value.len > 0) {
+        String8 item = str8_read_to(&value, ",");
+
+        if (!str8_is_valid(item)) {
+            item = value;
+            value.len = 0;
+        }
+
+        if (str8_are_equal_case_insensitive(str8_trim_whitespace(item), token)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+b32 ws_accept(Arena *arena, HttpRequest *request, HttpResponse *response, WsHandler *handler) {
+    String8 upgrade = http_headers_get(&request->headers, HttpHeaderId_Upgrade);
+    String8 connection = http_headers_get(&request->headers, HttpHeaderId_Connection);
+    String8 version = http_headers_get(&request->headers, HttpHeaderId_SecWebSocketVersion);
+    String8 key = str8_trim_whitespace(http_headers_get(&request->headers, HttpHeaderId_SecWebSocketKey));
+    u8 nonce[24];
+    u64 nonce_length = 0;
+
+    if (request->method != HTTP_METHOD_GET || request->version != HTTP_VERSION_11) {
+        return 0;
+    }
+
+    if (!ws_has_token(upgrade, str8("websocket")) || !ws_has_token(connection, str8("upgrade")) ||
+        !str8_are_equal(version, str8("13"))) {
+        return 0;
+    }
+
+    if (key.len != 24 || !str8_base64_decode(key, nonce, &nonce_length) || nonce_length != 16) {
+        return 0;
+    }
+
+    SHA1 sha;
+    u8 digest[SHA1_DIGEST_SIZE];
+
+    sha1_init(&sha);
+    sha1_update(&sha, key);
+    sha1_update(&sha, ws_guid);
+    sha1_final(&sha, digest);
+
+    HttpHeader *headers = push_array_zero(arena, HttpHeader, 3);
+    u8 *accept = arena_push(arena, 28, 1);
+
+    if (!headers || !accept) {
+        return 0;
+    }
+
+    String8 digest_string = {SHA1_DIGEST_SIZE, digest};
+
+    headers[0].key = str8("Upgrade");
+    headers[0].value = str8("websocket");
+    headers[0].next = &headers[1];
+    headers[1].key = str8("Connection");
+    headers[1].value = str8("Upgrade");
+    headers[1].next = &headers[2];
+    headers[2].key = str8("Sec-WebSocket-Accept");
+    headers[2].value.data = accept;
+    headers[2].value.len = str8_base64_encode(digest_string, accept);
+
+    response->status = 101;
+    response->headers = headers;
+    response->body = (String8){0};
+    response->websocket = handler;
+
+    return 1;
+}
+
+//////////////////////////////
+// Unmasking
+
+// NOTE: blocks are multiples of four bytes, so the mask rotated to the payload offset
+// lines up with every block
+void ws_unmask(u8 *dst, u8 *src, u64 length, u8 *mask, u64 offset) {
+    u8 rotated[4] = {mask[offset & 3], mask[(offset + 1) & 3], mask[(offset + 2) & 3], mask[(offset + 3) & 3]};
+    u32 mask_word = 0;
+    u64 pos = 0;
+
+    memcpy(&mask_word, rotated, 4);
+
+#if defined(__AVX2__)
+    __m256i mask_wide = _mm256_set1_epi32((i32)mask_word);
+
+    for (; pos + 32 <= length; pos += 32) {
+        __m256i data = _mm256_loadu_si256((__m256i *)(src + pos));
+        _mm256_storeu_si256((__m256i *)(dst + pos), _mm256_xor_si256(data, mask_wide));
+    }
+#endif
+
+#if defined(__SSE2__)
+    __m128i mask_narrow = _mm_set1_epi32((i32)mask_word);
+
+    for (; pos + 16 <= length; pos += 16) {
+        __m128i data = _mm_loadu_si128((__m128i *)(src + pos));
+        _mm_storeu_si128((__m128i *)(dst + pos), _mm_xor_si128(data, mask_narrow));
+    }
+#endif
+
+    for (; pos < length; ++pos) {
+        dst[pos] = src[pos] ^ rotated[pos & 3];
+    }
+}
+
+//////////////////////////////
+// Frames
+
+WsFrame *ws_frame_create(ThreadContext *context, WsOpcode opcode, String8 payload) {
+    Scratch *arena = thread_scratch_alloc(context);
+    WsFrame *frame = push_struct_zero(arena, WsFrame);
+    u64 header_length = payload.len < 126 ? 2 : payload.len <= 0xffff ? 4 : 10;
+    u8 *data = arena_push(arena, header_length + payload.len, 8);
+
+    if (!data) {
+        thread_scratch_release(context, arena);
+        return 0;
+    }
+
+    data[0] = (u8)(0x80 | opcode);
+
+    if (header_length == 2) {
+        data[1] = (u8)payload.len;
+    } else if (header_length == 4) {
+        data[1] = 126;
+        data[2] = (u8)(payload.len >> 8);
+        data[3] = (u8)payload.len;
+    } else {
+        data[1] = 127;
+
+        for (u32 index = 0; index < 8; ++index) {
+            data[2 + index] = (u8)(payload.len >> (56 - index * 8));
+        }
+    }
+
+    memcpy(data + header_length, payload.data, payload.len);
+
+    frame->arena = arena;
+    frame->ref_count = 1;
+    frame->data.data = data;
+    frame->data.len = header_length + payload.len;
+
+    return frame;
+}
+
+void ws_frame_release(ThreadContext *context, WsFrame *frame) {
+    frame->ref_count -= 1;
+
+    if (frame->ref_count == 0) {
+        thread_scratch_release(context, frame->arena);
+    }
+}
+
+local b32 ws_queue(WsConnection *connection, String8 data, WsFrame *frame) {
+    // NOTE: a client that lets this many frames pile up is not reading and gets dropped
+    if (connection->queue_count == WS_MAX_QUEUED_FRAMES) {
+        ws_teardown(connection);
+        return 0;
+    }
+
+    WsQueuedFrame *queued = &connection->queue[(connection->queue_head + connection->queue_count) % WS_MAX_QUEUED_FRAMES];
+    queued->data = data;
+    queued->frame = frame;
+    connection->queue_count += 1;
+
+    if (frame) {
+        frame->ref_count += 1;
+    }
+
+    return 1;
+}
+
+b32 ws_send_frame(WsConnection *connection, WsFrame *frame) {
+    if (connection->is_closing || connection->is_released) {
+        return 0;
+    }
+
+    if (!ws_queue(connection, frame->data, frame)) {
+        return 0;
+    }
+
+    ws_resume(connection);
+
+    return 1;
+}
+
+b32 ws_send(WsConnection *connection, WsOpcode opcode, String8 payload) {
+    b32 ok = 0;
+    WsFrame *frame = ws_frame_create(connection->context, opcode, payload);
+
+    if (frame) {
+        ok = ws_send_frame(connection, frame);
+        ws_frame_release(connection->context, frame);
+    }
+
+    return ok;
+}
+
+u32 ws_broadcast(ThreadContext *context, WsOpcode opcode, String8 payload) {
+    u32 count = 0;
+    WsFrame *frame = ws_frame_create(context, opcode, payload);
+
+    if (!frame) {
+        return 0;
+    }
+
+    for (WsConnection *connection = ws_connections, *next = 0; connection != 0; connection = next) {
+        next = connection->next;
+        count += ws_send_frame(connection, frame);
+    }
+
+    ws_frame_release(context, frame);
+
+    return count;
+}
+
+void ws_close(WsConnection *connection, WsCloseCode code) {
+    u8 payload[2] = {(u8)(code >> 8), (u8)code};
+    String8 payload_string = {2, payload};
+
+    if (connection->is_closing || connection->is_released) {
+        return;
+    }
+
+    ws_send(connection, WsOpcode_Close, payload_string);
+    connection->is_closing = 1;
+    ws_resume(connection);
+}
+
+//////////////////////////////
+// Submission
+
+local b32 ws_submit_writev(WsConnection *connection) {
+    u32 tail;
+    ThreadContext *context = connection->context;
+    u32 count = Min(connection->queue_count, WS_MAX_IOVECS);
+    IO_Uring_Submission_Entry *sqe = os_io_uring_get_sqe(&context->ring, &tail);
+
+    for (u32 index = 0; index < count; ++index) {
+        WsQueuedFrame *queued = &connection->queue[(connection->queue_head + index) % WS_MAX_QUEUED_FRAMES];
+        connection->iovecs[index].iov_base = queued->data.data;
+        connection->iovecs[index].iov_len = queued->data.len;
+    }
+
+    os_io_uring_prep_sqe(sqe, IORING_OP_WRITEV);
+
+    sqe->fd = connection->request->client_handle.value;
+    sqe->addr = (u64)connection->iovecs;
+    sqe->len = count;
+    sqe->off = -1;
+    sqe->user_data = request_user_data(connection->request, connection->request->send_event_type);
+    trace_submit(connection->request, connection->request->send_event_type);
+
+    return server_submit(context, sqe, tail);
+}
+
+//////////////////////////////
+// Connection
+
+local void ws_teardown(WsConnection *connection) {
+    ThreadContext *context = connection->context;
+    struct Request *request = connection->request;
+
+    // NOTE: shutting the socket down completes the outstanding read, whose buffer must
+    // not be released before it does
+    if (!connection->is_released) {
+        connection->is_released = 1;
+        os_shutdown(request->client_handle);
+    }
+
+    if (connection->is_receiving || connection->is_sending) {
+        return;
+    }
+
+    if (connection->prev) {
+        connection->prev->next = connection->next;
+    } else {
+        ws_connections = connection->next;
+    }
+
+    if (connection->next) {
+        connection->next->prev = connection->prev;
+    }
+
+    if (connection->handler->on_close) {
+        connection->handler->on_close(connection);
+    }
+
+    for (; connection->queue_count > 0; --connection->queue_count) {
+        WsQueuedFrame *queued = &connection->queue[connection->queue_head];
+
+        if (queued->frame) {
+            ws_frame_release(context, queued->frame);
+        }
+
+        connection->queue_head = (connection->queue_head + 1) % WS_MAX_QUEUED_FRAMES;
+    }
+
+    thread_scratch_release(context, connection->arena);
+    request_close(context, request);
+}
+
+local void ws_resume(WsConnection *connection) {
+    struct Request *request = connection->request;
+
+    if (connection->is_released) {
+        return;
+    }
+
+    if (!connection->is_sending && connection->queue_count > 0) {
+        connection->is_sending = 1;
+
+        if (!ws_submit_writev(connection)) {
+            connection->is_sending = 0;
+            ws_teardown(connection);
+            return;
+        }
+    }
+
+    // NOTE: the connection goes away once the close frame has been written
+    if (connection->is_closing) {
+        if (!connection->is_sending) {
+            ws_teardown(connection);
+        }
+
+        return;
+    }
+
+    if (!connection->is_receiving) {
+        connection->is_receiving = 1;
+
+        if (!submit_read(connection->context, request)) {
+            connection->is_receiving = 0;
+            ws_teardown(connection);
+        }
+    }
+}
+
+local u32 ws_header_needed(WsConnection *connection) {
+    u32 result = 2;
+
+    if (connection->header_length >= 2) {
+        u32 length = connection->header[1] & 0x7f;
+
+        result += length == 126 ? 2 : length == 127 ? 8 : 0;
+        result += (connection->header[1] & 0x80) ? 4 : 0;
+    }
+
+    return result;
+}
+
+local void ws_end_frame(WsConnection *connection);
+
+local b32 ws_begin_frame(WsConnection *connection) {
+    u8 *header = connection->header;
+    u32 length = header[1] & 0x7f;
+    u64 payload_length = length;
+    u32 pos = 2;
+    b32 is_control = (header[0] & 0x08) != 0;
+
+    connection->is_final = (header[0] & 0x80) != 0;
+    connection->opcode = header[0] & 0x0f;
+
+    if (length == 126) {
+        payload_length = ((u64)(header[2] & 0xff) << 8) | (u64)(header[3] & 0xff);
+        pos += 2;
+    } else if (length == 127) {
+        payload_length = 0;
+
+        for (u32 index = 0; index < 8; ++index) {
+            payload_length = (payload_length << 8) | (u64)(header[2 + index] & 0xff);
+        }
+
+        pos += 8;
+    }
+
+    // NOTE: clients must mask, and extensions that would define the reserved bits are never negotiated
+    if ((header[0] & 0x70) || !(header[1] & 0x80)) {
+        ws_close(connection, WsCloseCode_ProtocolError);
+        return 0;
+    }
+
+    memcpy(connection->mask, header + pos, 4);
+
+    if (is_control) {
+        b32 is_known = connection->opcode == WsOpcode_Close || connection->opcode == WsOpcode_Ping ||
+                       connection->opcode == WsOpcode_Pong;
+
+        if (!is_known || !connection->is_final || payload_length > WS_MAX_CONTROL_PAYLOAD) {
+            ws_close(connection, WsCloseCode_ProtocolError);
+            return 0;
+        }
+    } else {
+        b32 is_continuation = connection->opcode == WsOpcode_Continuation;
+        b32 is_data = connection->opcode == WsOpcode_Text || connection->opcode == WsOpcode_Binary;
+
+        if ((!is_continuation && !is_data) || is_continuation != (connection->message_opcode != 0)) {
+            ws_close(connection, WsCloseCode_ProtocolError);
+            return 0;
+        }
+
+        if (payload_length > WS_MAX_MESSAGE_SIZE - connection->message.len) {
+            ws_close(connection, WsCloseCode_MessageTooBig);
+            return 0;
+        }
+
+        if (is_data) {
+            connection->message_opcode = connection->opcode;
+        }
+    }
+
+    connection->header_length = 0;
+    connection->is_in_payload = 1;
+    connection->payload_length = payload_length;
+    connection->payload_offset = 0;
+
+    if (payload_length == 0) {
+        ws_end_frame(connection);
+    }
+
+    return 1;
+}
+
+local void ws_end_frame(WsConnection *connection) {
+    String8 control = {connection->payload_length, connection->control};
+
+    connection->is_in_payload = 0;
+
+    switch (connection->opcode) {
+    case WsOpcode_Ping:
+        ws_send(connection, WsOpcode_Pong, control);
+        break;
+    case WsOpcode_Pong:
+        break;
+    case WsOpcode_Close: {
+        WsCloseCode code = WsCloseCode_Normal;
+
+        if (control.len == 1) {
+            code = WsCloseCode_ProtocolError;
+        } else if (control.len >= 2) {
+            code = ((u32)(control.data[0] & 0xff) << 8) | (u32)(control.data[1] & 0xff);
+        }
+
+        ws_close(connection, code);
+    } break;
+    default: {
+        connection->message.len += connection->payload_length;
+
+        if (!connection->is_final) {
+            break;
+        }
+
+        WsOpcode opcode = connection->message_opcode;
+        String8 message = connection->message;
+
+        connection->message_opcode = 0;
+        connection->message.len = 0;
+
+        if (opcode == WsOpcode_Text && !str8_is_utf8(message)) {
+            ws_close(connection, WsCloseCode_InvalidPayload);
+            break;
+        }
+
+        if (connection->handler->on_message) {
+            connection->handler->on_message(connection, opcode, message);
+        }
+    } break;
+    }
+}
+
+local void ws_process_input(WsConnection *connection) {
+    struct Request *request = connection->request;
+    String8 input = str8_prefix(request->request_buffer, request->request_length);
+    u64 pos = 0;
+
+    while (pos < input.len && !connection->is_closing && !connection->is_released) {
+        if (!connection->is_in_payload) {
+            while (connection->header_length < ws_header_needed(connection) && pos < input.len) {
+                connection->header[connection->header_length++] = input.data[pos++];
+            }
+
+            if (connection->header_length < ws_header_needed(connection) || !ws_begin_frame(connection)) {
+                break;
+            }
+
+            continue;
+        }
+
+        u64 chunk = Min(connection->payload_length - connection->payload_offset, input.len - pos);
+        u8 *dst = connection->control + connection->payload_offset;
+
+        if (!(connection->opcode & 0x08)) {
+            dst = connection->message.data + connection->message.len + connection->payload_offset;
+        }
+
+        ws_unmask(dst, input.data + pos, chunk, connection->mask, connection->payload_offset);
+
+        pos += chunk;
+        connection->payload_offset += chunk;
+
+        if (connection->payload_offset == connection->payload_length) {
+            ws_end_frame(connection);
+        }
+    }
+
+    request->request_length = 0;
+}
+
+void ws_begin(ThreadContext *context, struct Request *request, WsHandler *handler, u64 head_length) {
+    Scratch *arena = thread_scratch_alloc(context);
+    WsConnection *connection = push_struct_zero(arena, WsConnection);
+
+    connection->context = context;
+    connection->request = request;
+    connection->arena = arena;
+    connection->handler = handler;
+    connection->message.data = arena_push(arena, WS_MAX_MESSAGE_SIZE, 8);
+
+    // NOTE: frames sent right behind the handshake are already in the request buffer
+    u8 *buffer = request->request_buffer.data;
+    memmove(buffer, buffer + head_length, request->request_length - head_length);
+    request->request_length -= head_length;
+
+    request->event_type = EventType_WsRead;
+    request->send_event_type = EventType_WsWrite;
+    request->websocket = connection;
+
+    connection->next = ws_connections;
+
+    if (ws_connections) {
+        ws_connections->prev = connection;
+    }
+
+    ws_connections = connection;
+
+    ws_queue(connection, request->response_buffer, 0);
+
+    // NOTE: the connection counts as receiving while input is processed, so a teardown
+    // triggered from a callback cannot release it underneath the parser
+    connection->is_receiving = 1;
+
+    if (handler->on_open) {
+        handler->on_open(connection);
+    }
+
+    ws_process_input(connection);
+    connection->is_receiving = 0;
+
+    if (connection->is_released) {
+        ws_teardown(connection);
+        return;
+    }
+
+    ws_resume(connection);
+}
+
+void ws_on_read(ThreadContext *context, struct Request *request, i32 result) {
+    WsConnection *connection = request->websocket;
+
+    if (!connection->is_released && result > 0) {
+        request->request_length += result;
+        ws_process_input(connection);
+    }
+
+    connection->is_receiving = 0;
+
+    if (connection->is_released || result <= 0) {
+        ws_teardown(connection);
+        return;
+    }
+
+    ws_resume(connection);
+}
+
+void ws_on_write(ThreadContext *context, struct Request *request, i32 result) {
+    WsConnection *connection = request->websocket;
+    connection->is_sending = 0;
+
+    if (connection->is_released || result <= 0) {
+        ws_teardown(connection);
+        return;
+    }
+
+    u64 remaining = result;
+
+    while (remaining > 0 && connection->queue_count > 0) {
+        WsQueuedFrame *queued = &connection->queue[connection->queue_head];
+
+        if (queued->data.len > remaining) {
+            queued->data = str8_skip(queued->data, remaining);
+            break;
+        }
+
+        remaining -= queued->data.len;
+
+        if (queued->frame) {
+            ws_frame_release(context, queued->frame);
+        }
+
+        connection->queue_head = (connection->queue_head + 1) % WS_MAX_QUEUED_FRAMES;
+        connection->queue_count -= 1;
+    }
+
+    ws_resume(connection);
+}
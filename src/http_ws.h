@@ -0,0 +1,107 @@
+#ifndef HTTP_WS_H
+#define HTTP_WS_H
+
+#include "http_server.h"
+#include <sys/uio.h>
+
+#define WS_MAX_MESSAGE_SIZE (16 * 1024)
+#define WS_MAX_CONTROL_PAYLOAD 125
+#define WS_MAX_HEADER_SIZE 14
+#define WS_MAX_QUEUED_FRAMES 64
+#define WS_MAX_IOVECS 16
+
+typedef enum WsOpcode {
+    WsOpcode_Continuation = 0x0,
+    WsOpcode_Text = 0x1,
+    WsOpcode_Binary = 0x2,
+    WsOpcode_Close = 0x8,
+    WsOpcode_Ping = 0x9,
+    WsOpcode_Pong = 0xa,
+} WsOpcode;
+
+typedef enum WsCloseCode {
+    WsCloseCode_Normal = 1000,
+    WsCloseCode_GoingAway = 1001,
+    WsCloseCode_ProtocolError = 1002,
+    WsCloseCode_InvalidPayload = 1007,
+    WsCloseCode_MessageTooBig = 1009,
+} WsCloseCode;
+
+typedef struct WsConnection WsConnection;
+
+typedef void WsOpenCallback(WsConnection *connection);
+typedef void WsMessageCallback(WsConnection *connection, WsOpcode opcode, String8 message);
+typedef void WsCloseCallback(WsConnection *connection);
+
+struct WsHandler {
+    WsOpenCallback *on_open;
+    WsMessageCallback *on_message;
+    WsCloseCallback *on_close;
+};
+
+// NOTE: a serialized server frame, shared by every connection it is queued on and
+// released once the last write that references it completes
+typedef struct WsFrame WsFrame;
+struct WsFrame {
+    Scratch *arena;
+    u32 ref_count;
+    String8 data;
+};
+
+typedef struct WsQueuedFrame WsQueuedFrame;
+struct WsQueuedFrame {
+    String8 data;
+    WsFrame *frame;
+};
+
+struct WsConnection {
+    WsConnection *prev;
+    WsConnection *next;
+
+    ThreadContext *context;
+    struct Request *request;
+    Scratch *arena;
+    WsHandler *handler;
+    void *user_data;
+
+    u8 header[WS_MAX_HEADER_SIZE];
+    u32 header_length;
+    b32 is_in_payload;
+    b32 is_final;
+    u8 opcode;
+    u8 mask[4];
+    u64 payload_length;
+    u64 payload_offset;
+
+    u8 message_opcode;
+    String8 message;
+    u8 control[WS_MAX_CONTROL_PAYLOAD];
+
+    WsQueuedFrame queue[WS_MAX_QUEUED_FRAMES];
+    u32 queue_head;
+    u32 queue_count;
+    struct iovec iovecs[WS_MAX_IOVECS];
+
+    b32 is_receiving;
+    b32 is_sending;
+    b32 is_closing;
+    b32 is_released;
+};
+
+b32 ws_accept(Arena *arena, HttpRequest *request, HttpResponse *response, WsHandler *handler);
+void ws_begin(ThreadContext *context, struct Request *request, WsHandler *handler, u64 head_length);
+
+void ws_on_read(ThreadContext *context, struct Request *request, i32 result);
+void ws_on_write(ThreadContext *context, struct Request *request, i32 result);
+
+WsFrame *ws_frame_create(ThreadContext *context, WsOpcode opcode, String8 payload);
+void ws_frame_release(ThreadContext *context, WsFrame *frame);
+
+b32 ws_send_frame(WsConnection *connection, WsFrame *frame);
+b32 ws_send(WsConnection *connection, WsOpcode opcode, String8 payload);
+u32 ws_broadcast(ThreadContext *context, WsOpcode opcode, String8 payload);
+void ws_close(WsConnection *connection, WsCloseCode code);
+
+void ws_unmask(u8 *dst, u8 *src, u64 length, u8 *mask, u64 offset);
+
+#endif // HTTP_WS_H